@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "attachment-cache.h"
+#include "fast-hash.h"
+#include "word-matcher.h"
+
+#define ATTACHMENT_CACHE_DIR "evolution-attachment-checker"
+#define ATTACHMENT_CACHE_FILE "scan-cache"
+#define ATTACHMENT_CACHE_MAGIC "ACCACHE"
+#define ATTACHMENT_CACHE_VERSION 2
+#define ATTACHMENT_CACHE_BYTE_ORDER 0x01020304u
+
+// При переполнении кэш начинается заново: это дешевле учёта давности записей
+#define ATTACHMENT_CACHE_MAX_ENTRIES 65536
+
+#define ATTACHMENT_CACHE_FILE_ATTRIBUTES \
+    G_FILE_ATTRIBUTE_UNIX_DEVICE "," G_FILE_ATTRIBUTE_UNIX_INODE "," \
+    G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+    G_FILE_ATTRIBUTE_TIME_MODIFIED "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC "," \
+    G_FILE_ATTRIBUTE_TIME_CHANGED "," G_FILE_ATTRIBUTE_TIME_CHANGED_USEC
+
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 byte_order;
+} AttachmentCacheHeader;
+
+// Запись файла кэша; новые записи дописываются в конец, последняя побеждает
+typedef struct {
+    AttachmentCacheKey key;
+    guint64 dictionary_version;
+    guint64 max_bytes;
+    guint32 word_index;
+    guint32 reserved;
+} AttachmentCacheRecord;
+
+typedef struct {
+    GMutex lock;
+    gchar *path;
+    GHashTable *records;    // AttachmentCacheRecord* -> он же
+    FILE *log;              // открыт на дозапись
+    gboolean initialized;
+    gboolean loaded;
+} AttachmentCache;
+
+static AttachmentCache attachment_cache;
+
+static guint
+attachment_cache_key_hash(gconstpointer data)
+{
+    guint64 hash = fast_hash64(data, sizeof(AttachmentCacheKey));
+
+    return (guint)(hash ^ (hash >> 32));
+}
+
+static gboolean
+attachment_cache_key_equal(gconstpointer a, gconstpointer b)
+{
+    return memcmp(a, b, sizeof(AttachmentCacheKey)) == 0;
+}
+
+gboolean
+attachment_cache_key_for_file(AttachmentCacheKey *key, GFile *file, GCancellable *cancellable)
+{
+    GFileInfo *info;
+    gboolean ok;
+
+    memset(key, 0, sizeof(*key));
+
+    info = g_file_query_info(file, ATTACHMENT_CACHE_FILE_ATTRIBUTES, G_FILE_QUERY_INFO_NONE,
+                             cancellable, NULL);
+    if (!info)
+        return FALSE;
+
+    ok = g_file_info_has_attribute(info, G_FILE_ATTRIBUTE_UNIX_INODE) &&
+         g_file_info_has_attribute(info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+    if (ok) {
+        key->device = g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+        key->inode = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_UNIX_INODE);
+        key->size = (guint64)g_file_info_get_size(info);
+        key->mtime = (gint64)g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED) *
+                     G_USEC_PER_SEC +
+                     g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+        key->ctime = (gint64)g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_CHANGED) *
+                     G_USEC_PER_SEC +
+                     g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_TIME_CHANGED_USEC);
+    }
+
+    g_object_unref(info);
+    return ok;
+}
+
+void
+attachment_cache_key_for_bytes(AttachmentCacheKey *key, GBytes *bytes)
+{
+    gsize size;
+    const guint8 *data = g_bytes_get_data(bytes, &size);
+
+    memset(key, 0, sizeof(*key));
+    key->size = size;
+    key->content_hash = fast_hash64(data, size);
+}
+
+static void
+attachment_cache_write_header(FILE *file)
+{
+    AttachmentCacheHeader header = { ATTACHMENT_CACHE_MAGIC, ATTACHMENT_CACHE_VERSION,
+                                     ATTACHMENT_CACHE_BYTE_ORDER };
+
+    fwrite(&header, sizeof(header), 1, file);
+    fflush(file);
+}
+
+// Файл пересоздаётся целиком: после сброса кэша или для сжатия дубликатов
+static void
+attachment_cache_rewrite(AttachmentCache *cache)
+{
+    GHashTableIter iter;
+    gpointer record;
+
+    if (cache->log)
+        fclose(cache->log);
+
+    cache->log = g_fopen(cache->path, "wb");
+    if (!cache->log)
+        return;
+
+    attachment_cache_write_header(cache->log);
+
+    g_hash_table_iter_init(&iter, cache->records);
+    while (g_hash_table_iter_next(&iter, &record, NULL))
+        fwrite(record, sizeof(AttachmentCacheRecord), 1, cache->log);
+    fflush(cache->log);
+}
+
+// Чтение файла при первом обращении, уже в рабочем потоке
+static void
+attachment_cache_load(AttachmentCache *cache)
+{
+    gchar *contents = NULL;
+    gsize length = 0;
+    const AttachmentCacheHeader *header;
+    gsize n_records = 0;
+
+    cache->loaded = TRUE;
+
+    if (g_file_get_contents(cache->path, &contents, &length, NULL) &&
+        length >= sizeof(AttachmentCacheHeader)) {
+        header = (const AttachmentCacheHeader *)contents;
+
+        if (memcmp(header->magic, ATTACHMENT_CACHE_MAGIC, sizeof(header->magic)) == 0 &&
+            header->version == ATTACHMENT_CACHE_VERSION &&
+            header->byte_order == ATTACHMENT_CACHE_BYTE_ORDER) {
+            n_records = (length - sizeof(*header)) / sizeof(AttachmentCacheRecord);
+
+            for (gsize i = 0; i < n_records; i++) {
+                AttachmentCacheRecord *record = g_new(AttachmentCacheRecord, 1);
+
+                memcpy(record, contents + sizeof(*header) + i * sizeof(*record), sizeof(*record));
+                g_hash_table_replace(cache->records, record, record);
+            }
+        }
+    }
+
+    g_free(contents);
+
+    // Дописываем к существующему файлу, если он в порядке и без лишних дубликатов
+    if (n_records > 0 && n_records <= 2 * g_hash_table_size(cache->records) &&
+        g_hash_table_size(cache->records) < ATTACHMENT_CACHE_MAX_ENTRIES) {
+        cache->log = g_fopen(cache->path, "ab");
+    } else {
+        if (g_hash_table_size(cache->records) >= ATTACHMENT_CACHE_MAX_ENTRIES)
+            g_hash_table_remove_all(cache->records);
+        attachment_cache_rewrite(cache);
+    }
+}
+
+void
+attachment_cache_init(void)
+{
+    AttachmentCache *cache = &attachment_cache;
+    gchar *dir;
+
+    if (cache->initialized)
+        return;
+
+    dir = g_build_filename(g_get_user_cache_dir(), ATTACHMENT_CACHE_DIR, NULL);
+    g_mkdir_with_parents(dir, 0700);
+
+    g_mutex_init(&cache->lock);
+    cache->path = g_build_filename(dir, ATTACHMENT_CACHE_FILE, NULL);
+    cache->records = g_hash_table_new_full(attachment_cache_key_hash, attachment_cache_key_equal,
+                                           g_free, NULL);
+    cache->loaded = FALSE;
+    cache->initialized = TRUE;
+
+    g_free(dir);
+}
+
+// Вызывается, когда проверок уже нет: плагин отключается
+void
+attachment_cache_shutdown(void)
+{
+    AttachmentCache *cache = &attachment_cache;
+
+    if (!cache->initialized)
+        return;
+
+    g_mutex_lock(&cache->lock);
+    if (cache->log)
+        fclose(cache->log);
+    cache->log = NULL;
+    g_clear_pointer(&cache->records, g_hash_table_unref);
+    g_clear_pointer(&cache->path, g_free);
+    cache->initialized = FALSE;
+    g_mutex_unlock(&cache->lock);
+
+    g_mutex_clear(&cache->lock);
+}
+
+gboolean
+attachment_cache_lookup(const AttachmentCacheKey *key, guint64 dictionary_version,
+                        guint64 max_bytes, guint *word_index)
+{
+    AttachmentCache *cache = &attachment_cache;
+    const AttachmentCacheRecord *record;
+    gboolean hit = FALSE;
+
+    if (!cache->initialized)
+        return FALSE;
+
+    g_mutex_lock(&cache->lock);
+
+    if (!cache->loaded)
+        attachment_cache_load(cache);
+
+    record = g_hash_table_lookup(cache->records, key);
+    if (record && record->dictionary_version == dictionary_version &&
+        record->max_bytes == max_bytes) {
+        if (word_index)
+            *word_index = record->word_index;
+        hit = TRUE;
+    }
+
+    g_mutex_unlock(&cache->lock);
+
+    return hit;
+}
+
+void
+attachment_cache_store(const AttachmentCacheKey *key, guint64 dictionary_version,
+                       guint64 max_bytes, guint word_index)
+{
+    AttachmentCache *cache = &attachment_cache;
+    AttachmentCacheRecord *record;
+
+    if (!cache->initialized)
+        return;
+
+    record = g_new0(AttachmentCacheRecord, 1);
+    record->key = *key;
+    record->dictionary_version = dictionary_version;
+    record->max_bytes = max_bytes;
+    record->word_index = word_index;
+
+    g_mutex_lock(&cache->lock);
+
+    if (!cache->loaded)
+        attachment_cache_load(cache);
+
+    if (g_hash_table_size(cache->records) >= ATTACHMENT_CACHE_MAX_ENTRIES) {
+        g_hash_table_remove_all(cache->records);
+        attachment_cache_rewrite(cache);
+    }
+
+    g_hash_table_replace(cache->records, record, record);
+
+    if (cache->log) {
+        fwrite(record, sizeof(*record), 1, cache->log);
+        fflush(cache->log);
+    }
+
+    g_mutex_unlock(&cache->lock);
+}
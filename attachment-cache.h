@@ -0,0 +1,41 @@
+#ifndef ATTACHMENT_CACHE_H
+#define ATTACHMENT_CACHE_H
+
+#include <gio/gio.h>
+
+// Кэш результатов проверки содержимого вложений на диске
+// (~/.cache/evolution-attachment-checker/scan-cache). Одни и те же файлы
+// пересылаются и прикладываются много раз: при попадании в кэш результат
+// берётся из хэш-таблицы, а сам файл не открывается.
+//
+// Файл на диске опознаётся по устройству, inode, размеру и времени изменения
+// (stat без чтения содержимого), вложение без файла - по размеру и хэшу
+// декодированного содержимого. Запись действительна только для того же
+// словаря (word_matcher_get_version) и того же предела объёма проверки.
+
+typedef struct {
+    guint64 device;
+    guint64 inode;
+    guint64 size;
+    gint64 mtime;           // микросекунды
+    gint64 ctime;           // меняется и при переименовании
+    guint64 content_hash;   // только для вложений без файла
+} AttachmentCacheKey;
+
+// Ключ по метаданным файла; FALSE, если у файла нет inode (не локальный)
+gboolean attachment_cache_key_for_file(AttachmentCacheKey *key, GFile *file,
+                                       GCancellable *cancellable);
+void attachment_cache_key_for_bytes(AttachmentCacheKey *key, GBytes *bytes);
+
+// Кэш на время жизни плагина. Файл читается при первом обращении,
+// поиск и запись можно вызывать из любого потока.
+void attachment_cache_init(void);
+void attachment_cache_shutdown(void);
+
+// TRUE при попадании; *word_index = WORD_MATCHER_NONE, если вложение чистое
+gboolean attachment_cache_lookup(const AttachmentCacheKey *key, guint64 dictionary_version,
+                                 guint64 max_bytes, guint *word_index);
+void attachment_cache_store(const AttachmentCacheKey *key, guint64 dictionary_version,
+                            guint64 max_bytes, guint word_index);
+
+#endif /* ATTACHMENT_CACHE_H */
@@ -0,0 +1,432 @@
+// Микробенчмарки проверки текста на синтетических данных
+//
+//   attachment-checker-bench [--quick] [--output FILE]
+//   attachment-checker-bench --compare OLD.tsv NEW.tsv
+//
+// Тексты (латиница, кириллица, смесь) и словари генерируются детерминированно,
+// поэтому результаты разных коммитов сравнимы построчно. Слова словаря
+// содержат букву, которой нет в тексте: совпадений нет, и каждый прогон
+// проходит текст целиком, как при проверке чистого письма.
+//
+// Каждая группа (алфавит, размер словаря, режим регистра) выполняется
+// в отдельном процессе, чтобы пиковый RSS относился к ней.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "forbidden-words.h"
+#include "word-matcher.h"
+
+// Минимальное время замера одного случая; маленькие тексты прогоняются
+// многократно
+#define BENCH_MIN_SECONDS 0.2
+#define BENCH_NAMES 10000
+
+// Подсчёт выделений памяти: перехват malloc во всём процессе, включая GLib
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static gint bench_allocations;
+
+void*
+malloc(size_t size)
+{
+    g_atomic_int_inc(&bench_allocations);
+    return __libc_malloc(size);
+}
+
+void*
+calloc(size_t n, size_t size)
+{
+    g_atomic_int_inc(&bench_allocations);
+    return __libc_calloc(n, size);
+}
+
+void*
+realloc(void *ptr, size_t size)
+{
+    g_atomic_int_inc(&bench_allocations);
+    return __libc_realloc(ptr, size);
+}
+
+#define BENCH_ALLOCATIONS() ((gint64)g_atomic_int_get(&bench_allocations))
+#else
+#define BENCH_ALLOCATIONS() ((gint64)-1)
+#endif
+
+typedef enum {
+    BENCH_LATIN,
+    BENCH_CYRILLIC,
+    BENCH_MIXED
+} BenchScript;
+
+static const gchar *bench_script_names[] = { "latin", "cyrillic", "mixed" };
+
+// Буквы текста; последняя буква алфавита встречается только в словаре
+static const gchar *latin_letters[] = {
+    "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m",
+    "n", "o", "p", "r", "s", "t", "u", "v", "w", "x", "y", "z", "q"
+};
+static const gchar *latin_upper[] = {
+    "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M",
+    "N", "O", "P", "R", "S", "T", "U", "V", "W", "X", "Y", "Z", "Q"
+};
+static const gchar *cyrillic_letters[] = {
+    "а", "б", "в", "г", "д", "е", "ж", "з", "и", "й", "к", "л", "м",
+    "н", "о", "п", "р", "с", "т", "у", "ф", "х", "ц", "ч", "ш", "щ"
+};
+static const gchar *cyrillic_upper[] = {
+    "А", "Б", "В", "Г", "Д", "Е", "Ж", "З", "И", "Й", "К", "Л", "М",
+    "Н", "О", "П", "Р", "С", "Т", "У", "Ф", "Х", "Ц", "Ч", "Ш", "Щ"
+};
+#define BENCH_TEXT_LETTERS 25
+#define BENCH_DICT_LETTER 25
+
+static const gsize bench_sizes[] = {
+    1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 100 * 1024 * 1024
+};
+static const guint bench_dictionaries[] = { 10, 1000, 100000, 1000000 };
+
+typedef struct {
+    guint64 state;
+} BenchRandom;
+
+static guint32
+bench_random(BenchRandom *random)
+{
+    // xorshift64*: одинаковая последовательность на всех платформах
+    random->state ^= random->state >> 12;
+    random->state ^= random->state << 25;
+    random->state ^= random->state >> 27;
+    return (guint32)((random->state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static gboolean
+bench_word_is_cyrillic(BenchScript script, BenchRandom *random)
+{
+    if (script == BENCH_MIXED)
+        return bench_random(random) & 1;
+    return script == BENCH_CYRILLIC;
+}
+
+static void
+bench_append_word(GString *out, BenchScript script, BenchRandom *random,
+                  guint length, gboolean capitalize, gboolean dictionary)
+{
+    gboolean cyrillic = bench_word_is_cyrillic(script, random);
+    const gchar **letters = cyrillic ? cyrillic_letters : latin_letters;
+    const gchar **upper = cyrillic ? cyrillic_upper : latin_upper;
+    guint marker = dictionary ? bench_random(random) % length : G_MAXUINT;
+
+    for (guint i = 0; i < length; i++) {
+        guint letter = i == marker ? BENCH_DICT_LETTER : bench_random(random) % BENCH_TEXT_LETTERS;
+
+        g_string_append(out, i == 0 && capitalize ? upper[letter] : letters[letter]);
+    }
+}
+
+static gchar*
+bench_corpus_new(BenchScript script, gsize size)
+{
+    BenchRandom random = { 0x9E3779B97F4A7C15ULL + script };
+    GString *out = g_string_sized_new(size + 64);
+    guint in_sentence = 0;
+
+    while (out->len < size) {
+        bench_append_word(out, script, &random, 2 + bench_random(&random) % 10,
+                          in_sentence == 0, FALSE);
+
+        if (++in_sentence >= 8 + bench_random(&random) % 8) {
+            g_string_append(out, bench_random(&random) % 4 ? ". " : ".\n");
+            in_sentence = 0;
+        } else {
+            g_string_append_c(out, ' ');
+        }
+    }
+
+    // Обрезаем по границе символа UTF-8
+    while (out->len > size && ((guchar)out->str[size] & 0xC0) == 0x80)
+        size--;
+    g_string_truncate(out, size);
+
+    return g_string_free(out, FALSE);
+}
+
+static gchar**
+bench_dictionary_new(BenchScript script, guint n_words)
+{
+    BenchRandom random = { 0xD1B54A32D192ED03ULL + script * 7919 + n_words };
+    gchar **words = g_new0(gchar *, n_words + 1);
+    GString *word = g_string_new(NULL);
+
+    for (guint i = 0; i < n_words; i++) {
+        g_string_truncate(word, 0);
+        bench_append_word(word, script, &random, 4 + bench_random(&random) % 9, FALSE, TRUE);
+        words[i] = g_strdup(word->str);
+    }
+
+    g_string_free(word, TRUE);
+    return words;
+}
+
+static glong
+bench_peak_rss_kb(void)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void
+bench_report(FILE *out, const gchar *operation, BenchScript script, guint n_words,
+             gboolean case_sensitive, gsize bytes, guint iterations,
+             gdouble seconds, gint64 allocations)
+{
+    gdouble total = (gdouble)bytes * iterations;
+
+    fprintf(out, "%s\t%s\t%u\t%s\t%" G_GSIZE_FORMAT "\t%u\t%.3f\t%.3f\t%.1f\t%" G_GINT64_FORMAT "\t%ld\n",
+            operation, bench_script_names[script], n_words,
+            case_sensitive ? "sensitive" : "insensitive", bytes, iterations,
+            seconds * 1000.0 / iterations,
+            total > 0 ? seconds * 1e9 / total : 0.0,
+            seconds > 0 ? total / (1024.0 * 1024.0) / seconds : 0.0,
+            allocations < 0 ? allocations : allocations / MAX(iterations, 1),
+            bench_peak_rss_kb());
+    fflush(out);
+}
+
+static void
+bench_group(FILE *out, BenchScript script, guint n_words, gboolean case_sensitive,
+            gsize max_size)
+{
+    gchar **words = bench_dictionary_new(script, n_words);
+    gint64 allocations = BENCH_ALLOCATIONS();
+    gint64 started = g_get_monotonic_time();
+    WordMatcher *matcher = word_matcher_new(words, case_sensitive);
+    gdouble seconds = (g_get_monotonic_time() - started) / (gdouble)G_USEC_PER_SEC;
+    gchar **names;
+    gsize names_bytes = 0;
+    guint iterations;
+
+    bench_report(out, "build", script, n_words, case_sensitive, 0, 1, seconds,
+                 allocations < 0 ? -1 : BENCH_ALLOCATIONS() - allocations);
+
+    // Текст письма: check_text_for_forbidden_words
+    for (guint s = 0; s < G_N_ELEMENTS(bench_sizes) && bench_sizes[s] <= max_size; s++) {
+        gchar *text = bench_corpus_new(script, bench_sizes[s]);
+        gsize len = strlen(text);
+
+        allocations = BENCH_ALLOCATIONS();
+        started = g_get_monotonic_time();
+        iterations = 0;
+        do {
+            if (check_text_for_forbidden_words(text, matcher, NULL))
+                fprintf(stderr, "Unexpected match in synthetic text\n");
+            iterations++;
+            seconds = (g_get_monotonic_time() - started) / (gdouble)G_USEC_PER_SEC;
+        } while (seconds < BENCH_MIN_SECONDS);
+
+        bench_report(out, "text", script, n_words, case_sensitive, len, iterations, seconds,
+                     allocations < 0 ? -1 : BENCH_ALLOCATIONS() - allocations);
+        g_free(text);
+    }
+
+    // Имена вложений: короткие строки, как имена файлов при проверке перед отправкой
+    names = g_new0(gchar *, BENCH_NAMES + 1);
+    for (guint i = 0; i < BENCH_NAMES; i++) {
+        gchar *base = bench_corpus_new(script, 8 + i % 40);
+
+        g_strdelimit(base, " .\n", '_');
+        names[i] = g_strconcat(base, i % 2 ? ".pdf" : ".docx", NULL);
+        names_bytes += strlen(names[i]);
+        g_free(base);
+    }
+
+    allocations = BENCH_ALLOCATIONS();
+    started = g_get_monotonic_time();
+    iterations = 0;
+    do {
+        for (guint i = 0; i < BENCH_NAMES; i++)
+            check_text_for_forbidden_words(names[i], matcher, NULL);
+        iterations++;
+        seconds = (g_get_monotonic_time() - started) / (gdouble)G_USEC_PER_SEC;
+    } while (seconds < BENCH_MIN_SECONDS);
+
+    bench_report(out, "names", script, n_words, case_sensitive, names_bytes, iterations,
+                 seconds, allocations < 0 ? -1 : BENCH_ALLOCATIONS() - allocations);
+
+    g_strfreev(names);
+    word_matcher_free(matcher);
+    g_strfreev(words);
+}
+
+static gboolean
+bench_run(FILE *out, gboolean quick)
+{
+    gsize max_size = quick ? 1024 * 1024 : G_MAXSIZE;
+    guint max_words = quick ? 100000 : G_MAXUINT;
+    gboolean ok = TRUE;
+
+    fprintf(out, "# operation\tscript\twords\tcase\tbytes\titerations\tms\tns_per_byte\t"
+            "mb_per_s\tallocations\tpeak_rss_kb\n");
+    fflush(out);
+
+    for (guint d = 0; d < G_N_ELEMENTS(bench_dictionaries); d++) {
+        if (bench_dictionaries[d] > max_words)
+            continue;
+
+        for (gint script = BENCH_LATIN; script <= BENCH_MIXED; script++) {
+            for (gint case_sensitive = 0; case_sensitive <= 1; case_sensitive++) {
+                pid_t pid = fork();
+                int status;
+
+                if (pid == 0) {
+                    bench_group(out, script, bench_dictionaries[d], case_sensitive, max_size);
+                    fflush(out);
+                    _exit(0);
+                }
+
+                if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+                    !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    fprintf(stderr, "Benchmark group %s/%u failed\n",
+                            bench_script_names[script], bench_dictionaries[d]);
+                    ok = FALSE;
+                }
+            }
+        }
+    }
+
+    return ok;
+}
+
+// Ключ строки - первые пять столбцов, сравнивается ns_per_byte
+// (для build - время в мс)
+static GHashTable*
+bench_load(const gchar *path)
+{
+    GHashTable *rows;
+    gchar *contents;
+    gchar **lines;
+
+    if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        return NULL;
+    }
+
+    rows = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    lines = g_strsplit(contents, "\n", -1);
+
+    for (gchar **line = lines; *line; line++) {
+        gchar **fields;
+
+        if (**line == '\0' || **line == '#')
+            continue;
+
+        fields = g_strsplit(*line, "\t", -1);
+        if (g_strv_length(fields) >= 11) {
+            gchar *key = g_strjoin("\t", fields[0], fields[1], fields[2], fields[3],
+                                   strcmp(fields[0], "build") == 0 ? "" : fields[4], NULL);
+            gdouble *value = g_new(gdouble, 1);
+
+            *value = g_ascii_strtod(strcmp(fields[0], "build") == 0 ? fields[6] : fields[7], NULL);
+            g_hash_table_replace(rows, key, value);
+        }
+        g_strfreev(fields);
+    }
+
+    g_strfreev(lines);
+    g_free(contents);
+    return rows;
+}
+
+// Замедление больше чем на 10% считается регрессией
+static int
+bench_compare(const gchar *old_path, const gchar *new_path)
+{
+    GHashTable *old_rows = bench_load(old_path);
+    GHashTable *new_rows = bench_load(new_path);
+    GList *keys;
+    guint regressions = 0;
+
+    if (!old_rows || !new_rows)
+        return 2;
+
+    keys = g_list_sort(g_hash_table_get_keys(new_rows), (GCompareFunc)strcmp);
+
+    for (GList *item = keys; item; item = item->next) {
+        const gdouble *old_value = g_hash_table_lookup(old_rows, item->data);
+        const gdouble *new_value = g_hash_table_lookup(new_rows, item->data);
+        gdouble ratio;
+
+        if (!old_value || *old_value <= 0)
+            continue;
+
+        ratio = *new_value / *old_value;
+        printf("%s\t%.3f\t%.3f\t%+.1f%%%s\n", (const gchar *)item->data, *old_value, *new_value,
+               (ratio - 1.0) * 100.0, ratio > 1.10 ? "\tREGRESSION" : "");
+        if (ratio > 1.10)
+            regressions++;
+    }
+
+    fprintf(stderr, "%u regressions\n", regressions);
+
+    g_list_free(keys);
+    g_hash_table_unref(old_rows);
+    g_hash_table_unref(new_rows);
+    return regressions ? 1 : 0;
+}
+
+static void
+usage(const gchar *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [--quick] [--output FILE]\n"
+            "       %s --compare OLD.tsv NEW.tsv\n", argv0, argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+    gboolean quick = FALSE;
+    const gchar *output = NULL;
+    FILE *out = stdout;
+    gboolean ok;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = TRUE;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 2 < argc) {
+            return bench_compare(argv[i + 1], argv[i + 2]);
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (output) {
+        out = fopen(output, "w");
+        if (!out) {
+            fprintf(stderr, "Cannot write %s\n", output);
+            return 2;
+        }
+    }
+
+    ok = bench_run(out, quick);
+
+    if (out != stdout)
+        fclose(out);
+    return ok ? 0 : 1;
+}
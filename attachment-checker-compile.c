@@ -0,0 +1,102 @@
+// Офлайн-компилятор словаря: words.conf -> words.bin
+//
+//   attachment-checker-compile [--case-sensitive] [--normalize] words.conf [words.bin]
+//
+// Результат загружается плагином через mmap без разбора текста.
+// Ошибочные правила (word-rules.h) выводятся с номером и файл не пишется.
+
+#include <string.h>
+#include <stdio.h>
+
+#include "word-matcher.h"
+#include "word-rules.h"
+#include "dictionary-file.h"
+
+static void
+usage(const gchar *argv0)
+{
+    fprintf(stderr, "Usage: %s [--case-sensitive] [--normalize] WORDS.conf [WORDS.bin]\n", argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+    WordMatcherFlags flags = 0;
+    const gchar *source = NULL;
+    const gchar *output = NULL;
+    gchar *default_output = NULL;
+    gchar **words;
+    WordMatcher *matcher;
+    GError *error = NULL;
+    int invalid = 0;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--case-sensitive") == 0) {
+            flags |= WORD_MATCHER_CASE_SENSITIVE;
+        } else if (strcmp(argv[i], "--normalize") == 0) {
+            flags |= WORD_MATCHER_NORMALIZE;
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else if (!source) {
+            source = argv[i];
+        } else if (!output) {
+            output = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!source) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (!output)
+        output = default_output = dictionary_file_binary_path(source);
+
+    words = dictionary_file_load_words(source);
+    if (!words) {
+        fprintf(stderr, "Cannot read %s\n", source);
+        g_free(default_output);
+        return 1;
+    }
+
+    for (i = 0; words[i]; i++) {
+        if (!word_rule_validate(words[i], (flags & WORD_MATCHER_CASE_SENSITIVE) != 0, &error)) {
+            fprintf(stderr, "%s: rule %d '%s': %s\n", source, i + 1, words[i], error->message);
+            g_clear_error(&error);
+            invalid++;
+        }
+    }
+
+    if (invalid > 0) {
+        fprintf(stderr, "%s: %d invalid rules, nothing written\n", source, invalid);
+        g_strfreev(words);
+        g_free(default_output);
+        return 1;
+    }
+
+    matcher = word_matcher_new_full(words, flags);
+    flags = word_matcher_get_flags(matcher);
+
+    if (!dictionary_file_write(output, matcher, source, &error)) {
+        fprintf(stderr, "Cannot write %s: %s\n", output, error->message);
+        g_error_free(error);
+        word_matcher_free(matcher);
+        g_strfreev(words);
+        g_free(default_output);
+        return 1;
+    }
+
+    printf("%s: %u words (%s%s)\n", output, g_strv_length(words),
+           (flags & WORD_MATCHER_CASE_SENSITIVE) ? "case-sensitive" : "case-insensitive",
+           (flags & WORD_MATCHER_NORMALIZE) ? ", normalized" : "");
+
+    word_matcher_free(matcher);
+    g_strfreev(words);
+    g_free(default_output);
+    return 0;
+}
@@ -0,0 +1,445 @@
+// Замер задержки отправки: хук presendchecks вызывается целиком, как из
+// Evolution, но с подставным композером и без окон
+//
+//   attachment-checker-latency [--iterations N] [--words N] [--with-cache]
+//
+// Композер заменён объектом HarnessComposer: функции e_msg_composer_*,
+// которые вызывает плагин, определены здесь и перекрывают библиотечные.
+// Вложения - настоящие EAttachment в EAttachmentStore. gtk_dialog_run()
+// тоже перекрыт и сразу отвечает "Да", поэтому этап dialog показывает
+// только стоимость самого окна. Нужен дисплей (в CI - xvfb-run).
+//
+// Для каждого вида письма выводятся p50/p99/max по этапам, в микросекундах.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <camel/camel.h>
+#include <evolution/e-util/e-util.h>
+#include <evolution/mail/em-event.h>
+#include <evolution/composer/e-msg-composer.h>
+
+#include "attachment-cache.h"
+#include "attachment-checker.h"
+#include "scan-arena.h"
+#include "scan-policy.h"
+#include "scan-timing.h"
+
+// Слово из словаря стенда; в тексте писем его нет, кроме вида "hit"
+#define LATENCY_FORBIDDEN_WORD "harnessforbiddenq"
+
+void org_gnome_evolution_attachment_checker(EPlugin *ep, gpointer t);
+
+// Подставной композер
+#define HARNESS_TYPE_COMPOSER (harness_composer_get_type())
+G_DECLARE_FINAL_TYPE(HarnessComposer, harness_composer, HARNESS, COMPOSER, GtkWindow)
+
+struct _HarnessComposer {
+    GtkWindow parent;
+    GByteArray *raw_text;           // NULL - текст берётся из MIME-сообщения
+    CamelMimeMessage *message;
+    GtkWidget *attachment_view;
+};
+
+enum {
+    PROP_0,
+    PROP_MESSAGE,
+    PROP_TEXT
+};
+
+G_DEFINE_TYPE(HarnessComposer, harness_composer, GTK_TYPE_WINDOW)
+
+static void
+harness_composer_get_property(GObject *object, guint property_id,
+                              GValue *value, GParamSpec *pspec)
+{
+    HarnessComposer *composer = HARNESS_COMPOSER(object);
+
+    switch (property_id) {
+    case PROP_MESSAGE:
+        g_value_set_object(value, composer->message);
+        break;
+    case PROP_TEXT:
+        g_value_set_string(value, NULL);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
+static void
+harness_composer_dispose(GObject *object)
+{
+    HarnessComposer *composer = HARNESS_COMPOSER(object);
+
+    g_clear_pointer(&composer->raw_text, g_byte_array_unref);
+    g_clear_object(&composer->message);
+    g_clear_object(&composer->attachment_view);
+
+    G_OBJECT_CLASS(harness_composer_parent_class)->dispose(object);
+}
+
+static void
+harness_composer_class_init(HarnessComposerClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+    object_class->get_property = harness_composer_get_property;
+    object_class->dispose = harness_composer_dispose;
+
+    g_object_class_install_property(object_class, PROP_MESSAGE,
+        g_param_spec_object("message", NULL, NULL, CAMEL_TYPE_MIME_MESSAGE, G_PARAM_READABLE));
+    g_object_class_install_property(object_class, PROP_TEXT,
+        g_param_spec_string("text", NULL, NULL, NULL, G_PARAM_READABLE));
+}
+
+static void
+harness_composer_init(HarnessComposer *composer)
+{
+    EAttachmentStore *store = E_ATTACHMENT_STORE(e_attachment_store_new());
+
+    composer->attachment_view = g_object_ref_sink(e_attachment_icon_view_new());
+    gtk_icon_view_set_model(GTK_ICON_VIEW(composer->attachment_view), GTK_TREE_MODEL(store));
+    g_object_unref(store);
+}
+
+// Функции композера, которые вызывает плагин
+GByteArray*
+e_msg_composer_get_raw_message_text(EMsgComposer *composer)
+{
+    HarnessComposer *harness = (HarnessComposer *)composer;
+
+    if (!harness->raw_text)
+        return NULL;
+
+    return g_byte_array_append(g_byte_array_new(), harness->raw_text->data,
+                               harness->raw_text->len);
+}
+
+EAttachmentView*
+e_msg_composer_get_attachment_view(EMsgComposer *composer)
+{
+    return E_ATTACHMENT_VIEW(((HarnessComposer *)composer)->attachment_view);
+}
+
+EHTMLEditor*
+e_msg_composer_get_editor(EMsgComposer *composer)
+{
+    (void)composer;
+    return NULL;
+}
+
+static gint latency_dialogs;
+
+gint
+gtk_dialog_run(GtkDialog *dialog)
+{
+    latency_dialogs++;
+
+    (void)dialog;
+    return GTK_RESPONSE_YES;
+}
+
+// Синтетический текст из букв a-p: слова словаря содержат 'q' и в нём не встречаются
+static gchar*
+latency_text_new(gsize size, gboolean with_hit)
+{
+    GString *out = g_string_sized_new(size + 32);
+    guint32 state = 2463534242u;
+
+    while (out->len < size) {
+        guint length = 2 + state % 9;
+
+        for (guint i = 0; i < length; i++) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            g_string_append_c(out, 'a' + state % 16);
+        }
+        g_string_append_c(out, out->len % 80 < 8 ? '\n' : ' ');
+    }
+    g_string_truncate(out, size);
+
+    if (with_hit && size > sizeof(LATENCY_FORBIDDEN_WORD) + 2)
+        memcpy(out->str + size / 2, " " LATENCY_FORBIDDEN_WORD " ",
+               sizeof(LATENCY_FORBIDDEN_WORD) + 1);
+
+    return g_string_free(out, FALSE);
+}
+
+static CamelMimePart*
+latency_mime_part_new(const gchar *filename, const gchar *content_type,
+                      const gchar *content, gsize length)
+{
+    CamelMimePart *part = camel_mime_part_new();
+
+    camel_mime_part_set_content(part, content, length, content_type);
+    camel_mime_part_set_encoding(part, CAMEL_TRANSFER_ENCODING_BASE64);
+    if (filename) {
+        camel_mime_part_set_filename(part, filename);
+        camel_mime_part_set_disposition(part, "attachment");
+    }
+
+    return part;
+}
+
+static void
+latency_add_attachment(HarnessComposer *composer, CamelMimePart *part)
+{
+    EAttachmentStore *store = e_attachment_view_get_store(
+        E_ATTACHMENT_VIEW(composer->attachment_view));
+    EAttachment *attachment = e_attachment_new();
+
+    e_attachment_set_mime_part(attachment, part);
+    e_attachment_store_add_attachment(store, attachment);
+    g_object_unref(attachment);
+}
+
+typedef struct {
+    const gchar *name;
+    gsize text_size;
+    gboolean mime_only;         // текст только в MIME (HTML + plain), без raw text
+    guint n_attachments;
+    gsize attachment_size;
+    gboolean text_attachments;  // text/plain, иначе application/octet-stream
+    gboolean hit;
+} LatencyShape;
+
+static const LatencyShape latency_shapes[] = {
+    { "text-4k",            4 * 1024,        FALSE, 0,  0,           FALSE, FALSE },
+    { "text-1m",            1024 * 1024,     FALSE, 0,  0,           FALSE, FALSE },
+    { "mime-html-256k",     256 * 1024,      TRUE,  0,  0,           FALSE, FALSE },
+    { "names-50x4k",        4 * 1024,        FALSE, 50, 4 * 1024,    FALSE, FALSE },
+    { "text-attach-10x1m",  4 * 1024,        FALSE, 10, 1024 * 1024, TRUE,  FALSE },
+    { "hit-4k",             4 * 1024,        FALSE, 0,  0,           FALSE, TRUE  },
+};
+
+static HarnessComposer*
+latency_composer_new(const LatencyShape *shape)
+{
+    HarnessComposer *composer = g_object_new(HARNESS_TYPE_COMPOSER, NULL);
+    gchar *text = latency_text_new(shape->text_size, shape->hit);
+
+    if (shape->mime_only) {
+        CamelMultipart *alternative = camel_multipart_new();
+        gchar *html = g_strdup_printf("<html><body><p>%s</p></body></html>", text);
+        CamelMimePart *part;
+
+        camel_data_wrapper_set_mime_type(CAMEL_DATA_WRAPPER(alternative), "multipart/alternative");
+        camel_multipart_set_boundary(alternative, NULL);
+
+        part = latency_mime_part_new(NULL, "text/plain; charset=utf-8", text, strlen(text));
+        camel_multipart_add_part(alternative, part);
+        g_object_unref(part);
+
+        part = latency_mime_part_new(NULL, "text/html; charset=utf-8", html, strlen(html));
+        camel_multipart_add_part(alternative, part);
+        g_object_unref(part);
+
+        composer->message = camel_mime_message_new();
+        camel_medium_set_content(CAMEL_MEDIUM(composer->message), CAMEL_DATA_WRAPPER(alternative));
+        g_object_unref(alternative);
+        g_free(html);
+    } else {
+        composer->raw_text = g_byte_array_new_take((guint8 *)text, strlen(text));
+        text = NULL;
+    }
+    g_free(text);
+
+    for (guint i = 0; i < shape->n_attachments; i++) {
+        gchar *content = latency_text_new(shape->attachment_size, FALSE);
+        gchar *filename = g_strdup_printf("report-%u.%s", i, shape->text_attachments ? "txt" : "bin");
+        CamelMimePart *part = latency_mime_part_new(
+            filename, shape->text_attachments ? "text/plain" : "application/octet-stream",
+            content, shape->attachment_size);
+
+        latency_add_attachment(composer, part);
+        g_object_unref(part);
+        g_free(filename);
+        g_free(content);
+    }
+
+    return composer;
+}
+
+typedef struct {
+    GArray *samples[SCAN_N_PHASES];
+} LatencySamples;
+
+static void
+latency_observer(const ScanTiming *timing, gpointer user_data)
+{
+    LatencySamples *samples = user_data;
+
+    for (guint phase = 0; phase < SCAN_N_PHASES; phase++)
+        g_array_append_val(samples->samples[phase], timing->elapsed[phase]);
+}
+
+static gint
+latency_compare(gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void
+latency_print(const gchar *shape, LatencySamples *samples)
+{
+    for (guint phase = 0; phase < SCAN_N_PHASES; phase++) {
+        GArray *values = samples->samples[phase];
+        guint n = values->len;
+
+        if (n == 0)
+            continue;
+
+        g_array_sort(values, latency_compare);
+        printf("%s\t%s\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\n",
+               shape, scan_phase_get_name(phase),
+               g_array_index(values, gint64, n / 2),
+               g_array_index(values, gint64, MIN(n - 1, n * 99 / 100)),
+               g_array_index(values, gint64, n - 1));
+        g_array_set_size(values, 0);
+    }
+    fflush(stdout);
+}
+
+// Отдельный HOME со словарём стенда: пользовательские настройки не трогаются
+static gchar*
+latency_prepare_home(guint n_words)
+{
+    gchar *home = g_dir_make_tmp("attachment-checker-latency-XXXXXX", NULL);
+    gchar *config = g_build_filename(home, USER_CONFIG_FILE, NULL);
+    gchar *config_dir = g_path_get_dirname(config);
+    GString *words = g_string_new(LATENCY_FORBIDDEN_WORD "\n");
+
+    for (guint i = 1; i < n_words; i++)
+        g_string_append_printf(words, "secretq%u\n", i);
+
+    g_mkdir_with_parents(config_dir, 0700);
+    g_file_set_contents(config, words->str, words->len, NULL);
+
+    g_setenv("HOME", home, TRUE);
+    g_setenv("XDG_CACHE_HOME", home, TRUE);
+    g_setenv("GSETTINGS_BACKEND", "memory", TRUE);
+
+    g_string_free(words, TRUE);
+    g_free(config_dir);
+    g_free(config);
+    return home;
+}
+
+static void
+latency_remove_tree(const gchar *path)
+{
+    GDir *dir = g_dir_open(path, 0, NULL);
+    const gchar *name;
+
+    while (dir && (name = g_dir_read_name(dir))) {
+        gchar *child = g_build_filename(path, name, NULL);
+
+        if (g_file_test(child, G_FILE_TEST_IS_DIR) && !g_file_test(child, G_FILE_TEST_IS_SYMLINK))
+            latency_remove_tree(child);
+        else
+            g_unlink(child);
+        g_free(child);
+    }
+
+    if (dir)
+        g_dir_close(dir);
+    g_rmdir(path);
+}
+
+static void
+usage(const gchar *argv0)
+{
+    fprintf(stderr, "Usage: %s [--iterations N] [--words N] [--with-cache]\n", argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+    guint iterations = 200;
+    guint n_words = 1000;
+    gboolean with_cache = FALSE;
+    LatencySamples samples;
+    gchar *home;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = MAX(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--words") == 0 && i + 1 < argc) {
+            n_words = MAX(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--with-cache") == 0) {
+            with_cache = TRUE;
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    home = latency_prepare_home(n_words);
+
+    if (!gtk_init_check(&argc, &argv)) {
+        fprintf(stderr, "Cannot open display; run under xvfb-run\n");
+        return 2;
+    }
+
+    if (g_file_test(CONFIG_FILE, G_FILE_TEST_EXISTS))
+        fprintf(stderr, "Note: %s exists and is used instead of the harness dictionary\n",
+                CONFIG_FILE);
+
+    // То же, что e_plugin_lib_enable(); кэш вложений - только по запросу,
+    // иначе со второго прогона вложения не читаются
+    scan_policy_init();
+    if (with_cache)
+        attachment_cache_init();
+
+    for (guint phase = 0; phase < SCAN_N_PHASES; phase++)
+        samples.samples[phase] = g_array_new(FALSE, FALSE, sizeof(gint64));
+    scan_timing_set_observer(latency_observer, &samples);
+
+    printf("# shape\tphase\tp50_us\tp99_us\tmax_us\n");
+
+    for (guint s = 0; s < G_N_ELEMENTS(latency_shapes); s++) {
+        HarnessComposer *composer = latency_composer_new(&latency_shapes[s]);
+        EMEventTargetComposer target = { { 0 } };
+
+        target.composer = (EMsgComposer *)composer;
+
+        // Первый прогон прогревает словарь и не учитывается
+        org_gnome_evolution_attachment_checker(NULL, &target);
+        for (guint phase = 0; phase < SCAN_N_PHASES; phase++)
+            g_array_set_size(samples.samples[phase], 0);
+
+        for (guint n = 0; n < iterations; n++) {
+            g_object_set_data(G_OBJECT(composer), "presend_check_status", NULL);
+            org_gnome_evolution_attachment_checker(NULL, &target);
+        }
+
+        latency_print(latency_shapes[s].name, &samples);
+        gtk_widget_destroy(GTK_WIDGET(composer));
+    }
+
+    fprintf(stderr, "%d warning dialogs answered\n", latency_dialogs);
+
+    scan_timing_set_observer(NULL, NULL);
+    for (guint phase = 0; phase < SCAN_N_PHASES; phase++)
+        g_array_unref(samples.samples[phase]);
+
+    if (with_cache)
+        attachment_cache_shutdown();
+    scan_policy_shutdown();
+    scan_arena_cache_clear();
+
+    latency_remove_tree(home);
+    g_free(home);
+    return 0;
+}
@@ -0,0 +1,153 @@
+// Отчёт по профилю стоимости правил (word-profile.h)
+//
+//   attachment-checker-profile [--top N] [ФАЙЛ...]
+//
+// ФАЙЛ - профиль плагина (ATTACHMENT_CHECKER_TRACE=rules, по умолчанию
+// ~/.cache/evolution-attachment-checker/rule-profile) или
+// attachment-checker-scan --profile. Несколько файлов, например собранных
+// у разных пользователей, складываются. Выводятся самые дорогие правила
+// (по доле процессорного времени) и самые шумные (по числу совпадений):
+// кандидаты на удаление или уточнение.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "word-profile.h"
+
+#define PROFILE_DEFAULT_TOP 20
+
+typedef struct {
+    const gchar *rule;
+    const WordProfileCounters *counters;
+} ProfileRule;
+
+static void
+usage(const gchar *argv0)
+{
+    fprintf(stderr, "Usage: %s [--top N] [PROFILE...]\n", argv0);
+}
+
+static gint
+compare_cpu(gconstpointer a, gconstpointer b)
+{
+    const ProfileRule *x = *(const ProfileRule **)a;
+    const ProfileRule *y = *(const ProfileRule **)b;
+
+    if (x->counters->cpu_ns != y->counters->cpu_ns)
+        return (x->counters->cpu_ns < y->counters->cpu_ns) ? 1 : -1;
+    if (x->counters->candidates != y->counters->candidates)
+        return (x->counters->candidates < y->counters->candidates) ? 1 : -1;
+    return strcmp(x->rule, y->rule);
+}
+
+static gint
+compare_hits(gconstpointer a, gconstpointer b)
+{
+    const ProfileRule *x = *(const ProfileRule **)a;
+    const ProfileRule *y = *(const ProfileRule **)b;
+
+    if (x->counters->hits != y->counters->hits)
+        return (x->counters->hits < y->counters->hits) ? 1 : -1;
+    return compare_cpu(a, b);
+}
+
+static void
+print_rules(const gchar *title, GPtrArray *rules, guint top, const WordProfileData *data)
+{
+    printf("\n%s:\n", title);
+    printf("%10s %7s %12s %14s %10s  %s\n", "cpu-ms", "share", "hits", "candidates",
+           "cand/hit", "rule");
+
+    for (guint i = 0; i < rules->len && i < top; i++) {
+        const ProfileRule *entry = g_ptr_array_index(rules, i);
+        const WordProfileCounters *counters = entry->counters;
+        gchar ratio[32];
+
+        if (counters->hits > 0)
+            g_snprintf(ratio, sizeof(ratio), "%.1f",
+                       counters->candidates / (gdouble)counters->hits);
+        else
+            g_strlcpy(ratio, "-", sizeof(ratio));
+
+        printf("%10.2f %6.1f%% %12" G_GUINT64_FORMAT " %14" G_GUINT64_FORMAT " %10s  %s\n",
+               counters->cpu_ns / 1e6, 100.0 * counters->cpu_ns / MAX(data->cpu_ns, 1),
+               counters->hits, counters->candidates, ratio, entry->rule);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    WordProfileData data;
+    GPtrArray *paths = g_ptr_array_new();
+    GPtrArray *rules = g_ptr_array_new_with_free_func(g_free);
+    gchar *default_path = NULL;
+    guint top = PROFILE_DEFAULT_TOP;
+    GHashTableIter iter;
+    gpointer key, value;
+    int status = 0;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+            top = MAX(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else {
+            g_ptr_array_add(paths, argv[i]);
+        }
+    }
+
+    if (paths->len == 0) {
+        default_path = g_build_filename(g_get_user_cache_dir(), "evolution-attachment-checker",
+                                        "rule-profile", NULL);
+        g_ptr_array_add(paths, default_path);
+    }
+
+    word_profile_data_init(&data);
+    for (guint p = 0; p < paths->len; p++) {
+        GError *error = NULL;
+
+        if (!word_profile_data_load(&data, g_ptr_array_index(paths, p), &error)) {
+            fprintf(stderr, "%s\n", error->message);
+            g_error_free(error);
+            status = 2;
+        }
+    }
+
+    if (status == 0) {
+        g_hash_table_iter_init(&iter, data.rules);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            ProfileRule *entry = g_new(ProfileRule, 1);
+
+            entry->rule = key;
+            entry->counters = value;
+            g_ptr_array_add(rules, entry);
+        }
+
+        printf("%" G_GUINT64_FORMAT " calls, %.1f MB, %.2f ms CPU: %.1f%% base scan, "
+               "%.1f%% attributed to %u rules\n",
+               data.calls, data.bytes / (1024.0 * 1024.0), data.cpu_ns / 1e6,
+               100.0 * data.base_ns / MAX(data.cpu_ns, 1),
+               100.0 * (data.cpu_ns - MIN(data.base_ns, data.cpu_ns)) / MAX(data.cpu_ns, 1),
+               rules->len);
+
+        g_ptr_array_sort(rules, compare_cpu);
+        print_rules("Most expensive rules", rules, top, &data);
+
+        g_ptr_array_sort(rules, compare_hits);
+        print_rules("Noisiest rules", rules, top, &data);
+    }
+
+    g_ptr_array_unref(rules);
+    word_profile_data_clear(&data);
+    g_ptr_array_unref(paths);
+    g_free(default_path);
+
+    return status;
+}
@@ -0,0 +1,534 @@
+// Пакетная проверка почтовых архивов по тому же словарю, что и плагин
+//
+//   attachment-checker-scan [ПАРАМЕТРЫ] ПУТЬ...
+//
+// ПУТЬ - файл mbox, отдельное письмо (.eml) или каталог (Maildir или
+// любое дерево с письмами). Письма проверяются на всех ядрах: у каждого
+// потока своя очередь, опустевший поток забирает работу у соседей.
+// Совпадения выводятся построчно (TSV или JSON Lines), итог с пропускной
+// способностью - в stderr. Код возврата: 0 - чисто, 1 - есть совпадения,
+// 2 - ошибка. С --profile стоимость каждого правила (word-profile.h)
+// дописывается в файл; смотреть - attachment-checker-profile.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <camel/camel.h>
+
+#include "attachment-scan.h"
+#include "dictionary-file.h"
+#include "message-scan.h"
+#include "word-dictionary.h"
+#include "word-profile.h"
+
+// Письмо для проверки: срез файла mbox или целый файл
+typedef struct {
+    gchar *path;
+    GMappedFile *mapped;    // у писем из mbox - общее отображение файла
+    gsize offset;
+    gsize length;
+} ScanItem;
+
+// Очередь потока: владелец берёт с конца, чужие потоки крадут с начала
+typedef struct {
+    GMutex lock;
+    GPtrArray *items;
+    guint head;
+} WorkQueue;
+
+typedef struct {
+    const WordMatcher *matcher;
+    gboolean json;
+    gboolean check_attachments;
+    guint64 max_attachment_bytes;
+
+    WorkQueue *queues;
+    guint n_workers;
+    guint next_queue;
+
+    GMutex output_lock;
+    gint messages;
+    gint matches;
+    gint errors;
+    gsize bytes;
+} Scanner;
+
+typedef struct {
+    Scanner *scanner;
+    guint index;
+} Worker;
+
+static void
+usage(const gchar *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [--case-sensitive] [--normalize] [--dictionary WORDS.conf|WORDS.bin] [--jobs N]\n"
+            "       [--json] [--no-attachments] [--max-attachment-size MB] [--profile FILE] PATH...\n",
+            argv0);
+}
+
+static void
+scan_item_free(gpointer data)
+{
+    ScanItem *item = data;
+
+    g_free(item->path);
+    if (item->mapped)
+        g_mapped_file_unref(item->mapped);
+    g_free(item);
+}
+
+static void
+scanner_push(Scanner *scanner, ScanItem *item)
+{
+    // Начальное распределение по кругу; дальше баланс держит кража
+    WorkQueue *queue = &scanner->queues[scanner->next_queue++ % scanner->n_workers];
+
+    g_ptr_array_add(queue->items, item);
+}
+
+static ScanItem*
+work_queue_pop(WorkQueue *queue)
+{
+    ScanItem *item = NULL;
+
+    g_mutex_lock(&queue->lock);
+    if (queue->items->len > queue->head)
+        item = g_ptr_array_steal_index(queue->items, queue->items->len - 1);
+    g_mutex_unlock(&queue->lock);
+
+    return item;
+}
+
+static ScanItem*
+work_queue_steal(WorkQueue *queue)
+{
+    ScanItem *item = NULL;
+
+    g_mutex_lock(&queue->lock);
+    if (queue->items->len > queue->head) {
+        item = g_ptr_array_index(queue->items, queue->head);
+        g_ptr_array_index(queue->items, queue->head) = NULL;
+        queue->head++;
+    }
+    g_mutex_unlock(&queue->lock);
+
+    return item;
+}
+
+// Вся работа раздаётся до старта потоков, поэтому пустые очереди
+// у всех означают конец
+static ScanItem*
+scanner_next(Scanner *scanner, guint self)
+{
+    ScanItem *item = work_queue_pop(&scanner->queues[self]);
+
+    for (guint i = 1; !item && i < scanner->n_workers; i++)
+        item = work_queue_steal(&scanner->queues[(self + i) % scanner->n_workers]);
+
+    return item;
+}
+
+// Разбиение mbox по строкам "From " в начале строки
+static void
+enqueue_mbox(Scanner *scanner, const gchar *path, GMappedFile *mapped)
+{
+    const gchar *data = g_mapped_file_get_contents(mapped);
+    gsize length = g_mapped_file_get_length(mapped);
+    gsize start = 0;
+
+    while (start < length) {
+        const gchar *body = memchr(data + start, '\n', length - start);
+        const gchar *next;
+        gsize end;
+        ScanItem *item;
+
+        if (!body)
+            break;
+        body++;
+
+        next = g_strstr_len(body, length - (body - data), "\nFrom ");
+        end = next ? (gsize)(next - data) + 1 : length;
+
+        item = g_new0(ScanItem, 1);
+        item->path = g_strdup(path);
+        item->mapped = g_mapped_file_ref(mapped);
+        item->offset = body - data;
+        item->length = end - item->offset;
+        scanner_push(scanner, item);
+
+        start = end;
+    }
+}
+
+static void
+enqueue_file(Scanner *scanner, const gchar *path)
+{
+    GError *error = NULL;
+    GMappedFile *mapped = g_mapped_file_new(path, FALSE, &error);
+    ScanItem *item;
+
+    if (!mapped) {
+        fprintf(stderr, "%s: %s\n", path, error->message);
+        g_error_free(error);
+        scanner->errors++;
+        return;
+    }
+
+    if (g_mapped_file_get_length(mapped) >= 5 &&
+        memcmp(g_mapped_file_get_contents(mapped), "From ", 5) == 0) {
+        enqueue_mbox(scanner, path, mapped);
+        g_mapped_file_unref(mapped);
+        return;
+    }
+
+    // Отдельные письма отображаются в память уже в рабочем потоке,
+    // чтобы большой Maildir не упёрся в лимит отображений
+    g_mapped_file_unref(mapped);
+
+    item = g_new0(ScanItem, 1);
+    item->path = g_strdup(path);
+    scanner_push(scanner, item);
+}
+
+static void
+enqueue_path(Scanner *scanner, const gchar *path)
+{
+    GDir *dir;
+    const gchar *name;
+    gboolean maildir;
+
+    if (!g_file_test(path, G_FILE_TEST_IS_DIR)) {
+        enqueue_file(scanner, path);
+        return;
+    }
+
+    dir = g_dir_open(path, 0, NULL);
+    if (!dir) {
+        fprintf(stderr, "%s: cannot open directory\n", path);
+        scanner->errors++;
+        return;
+    }
+
+    // В Maildir tmp содержит недоставленные письма
+    {
+        gchar *cur = g_build_filename(path, "cur", NULL);
+        maildir = g_file_test(cur, G_FILE_TEST_IS_DIR);
+        g_free(cur);
+    }
+
+    while ((name = g_dir_read_name(dir))) {
+        gchar *child;
+
+        if (name[0] == '.' || (maildir && strcmp(name, "tmp") == 0))
+            continue;
+
+        child = g_build_filename(path, name, NULL);
+        enqueue_path(scanner, child);
+        g_free(child);
+    }
+
+    g_dir_close(dir);
+}
+
+static void
+json_append_string(GString *out, const gchar *value)
+{
+    g_string_append_c(out, '"');
+    for (const gchar *p = value ? value : ""; *p; p++) {
+        guchar c = (guchar)*p;
+
+        if (c == '"' || c == '\\')
+            g_string_append_printf(out, "\\%c", c);
+        else if (c < 0x20)
+            g_string_append_printf(out, "\\u%04x", c);
+        else
+            g_string_append_c(out, c);
+    }
+    g_string_append_c(out, '"');
+}
+
+static void
+report_match(Scanner *scanner, ScanItem *item, CamelMimeMessage *message,
+             const gchar *where, const gchar *attachment, guint word_index)
+{
+    const gchar *word = word_matcher_get_word(scanner->matcher, word_index);
+    const gchar *message_id = camel_mime_message_get_message_id(message);
+    GString *out = g_string_new(NULL);
+
+    if (scanner->json) {
+        g_string_append(out, "{\"path\":");
+        json_append_string(out, item->path);
+        g_string_append_printf(out, ",\"offset\":%" G_GSIZE_FORMAT ",\"message_id\":", item->offset);
+        json_append_string(out, message_id);
+        g_string_append(out, ",\"where\":");
+        json_append_string(out, where);
+        g_string_append(out, ",\"attachment\":");
+        json_append_string(out, attachment);
+        g_string_append(out, ",\"word\":");
+        json_append_string(out, word);
+        g_string_append(out, "}\n");
+    } else {
+        g_string_append_printf(out, "%s\t%" G_GSIZE_FORMAT "\t%s\t%s\t%s\t%s\n",
+                               item->path, item->offset, message_id ? message_id : "",
+                               where, attachment ? attachment : "", word);
+    }
+
+    g_mutex_lock(&scanner->output_lock);
+    fputs(out->str, stdout);
+    g_mutex_unlock(&scanner->output_lock);
+
+    g_string_free(out, TRUE);
+    g_atomic_int_inc(&scanner->matches);
+}
+
+static void
+scan_message(Scanner *scanner, ScanItem *item, const gchar *data, gsize length)
+{
+    GInputStream *input = g_memory_input_stream_new_from_data(data, length, NULL);
+    CamelMimeMessage *message = camel_mime_message_new();
+    GError *error = NULL;
+    guint word_index;
+
+    if (!camel_data_wrapper_construct_from_input_stream_sync(CAMEL_DATA_WRAPPER(message),
+                                                             input, NULL, &error)) {
+        fprintf(stderr, "%s@%" G_GSIZE_FORMAT ": %s\n", item->path, item->offset,
+                error ? error->message : "cannot parse message");
+        g_clear_error(&error);
+        g_atomic_int_inc(&scanner->errors);
+        g_object_unref(message);
+        g_object_unref(input);
+        return;
+    }
+
+    if (message_scan_text(CAMEL_MIME_PART(message), scanner->matcher, 0, NULL,
+                          &word_index, NULL))
+        report_match(scanner, item, message, "body", NULL, word_index);
+
+    if (scanner->check_attachments) {
+        GPtrArray *sources = g_ptr_array_new_with_free_func((GDestroyNotify)attachment_source_free);
+
+        message_scan_collect_attachments(CAMEL_MIME_PART(message), sources);
+
+        for (guint i = 0; i < sources->len; i++) {
+            AttachmentSource *source = g_ptr_array_index(sources, i);
+
+            if (source->name && word_matcher_search(scanner->matcher, source->name, -1, &word_index))
+                report_match(scanner, item, message, "attachment-name", source->name, word_index);
+            else if (attachment_scan_archive_names(source, scanner->matcher, NULL, NULL, 0,
+                                                   &word_index))
+                report_match(scanner, item, message, "attachment-name", source->name, word_index);
+
+            if (attachment_scan_source(source, scanner->matcher, scanner->max_attachment_bytes,
+                                       NULL, &word_index, NULL))
+                report_match(scanner, item, message, "attachment", source->name, word_index);
+        }
+
+        g_ptr_array_unref(sources);
+    }
+
+    g_atomic_int_inc(&scanner->messages);
+    g_atomic_pointer_add(&scanner->bytes, length);
+
+    g_object_unref(message);
+    g_object_unref(input);
+}
+
+static gpointer
+worker_thread(gpointer data)
+{
+    Worker *worker = data;
+    Scanner *scanner = worker->scanner;
+    ScanItem *item;
+
+    while ((item = scanner_next(scanner, worker->index))) {
+        if (item->mapped) {
+            scan_message(scanner, item,
+                         g_mapped_file_get_contents(item->mapped) + item->offset, item->length);
+        } else {
+            GError *error = NULL;
+            GMappedFile *mapped = g_mapped_file_new(item->path, FALSE, &error);
+
+            if (mapped) {
+                scan_message(scanner, item, g_mapped_file_get_contents(mapped),
+                             g_mapped_file_get_length(mapped));
+                g_mapped_file_unref(mapped);
+            } else {
+                fprintf(stderr, "%s: %s\n", item->path, error->message);
+                g_error_free(error);
+                g_atomic_int_inc(&scanner->errors);
+            }
+        }
+
+        scan_item_free(item);
+    }
+
+    return NULL;
+}
+
+// Словарь из указанного файла или тот же, что у плагина
+static WordMatcher*
+load_matcher(const gchar *path, WordMatcherFlags flags, WordDictionary **dictionary)
+{
+    GError *error = NULL;
+    WordMatcher *matcher;
+    gchar **words;
+
+    *dictionary = NULL;
+
+    if (!path) {
+        *dictionary = word_dictionary_load();
+        return word_dictionary_get_matcher(*dictionary, flags);
+    }
+
+    if (g_str_has_suffix(path, DICTIONARY_FILE_SUFFIX)) {
+        matcher = dictionary_file_map(path, NULL, &error);
+        if (!matcher) {
+            fprintf(stderr, "%s\n", error->message);
+            g_error_free(error);
+        }
+        return matcher;
+    }
+
+    words = dictionary_file_load_words(path);
+    if (!words) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        return NULL;
+    }
+
+    matcher = word_matcher_new_full(words, flags);
+    g_strfreev(words);
+    return matcher;
+}
+
+int
+main(int argc, char **argv)
+{
+    Scanner scanner = { 0 };
+    WordMatcherFlags flags = 0;
+    const gchar *dictionary_path = NULL;
+    const gchar *profile_path = NULL;
+    WordDictionary *dictionary = NULL;
+    WordMatcher *matcher;
+    GPtrArray *paths = g_ptr_array_new();
+    GThread **threads;
+    Worker *workers;
+    gint64 started;
+    gdouble seconds, megabytes;
+    int i;
+
+    scanner.check_attachments = TRUE;
+    scanner.max_attachment_bytes = ATTACHMENT_SCAN_DEFAULT_MAX_BYTES;
+    scanner.n_workers = g_get_num_processors();
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--case-sensitive") == 0) {
+            flags |= WORD_MATCHER_CASE_SENSITIVE;
+        } else if (strcmp(argv[i], "--normalize") == 0) {
+            flags |= WORD_MATCHER_NORMALIZE;
+        } else if (strcmp(argv[i], "--dictionary") == 0 && i + 1 < argc) {
+            dictionary_path = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            scanner.n_workers = MAX(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--json") == 0) {
+            scanner.json = TRUE;
+        } else if (strcmp(argv[i], "--no-attachments") == 0) {
+            scanner.check_attachments = FALSE;
+        } else if (strcmp(argv[i], "--max-attachment-size") == 0 && i + 1 < argc) {
+            scanner.max_attachment_bytes = (guint64)g_ascii_strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_path = argv[++i];
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else {
+            g_ptr_array_add(paths, argv[i]);
+        }
+    }
+
+    if (paths->len == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    camel_init(NULL, FALSE);
+
+    matcher = load_matcher(dictionary_path, flags, &dictionary);
+    if (!matcher)
+        return 2;
+    scanner.matcher = matcher;
+    if (profile_path)
+        word_profile_enable(matcher);
+
+    g_mutex_init(&scanner.output_lock);
+    scanner.queues = g_new0(WorkQueue, scanner.n_workers);
+    for (guint w = 0; w < scanner.n_workers; w++) {
+        g_mutex_init(&scanner.queues[w].lock);
+        scanner.queues[w].items = g_ptr_array_new_with_free_func(scan_item_free);
+    }
+
+    started = g_get_monotonic_time();
+
+    for (guint p = 0; p < paths->len; p++)
+        enqueue_path(&scanner, g_ptr_array_index(paths, p));
+
+    threads = g_new0(GThread *, scanner.n_workers);
+    workers = g_new0(Worker, scanner.n_workers);
+    for (guint w = 0; w < scanner.n_workers; w++) {
+        workers[w].scanner = &scanner;
+        workers[w].index = w;
+        threads[w] = g_thread_new("scan-worker", worker_thread, &workers[w]);
+    }
+    for (guint w = 0; w < scanner.n_workers; w++)
+        g_thread_join(threads[w]);
+
+    seconds = (g_get_monotonic_time() - started) / (gdouble)G_USEC_PER_SEC;
+
+    if (profile_path) {
+        GError *error = NULL;
+
+        if (!word_profile_save(matcher, profile_path, &error)) {
+            fprintf(stderr, "%s\n", error->message);
+            g_error_free(error);
+            scanner.errors++;
+        }
+    }
+    megabytes = scanner.bytes / (1024.0 * 1024.0);
+
+    if (scanner.json) {
+        fprintf(stderr, "{\"messages\":%d,\"bytes\":%" G_GSIZE_FORMAT ",\"seconds\":%.3f,"
+                "\"mb_per_second\":%.1f,\"messages_per_second\":%.0f,\"matches\":%d,"
+                "\"errors\":%d,\"jobs\":%u}\n",
+                scanner.messages, scanner.bytes, seconds, megabytes / MAX(seconds, 1e-9),
+                scanner.messages / MAX(seconds, 1e-9), scanner.matches, scanner.errors,
+                scanner.n_workers);
+    } else {
+        fprintf(stderr, "%d messages, %.1f MB in %.2f s: %.1f MB/s, %.0f messages/s, "
+                "%d matches, %d errors, %u jobs\n",
+                scanner.messages, megabytes, seconds, megabytes / MAX(seconds, 1e-9),
+                scanner.messages / MAX(seconds, 1e-9), scanner.matches, scanner.errors,
+                scanner.n_workers);
+    }
+
+    for (guint w = 0; w < scanner.n_workers; w++) {
+        g_ptr_array_unref(scanner.queues[w].items);
+        g_mutex_clear(&scanner.queues[w].lock);
+    }
+    g_free(scanner.queues);
+    g_free(threads);
+    g_free(workers);
+    g_ptr_array_unref(paths);
+
+    if (dictionary)
+        word_dictionary_unref(dictionary);
+    else
+        word_matcher_free(matcher);
+
+    if (scanner.errors)
+        return 2;
+    return scanner.matches ? 1 : 0;
+}
@@ -0,0 +1,949 @@
+// Проверки ядра (make check)
+//
+//   attachment-checker-test [опции g_test]
+//
+// Потоковый поиск должен давать то же, что поиск по всему тексту, как бы
+// текст ни был разрезан на блоки: каждый случай прогоняется целиком и со
+// всеми разрезами в одном месте, а также побайтно. То же для извлечения
+// текста из разметки. Читатели ZIP и tar проверяются на архивах, собранных
+// в памяти: имена и содержимое записей, ограничения и обрезанные данные.
+
+#include <string.h>
+#include <glib/gstdio.h>
+#include <zlib.h>
+
+#include "attachment-scan.h"
+#include "markup-text.h"
+#include "tar-reader.h"
+#include "word-matcher.h"
+#include "zip-reader.h"
+
+typedef struct {
+    const gchar *rules;     // через '\n'
+    const gchar *text;
+    WordMatcherFlags flags;
+} MatcherCase;
+
+static const MatcherCase boundary_cases[] = {
+    // Префильтр доходит до конца блока на разрезанном символе "ё"
+    { "word:ак", "ёак", 0 },
+    { "word:ак", "ёак ак", 0 },
+    { "word:ак", "ёак ак", WORD_MATCHER_CASE_SENSITIVE },
+    { "word:ак", "ЁАК ак ёак", WORD_MATCHER_NORMALIZE },
+    { "word:кот", "скотина кот, котёнок; кот", 0 },
+    { "word:кот\nглоб\nglob:док*", "ъкот документ эдок кот", 0 },
+    { "word:key\nword:ключ", "monkey ключик key клю\xd1\x87", 0 },
+    { "word:ёж", "ёёж ёж жёж", 0 },
+};
+
+// Регулярное правило - одно совпадение на серию принимающих позиций
+static const struct {
+    MatcherCase test;
+    guint n_matches;
+} regex_cases[] = {
+    { { "re:inv-\\d+", "INV-12345", 0 }, 1 },
+    { { "re:\\d{4,8}", "12345678", 0 }, 1 },
+    { { "re:\\d{4,8}", "1234 и 5678", 0 }, 2 },
+    { { "re:\\d{4,8}", "1234й5678", 0 }, 2 },
+    { { "re:догов[оа]р\\w*", "договорами и договор", 0 }, 2 },
+    { { "re:inv-\\d+\nword:inv", "inv-1 inv-22 inv", 0 }, 5 },
+};
+
+// Извлечение текста из разметки: исходник и ожидаемый текст
+static const struct {
+    const gchar *markup;
+    const gchar *text;
+    gboolean html;
+} markup_cases[] = {
+    // '<' без буквы, '/', '!' или '?' за ним - текст, а не начало тега
+    { "x < 5 и y > 3", "x < 5 и y > 3", TRUE },
+    { "a<5 секрет", "a<5 секрет", TRUE },
+    { "1 <2 секрет", "1 <2 секрет", TRUE },
+    { "a <", "a <", TRUE },
+    { "<<b>секрет</b>>", "<секрет>", TRUE },
+    { "if a < b секрет", "if a < b секрет", FALSE },
+    // Сущности
+    { "&lt;b&gt; &amp; &#1089;&#x435;к", "<b> & сек", TRUE },
+    { "се&shy;крет &bogus; a&b", "секрет &bogus; a&b", TRUE },
+    // Скрытое содержимое и комментарии
+    { "до<script>if (a<b) x='секрет'</script>после", "допосле", TRUE },
+    { "<STYLE>p{color:red}</Style>текст", "текст", TRUE },
+    { "a<!-- секрет > -- -->b", "ab", TRUE },
+    { "<p>один</p><p title=\"a>b\">два</p>", "\nодин\n\nдва\n", TRUE },
+    { "<text:p>a &lt; b</text:p>", "\na < b\n", FALSE },
+};
+
+typedef struct {
+    guint word_index;
+    guint64 end;
+} TestMatch;
+
+static void
+collect_match(guint word_index, guint64 end, gpointer user_data)
+{
+    TestMatch match = { word_index, end };
+
+    g_array_append_val((GArray *)user_data, match);
+}
+
+static WordMatcher*
+case_matcher(const MatcherCase *test)
+{
+    gchar **words = g_strsplit(test->rules, "\n", -1);
+    WordMatcher *matcher = word_matcher_new_full(words, test->flags);
+
+    g_strfreev(words);
+    g_assert_nonnull(matcher);
+    return matcher;
+}
+
+// Совпадения при подаче текста блоками с границами cuts (по возрастанию)
+static GArray*
+scan_blocks(const WordMatcher *matcher, const gchar *text, const gsize *cuts, guint n_cuts)
+{
+    GArray *matches = g_array_new(FALSE, FALSE, sizeof(TestMatch));
+    gsize len = strlen(text), from = 0;
+    WordMatcherScan scan;
+
+    word_matcher_scan_init(&scan);
+    word_matcher_scan_set_func(&scan, collect_match, matches);
+
+    for (guint i = 0; i <= n_cuts; i++) {
+        gsize to = (i < n_cuts) ? cuts[i] : len;
+
+        word_matcher_scan_feed(matcher, &scan, text + from, to - from, NULL);
+        from = to;
+    }
+    word_matcher_scan_finish(matcher, &scan, NULL);
+
+    return matches;
+}
+
+static void
+assert_same_matches(GArray *expected, GArray *actual, const MatcherCase *test,
+                    const gchar *split)
+{
+    if (expected->len != actual->len ||
+        memcmp(expected->data, actual->data, expected->len * sizeof(TestMatch)) != 0)
+        g_error("\"%s\" on \"%s\" (flags %d): %u matches whole, %u split %s",
+                test->rules, test->text, test->flags, expected->len, actual->len, split);
+}
+
+// Первое совпадение при подаче блоками
+static gboolean
+search_blocks(const WordMatcher *matcher, const gchar *text, gsize cut, guint *word_index)
+{
+    gsize len = strlen(text);
+    WordMatcherScan scan;
+
+    word_matcher_scan_init(&scan);
+    return word_matcher_scan_feed(matcher, &scan, text, cut, word_index) ||
+           word_matcher_scan_feed(matcher, &scan, text + cut, len - cut, word_index) ||
+           word_matcher_scan_finish(matcher, &scan, word_index);
+}
+
+static void
+test_split_feed(void)
+{
+    for (guint c = 0; c < G_N_ELEMENTS(boundary_cases); c++) {
+        const MatcherCase *test = &boundary_cases[c];
+        WordMatcher *matcher = case_matcher(test);
+        gsize len = strlen(test->text);
+        gsize *bytes = g_new(gsize, MAX(len, 1));
+        GArray *whole = scan_blocks(matcher, test->text, NULL, 0);
+        guint whole_index = 0;
+        gboolean whole_found = word_matcher_search(matcher, test->text, -1, &whole_index);
+
+        g_assert_cmpuint(whole->len, ==,
+                         word_matcher_search_all(matcher, test->text, -1, NULL, NULL));
+        g_assert_cmpint(whole_found, ==, whole->len > 0);
+
+        for (gsize cut = 1; cut < len; cut++) {
+            GArray *split = scan_blocks(matcher, test->text, &cut, 1);
+            gchar *where = g_strdup_printf("at byte %" G_GSIZE_FORMAT, cut);
+            guint split_index = 0;
+
+            assert_same_matches(whole, split, test, where);
+            g_assert_cmpint(search_blocks(matcher, test->text, cut, &split_index), ==,
+                            whole_found);
+            if (whole_found)
+                g_assert_cmpuint(split_index, ==, whole_index);
+
+            g_array_unref(split);
+            g_free(where);
+        }
+
+        for (gsize i = 0; i + 1 < len; i++)
+            bytes[i] = i + 1;
+        if (len > 1) {
+            GArray *split = scan_blocks(matcher, test->text, bytes, len - 1);
+
+            assert_same_matches(whole, split, test, "by byte");
+            g_array_unref(split);
+        }
+
+        g_array_unref(whole);
+        g_free(bytes);
+        word_matcher_free(matcher);
+    }
+}
+
+static void
+test_regex_runs(void)
+{
+    for (guint c = 0; c < G_N_ELEMENTS(regex_cases); c++) {
+        const MatcherCase *test = &regex_cases[c].test;
+        WordMatcher *matcher = case_matcher(test);
+        gsize len = strlen(test->text);
+        guint n_matches = word_matcher_search_all(matcher, test->text, -1, NULL, NULL);
+
+        if (n_matches != regex_cases[c].n_matches)
+            g_error("\"%s\" on \"%s\": %u matches, expected %u", test->rules, test->text,
+                    n_matches, regex_cases[c].n_matches);
+
+        for (gsize cut = 1; cut < len; cut++) {
+            GArray *split = scan_blocks(matcher, test->text, &cut, 1);
+
+            g_assert_cmpuint(split->len, ==, n_matches);
+            g_array_unref(split);
+        }
+
+        word_matcher_free(matcher);
+    }
+}
+
+static gboolean
+collect_text(const gchar *data, gsize len, gpointer user_data)
+{
+    g_string_append_len(user_data, data, len);
+    return TRUE;
+}
+
+// Текст разметки, поданной двумя блоками (cut = 0 - одним)
+static gchar*
+markup_blocks(const gchar *data, gboolean html, gsize cut)
+{
+    GString *text = g_string_new(NULL);
+    MarkupText markup;
+
+    if (html)
+        markup_text_init_html(&markup, collect_text, text);
+    else
+        markup_text_init(&markup, collect_text, text);
+
+    markup_text_feed(&markup, data, cut);
+    markup_text_feed(&markup, data + cut, strlen(data) - cut);
+    markup_text_finish(&markup);
+
+    return g_string_free(text, FALSE);
+}
+
+static void
+test_markup_text(void)
+{
+    for (guint c = 0; c < G_N_ELEMENTS(markup_cases); c++) {
+        gsize len = strlen(markup_cases[c].markup);
+
+        for (gsize cut = 0; cut < len; cut++) {
+            gchar *text = markup_blocks(markup_cases[c].markup, markup_cases[c].html, cut);
+
+            if (strcmp(text, markup_cases[c].text) != 0)
+                g_error("\"%s\" split at %" G_GSIZE_FORMAT ": \"%s\", expected \"%s\"",
+                        markup_cases[c].markup, cut, text, markup_cases[c].text);
+            g_free(text);
+        }
+    }
+}
+
+static void
+test_split_utf8_word_boundary(void)
+{
+    const MatcherCase test = { "word:ак", "ёак", 0 };
+    WordMatcher *matcher = case_matcher(&test);
+    gsize cut = 1;
+    GArray *split = scan_blocks(matcher, test.text, &cut, 1);
+
+    // "ак" внутри слова "ёак": совпадения нет ни целиком, ни по частям
+    g_assert_cmpuint(word_matcher_search_all(matcher, test.text, -1, NULL, NULL), ==, 0);
+    g_assert_cmpuint(split->len, ==, 0);
+
+    g_array_unref(split);
+    word_matcher_free(matcher);
+}
+
+// Архивы для проверок собираются в памяти
+
+static void
+put_u16(GByteArray *data, guint value)
+{
+    guint8 bytes[2] = { value & 0xff, (value >> 8) & 0xff };
+
+    g_byte_array_append(data, bytes, sizeof(bytes));
+}
+
+static void
+put_u32(GByteArray *data, guint32 value)
+{
+    put_u16(data, value & 0xffff);
+    put_u16(data, value >> 16);
+}
+
+static void
+put_u64(GByteArray *data, guint64 value)
+{
+    put_u32(data, (guint32)value);
+    put_u32(data, (guint32)(value >> 32));
+}
+
+// Сжатие zlib: window_bits -MAX_WBITS - raw deflate, 16 + MAX_WBITS - gzip.
+// С Z_FULL_FLUSH поток не завершается и кончается на границе байта.
+static GBytes*
+test_deflate(const gchar *data, gsize len, gint window_bits, gint flush)
+{
+    GByteArray *out = g_byte_array_new();
+    z_stream zs = { 0 };
+    guint8 buffer[4096];
+    gint ret;
+
+    g_assert_cmpint(deflateInit2(&zs, 9, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY),
+                    ==, Z_OK);
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = len;
+    do {
+        zs.next_out = buffer;
+        zs.avail_out = sizeof(buffer);
+        ret = deflate(&zs, flush);
+        g_assert_cmpint(ret, !=, Z_STREAM_ERROR);
+        g_byte_array_append(out, buffer, sizeof(buffer) - zs.avail_out);
+    } while (flush == Z_FINISH ? ret != Z_STREAM_END : zs.avail_out == 0);
+    deflateEnd(&zs);
+
+    return g_byte_array_free_to_bytes(out);
+}
+
+typedef struct {
+    const gchar *name;
+    const gchar *data;
+    gsize len;
+    gboolean deflate;
+    gboolean descriptor;    // размеры после данных (бит 3 флагов)
+    gboolean zip64;         // размеры и смещение в дополнительном поле ZIP64
+    GBytes *packed;         // готовый поток deflate вместо сжатия data
+    guint64 declared_size;  // размер в оглавлении, 0 - настоящий
+} ZipFixture;
+
+static GBytes*
+zip_fixture(const ZipFixture *entries, guint n_entries)
+{
+    GByteArray *zip = g_byte_array_new();
+    GByteArray *dir = g_byte_array_new();
+    guint32 dir_offset;
+
+    for (guint i = 0; i < n_entries; i++) {
+        const ZipFixture *entry = &entries[i];
+        GBytes *packed = entry->packed ? g_bytes_ref(entry->packed) :
+                         entry->deflate ? test_deflate(entry->data, entry->len, -MAX_WBITS,
+                                                       Z_FINISH) :
+                         g_bytes_new_static(entry->data, entry->len);
+        guint32 packed_len = g_bytes_get_size(packed);
+        guint64 size = entry->declared_size ? entry->declared_size : entry->len;
+        guint32 crc = crc32(0, (const Bytef *)entry->data, entry->len);
+        guint32 offset = zip->len;
+        guint flags = entry->descriptor ? 1 << 3 : 0;
+        guint method = (entry->deflate || entry->packed) ? 8 : 0;
+        guint name_len = strlen(entry->name);
+
+        put_u32(zip, 0x04034b50);
+        put_u16(zip, 20);
+        put_u16(zip, flags);
+        put_u16(zip, method);
+        put_u32(zip, 0);
+        put_u32(zip, entry->descriptor ? 0 : crc);
+        put_u32(zip, entry->descriptor ? 0 : packed_len);
+        put_u32(zip, entry->descriptor ? 0 : (guint32)size);
+        put_u16(zip, name_len);
+        put_u16(zip, 0);
+        g_byte_array_append(zip, (const guint8 *)entry->name, name_len);
+        g_byte_array_append(zip, g_bytes_get_data(packed, NULL), packed_len);
+        if (entry->descriptor) {
+            put_u32(zip, 0x08074b50);
+            put_u32(zip, crc);
+            put_u32(zip, packed_len);
+            put_u32(zip, (guint32)size);
+        }
+
+        put_u32(dir, 0x02014b50);
+        put_u16(dir, 20);
+        put_u16(dir, 20);
+        put_u16(dir, flags);
+        put_u16(dir, method);
+        put_u32(dir, 0);
+        put_u32(dir, crc);
+        put_u32(dir, entry->zip64 ? 0xffffffffu : packed_len);
+        put_u32(dir, entry->zip64 ? 0xffffffffu : (guint32)size);
+        put_u16(dir, name_len);
+        put_u16(dir, entry->zip64 ? 4 + 24 : 0);
+        put_u16(dir, 0);
+        put_u16(dir, 0);
+        put_u16(dir, 0);
+        put_u32(dir, 0);
+        put_u32(dir, entry->zip64 ? 0xffffffffu : offset);
+        g_byte_array_append(dir, (const guint8 *)entry->name, name_len);
+        if (entry->zip64) {
+            put_u16(dir, 0x0001);
+            put_u16(dir, 24);
+            put_u64(dir, size);
+            put_u64(dir, packed_len);
+            put_u64(dir, offset);
+        }
+
+        g_bytes_unref(packed);
+    }
+
+    dir_offset = zip->len;
+    g_byte_array_append(zip, dir->data, dir->len);
+    put_u32(zip, 0x06054b50);
+    put_u16(zip, 0);
+    put_u16(zip, 0);
+    put_u16(zip, n_entries);
+    put_u16(zip, n_entries);
+    put_u32(zip, dir->len);
+    put_u32(zip, dir_offset);
+    put_u16(zip, 0);
+
+    g_byte_array_unref(dir);
+    return g_byte_array_free_to_bytes(zip);
+}
+
+// Запись tar с заголовком ustar; prefix может быть NULL
+static void
+tar_put_entry(GByteArray *tar, const gchar *name, const gchar *prefix, gchar type,
+              const gchar *data, gsize len)
+{
+    guint8 header[512] = { 0 };
+    guint8 padding[512] = { 0 };
+    guint sum = 0;
+
+    memcpy(header, name, MIN(strlen(name), 100));
+    memcpy(header + 100, "0000644", 8);
+    memcpy(header + 108, "0000000", 8);
+    memcpy(header + 116, "0000000", 8);
+    g_snprintf((gchar *)header + 124, 12, "%011" G_GSIZE_MODIFIER "o", len);
+    memcpy(header + 136, "00000000000", 12);
+    header[156] = type;
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+    if (prefix)
+        memcpy(header + 345, prefix, MIN(strlen(prefix), 155));
+
+    memset(header + 148, ' ', 8);
+    for (guint i = 0; i < sizeof(header); i++)
+        sum += header[i];
+    g_snprintf((gchar *)header + 148, 7, "%06o", sum);
+
+    g_byte_array_append(tar, header, sizeof(header));
+    g_byte_array_append(tar, (const guint8 *)data, len);
+    g_byte_array_append(tar, padding, (512 - len % 512) % 512);
+}
+
+// Длинное имя записью GNU 'L' перед заголовком
+static void
+tar_put_gnu_long_name(GByteArray *tar, const gchar *name)
+{
+    tar_put_entry(tar, "././@LongLink", NULL, 'L', name, strlen(name) + 1);
+}
+
+// Длинное имя записью pax 'x' с полем path: длина записи включает саму себя
+static void
+tar_put_pax_path(GByteArray *tar, const gchar *name)
+{
+    gchar *body = g_strdup_printf(" path=%s\n", name);
+    gsize len = strlen(body) + 1;
+    gchar *record;
+
+    while (strlen(body) + (gsize)snprintf(NULL, 0, "%" G_GSIZE_FORMAT, len) != len)
+        len++;
+    record = g_strdup_printf("%" G_GSIZE_FORMAT "%s", len, body);
+
+    tar_put_entry(tar, "PaxHeaders/entry", NULL, 'x', record, len);
+
+    g_free(record);
+    g_free(body);
+}
+
+static void
+tar_put_end(GByteArray *tar)
+{
+    guint8 zeros[1024] = { 0 };
+
+    g_byte_array_append(tar, zeros, sizeof(zeros));
+}
+
+// Записи ZIP как "имя=содержимое\n"; NULL и error - ошибка чтения
+static gchar*
+zip_contents(GBytes *bytes, GError **error)
+{
+    GInputStream *input = g_memory_input_stream_new_from_bytes(bytes);
+    ZipReader *zip = zip_reader_new(input, NULL, error);
+    GString *out = g_string_new(NULL);
+    gboolean ok = (zip != NULL);
+
+    for (guint i = 0; ok && i < zip_reader_get_n_entries(zip); i++) {
+        g_string_append_printf(out, "%s=", zip_reader_get_name(zip, i));
+        ok = zip_reader_extract(zip, i, 0, collect_text, out, NULL, error);
+        g_string_append_c(out, '\n');
+    }
+
+    if (zip)
+        zip_reader_free(zip);
+    g_object_unref(input);
+    return g_string_free(out, !ok);
+}
+
+// То же для tar с ограничениями читателя
+static gchar*
+tar_contents(GBytes *bytes, gboolean gzip, guint64 max_total, guint max_ratio, GError **error)
+{
+    GInputStream *input = g_memory_input_stream_new_from_bytes(bytes);
+    TarReader *tar = tar_reader_new(input, gzip);
+    GString *out = g_string_new(NULL);
+    GError *local_error = NULL;
+
+    tar_reader_set_limits(tar, max_total, max_ratio);
+    while (tar_reader_next(tar, NULL, &local_error)) {
+        g_string_append_printf(out, "%s=", tar_reader_get_name(tar));
+        if (!tar_reader_extract(tar, 0, collect_text, out, NULL, &local_error))
+            break;
+        g_string_append_c(out, '\n');
+    }
+
+    tar_reader_free(tar);
+    g_object_unref(input);
+    if (local_error) {
+        g_propagate_error(error, local_error);
+        g_string_free(out, TRUE);
+        return NULL;
+    }
+    return g_string_free(out, FALSE);
+}
+
+static void
+assert_contents(gchar *contents, GError *error, const gchar *expected)
+{
+    g_assert_no_error(error);
+    g_assert_cmpstr(contents, ==, expected);
+    g_free(contents);
+}
+
+static void
+assert_read_error(gchar *contents, GError *error, gint code)
+{
+    g_assert_null(contents);
+    g_assert_error(error, G_IO_ERROR, code);
+    g_error_free(error);
+}
+
+static void
+test_zip_entries(void)
+{
+    gchar *text = g_strnfill(5000, 'z');
+    const ZipFixture entries[] = {
+        { .name = "a.txt", .data = "stored", .len = 6 },
+        { .name = "dir/b.txt", .data = text, .len = 5000, .deflate = TRUE },
+        { .name = "c.txt", .data = "descriptor", .len = 10, .deflate = TRUE,
+          .descriptor = TRUE },
+        { .name = "d.txt", .data = "stored descriptor", .len = 17, .descriptor = TRUE },
+        { .name = "e.txt", .data = "zip64", .len = 5, .zip64 = TRUE },
+        { .name = "f.txt", .data = "zip64 deflate", .len = 13, .deflate = TRUE,
+          .zip64 = TRUE },
+    };
+    GBytes *bytes = zip_fixture(entries, G_N_ELEMENTS(entries));
+    GInputStream *input = g_memory_input_stream_new_from_bytes(bytes);
+    ZipReader *zip = zip_reader_new(input, NULL, NULL);
+    gchar *expected = g_strdup_printf("a.txt=stored\ndir/b.txt=%s\nc.txt=descriptor\n"
+                                      "d.txt=stored descriptor\ne.txt=zip64\n"
+                                      "f.txt=zip64 deflate\n", text);
+    GError *error = NULL;
+    gchar *contents = zip_contents(bytes, &error);
+
+    g_assert_nonnull(zip);
+    g_assert_cmpuint(zip_reader_get_n_entries(zip), ==, G_N_ELEMENTS(entries));
+    for (guint i = 0; i < G_N_ELEMENTS(entries); i++) {
+        g_assert_cmpstr(zip_reader_get_name(zip, i), ==, entries[i].name);
+        g_assert_cmpuint(zip_reader_get_size(zip, i), ==, entries[i].len);
+    }
+    assert_contents(contents, error, expected);
+
+    zip_reader_free(zip);
+    g_object_unref(input);
+    g_bytes_unref(bytes);
+    g_free(expected);
+    g_free(text);
+}
+
+// Поток deflate, на котором первый блок входа (64 КБ) кончается внутри
+// несжатого блока ровно тогда, когда заполнен буфер выхода: блок из zeros
+// нулей, затем несжатый блок. Тогда zeros = 64 КБ + длина первого блока
+// + 5 байт заголовка несжатого блока.
+static GBytes*
+inflate_boundary_stream(GString *plain)
+{
+    const gsize chunk = 64 * 1024;
+    const gsize stored = 65535;
+    GByteArray *packed = g_byte_array_new();
+    GBytes *head = NULL;
+    gsize zeros = chunk + 5;
+    gchar *data;
+    const guint8 end[] = { 0x01, 0x00, 0x00, 0xff, 0xff };
+    const guint8 header[] = { 0x00, stored & 0xff, stored >> 8, ~stored & 0xff,
+                              (~stored >> 8) & 0xff };
+
+    for (guint i = 0; i < 16; i++) {
+        gsize head_len;
+
+        g_clear_pointer(&head, g_bytes_unref);
+        data = g_malloc0(zeros);
+        head = test_deflate(data, zeros, -MAX_WBITS, Z_FULL_FLUSH);
+        g_free(data);
+
+        head_len = g_bytes_get_size(head);
+        if (zeros == chunk + head_len + 5)
+            break;
+        zeros = chunk + head_len + 5;
+    }
+    g_assert_cmpuint(zeros, ==, chunk + g_bytes_get_size(head) + 5);
+
+    g_string_set_size(plain, 0);
+    for (gsize i = 0; i < zeros; i++)
+        g_string_append_c(plain, '\0');
+    for (gsize i = 0; i < stored; i++)
+        g_string_append_c(plain, 'a' + i % 26);
+
+    g_byte_array_append(packed, g_bytes_get_data(head, NULL), g_bytes_get_size(head));
+    g_byte_array_append(packed, header, sizeof(header));
+    g_byte_array_append(packed, (const guint8 *)plain->str + zeros, stored);
+    g_byte_array_append(packed, end, sizeof(end));
+
+    g_bytes_unref(head);
+    return g_byte_array_free_to_bytes(packed);
+}
+
+static void
+test_zip_inflate_boundary(void)
+{
+    GString *plain = g_string_new(NULL);
+    GBytes *packed = inflate_boundary_stream(plain);
+    ZipFixture entry = { .name = "boundary.bin", .packed = packed };
+    GString *extracted = g_string_new(NULL);
+    GBytes *bytes;
+    GInputStream *input;
+    ZipReader *zip;
+    GError *error = NULL;
+
+    entry.data = plain->str;
+    entry.len = plain->len;
+    bytes = zip_fixture(&entry, 1);
+    input = g_memory_input_stream_new_from_bytes(bytes);
+    zip = zip_reader_new(input, NULL, &error);
+    g_assert_no_error(error);
+
+    g_assert_true(zip_reader_extract(zip, 0, 0, collect_text, extracted, NULL, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(extracted->len, ==, plain->len);
+    g_assert_true(memcmp(extracted->str, plain->str, plain->len) == 0);
+
+    zip_reader_free(zip);
+    g_object_unref(input);
+    g_bytes_unref(bytes);
+    g_bytes_unref(packed);
+    g_string_free(extracted, TRUE);
+    g_string_free(plain, TRUE);
+}
+
+static void
+test_zip_truncated(void)
+{
+    const gchar *text = "truncated deflate data, truncated deflate data";
+    GBytes *packed = test_deflate(text, strlen(text), -MAX_WBITS, Z_FINISH);
+    GBytes *cut = g_bytes_new_from_bytes(packed, 0, g_bytes_get_size(packed) / 2);
+    static const guint8 broken[] = { 0xff, 0xff, 0xff, 0xff };
+    GBytes *garbage = g_bytes_new_static(broken, sizeof(broken));
+    ZipFixture entry = { .name = "cut.txt", .data = text, .len = strlen(text), .packed = cut };
+    GBytes *bytes = zip_fixture(&entry, 1);
+    GBytes *head;
+    GError *error = NULL;
+
+    // Поток deflate кончается раньше конца записи
+    assert_read_error(zip_contents(bytes, &error), error, G_IO_ERROR_INVALID_DATA);
+    error = NULL;
+    g_bytes_unref(bytes);
+
+    entry.packed = garbage;
+    bytes = zip_fixture(&entry, 1);
+    assert_read_error(zip_contents(bytes, &error), error, G_IO_ERROR_INVALID_DATA);
+    error = NULL;
+
+    // Архив без конца - нет оглавления
+    head = g_bytes_new_from_bytes(bytes, 0, g_bytes_get_size(bytes) - 10);
+    assert_read_error(zip_contents(head, &error), error, G_IO_ERROR_INVALID_DATA);
+
+    g_bytes_unref(head);
+    g_bytes_unref(bytes);
+    g_bytes_unref(garbage);
+    g_bytes_unref(cut);
+    g_bytes_unref(packed);
+}
+
+// Архив записывается во временный каталог под новым именем: у разных
+// архивов не совпадают ключи кэша проверки
+static gchar*
+write_archive(const gchar *dir, GBytes *bytes)
+{
+    static guint n_archives;
+    gchar *name = g_strdup_printf("archive-%u.zip", n_archives++);
+    gchar *path = g_build_filename(dir, name, NULL);
+
+    g_assert_true(g_file_set_contents(path, g_bytes_get_data(bytes, NULL),
+                                      g_bytes_get_size(bytes), NULL));
+    g_free(name);
+    return path;
+}
+
+static gboolean
+scan_archive(const gchar *path, const WordMatcher *matcher, GError **error)
+{
+    GFile *file = g_file_new_for_path(path);
+    AttachmentSource *source = attachment_source_new_for_file(file, NULL, NULL);
+    guint word_index = 0;
+    gboolean found;
+
+    g_assert_cmpint(source->kind, ==, ATTACHMENT_KIND_ARCHIVE);
+    found = attachment_scan_source(source, matcher, ATTACHMENT_SCAN_DEFAULT_MAX_BYTES, NULL,
+                                   &word_index, error);
+
+    attachment_source_free(source);
+    g_object_unref(file);
+    return found;
+}
+
+static void
+test_archive_scan_limits(void)
+{
+    const MatcherCase test = { "word:секрет", NULL, 0 };
+    WordMatcher *matcher = case_matcher(&test);
+    const guint n_entries = 10001;
+    ZipFixture *entries = g_new0(ZipFixture, n_entries);
+    gchar **names = g_new0(gchar *, n_entries + 1);
+    ZipFixture entry = { .name = "big.txt", .data = "секрет", .len = strlen("секрет") };
+    static const guint8 broken[] = { 0xff, 0xff, 0xff, 0xff };
+    gchar *dir = g_dir_make_tmp("attachment-checker-test-XXXXXX", NULL);
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    GBytes *bytes;
+    GError *error = NULL;
+
+    g_assert_nonnull(dir);
+
+    // Проверяются первые 10 000 записей
+    for (guint i = 0; i < n_entries; i++) {
+        names[i] = g_strdup_printf("f%05u.txt", i);
+        entries[i].name = names[i];
+        entries[i].data = "x";
+        entries[i].len = 1;
+    }
+    entries[n_entries - 1].data = "секрет";
+    entries[n_entries - 1].len = strlen("секрет");
+    bytes = zip_fixture(entries, n_entries);
+    g_ptr_array_add(paths, write_archive(dir, bytes));
+    g_assert_false(scan_archive(paths->pdata[paths->len - 1], matcher, &error));
+    g_assert_no_error(error);
+    g_bytes_unref(bytes);
+
+    entries[0] = entries[n_entries - 1];
+    entries[0].name = names[0];
+    bytes = zip_fixture(entries, n_entries);
+    g_ptr_array_add(paths, write_archive(dir, bytes));
+    g_assert_true(scan_archive(paths->pdata[paths->len - 1], matcher, &error));
+    g_assert_no_error(error);
+    g_bytes_unref(bytes);
+
+    // Заявленная степень сжатия выше 100:1 - запись пропускается с ошибкой
+    entry.declared_size = 200 * 1024 * 1024;
+    bytes = zip_fixture(&entry, 1);
+    g_ptr_array_add(paths, write_archive(dir, bytes));
+    g_assert_false(scan_archive(paths->pdata[paths->len - 1], matcher, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+    g_clear_error(&error);
+    g_bytes_unref(bytes);
+
+    // Ошибка записи не запоминается в кэше как чистый архив: повторная
+    // проверка того же файла снова читает его и снова даёт ошибку
+    entry.declared_size = 0;
+    entry.packed = g_bytes_new_static(broken, sizeof(broken));
+    bytes = zip_fixture(&entry, 1);
+    g_ptr_array_add(paths, write_archive(dir, bytes));
+    for (guint i = 0; i < 2; i++) {
+        g_assert_false(scan_archive(paths->pdata[paths->len - 1], matcher, &error));
+        g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+        g_clear_error(&error);
+    }
+    g_bytes_unref(bytes);
+    g_bytes_unref(entry.packed);
+
+    for (guint i = 0; i < paths->len; i++)
+        g_remove(paths->pdata[i]);
+    g_rmdir(dir);
+
+    g_ptr_array_unref(paths);
+    g_free(dir);
+    g_strfreev(names);
+    g_free(entries);
+    word_matcher_free(matcher);
+}
+
+// tar со всеми видами имён: обычное, ustar prefix, GNU 'L' и pax path
+static GBytes*
+tar_fixture(gchar **expected)
+{
+    GByteArray *tar = g_byte_array_new();
+    gchar *gnu_dir = g_strnfill(140, 'g');
+    gchar *pax_dir = g_strnfill(300, 'p');
+    gchar *gnu_name = g_strdup_printf("%s/gnu.txt", gnu_dir);
+    gchar *pax_name = g_strdup_printf("%s/pax.txt", pax_dir);
+
+    tar_put_entry(tar, "plain.txt", NULL, '0', "plain", 5);
+    tar_put_entry(tar, "dir/", NULL, '5', NULL, 0);
+    tar_put_entry(tar, "file.txt", "some/dir", '0', "prefix", 6);
+    tar_put_entry(tar, "link", NULL, '2', NULL, 0);
+    tar_put_gnu_long_name(tar, gnu_name);
+    tar_put_entry(tar, "truncated-gnu-name", NULL, '0', "gnu", 3);
+    tar_put_pax_path(tar, pax_name);
+    tar_put_entry(tar, "truncated-pax-name", NULL, '0', "pax", 3);
+    tar_put_entry(tar, "old.txt", NULL, '\0', "old", 3);
+    tar_put_end(tar);
+
+    *expected = g_strdup_printf("plain.txt=plain\nsome/dir/file.txt=prefix\n%s=gnu\n%s=pax\n"
+                                "old.txt=old\n", gnu_name, pax_name);
+    g_free(gnu_name);
+    g_free(pax_name);
+    g_free(gnu_dir);
+    g_free(pax_dir);
+    return g_byte_array_free_to_bytes(tar);
+}
+
+static void
+test_tar_entries(void)
+{
+    gchar *expected;
+    GBytes *tar = tar_fixture(&expected);
+    gsize len = g_bytes_get_size(tar);
+    const gchar *data = g_bytes_get_data(tar, NULL);
+    GBytes *gzip = test_deflate(data, len, 16 + MAX_WBITS, Z_FINISH);
+    GByteArray *members = g_byte_array_new();
+    GBytes *multi;
+    GError *error = NULL;
+
+    assert_contents(tar_contents(tar, FALSE, 0, 0, &error), error, expected);
+    assert_contents(tar_contents(gzip, TRUE, 0, 0, &error), error, expected);
+
+    // Несколько членов gzip читаются как один поток; разрез внутри заголовка
+    for (gsize from = 0, cut = 700; from < len; from = cut, cut = MIN(cut * 2, len)) {
+        GBytes *member = test_deflate(data + from, cut - from, 16 + MAX_WBITS, Z_FINISH);
+
+        g_byte_array_append(members, g_bytes_get_data(member, NULL), g_bytes_get_size(member));
+        g_bytes_unref(member);
+    }
+    multi = g_byte_array_free_to_bytes(members);
+    assert_contents(tar_contents(multi, TRUE, 0, 0, &error), error, expected);
+
+    g_bytes_unref(multi);
+    g_bytes_unref(gzip);
+    g_bytes_unref(tar);
+    g_free(expected);
+}
+
+static void
+test_tar_truncated(void)
+{
+    gchar *expected;
+    GBytes *tar = tar_fixture(&expected);
+    const gchar *data = g_bytes_get_data(tar, NULL);
+    GBytes *cut, *gzip;
+    GError *error = NULL;
+
+    // Обрыв в данных записи и в заголовке
+    cut = g_bytes_new_from_bytes(tar, 0, 512 + 3);
+    assert_read_error(tar_contents(cut, FALSE, 0, 0, &error), error, G_IO_ERROR_INVALID_DATA);
+    error = NULL;
+    g_bytes_unref(cut);
+
+    cut = g_bytes_new_from_bytes(tar, 0, 1024 + 100);
+    assert_read_error(tar_contents(cut, FALSE, 0, 0, &error), error, G_IO_ERROR_INVALID_DATA);
+    error = NULL;
+    g_bytes_unref(cut);
+
+    gzip = test_deflate(data, g_bytes_get_size(tar), 16 + MAX_WBITS, Z_FINISH);
+    cut = g_bytes_new_from_bytes(gzip, 0, g_bytes_get_size(gzip) / 2);
+    assert_read_error(tar_contents(cut, TRUE, 0, 0, &error), error, G_IO_ERROR_INVALID_DATA);
+
+    g_bytes_unref(cut);
+    g_bytes_unref(gzip);
+    g_bytes_unref(tar);
+    g_free(expected);
+}
+
+static void
+test_tar_limits(void)
+{
+    const gsize big = 2 * 1024 * 1024;
+    gchar *data = g_malloc0(big);
+    GByteArray *tar = g_byte_array_new();
+    GBytes *bytes, *gzip;
+    gchar *contents;
+    GError *error = NULL;
+
+    tar_put_entry(tar, "zeros.bin", NULL, '0', data, big);
+    tar_put_end(tar);
+    bytes = g_byte_array_free_to_bytes(tar);
+    gzip = test_deflate(g_bytes_get_data(bytes, NULL), g_bytes_get_size(bytes), 16 + MAX_WBITS,
+                        Z_FINISH);
+
+    contents = tar_contents(gzip, TRUE, 0, 0, &error);
+    g_assert_no_error(error);
+    g_assert_cmpuint(strlen(contents), ==, strlen("zeros.bin=\n"));
+    g_free(contents);
+
+    // Общий объём распакованного (в плагине 1 ГБ) и степень сжатия gzip
+    assert_read_error(tar_contents(bytes, FALSE, 64 * 1024, 0, &error), error,
+                      G_IO_ERROR_NO_SPACE);
+    error = NULL;
+    assert_read_error(tar_contents(gzip, TRUE, 64 * 1024, 0, &error), error,
+                      G_IO_ERROR_NO_SPACE);
+    error = NULL;
+    assert_read_error(tar_contents(gzip, TRUE, 0, 100, &error), error,
+                      G_IO_ERROR_INVALID_DATA);
+
+    g_bytes_unref(gzip);
+    g_bytes_unref(bytes);
+    g_free(data);
+}
+
+int
+main(int argc, char **argv)
+{
+    // Кэш проверки вложений пишется во временный каталог, а не в кэш пользователя
+    g_test_init(&argc, &argv, G_TEST_OPTION_ISOLATE_DIRS, NULL);
+
+    g_test_add_func("/matcher/split-feed", test_split_feed);
+    g_test_add_func("/matcher/split-utf8-word-boundary", test_split_utf8_word_boundary);
+    g_test_add_func("/matcher/regex-runs", test_regex_runs);
+    g_test_add_func("/markup/text", test_markup_text);
+    g_test_add_func("/zip/entries", test_zip_entries);
+    g_test_add_func("/zip/inflate-buffer-boundary", test_zip_inflate_boundary);
+    g_test_add_func("/zip/truncated", test_zip_truncated);
+    g_test_add_func("/zip/archive-limits", test_archive_scan_limits);
+    g_test_add_func("/tar/entries", test_tar_entries);
+    g_test_add_func("/tar/truncated", test_tar_truncated);
+    g_test_add_func("/tar/limits", test_tar_limits);
+
+    return g_test_run();
+}
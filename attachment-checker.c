@@ -11,68 +11,22 @@
 #include <evolution/composer/e-msg-composer.h>
 
 #include "attachment-checker.h"
+#include "word-dictionary.h"
+#include "word-rules.h"
+#include "presend-scan.h"
+#include "attachment-cache.h"
+#include "composer-watch.h"
+#include "scan-policy.h"
+#include "mail-audit.h"
 
 #include <time.h>
 
-// Путь к конфигурационному файлу
-#define CONFIG_FILE "/etc/evolution-attachment-checker/words.conf"
-#define USER_CONFIG_FILE ".config/evolution-attachment-checker/words.conf"
+// Окно прогресса появляется, только если проверка заметно затянулась
+#define PROGRESS_DIALOG_DELAY_MS 300
+#define PROGRESS_UPDATE_MS 100
 
-
-// Объявления функций (прототипы)
-static gchar* extract_text_from_camel_data_wrapper(CamelDataWrapper *dw);
-static gchar* extract_text_from_camel_part(CamelMimePart *part);
-static gchar* get_message_text(EMsgComposer *composer);
-static gchar* get_message_text_simple(EMsgComposer *composer);
-
-// Загрузка запрещённых слов из GSettings
-gchar**
-load_forbidden_words(GSettings *settings)
-{
-    GPtrArray *words_array;
-    gchar **words = NULL;
-    FILE *file = NULL;
-    gchar config_path[512];
-
-    // Сначала пробуем системный файл
-    file = fopen(CONFIG_FILE, "r");
-
-    // Если нет системного, пробуем пользовательский
-    if (!file) {
-        snprintf(config_path, sizeof(config_path), "%s/%s",
-                 g_get_home_dir(), USER_CONFIG_FILE);
-        file = fopen(config_path, "r");
-    }
-
-    words_array = g_ptr_array_new_with_free_func(g_free);
-
-    if (file) {
-        char line[1024];
-        while (fgets(line, sizeof(line), file)) {
-            // Удаляем пробелы и переводы строк
-            gchar *word = g_strstrip(g_strdup(line));
-            if (strlen(word) > 0 && word[0] != '#') { // Пропускаем комментарии
-                g_ptr_array_add(words_array, word);
-            } else {
-                g_free(word);
-            }
-        }
-        fclose(file);
-    } else {
-        // Значения по умолчанию, если нет файлов
-        g_ptr_array_add(words_array, g_strdup("confidential"));
-        g_ptr_array_add(words_array, g_strdup("secret"));
-        g_ptr_array_add(words_array, g_strdup("password"));
-        g_ptr_array_add(words_array, g_strdup("private"));
-        g_ptr_array_add(words_array, g_strdup("internal"));
-        g_ptr_array_add(words_array, g_strdup("draft"));
-    }
-
-    g_ptr_array_add(words_array, NULL);
-    words = (gchar **)g_ptr_array_free(words_array, FALSE);
-
-    return words;
-}
+// Признак идущей проверки на композере: повторное "Отправить" не запускает вторую
+#define BUSY_KEY "attachment-checker-busy"
 
 // Сохранение запрещённых слов в GSettings
 void
@@ -107,250 +61,287 @@ save_forbidden_words(GSettings *settings, gchar **words)
     (void)settings; // GSettings больше не используется
 }
 
-// Проверка текста на запрещённые слова
-gboolean
-check_text_for_forbidden_words(const gchar *text, gchar **forbidden_words, 
-                                 gboolean case_sensitive, gchar **found_word)
+WordMatcherFlags
+attachment_checker_get_matcher_flags(GSettings *settings)
+{
+    WordMatcherFlags flags = 0;
+
+    if (g_settings_get_boolean(settings, KEY_CASE_SENSITIVE))
+        flags |= WORD_MATCHER_CASE_SENSITIVE;
+    if (g_settings_get_boolean(settings, KEY_NORMALIZE_TEXT))
+        flags |= WORD_MATCHER_NORMALIZE;
+
+    return flags;
+}
+
+// Состояние ожидания фоновой проверки
+typedef struct {
+    PresendScan *scan;
+    GCancellable *cancellable;
+    GMainLoop *loop;
+    GtkWindow *parent;
+    GtkWidget *dialog;
+    GtkWidget *progress;
+    gint64 started;
+    gboolean completed;
+    gboolean cancelled;
+    gboolean parent_destroyed;
+} ScanProgress;
+
+static void
+progress_dialog_response(GtkDialog *dialog, gint response_id, ScanProgress *progress)
 {
-    if (!text || !forbidden_words || !forbidden_words[0])
-        return FALSE;
+    // Закрытие окна тоже считается отменой
+    g_cancellable_cancel(progress->cancellable);
+    gtk_widget_set_sensitive(GTK_WIDGET(dialog), FALSE);
     
-    gchar *text_to_search = NULL;
-    gchar **words_to_search = NULL;
-    gboolean found = FALSE;
-    int i;
+    (void)response_id;
+}
+
+static void
+progress_dialog_create(ScanProgress *progress)
+{
+    GtkWidget *content, *label;
+    
+    progress->dialog = gtk_dialog_new_with_buttons(
+        "Проверка безопасности", progress->parent,
+        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+        _("_Отмена"), GTK_RESPONSE_CANCEL,
+        NULL);
+    gtk_window_set_resizable(GTK_WINDOW(progress->dialog), FALSE);
+    
+    content = gtk_dialog_get_content_area(GTK_DIALOG(progress->dialog));
+    gtk_container_set_border_width(GTK_CONTAINER(content), 12);
+    gtk_box_set_spacing(GTK_BOX(content), 6);
+    
+    label = gtk_label_new("Проверка письма на запрещённые слова...");
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_box_pack_start(GTK_BOX(content), label, FALSE, FALSE, 0);
+    
+    progress->progress = gtk_progress_bar_new();
+    gtk_box_pack_start(GTK_BOX(content), progress->progress, FALSE, FALSE, 0);
+    
+    g_signal_connect(progress->dialog, "response",
+                     G_CALLBACK(progress_dialog_response), progress);
+    // Окно уничтожается вместе с композером - указатель обнуляется сам
+    g_object_add_weak_pointer(G_OBJECT(progress->dialog), (gpointer *)&progress->dialog);
+    gtk_widget_show_all(progress->dialog);
+}
+
+static gboolean
+progress_update_cb(gpointer user_data)
+{
+    ScanProgress *progress = user_data;
+    gdouble fraction;
     
-    // Подготовка текста для поиска
-    if (!case_sensitive) {
-        text_to_search = g_utf8_strdown(text, -1);
-    } else {
-        text_to_search = g_strdup(text);
-    }
+    if (progress->completed)
+        return G_SOURCE_REMOVE;
     
-    // Подготовка слов для поиска
-    if (!case_sensitive) {
-        words_to_search = g_new0(gchar*, g_strv_length(forbidden_words) + 1);
-        for (i = 0; forbidden_words[i]; i++) {
-            words_to_search[i] = g_utf8_strdown(forbidden_words[i], -1);
-        }
-    } else {
-        words_to_search = g_strdupv(forbidden_words);
-    }
+    if (progress->parent_destroyed)
+        return G_SOURCE_CONTINUE;
     
-    // Поиск
-    for (i = 0; words_to_search[i] && !found; i++) {
-        if (strstr(text_to_search, words_to_search[i])) {
-            found = TRUE;
-            if (found_word) {
-                *found_word = g_strdup(forbidden_words[i]);
-            }
-        }
+    if (!progress->dialog) {
+        if (g_get_monotonic_time() - progress->started < PROGRESS_DIALOG_DELAY_MS * 1000)
+            return G_SOURCE_CONTINUE;
+        progress_dialog_create(progress);
     }
     
-    // Очистка
-    g_free(text_to_search);
-    if (!case_sensitive) {
-        g_strfreev(words_to_search);
-    } else {
-        g_free(words_to_search);
-    }
+    fraction = presend_scan_get_progress(progress->scan);
+    if (fraction < 0)
+        gtk_progress_bar_pulse(GTK_PROGRESS_BAR(progress->progress));
+    else
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress->progress), fraction);
     
-    return found;
+    return G_SOURCE_CONTINUE;
 }
 
-// Проверка имён вложений
-gboolean
-check_attachment_names(EAttachmentStore *store, gchar **forbidden_words,
-                         gboolean case_sensitive, gchar **found_name)
+static void
+presend_scan_done(GObject *source_object, GAsyncResult *result, gpointer user_data)
 {
-    if (!store || !forbidden_words || !forbidden_words[0])
-        return FALSE;
-    
-    GList *attachments = e_attachment_store_get_attachments(store);
-    gboolean found = FALSE;
+    ScanProgress *progress = user_data;
+    GError *error = NULL;
     
-    for (GList *item = attachments; item != NULL && !found; item = item->next) {
-        EAttachment *attachment = E_ATTACHMENT(item->data);
-        GFile *file = e_attachment_ref_file(attachment);
-        
-        if (file) {
-            gchar *basename = g_file_get_basename(file);
-            if (basename) {
-                found = check_text_for_forbidden_words(basename, forbidden_words,
-                                                        case_sensitive, found_name);
-                g_free(basename);
-            }
-            g_object_unref(file);
-        }
+    if (!presend_scan_finish(progress->scan, result, &error)) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            g_warning("Attachment checker scan failed: %s", error ? error->message : "unknown");
+        progress->cancelled = TRUE;
+        g_clear_error(&error);
     }
     
-    g_list_free_full(attachments, g_object_unref);
-    return found;
+    progress->completed = TRUE;
+    g_main_loop_quit(progress->loop);
+    
+    (void)source_object;
 }
 
-// Функция для извлечения текста из Camel-объектов
-static gchar*
-extract_text_from_camel_data_wrapper(CamelDataWrapper *dw)
+// Композер закрыт во время проверки (не через окно - его закрытие
+// заблокировано): проверка отменяется, письмо не отправляется
+static void
+progress_parent_destroyed(GtkWidget *widget, ScanProgress *progress)
 {
-    if (!dw)
-        return NULL;
-    
-    GByteArray *data = g_byte_array_new();
-    CamelStream *stream = camel_stream_mem_new_with_byte_array(data);
-    GCancellable *cancellable = NULL;
-    GError *error = NULL;
+    progress->parent_destroyed = TRUE;
+    g_cancellable_cancel(progress->cancellable);
     
-    // Используем синхронную версию функции
-    gssize bytes_written = camel_data_wrapper_decode_to_stream_sync(dw, stream, cancellable, &error);
-    
-    if (bytes_written >= 0 && error == NULL) {
-        if (data->len > 0) {
-            gchar *text = g_strndup((gchar *)data->data, data->len);
-            g_object_unref(stream);
-            g_byte_array_free(data, TRUE);
-            return text;
-        }
-    } else {
-        if (error) {
-            g_warning("Error decoding data wrapper: %s", error->message);
-            g_error_free(error);
-        }
-    }
-    
-    g_object_unref(stream);
-    g_byte_array_free(data, TRUE);
-    return NULL;
+    (void)widget;
 }
 
-// Функция для извлечения текста из CamelMimePart
-static gchar*
-extract_text_from_camel_part(CamelMimePart *part)
+static gboolean
+progress_parent_delete(GtkWidget *widget, GdkEvent *event, gpointer user_data)
 {
-    if (!part)
-        return NULL;
-    
-    GString *result = g_string_new(NULL);
-    
-    // Получаем тип содержимого
-    CamelContentType *content_type = camel_mime_part_get_content_type(part);
-    const gchar *mime_type = camel_content_type_simple(content_type);
-    
-    g_debug("Processing MIME part of type: %s", mime_type ? mime_type : "unknown");
-    
-    // Проверяем, является ли часть текстовой
-    if (mime_type && g_str_has_prefix(mime_type, "text/")) {
-        CamelDataWrapper *dw = camel_medium_get_content(CAMEL_MEDIUM(part));
-        if (dw) {
-            gchar *text = extract_text_from_camel_data_wrapper(dw);
-            if (text) {
-                g_string_append(result, text);
-                g_free(text);
-            }
-        }
-    }
-    // Обрабатываем multipart
-    else if (mime_type && g_str_has_prefix(mime_type, "multipart/")) {
-        // Проверяем, является ли часть multipart
-        if (CAMEL_IS_MULTIPART(part)) {
-            CamelMultipart *multipart = CAMEL_MULTIPART(part);
-            gint n_parts = camel_multipart_get_number(multipart);
-            
-            g_debug("Multipart message with %d parts", n_parts);
-            
-            for (gint i = 0; i < n_parts; i++) {
-                CamelMimePart *subpart = camel_multipart_get_part(multipart, i);
-                if (subpart) {
-                    gchar *subtext = extract_text_from_camel_part(subpart);
-                    if (subtext) {
-                        g_string_append(result, subtext);
-                        g_string_append_c(result, '\n');
-                        g_free(subtext);
-                    }
-                }
-            }
-        }
+    (void)widget;
+    (void)event;
+    (void)user_data;
+    return TRUE;
+}
+
+// Запуск проверки в рабочем потоке. Хук presendchecks синхронный, поэтому
+// ждём результат во вложенном цикле событий: интерфейс остаётся отзывчивым,
+// а при долгой проверке показывается окно с прогрессом и кнопкой отмены.
+// Композер на это время недоступен: текст, набранный после снимка, ушёл бы
+// непроверенным. Вызывающий держит ссылку на композер.
+// Возвращает FALSE, если проверка отменена.
+static gboolean
+run_presend_scan(EMsgComposer *composer, PresendScan *scan)
+{
+    ScanProgress progress = { 0 };
+    gboolean was_sensitive = gtk_widget_get_sensitive(GTK_WIDGET(composer));
+    gulong destroy_id, delete_id;
+    guint timeout_id;
+    
+    progress.scan = scan;
+    progress.cancellable = g_cancellable_new();
+    progress.loop = g_main_loop_new(NULL, FALSE);
+    progress.parent = GTK_WINDOW(composer);
+    progress.started = g_get_monotonic_time();
+    
+    destroy_id = g_signal_connect(composer, "destroy",
+                                  G_CALLBACK(progress_parent_destroyed), &progress);
+    delete_id = g_signal_connect(composer, "delete-event",
+                                 G_CALLBACK(progress_parent_delete), NULL);
+    gtk_widget_set_sensitive(GTK_WIDGET(composer), FALSE);
+    
+    presend_scan_run_async(scan, progress.cancellable, presend_scan_done, &progress);
+    timeout_id = g_timeout_add(PROGRESS_UPDATE_MS, progress_update_cb, &progress);
+    
+    // Выход только по завершении: рабочий поток ссылается на progress
+    if (!progress.completed)
+        g_main_loop_run(progress.loop);
+    
+    g_source_remove(timeout_id);
+    if (progress.dialog) {
+        g_object_remove_weak_pointer(G_OBJECT(progress.dialog), (gpointer *)&progress.dialog);
+        gtk_widget_destroy(progress.dialog);
     }
     
-    if (result->len == 0) {
-        g_string_free(result, TRUE);
-        return NULL;
+    // Уничтоженный композер обработчики уже снял
+    if (!progress.parent_destroyed) {
+        g_signal_handler_disconnect(composer, destroy_id);
+        g_signal_handler_disconnect(composer, delete_id);
+        gtk_widget_set_sensitive(GTK_WIDGET(composer), was_sensitive);
     }
     
-    return g_string_free(result, FALSE);
+    g_main_loop_unref(progress.loop);
+    g_object_unref(progress.cancellable);
+    
+    return !progress.cancelled && !progress.parent_destroyed;
 }
 
-// Получение текста письма
-static gchar*
-get_message_text(EMsgComposer *composer)
+// Новое окно композера: подключаем фоновую проверку черновика
+gboolean
+attachment_checker_composer_init(GtkUIManager *ui_manager, EMsgComposer *composer)
 {
-    if (!composer)
-        return NULL;
-    
-    GString *full_text = g_string_new(NULL);
-    
-    g_debug("Getting message text from composer");
-    
-    // Способ 1: Пробуем получить через raw message text
-    GByteArray *raw_text = e_msg_composer_get_raw_message_text(composer);
-    
-    if (raw_text && raw_text->len > 0) {
-        g_debug("Got raw message text, length: %u", raw_text->len);
-        g_string_append_len(full_text, (gchar *)raw_text->data, raw_text->len);
-        g_byte_array_free(raw_text, TRUE);
-    } else {
-        if (raw_text) g_byte_array_free(raw_text, TRUE);
-        
-        // Способ 2: Пробуем получить через Camel MIME сообщение
-        CamelMimeMessage *message = NULL;
-        g_object_get(composer, "message", &message, NULL);
-        
-        if (message) {
-            g_debug("Got Camel message");
-            gchar *msg_text = extract_text_from_camel_part(CAMEL_MIME_PART(message));
-            if (msg_text) {
-                g_debug("Extracted text from Camel message, length: %lu", strlen(msg_text));
-                g_string_append(full_text, msg_text);
-                g_free(msg_text);
-            }
-            g_object_unref(message);
-        }
-        
-        // Способ 3: Пробуем получить через свойства composer
-        if (full_text->len == 0) {
-            gchar *text = NULL;
-            g_object_get(composer, "text", &text, NULL);
-            if (text && *text) {
-                g_debug("Got text from composer property, length: %lu", strlen(text));
-                g_string_append(full_text, text);
-                g_free(text);
-            }
-        }
-    }
-    
-    // Если текст не найден, возвращаем NULL
-    if (full_text->len == 0) {
-        g_debug("No text found in message");
-        g_string_free(full_text, TRUE);
-        return g_strdup(""); // Пустая строка вместо NULL
+    composer_watch_attach(composer);
+
+    (void)ui_manager;
+    return TRUE;
+}
+
+// Сколько слов и смещений перечисляется в предупреждении
+#define REPORT_MAX_WORDS 20
+#define REPORT_MAX_OFFSETS 5
+
+// Место совпадения для предупреждения: текст письма или вложение
+static void
+append_match_place(GString *report, const WordMatch *match, GPtrArray *attachments)
+{
+    AttachmentSource *source = match->source < attachments->len
+                                   ? g_ptr_array_index(attachments, match->source) : NULL;
+    const gchar *name = source && source->name ? source->name : "без имени";
+
+    switch (match->place) {
+    case WORD_MATCH_BODY:
+        g_string_append(report, "текст письма");
+        break;
+    case WORD_MATCH_ATTACHMENT_NAME:
+        g_string_append_printf(report, "имя вложения «%s»", name);
+        break;
+    case WORD_MATCH_ATTACHMENT:
+        g_string_append_printf(report, "вложение «%s»", name);
+        break;
     }
-    
-    g_debug("Final message text length: %lu", full_text->len);
-    return g_string_free(full_text, FALSE);
 }
 
-// Упрощенная версия для тестирования
+// Текст предупреждения: каждое слово с числом совпадений и местами,
+// для текста письма - смещения первых совпадений
 static gchar*
-get_message_text_simple(EMsgComposer *composer)
+format_matches_report(const WordMatches *matches, const WordMatcher *matcher,
+                      GPtrArray *attachments, ScanArena *arena)
 {
-    gchar *text = get_message_text(composer);
-    
-    // Для тестирования, если текст не найден, возвращаем тестовую строку
-    if (!text || strlen(text) == 0) {
-        if (text) g_free(text);
-        text = g_strdup("Test message with confidential information in body");
+    GString *report = g_string_sized_new(1024);
+    guint n_words = word_matches_get_n_words(matches);
+    guint n_stored = word_matches_get_n_stored(matches);
+    gboolean *listed = scan_arena_alloc(arena, MAX(n_stored, 1) * sizeof(gboolean));
+
+    g_string_append_printf(report, "Обнаружены запрещённые слова (совпадений: %u):\n",
+                           word_matches_get_total(matches));
+
+    for (guint w = 0; w < MIN(n_words, REPORT_MAX_WORDS); w++) {
+        guint count;
+        guint word_index = word_matches_get_word(matches, w, &count);
+        guint n_places = 0;
+
+        memset(listed, 0, n_stored * sizeof(gboolean));
+
+        g_string_append_printf(report, "\n• «%s» - %u: ",
+                               word_matcher_get_word(matcher, word_index), count);
+
+        // Места по первому появлению, совпадения в одном месте - вместе
+        for (guint i = 0; i < n_stored; i++) {
+            const WordMatch *match = word_matches_get(matches, i);
+            guint in_place = 0;
+
+            if (listed[i] || match->word_index != word_index)
+                continue;
+
+            if (n_places++ > 0)
+                g_string_append(report, "; ");
+            append_match_place(report, match, attachments);
+
+            for (guint j = i; j < n_stored; j++) {
+                const WordMatch *other = word_matches_get(matches, j);
+
+                if (other->word_index != word_index || other->place != match->place ||
+                    other->source != match->source)
+                    continue;
+
+                listed[j] = TRUE;
+                if (match->place == WORD_MATCH_BODY && in_place < REPORT_MAX_OFFSETS)
+                    g_string_append_printf(report, "%s%" G_GUINT64_FORMAT,
+                                           in_place ? ", " : ", смещение ", other->offset);
+                in_place++;
+            }
+
+            if (match->place == WORD_MATCH_BODY && in_place > REPORT_MAX_OFFSETS)
+                g_string_append(report, ", ...");
+            else if (match->place != WORD_MATCH_BODY && in_place > 1)
+                g_string_append_printf(report, " (%u)", in_place);
+        }
     }
-    
-    return text;
+
+    if (n_words > REPORT_MAX_WORDS)
+        g_string_append_printf(report, "\n...и ещё слов: %u", n_words - REPORT_MAX_WORDS);
+
+    return g_string_free(report, FALSE);
 }
 
 // Основная функция плагина
@@ -365,70 +356,85 @@ org_gnome_evolution_attachment_checker(EPlugin *ep, gpointer t)
         return;
     }
     
-    GSettings *settings = NULL;
-    gchar **forbidden_words = NULL;
-    gboolean check_attachments = TRUE;
-    gboolean check_message_body = TRUE;
-    gboolean case_sensitive = FALSE;
-    gchar *found_item = NULL;
-    gboolean should_cancel = FALSE;
-    
-    // Загружаем настройки
-    settings = g_settings_new(ATTACHMENT_CHECKER_SCHEMA_ID);
-    if (!settings) {
-        g_warning("Failed to load attachment checker settings");
+    EMsgComposer *composer;
+    ScanPolicy *policy;
+    WordMatcher *matcher;
+    PresendScan *scan = NULL;
+    ComposerWatch *watch;
+    gchar *report = NULL;
+    gboolean completed;
+    ScanTiming timing = { { 0 } };
+    gint64 total_started = scan_timing_begin();
+    gint64 started = total_started;
+    
+    // Настройки и словарь с автоматом - готовым снимком, без чтения
+    // GSettings и файлов
+    policy = scan_policy_get();
+    matcher = scan_policy_get_matcher(policy);
+    scan_timing_end(&timing, SCAN_PHASE_SETTINGS, started);
+    
+    if (!matcher) {
+        scan_policy_unref(policy);
         return;
     }
     
-    check_attachments = g_settings_get_boolean(settings, KEY_CHECK_ATTACHMENTS);
-    check_message_body = g_settings_get_boolean(settings, KEY_CHECK_MESSAGE_BODY);
-    case_sensitive = g_settings_get_boolean(settings, KEY_CASE_SENSITIVE);
-    forbidden_words = load_forbidden_words(settings);
-    
-    if (!forbidden_words || !forbidden_words[0]) {
-        g_strfreev(forbidden_words);
-        g_object_unref(settings);
+    // Повторный вызов, пока идёт проверка (второе нажатие "Отправить"
+    // во время вложенного цикла событий), отправку не пропускает
+    if (g_object_get_data(G_OBJECT(target->composer), BUSY_KEY)) {
+        g_object_set_data(G_OBJECT(target->composer), "presend_check_status",
+                          GINT_TO_POINTER(1));
+        scan_policy_unref(policy);
         return;
     }
     
-    // Проверяем вложения если включено
-    if (check_attachments) {
-        EAttachmentView *view = e_msg_composer_get_attachment_view(target->composer);
-        if (view) {
-            EAttachmentStore *store = e_attachment_view_get_store(view);
-            if (store && e_attachment_store_get_num_attachments(store) > 0) {
-                if (check_attachment_names(store, forbidden_words, case_sensitive, &found_item)) {
-                    should_cancel = TRUE;
-                }
-            }
-        }
-    }
-    
-    // Проверяем текст письма если включено и ещё не нашли нарушений
-    if (!should_cancel && check_message_body) {
-        gchar *message_text = get_message_text_simple(target->composer);
-        if (message_text && strlen(message_text) > 0) {
-            if (check_text_for_forbidden_words(message_text, forbidden_words, 
-                                                case_sensitive, &found_item)) {
-                should_cancel = TRUE;
-            }
-            g_free(message_text);
-        }
+    // Во вложенном цикле событий композер могут закрыть - ссылка держится
+    // до конца хука
+    composer = g_object_ref(target->composer);
+    
+    // Данные композера забираются здесь, поиск идёт в рабочем потоке
+    started = scan_timing_begin();
+    scan = presend_scan_new(composer, scan_policy_get_dictionary(policy), matcher,
+                            scan_policy_get_flags(policy),
+                            scan_policy_get_max_attachment_bytes(policy));
+    scan_timing_end(&timing, SCAN_PHASE_EXTRACTION, started);
+    
+    // Текст уже проверялся в фоне - остаётся досмотреть изменения
+    watch = composer_watch_get(composer);
+    if (watch)
+        presend_scan_set_block_cache(scan, composer_watch_get_block_cache(watch));
+    
+    g_object_set_data(G_OBJECT(composer), BUSY_KEY, GINT_TO_POINTER(1));
+    completed = run_presend_scan(composer, scan);
+    g_object_set_data(G_OBJECT(composer), BUSY_KEY, NULL);
+    
+    if (!completed) {
+        // Проверка отменена пользователем или закрытием композера -
+        // письмо не отправляем
+        g_object_set_data(G_OBJECT(composer), "presend_check_status",
+                          GINT_TO_POINTER(1));
+    } else if (word_matches_get_total(presend_scan_get_matches(scan)) > 0) {
+        report = format_matches_report(presend_scan_get_matches(scan), matcher,
+                                       presend_scan_get_attachments(scan),
+                                       presend_scan_get_arena(scan));
     }
+    timing.arena_bytes = scan_arena_get_used(presend_scan_get_arena(scan));
+    scan_timing_merge(&timing, presend_scan_get_timing(scan));
+    timing.cancelled = !completed;
+    presend_scan_free(scan);
     
     // Если найдены нарушения, показываем предупреждение
-    if (should_cancel && found_item) {
+    if (report) {
         GtkWidget *dialog;
         gint response;
         
         gchar *message = g_strdup_printf(
-            "Обнаружено запрещённое слово: '%s'\n\n"
+            "%s\n\n"
             "Вы уверены, что хотите отправить это письмо?",
-            found_item
+            report
         );
         
         dialog = gtk_message_dialog_new(
-            GTK_WINDOW(target->composer),
+            GTK_WINDOW(composer),
             GTK_DIALOG_MODAL,
             GTK_MESSAGE_WARNING,
             GTK_BUTTONS_YES_NO,
@@ -436,24 +442,31 @@ org_gnome_evolution_attachment_checker(EPlugin *ep, gpointer t)
         );
         gtk_window_set_title(GTK_WINDOW(dialog), "Проверка безопасности");
         
+        started = scan_timing_begin();
         response = gtk_dialog_run(GTK_DIALOG(dialog));
+        scan_timing_end(&timing, SCAN_PHASE_DIALOG, started);
         gtk_widget_destroy(dialog);
         g_free(message);
         
         // Если пользователь нажал "Нет" - отменяем отправку
         if (response != GTK_RESPONSE_YES) {
             g_object_set_data(
-                G_OBJECT(target->composer),
+                G_OBJECT(composer),
                 "presend_check_status",
                 GINT_TO_POINTER(1)
             );
         }
         
-        g_free(found_item);
+        g_free(report);
     }
     
-    g_strfreev(forbidden_words);
-    g_object_unref(settings);
+    scan_timing_end(&timing, SCAN_PHASE_TOTAL, total_started);
+    scan_timing_report(&timing);
+    // Профиль правил (ATTACHMENT_CHECKER_TRACE=rules) - в файл, после замера
+    scan_timing_save_rule_profile(matcher);
+    
+    g_object_unref(composer);
+    scan_policy_unref(policy);
     
     (void)ep;
 }
@@ -493,10 +506,14 @@ commit_changes(UIData *ui)
     // Сохраняем настройки проверок
     g_settings_set_boolean(ui->settings, KEY_CHECK_ATTACHMENTS,
                            gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(ui->check_attachments)));
+    g_settings_set_boolean(ui->settings, KEY_CHECK_ATTACHMENT_CONTENTS,
+                           gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(ui->check_attachment_contents)));
     g_settings_set_boolean(ui->settings, KEY_CHECK_MESSAGE_BODY,
                            gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(ui->check_message_body)));
     g_settings_set_boolean(ui->settings, KEY_CASE_SENSITIVE,
                            gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(ui->check_case_sensitive)));
+    g_settings_set_boolean(ui->settings, KEY_NORMALIZE_TEXT,
+                           gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(ui->check_normalize_text)));
     g_settings_sync();
 }
 
@@ -508,8 +525,27 @@ cell_edited_cb(GtkCellRendererText *cell, gchar *path_string,
     GtkTreeIter iter;
 
     if (gtk_tree_model_get_iter_from_string(model, &iter, path_string)) {
+        GError *error = NULL;
+
         if (new_text == NULL || *g_strstrip(new_text) == '\0') {
             gtk_list_store_remove(ui->store, &iter);
+        } else if (!word_rule_validate(new_text,
+                                       gtk_toggle_button_get_active(
+                                           GTK_TOGGLE_BUTTON(ui->check_case_sensitive)),
+                                       &error)) {
+            // Ошибочное правило не сохраняется, прежний текст остаётся
+            GtkWidget *dialog = gtk_message_dialog_new(
+                GTK_WINDOW(gtk_widget_get_toplevel(ui->treeview)),
+                GTK_DIALOG_MODAL,
+                GTK_MESSAGE_ERROR,
+                GTK_BUTTONS_CLOSE,
+                _("Некорректное правило: %s"), new_text);
+            gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(dialog),
+                                                     "%s", error->message);
+            gtk_dialog_run(GTK_DIALOG(dialog));
+            gtk_widget_destroy(dialog);
+            g_error_free(error);
+            return;
         } else {
             gtk_list_store_set(ui->store, &iter,
                                WORD_KEYWORD_COLUMN, new_text, -1);
@@ -576,6 +612,37 @@ setting_toggled(GtkToggleButton *button, UIData *ui)
     (void)button;
 }
 
+static void
+audit_update(UIData *ui)
+{
+    gchar *status = mail_audit_dup_status();
+
+    gtk_button_set_label(GTK_BUTTON(ui->audit_button),
+                         mail_audit_is_running() ? _("Остановить") : _("Проверить отправленные"));
+    gtk_label_set_text(GTK_LABEL(ui->audit_label),
+                       status ? status : _("Письма в отправленных ещё не проверялись"));
+    g_free(status);
+}
+
+static gboolean
+audit_timeout_cb(gpointer user_data)
+{
+    audit_update(user_data);
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+audit_clicked(GtkButton *button, UIData *ui)
+{
+    if (mail_audit_is_running())
+        mail_audit_stop();
+    else
+        mail_audit_start();
+
+    audit_update(ui);
+    (void)button;
+}
+
 static void
 destroy_ui_data(gpointer data)
 {
@@ -584,6 +651,8 @@ destroy_ui_data(gpointer data)
     if (!ui)
         return;
 
+    if (ui->audit_timeout_id)
+        g_source_remove(ui->audit_timeout_id);
     if (ui->settings)
         g_object_unref(ui->settings);
     g_free(ui);
@@ -610,28 +679,44 @@ e_plugin_lib_get_configure_widget(EPlugin *plugin)
 
     ui->check_attachments = gtk_check_button_new_with_label(
         _("Проверять имена вложений"));
+    ui->check_attachment_contents = gtk_check_button_new_with_label(
+        _("Проверять содержимое вложений"));
     ui->check_message_body = gtk_check_button_new_with_label(
         _("Проверять текст письма"));
     ui->check_case_sensitive = gtk_check_button_new_with_label(
         _("Учитывать регистр"));
+    ui->check_normalize_text = gtk_check_button_new_with_label(
+        _("Распознавать замаскированные слова (s3cr3t, s e c r e t, похожие буквы)"));
+    gtk_widget_set_tooltip_text(ui->check_normalize_text,
+        _("Регистр при этом не учитывается"));
 
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(ui->check_attachments),
                                  g_settings_get_boolean(ui->settings, KEY_CHECK_ATTACHMENTS));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(ui->check_attachment_contents),
+                                 g_settings_get_boolean(ui->settings, KEY_CHECK_ATTACHMENT_CONTENTS));
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(ui->check_message_body),
                                  g_settings_get_boolean(ui->settings, KEY_CHECK_MESSAGE_BODY));
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(ui->check_case_sensitive),
                                  g_settings_get_boolean(ui->settings, KEY_CASE_SENSITIVE));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(ui->check_normalize_text),
+                                 g_settings_get_boolean(ui->settings, KEY_NORMALIZE_TEXT));
 
     g_signal_connect(ui->check_attachments, "toggled",
                      G_CALLBACK(setting_toggled), ui);
+    g_signal_connect(ui->check_attachment_contents, "toggled",
+                     G_CALLBACK(setting_toggled), ui);
     g_signal_connect(ui->check_message_body, "toggled",
                      G_CALLBACK(setting_toggled), ui);
     g_signal_connect(ui->check_case_sensitive, "toggled",
                      G_CALLBACK(setting_toggled), ui);
+    g_signal_connect(ui->check_normalize_text, "toggled",
+                     G_CALLBACK(setting_toggled), ui);
 
     gtk_box_pack_start(GTK_BOX(check_box), ui->check_attachments, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(check_box), ui->check_attachment_contents, FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(check_box), ui->check_message_body, FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(check_box), ui->check_case_sensitive, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(check_box), ui->check_normalize_text, FALSE, FALSE, 0);
 
     // Список запрещённых слов
     GtkWidget *words_frame = gtk_frame_new(_("Запрещённые слова"));
@@ -708,6 +793,30 @@ e_plugin_lib_get_configure_widget(EPlugin *plugin)
 
     gtk_widget_set_sensitive(ui->word_remove, FALSE);
 
+    // Проверка уже отправленных писем тем же словарём
+    GtkWidget *audit_frame = gtk_frame_new(_("Отправленная почта"));
+    GtkWidget *audit_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    gtk_container_set_border_width(GTK_CONTAINER(audit_box), 6);
+    gtk_container_add(GTK_CONTAINER(audit_frame), audit_box);
+    gtk_box_pack_start(GTK_BOX(main_box), audit_frame, FALSE, FALSE, 0);
+
+    gchar *report_path = mail_audit_dup_report_path();
+    gchar *report_tooltip = g_strdup_printf(_("Найденное записывается в %s"), report_path);
+
+    ui->audit_button = gtk_button_new_with_label(_("Проверить отправленные"));
+    gtk_widget_set_tooltip_text(ui->audit_button, report_tooltip);
+    ui->audit_label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(ui->audit_label), 0);
+    gtk_label_set_line_wrap(GTK_LABEL(ui->audit_label), TRUE);
+    gtk_box_pack_start(GTK_BOX(audit_box), ui->audit_button, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(audit_box), ui->audit_label, TRUE, TRUE, 0);
+    g_free(report_tooltip);
+    g_free(report_path);
+
+    g_signal_connect(ui->audit_button, "clicked", G_CALLBACK(audit_clicked), ui);
+    audit_update(ui);
+    ui->audit_timeout_id = g_timeout_add_seconds(1, audit_timeout_cb, ui);
+
     g_object_set_data_full(G_OBJECT(main_box), "ui-data", ui, destroy_ui_data);
 
     gtk_widget_show_all(main_box);
@@ -720,7 +829,18 @@ e_plugin_lib_get_configure_widget(EPlugin *plugin)
 gint
 e_plugin_lib_enable(EPlugin *ep, gint enable)
 {
+    if (enable) {
+        scan_timing_init();
+        scan_policy_init();
+        attachment_cache_init();
+    } else {
+        mail_audit_shutdown();
+        scan_policy_shutdown();
+        attachment_cache_shutdown();
+        scan_arena_cache_clear();
+        scan_timing_shutdown();
+    }
+
     (void)ep;
-    (void)enable;
     return 0;
 }
@@ -5,6 +5,9 @@
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 
+#include "forbidden-words.h"
+#include "word-matcher.h"
+
 // Ключи для GSettings
 #define ATTACHMENT_CHECKER_SCHEMA_ID "org.gnome.evolution.plugin.attachment-checker"
 #define ATTACHMENT_CHECKER_PATH "/org/gnome/evolution/plugin/attachment-checker/"
@@ -13,6 +16,9 @@
 #define KEY_CHECK_ATTACHMENTS "check-attachments"
 #define KEY_CHECK_MESSAGE_BODY "check-message-body"
 #define KEY_CASE_SENSITIVE "case-sensitive"
+#define KEY_CHECK_ATTACHMENT_CONTENTS "check-attachment-contents"
+#define KEY_MAX_ATTACHMENT_SIZE "max-attachment-size"
+#define KEY_NORMALIZE_TEXT "normalize-text"
 
 // Структура для UI настроек
 typedef struct {
@@ -22,8 +28,13 @@ typedef struct {
     GtkWidget *word_remove;
     GtkListStore *store;
     GtkWidget *check_attachments;
+    GtkWidget *check_attachment_contents;
     GtkWidget *check_message_body;
     GtkWidget *check_case_sensitive;
+    GtkWidget *check_normalize_text;
+    GtkWidget *audit_button;
+    GtkWidget *audit_label;
+    guint audit_timeout_id;     // обновление состояния проверки отправленных
 } UIData;
 
 // Колонки для TreeView
@@ -33,11 +44,8 @@ enum {
 };
 
 // Прототипы функций
-gchar** load_forbidden_words(GSettings *settings);
 void save_forbidden_words(GSettings *settings, gchar **words);
-gboolean check_text_for_forbidden_words(const gchar *text, gchar **forbidden_words, 
-                                         gboolean case_sensitive, gchar **found_word);
-gboolean check_attachment_names(EAttachmentStore *store, gchar **forbidden_words,
-                                  gboolean case_sensitive, gchar **found_name);
+// Режим автомата по настройкам: регистр и нормализация текста
+WordMatcherFlags attachment_checker_get_matcher_flags(GSettings *settings);
 
 #endif /* ATTACHMENT_CHECKER_H */
\ No newline at end of file
@@ -0,0 +1,1046 @@
+#include <string.h>
+
+#include <camel/camel.h>
+
+#include "attachment-cache.h"
+#include "attachment-scan.h"
+#include "markup-text.h"
+#include "scan-output-stream.h"
+#include "tar-reader.h"
+#include "zip-reader.h"
+
+#define ATTACHMENT_SCAN_CHUNK (64 * 1024)
+
+// Архивы: защита от архивных бомб и от архивов из множества мелких записей
+#define ARCHIVE_MAX_ENTRIES     10000
+#define ARCHIVE_MAX_RATIO       100
+#define ARCHIVE_RATIO_SLACK     (1024 * 1024)
+#define ARCHIVE_MAX_UNPACKED    (G_GUINT64_CONSTANT(1) << 30)
+// Записи ZIP проверяются параллельно, если текста в них не меньше этого
+#define ARCHIVE_PARALLEL_BYTES  (1024 * 1024)
+
+// Части документов, в которых лежит видимый текст
+static const gchar * const odf_parts[] = {
+    "content.xml",
+    "styles.xml",       // колонтитулы
+    "meta.xml",
+    NULL
+};
+
+static const gchar * const ooxml_parts[] = {
+    "word/document.xml",
+    "word/header*.xml",
+    "word/footer*.xml",
+    "word/footnotes.xml",
+    "word/endnotes.xml",
+    "word/comments.xml",
+    "xl/sharedStrings.xml",
+    "xl/worksheets/sheet*.xml",
+    "xl/comments*.xml",
+    "ppt/slides/slide*.xml",
+    "ppt/notesSlides/notesSlide*.xml",
+    "docProps/core.xml",
+    NULL
+};
+
+static const gchar * const text_extensions[] = {
+    "txt", "csv", "tsv", "log", "md", "ini", "conf", "json", "yaml", "yml", NULL
+};
+
+static const gchar * const markup_extensions[] = {
+    "html", "htm", "xhtml", "xml", "svg", NULL
+};
+
+static const gchar * const html_extensions[] = {
+    "html", "htm", "xhtml", NULL
+};
+
+static const gchar * const odf_extensions[] = {
+    "odt", "ods", "odp", "odg", "ott", "ots", "otp", NULL
+};
+
+static const gchar * const ooxml_extensions[] = {
+    "docx", "docm", "dotx", "xlsx", "xlsm", "xltx", "pptx", "pptm", "potx", NULL
+};
+
+static const gchar * const archive_extensions[] = {
+    "zip", "tar", "tgz", NULL
+};
+
+static const gchar * const archive_content_types[] = {
+    "application/zip", "application/x-zip-compressed", "application/x-tar",
+    "application/x-gtar", "application/x-compressed-tar", NULL
+};
+
+// Приёмник: текст вложения идёт в автомат, отмена проверяется на каждом блоке
+typedef struct {
+    GOutputStream *stream;
+    GCancellable *cancellable;
+    MarkupText markup;
+    guint64 consumed;       // байт из источника (до удаления разметки)
+    gboolean found;         // совпадение в записи архива, проверенной отдельно
+    guint word_index;
+} ScanSink;
+
+static gboolean
+scan_sink_write(const gchar *data, gsize len, gpointer user_data)
+{
+    ScanSink *sink = user_data;
+
+    return g_output_stream_write_all(sink->stream, data, len, NULL, sink->cancellable, NULL);
+}
+
+static gboolean
+scan_sink_text(const gchar *data, gsize len, gpointer user_data)
+{
+    ScanSink *sink = user_data;
+
+    sink->consumed += len;
+    return scan_sink_write(data, len, sink);
+}
+
+static gboolean
+scan_sink_markup(const gchar *data, gsize len, gpointer user_data)
+{
+    ScanSink *sink = user_data;
+
+    sink->consumed += len;
+    return markup_text_feed(&sink->markup, data, len);
+}
+
+static void
+scan_sink_init_markup(ScanSink *sink, gboolean html)
+{
+    if (html)
+        markup_text_init_html(&sink->markup, scan_sink_write, sink);
+    else
+        markup_text_init(&sink->markup, scan_sink_write, sink);
+}
+
+static gboolean
+extension_in(const gchar *extension, const gchar * const *list)
+{
+    for (guint i = 0; list[i]; i++) {
+        if (g_ascii_strcasecmp(extension, list[i]) == 0)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static gboolean
+name_has_extension(const gchar *name, const gchar * const *list)
+{
+    const gchar *extension = name ? strrchr(name, '.') : NULL;
+
+    return extension && extension_in(extension + 1, list);
+}
+
+static gboolean
+name_is_tar_gz(const gchar *name)
+{
+    gsize len = name ? strlen(name) : 0;
+
+    return len > 7 && g_ascii_strcasecmp(name + len - 7, ".tar.gz") == 0;
+}
+
+AttachmentKind
+attachment_kind_classify(const gchar *name, const gchar *content_type)
+{
+    const gchar *extension = name ? strrchr(name, '.') : NULL;
+
+    if (extension) {
+        extension++;
+
+        if (extension_in(extension, ooxml_extensions))
+            return ATTACHMENT_KIND_OOXML;
+        if (extension_in(extension, odf_extensions))
+            return ATTACHMENT_KIND_ODF;
+        if (extension_in(extension, archive_extensions) || name_is_tar_gz(name))
+            return ATTACHMENT_KIND_ARCHIVE;
+        if (extension_in(extension, markup_extensions))
+            return ATTACHMENT_KIND_MARKUP;
+        if (extension_in(extension, text_extensions))
+            return ATTACHMENT_KIND_TEXT;
+    }
+
+    if (!content_type)
+        return ATTACHMENT_KIND_NONE;
+
+    if (g_str_has_prefix(content_type, "application/vnd.openxmlformats-officedocument."))
+        return ATTACHMENT_KIND_OOXML;
+    if (g_str_has_prefix(content_type, "application/vnd.oasis.opendocument."))
+        return ATTACHMENT_KIND_ODF;
+    if (extension_in(content_type, archive_content_types))
+        return ATTACHMENT_KIND_ARCHIVE;
+    if (g_ascii_strcasecmp(content_type, "text/html") == 0 ||
+        g_ascii_strcasecmp(content_type, "text/xml") == 0 ||
+        g_ascii_strcasecmp(content_type, "application/xml") == 0)
+        return ATTACHMENT_KIND_MARKUP;
+    if (g_str_has_prefix(content_type, "text/"))
+        return ATTACHMENT_KIND_TEXT;
+
+    return ATTACHMENT_KIND_NONE;
+}
+
+AttachmentSource*
+attachment_source_new_for_file(GFile *file, const gchar *display_name,
+                               const gchar *content_type)
+{
+    AttachmentSource *source = g_new0(AttachmentSource, 1);
+
+    source->file = g_object_ref(file);
+    source->name = display_name ? g_strdup(display_name) : g_file_get_basename(file);
+    if (content_type)
+        source->content_type = g_content_type_get_mime_type(content_type);
+    source->kind = attachment_kind_classify(source->name, source->content_type);
+
+    return source;
+}
+
+AttachmentSource*
+attachment_source_new_for_mime_part(CamelMimePart *part)
+{
+    AttachmentSource *source = g_new0(AttachmentSource, 1);
+
+    source->mime_part = g_object_ref(part);
+    source->name = g_strdup(camel_mime_part_get_filename(part));
+    source->content_type = camel_content_type_simple(camel_mime_part_get_content_type(part));
+    source->kind = attachment_kind_classify(source->name, source->content_type);
+
+    return source;
+}
+
+void
+attachment_source_free(AttachmentSource *source)
+{
+    if (!source)
+        return;
+
+    g_free(source->name);
+    g_free(source->content_type);
+    g_clear_object(&source->file);
+    g_clear_object(&source->mime_part);
+    g_free(source);
+}
+
+// Декодированное содержимое вложения без файла. MIME-часть уже лежит
+// в памяти композера; копия даёт потоку произвольный доступ для ZIP
+// и служит ключом кэша.
+static GBytes*
+attachment_source_decode(AttachmentSource *source, GCancellable *cancellable, GError **error)
+{
+    GOutputStream *memory;
+    CamelDataWrapper *content;
+    GBytes *bytes;
+
+    content = source->mime_part ? camel_medium_get_content(CAMEL_MEDIUM(source->mime_part)) : NULL;
+    if (!content) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Attachment has no content");
+        return NULL;
+    }
+
+    memory = g_memory_output_stream_new_resizable();
+    if (camel_data_wrapper_decode_to_output_stream_sync(content, memory, cancellable, error) < 0 ||
+        !g_output_stream_close(memory, cancellable, error)) {
+        g_object_unref(memory);
+        return NULL;
+    }
+
+    bytes = g_memory_output_stream_steal_as_bytes(G_MEMORY_OUTPUT_STREAM(memory));
+    g_object_unref(memory);
+
+    return bytes;
+}
+
+// Разметку HTML разбираем как HTML: без скриптов, стилей и атрибутов
+static gboolean
+attachment_source_is_html(const AttachmentSource *source)
+{
+    if (name_has_extension(source->name, html_extensions))
+        return TRUE;
+
+    return source->content_type && g_ascii_strcasecmp(source->content_type, "text/html") == 0;
+}
+
+// Текст и разметка читаются последовательно, не больше max_bytes
+static gboolean
+scan_plain_stream(GInputStream *input, ScanSink *sink, gboolean markup, gboolean html,
+                  guint64 max_bytes, GError **error)
+{
+    gchar *buffer = g_malloc(ATTACHMENT_SCAN_CHUNK);
+    gboolean ok = TRUE;
+
+    if (markup)
+        scan_sink_init_markup(sink, html);
+
+    while (sink->consumed < max_bytes) {
+        gsize want = (gsize)MIN(max_bytes - sink->consumed, ATTACHMENT_SCAN_CHUNK);
+        gssize n_read = g_input_stream_read(input, buffer, want, sink->cancellable, error);
+
+        if (n_read <= 0) {
+            ok = n_read == 0;
+            break;
+        }
+
+        if (!(markup ? scan_sink_markup : scan_sink_text)(buffer, n_read, sink))
+            break;
+    }
+
+    if (markup)
+        markup_text_finish(&sink->markup);
+
+    g_free(buffer);
+    return ok;
+}
+
+static gboolean
+zip_part_wanted(const gchar *name, const gchar * const *parts)
+{
+    for (guint i = 0; parts[i]; i++) {
+        if (g_pattern_match_simple(parts[i], name))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+// Документ ODF/OOXML: текстовые XML-части распаковываются прямо в разборщик
+static gboolean
+scan_zip_stream(GInputStream *input, ScanSink *sink, const gchar * const *parts,
+                guint64 max_bytes, GError **error)
+{
+    ZipReader *zip = zip_reader_new(input, sink->cancellable, error);
+    gboolean ok = TRUE;
+
+    if (!zip)
+        return FALSE;
+
+    for (guint i = 0; i < zip_reader_get_n_entries(zip) && sink->consumed < max_bytes; i++) {
+        if (!zip_part_wanted(zip_reader_get_name(zip, i), parts))
+            continue;
+
+        markup_text_init(&sink->markup, scan_sink_write, sink);
+        ok = zip_reader_extract(zip, i, max_bytes - sink->consumed, scan_sink_markup, sink,
+                                sink->cancellable, error);
+        if (!ok || !markup_text_finish(&sink->markup))
+            break;
+
+        // Части разделяются, чтобы слово не собралось из двух файлов
+        if (!scan_sink_write("\n", 1, sink))
+            break;
+    }
+
+    zip_reader_free(zip);
+    return ok;
+}
+
+static void
+attachment_scan_cancelled(GCancellable *cancellable, gpointer user_data)
+{
+    g_cancellable_cancel(G_CANCELLABLE(user_data));
+    (void)cancellable;
+}
+
+// Записи архива, содержимое которых проверяется: текст и разметка.
+// Вложенные документы и архивы требуют распаковки целиком и пропускаются.
+static AttachmentKind
+archive_entry_kind(const gchar *name)
+{
+    AttachmentKind kind = attachment_kind_classify(name, NULL);
+
+    return (kind == ATTACHMENT_KIND_TEXT || kind == ATTACHMENT_KIND_MARKUP) ?
+           kind : ATTACHMENT_KIND_NONE;
+}
+
+// Формат архива - по первым байтам, а не по имени: ZIP или tar (*gzip - tar.gz)
+static gboolean
+archive_detect(GInputStream *input, gboolean *zip, gboolean *gzip,
+               GCancellable *cancellable, GError **error)
+{
+    guchar magic[4] = { 0 };
+    gsize n_read = 0;
+
+    if (!g_input_stream_read_all(input, magic, sizeof(magic), &n_read, cancellable, error) ||
+        !g_seekable_seek(G_SEEKABLE(input), 0, G_SEEK_SET, cancellable, error))
+        return FALSE;
+
+    *zip = n_read == sizeof(magic) && magic[0] == 'P' && magic[1] == 'K';
+    *gzip = n_read >= 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+
+    return TRUE;
+}
+
+// tar и tar.gz читаются одним проходом, текстовые записи - по порядку
+static gboolean
+scan_tar_archive(GInputStream *input, ScanSink *sink, gboolean gzip,
+                 guint64 max_bytes, GError **error)
+{
+    TarReader *tar = tar_reader_new(input, gzip);
+    GError *local_error = NULL;
+    guint n_entries = 0;
+    gboolean ok = TRUE;
+
+    tar_reader_set_limits(tar, ARCHIVE_MAX_UNPACKED, ARCHIVE_MAX_RATIO);
+
+    while (n_entries++ < ARCHIVE_MAX_ENTRIES && sink->consumed < max_bytes &&
+           tar_reader_next(tar, sink->cancellable, &local_error)) {
+        const gchar *name = tar_reader_get_name(tar);
+        AttachmentKind kind = archive_entry_kind(name);
+
+        if (kind == ATTACHMENT_KIND_MARKUP) {
+            scan_sink_init_markup(sink, name_has_extension(name, html_extensions));
+            ok = tar_reader_extract(tar, max_bytes - sink->consumed, scan_sink_markup, sink,
+                                    sink->cancellable, error);
+            if (!ok || !markup_text_finish(&sink->markup))
+                break;
+        } else if (kind == ATTACHMENT_KIND_TEXT) {
+            ok = tar_reader_extract(tar, max_bytes - sink->consumed, scan_sink_text, sink,
+                                    sink->cancellable, error);
+            if (!ok)
+                break;
+        } else {
+            continue;
+        }
+
+        // Записи разделяются, чтобы слово не собралось из двух файлов
+        if (!scan_sink_write("\n", 1, sink))
+            break;
+    }
+
+    if (local_error) {
+        g_propagate_error(error, local_error);
+        ok = FALSE;
+    }
+
+    tar_reader_free(tar);
+    return ok;
+}
+
+// Запись ZIP, проверяемая своим автоматом
+typedef struct {
+    guint index;
+    AttachmentKind kind;
+    gboolean found;
+    guint word_index;
+    guint64 scanned;
+    WordMatches *matches;   // при сборе - свои у каждой записи
+    GError *error;          // запись проверена не целиком
+} ArchiveEntry;
+
+// Общее состояние проверки записей одного ZIP-архива
+typedef struct {
+    ZipReader *zip;
+    GFile *file;            // откуда открыть свой поток для параллельного чтения
+    GBytes *bytes;
+    const WordMatcher *matcher;
+    WordMatches *matches;   // общий список; задаёт место совпадений
+    GArray *entries;        // ArchiveEntry
+    gssize budget;          // остаток текста на весь архив (атомарно)
+    GCancellable *stop;
+} ArchiveJob;
+
+static void
+archive_scan_entry(ArchiveJob *job, ArchiveEntry *entry, ZipReader *zip)
+{
+    const gchar *name = zip_reader_get_name(zip, entry->index);
+    // Распакованное - не больше, чем допускает отношение к сжатому
+    guint64 limit = zip_reader_get_compressed_size(zip, entry->index) * ARCHIVE_MAX_RATIO +
+                    ARCHIVE_RATIO_SLACK;
+    ScanSink sink = { 0 };
+    GError *error = NULL;
+
+    if (g_cancellable_is_cancelled(job->stop))
+        return;
+
+    sink.stream = scan_output_stream_new(job->matcher);
+    sink.cancellable = job->stop;
+    scan_output_stream_set_budget(SCAN_OUTPUT_STREAM(sink.stream), &job->budget);
+    if (job->matches) {
+        WordMatchPlace place;
+        guint source;
+
+        word_matches_get_place(job->matches, &place, &source);
+        entry->matches = word_matches_new_in(word_matches_get_arena(job->matches));
+        word_matches_set_place(entry->matches, place, source);
+        scan_output_stream_set_matches(SCAN_OUTPUT_STREAM(sink.stream), entry->matches);
+    }
+
+    if (entry->kind == ATTACHMENT_KIND_MARKUP) {
+        scan_sink_init_markup(&sink, name_has_extension(name, html_extensions));
+        if (zip_reader_extract(zip, entry->index, limit, scan_sink_markup, &sink,
+                               job->stop, &error))
+            markup_text_finish(&sink.markup);
+    } else {
+        zip_reader_extract(zip, entry->index, limit, scan_sink_text, &sink, job->stop, &error);
+    }
+
+    if (error && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_debug("Archive entry '%s' not scanned: %s", name, error->message);
+        entry->error = error;
+        error = NULL;
+    }
+    g_clear_error(&error);
+
+    g_output_stream_close(sink.stream, NULL, NULL);
+    entry->found = scan_output_stream_get_match(SCAN_OUTPUT_STREAM(sink.stream),
+                                                &entry->word_index);
+    entry->scanned = scan_output_stream_get_bytes_scanned(SCAN_OUTPUT_STREAM(sink.stream));
+
+    if (entry->found)
+        g_cancellable_cancel(job->stop);
+
+    g_object_unref(sink.stream);
+}
+
+static void
+archive_scan_worker(gpointer data, gpointer user_data)
+{
+    ArchiveJob *job = user_data;
+    ArchiveEntry *entry = &g_array_index(job->entries, ArchiveEntry, GPOINTER_TO_UINT(data) - 1);
+    GInputStream *input;
+    GError *error = NULL;
+    ZipReader *zip;
+
+    if (g_cancellable_is_cancelled(job->stop))
+        return;
+
+    // Свой поток у каждой записи: чтение ZIP переставляет позицию в потоке
+    if (job->bytes)
+        input = g_memory_input_stream_new_from_bytes(job->bytes);
+    else
+        input = G_INPUT_STREAM(g_file_read(job->file, job->stop, &error));
+    if (!input) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            entry->error = g_steal_pointer(&error);
+        g_clear_error(&error);
+        return;
+    }
+
+    zip = zip_reader_clone(job->zip, input);
+    archive_scan_entry(job, entry, zip);
+    zip_reader_free(zip);
+    g_object_unref(input);
+}
+
+// ZIP: текстовые записи выбираются по оглавлению; у большого архива
+// они распаковываются параллельно. Как и для tar, запись, проверенная не
+// целиком (обрезана, не распаковывается, подозрительно сжата), делает
+// проверку архива неполной: без совпадений - ошибка, и архив не попадает
+// в кэш чистым.
+static gboolean
+scan_zip_archive(GInputStream *input, ScanSink *sink, GFile *file, GBytes *bytes,
+                 const WordMatcher *matcher, WordMatches *matches,
+                 guint64 max_bytes, GError **error)
+{
+    ZipReader *zip = zip_reader_new(input, sink->cancellable, error);
+    ArchiveJob job = { 0 };
+    gulong handler_id = 0;
+    guint64 unpacked = 0;
+    guint64 base = 0;
+    GError *entry_error = NULL;
+    guint n_entries;
+
+    if (!zip)
+        return FALSE;
+
+    job.entries = g_array_new(FALSE, TRUE, sizeof(ArchiveEntry));
+    n_entries = MIN(zip_reader_get_n_entries(zip), ARCHIVE_MAX_ENTRIES);
+
+    for (guint i = 0; i < n_entries; i++) {
+        const gchar *name = zip_reader_get_name(zip, i);
+        ArchiveEntry entry = { 0 };
+
+        entry.index = i;
+        entry.kind = archive_entry_kind(name);
+        if (entry.kind == ATTACHMENT_KIND_NONE)
+            continue;
+
+        // Бомба видна по оглавлению ещё до распаковки
+        if (zip_reader_get_size(zip, i) > zip_reader_get_compressed_size(zip, i) *
+                                          ARCHIVE_MAX_RATIO + ARCHIVE_RATIO_SLACK) {
+            g_debug("Archive entry '%s' skipped: compression ratio is too high", name);
+            if (!entry_error)
+                g_set_error(&entry_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                            "Archive entry '%s' skipped: compression ratio is too high", name);
+            continue;
+        }
+
+        unpacked += zip_reader_get_size(zip, i);
+        g_array_append_val(job.entries, entry);
+    }
+
+    job.zip = zip;
+    job.file = file;
+    job.bytes = bytes;
+    job.matcher = matcher;
+    job.matches = matches;
+    job.budget = (gssize)MIN(max_bytes, (guint64)G_MAXSSIZE);
+    job.stop = g_cancellable_new();
+
+    if (sink->cancellable)
+        handler_id = g_cancellable_connect(sink->cancellable,
+                                           G_CALLBACK(attachment_scan_cancelled),
+                                           g_object_ref(job.stop), g_object_unref);
+
+    if (job.entries->len > 1 && unpacked >= ARCHIVE_PARALLEL_BYTES && (file || bytes)) {
+        GThreadPool *pool = g_thread_pool_new(archive_scan_worker, &job,
+                                              (gint)MIN(job.entries->len,
+                                                        g_get_num_processors()),
+                                              FALSE, NULL);
+
+        for (guint i = 0; i < job.entries->len; i++)
+            g_thread_pool_push(pool, GUINT_TO_POINTER(i + 1), NULL);
+        g_thread_pool_free(pool, FALSE, TRUE);
+    } else {
+        for (guint i = 0; i < job.entries->len; i++)
+            archive_scan_entry(&job, &g_array_index(job.entries, ArchiveEntry, i), zip);
+    }
+
+    if (handler_id)
+        g_cancellable_disconnect(sink->cancellable, handler_id);
+
+    // Результаты в порядке записей; смещения - как если бы записи шли
+    // одним текстом через перевод строки
+    for (guint i = 0; i < job.entries->len; i++) {
+        ArchiveEntry *entry = &g_array_index(job.entries, ArchiveEntry, i);
+
+        if (entry->matches) {
+            word_matches_append_at(matches, entry->matches, base);
+            word_matches_free(entry->matches);
+        }
+        if (entry->found && !sink->found) {
+            sink->found = TRUE;
+            sink->word_index = entry->word_index;
+        }
+
+        base += entry->scanned + 1;
+        sink->consumed += entry->scanned;
+
+        if (entry->error && !entry_error)
+            entry_error = g_steal_pointer(&entry->error);
+        g_clear_error(&entry->error);
+    }
+
+    g_object_unref(job.stop);
+    g_array_unref(job.entries);
+    zip_reader_free(zip);
+
+    if (entry_error) {
+        g_propagate_error(error, entry_error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+scan_archive_stream(GInputStream *input, ScanSink *sink, GFile *file, GBytes *bytes,
+                    const WordMatcher *matcher, WordMatches *matches,
+                    guint64 max_bytes, GError **error)
+{
+    gboolean zip, gzip;
+
+    if (!archive_detect(input, &zip, &gzip, sink->cancellable, error))
+        return FALSE;
+
+    if (zip)
+        return scan_zip_archive(input, sink, file, bytes, matcher, matches, max_bytes, error);
+
+    return scan_tar_archive(input, sink, gzip, max_bytes, error);
+}
+
+// Без matches - до первого совпадения (слово в *word_index), с matches -
+// все совпадения. Кэш хранит только первое слово, поэтому при сборе из него
+// берутся лишь чистые вложения.
+static gboolean
+attachment_scan_source_real(AttachmentSource *source, const WordMatcher *matcher,
+                            guint64 max_bytes, GCancellable *cancellable,
+                            WordMatches *matches, guint *word_index, GError **error)
+{
+    AttachmentCacheKey key;
+    guint n_stored = word_matches_get_n_stored(matches);
+    guint total = word_matches_get_total(matches);
+    guint first_word = WORD_MATCHER_NONE;
+    gboolean have_key;
+    guint cached_word = WORD_MATCHER_NONE;
+    GBytes *bytes = NULL;
+    GInputStream *input;
+    ScanSink sink = { 0 };
+    GError *local_error = NULL;
+    gboolean complete = FALSE;
+    gboolean found;
+
+    if (source->kind == ATTACHMENT_KIND_NONE)
+        return FALSE;
+
+    if (!max_bytes)
+        max_bytes = ATTACHMENT_SCAN_DEFAULT_MAX_BYTES;
+
+    // Файл опознаётся по stat, без открытия; вложение без файла - по содержимому
+    if (source->file) {
+        have_key = attachment_cache_key_for_file(&key, source->file, cancellable);
+    } else {
+        bytes = attachment_source_decode(source, cancellable, error);
+        if (!bytes)
+            return FALSE;
+        attachment_cache_key_for_bytes(&key, bytes);
+        have_key = TRUE;
+    }
+
+    if (have_key && attachment_cache_lookup(&key, word_matcher_get_version(matcher),
+                                            max_bytes, &cached_word) &&
+        (!matches || cached_word == WORD_MATCHER_NONE)) {
+        if (bytes)
+            g_bytes_unref(bytes);
+        if (cached_word == WORD_MATCHER_NONE)
+            return FALSE;
+        if (word_index)
+            *word_index = cached_word;
+        return TRUE;
+    }
+
+    // Байты нужны и дальше: записи ZIP читаются параллельно своими потоками
+    if (bytes) {
+        input = g_memory_input_stream_new_from_bytes(bytes);
+    } else {
+        input = G_INPUT_STREAM(g_file_read(source->file, cancellable, error));
+        if (!input)
+            return FALSE;
+    }
+
+    sink.stream = scan_output_stream_new(matcher);
+    sink.cancellable = cancellable;
+    scan_output_stream_set_matches(SCAN_OUTPUT_STREAM(sink.stream), matches);
+
+    switch (source->kind) {
+    case ATTACHMENT_KIND_TEXT:
+        complete = scan_plain_stream(input, &sink, FALSE, FALSE, max_bytes, &local_error);
+        break;
+    case ATTACHMENT_KIND_MARKUP:
+        complete = scan_plain_stream(input, &sink, TRUE, attachment_source_is_html(source),
+                                     max_bytes, &local_error);
+        break;
+    case ATTACHMENT_KIND_ODF:
+        complete = scan_zip_stream(input, &sink, odf_parts, max_bytes, &local_error);
+        break;
+    case ATTACHMENT_KIND_OOXML:
+        complete = scan_zip_stream(input, &sink, ooxml_parts, max_bytes, &local_error);
+        break;
+    case ATTACHMENT_KIND_ARCHIVE:
+        complete = scan_archive_stream(input, &sink, source->file, bytes, matcher, matches,
+                                       max_bytes, &local_error);
+        break;
+    case ATTACHMENT_KIND_NONE:
+        break;
+    }
+
+    g_output_stream_close(sink.stream, NULL, NULL);
+
+    if (matches) {
+        found = word_matches_get_total(matches) > total;
+        if (found && word_matches_get_n_stored(matches) > n_stored)
+            first_word = word_matches_get(matches, n_stored)->word_index;
+    } else {
+        found = scan_output_stream_get_match(SCAN_OUTPUT_STREAM(sink.stream), &first_word);
+        if (!found && sink.found) {
+            found = TRUE;
+            first_word = sink.word_index;
+        }
+        if (found && word_index)
+            *word_index = first_word;
+    }
+
+    if (found) {
+        g_clear_error(&local_error);
+        if (have_key && first_word != WORD_MATCHER_NONE)
+            attachment_cache_store(&key, word_matcher_get_version(matcher), max_bytes, first_word);
+    } else if (g_cancellable_is_cancelled(cancellable)) {
+        // Прерванная проверка ничего не доказывает и в кэш не попадает
+        g_clear_error(&local_error);
+        g_cancellable_set_error_if_cancelled(cancellable, error);
+    } else if (local_error) {
+        g_propagate_error(error, local_error);
+    } else if (complete && have_key) {
+        attachment_cache_store(&key, word_matcher_get_version(matcher), max_bytes,
+                               WORD_MATCHER_NONE);
+    }
+
+    g_object_unref(sink.stream);
+    g_object_unref(input);
+    if (bytes)
+        g_bytes_unref(bytes);
+
+    return found;
+}
+
+gboolean
+attachment_scan_source(AttachmentSource *source, const WordMatcher *matcher,
+                       guint64 max_bytes, GCancellable *cancellable,
+                       guint *word_index, GError **error)
+{
+    return attachment_scan_source_real(source, matcher, max_bytes, cancellable, NULL,
+                                       word_index, error);
+}
+
+gboolean
+attachment_scan_source_collect(AttachmentSource *source, const WordMatcher *matcher,
+                               guint64 max_bytes, GCancellable *cancellable,
+                               WordMatches *matches, guint source_index, GError **error)
+{
+    word_matches_set_place(matches, WORD_MATCH_ATTACHMENT, source_index);
+    return attachment_scan_source_real(source, matcher, max_bytes, cancellable, matches,
+                                       NULL, error);
+}
+
+// Проверка имён записей архива: со сбором - все совпадения, без - до первого
+typedef struct {
+    const WordMatcher *matcher;
+    WordMatches *matches;
+    gboolean found;
+    guint word_index;
+} ArchiveNames;
+
+static gboolean
+archive_check_name(ArchiveNames *names, const gchar *name)
+{
+    if (names->matches) {
+        if (word_matcher_search_all(names->matcher, name, -1, word_matches_collect,
+                                    names->matches) > 0)
+            names->found = TRUE;
+        return TRUE;
+    }
+
+    names->found = word_matcher_search(names->matcher, name, -1, &names->word_index);
+    return !names->found;
+}
+
+gboolean
+attachment_scan_archive_names(AttachmentSource *source, const WordMatcher *matcher,
+                              GCancellable *cancellable, WordMatches *matches,
+                              guint source_index, guint *word_index)
+{
+    ArchiveNames names = { matcher, matches, FALSE, WORD_MATCHER_NONE };
+    GInputStream *input;
+    GError *error = NULL;
+    gboolean zip, gzip;
+
+    if (source->kind != ATTACHMENT_KIND_ARCHIVE || word_matcher_get_n_words(matcher) == 0)
+        return FALSE;
+
+    if (source->file) {
+        input = G_INPUT_STREAM(g_file_read(source->file, cancellable, &error));
+    } else {
+        GBytes *bytes = attachment_source_decode(source, cancellable, &error);
+
+        input = bytes ? g_memory_input_stream_new_from_bytes(bytes) : NULL;
+        if (bytes)
+            g_bytes_unref(bytes);
+    }
+
+    if (matches)
+        word_matches_set_place(matches, WORD_MATCH_ATTACHMENT_NAME, source_index);
+
+    if (input && archive_detect(input, &zip, &gzip, cancellable, &error)) {
+        if (zip) {
+            // У ZIP имена - в оглавлении, содержимое не читается
+            ZipReader *reader = zip_reader_new(input, cancellable, &error);
+            guint n_entries = reader ? MIN(zip_reader_get_n_entries(reader),
+                                           ARCHIVE_MAX_ENTRIES) : 0;
+
+            for (guint i = 0; i < n_entries; i++) {
+                if (!archive_check_name(&names, zip_reader_get_name(reader, i)))
+                    break;
+            }
+            zip_reader_free(reader);
+        } else {
+            // У tar заголовки идут вперемешку с содержимым, оно пропускается
+            TarReader *reader = tar_reader_new(input, gzip);
+            guint n_entries = 0;
+
+            tar_reader_set_limits(reader, ARCHIVE_MAX_UNPACKED, ARCHIVE_MAX_RATIO);
+            while (n_entries++ < ARCHIVE_MAX_ENTRIES &&
+                   tar_reader_next(reader, cancellable, &error)) {
+                if (!archive_check_name(&names, tar_reader_get_name(reader)))
+                    break;
+            }
+            tar_reader_free(reader);
+        }
+    }
+
+    if (error && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_debug("Archive '%s' not listed: %s",
+                source->name ? source->name : "unknown", error->message);
+    }
+
+    g_clear_error(&error);
+    g_clear_object(&input);
+
+    if (names.found && word_index && !matches)
+        *word_index = names.word_index;
+
+    return names.found;
+}
+
+// Общее состояние параллельной проверки
+typedef struct {
+    GPtrArray *sources;
+    const WordMatcher *matcher;
+    guint64 max_bytes;
+    GCancellable *stop;         // отменяется пользователем или первым совпадением
+    gboolean *found;
+    guint *word_indexes;
+    WordMatches **matches;      // при сборе - свои у каждого вложения
+    ScanArena *arena;           // при сборе - область памяти общего списка
+} ScanJob;
+
+static void
+attachment_scan_worker(gpointer data, gpointer user_data)
+{
+    ScanJob *job = user_data;
+    guint index = GPOINTER_TO_UINT(data) - 1;
+    AttachmentSource *source = g_ptr_array_index(job->sources, index);
+    GError *error = NULL;
+
+    if (g_cancellable_is_cancelled(job->stop))
+        return;
+
+    if (job->matches) {
+        job->matches[index] = word_matches_new_in(job->arena);
+        job->found[index] = attachment_scan_source_collect(source, job->matcher, job->max_bytes,
+                                                           job->stop, job->matches[index],
+                                                           index, &error);
+    } else if (attachment_scan_source(source, job->matcher, job->max_bytes, job->stop,
+                                      &job->word_indexes[index], &error)) {
+        job->found[index] = TRUE;
+        g_cancellable_cancel(job->stop);
+    }
+
+    if (error && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_debug("Attachment '%s' not scanned: %s",
+                source->name ? source->name : "unknown", error->message);
+    }
+
+    g_clear_error(&error);
+}
+
+static void
+attachment_scan_run(ScanJob *job, GCancellable *cancellable)
+{
+    GPtrArray *sources = job->sources;
+    GThreadPool *pool;
+    gulong handler_id = 0;
+    guint n_jobs = 0;
+
+    job->stop = g_cancellable_new();
+    if (job->arena) {
+        job->found = scan_arena_alloc0(job->arena, sources->len * sizeof(gboolean));
+        job->word_indexes = scan_arena_alloc0(job->arena, sources->len * sizeof(guint));
+    } else {
+        job->found = g_new0(gboolean, sources->len);
+        job->word_indexes = g_new0(guint, sources->len);
+    }
+
+    if (cancellable)
+        handler_id = g_cancellable_connect(cancellable, G_CALLBACK(attachment_scan_cancelled),
+                                           g_object_ref(job->stop), g_object_unref);
+
+    for (guint i = 0; i < sources->len; i++) {
+        if (((AttachmentSource *)g_ptr_array_index(sources, i))->kind != ATTACHMENT_KIND_NONE)
+            n_jobs++;
+    }
+
+    // Вложения раскладываются по ядрам; одно вложение проверяется на месте
+    if (n_jobs == 1) {
+        for (guint i = 0; i < sources->len; i++)
+            attachment_scan_worker(GUINT_TO_POINTER(i + 1), job);
+    } else if (n_jobs > 1) {
+        pool = g_thread_pool_new(attachment_scan_worker, job,
+                                 (gint)MIN(n_jobs, g_get_num_processors()), FALSE, NULL);
+        for (guint i = 0; i < sources->len; i++) {
+            if (((AttachmentSource *)g_ptr_array_index(sources, i))->kind != ATTACHMENT_KIND_NONE)
+                g_thread_pool_push(pool, GUINT_TO_POINTER(i + 1), NULL);
+        }
+        // Дожидаемся всех задач; после совпадения оставшиеся выходят сразу
+        g_thread_pool_free(pool, FALSE, TRUE);
+    }
+
+    if (handler_id)
+        g_cancellable_disconnect(cancellable, handler_id);
+}
+
+static void
+attachment_scan_job_clear(ScanJob *job)
+{
+    if (!job->arena) {
+        g_free(job->found);
+        g_free(job->word_indexes);
+    }
+    g_object_unref(job->stop);
+}
+
+gboolean
+attachment_scan_all(GPtrArray *sources, const WordMatcher *matcher,
+                    guint64 max_bytes, GCancellable *cancellable,
+                    guint *source_index, guint *word_index)
+{
+    ScanJob job = { 0 };
+    gboolean found = FALSE;
+
+    if (!sources || sources->len == 0)
+        return FALSE;
+
+    job.sources = sources;
+    job.matcher = matcher;
+    job.max_bytes = max_bytes;
+    attachment_scan_run(&job, cancellable);
+
+    for (guint i = 0; i < sources->len && !found; i++) {
+        if (job.found[i]) {
+            if (source_index)
+                *source_index = i;
+            if (word_index)
+                *word_index = job.word_indexes[i];
+            found = TRUE;
+        }
+    }
+
+    attachment_scan_job_clear(&job);
+
+    return found;
+}
+
+gboolean
+attachment_scan_all_collect(GPtrArray *sources, const WordMatcher *matcher,
+                            guint64 max_bytes, GCancellable *cancellable,
+                            WordMatches *matches)
+{
+    ScanJob job = { 0 };
+    gboolean found = FALSE;
+
+    if (!sources || sources->len == 0)
+        return FALSE;
+
+    job.sources = sources;
+    job.matcher = matcher;
+    job.max_bytes = max_bytes;
+    job.arena = word_matches_get_arena(matches);
+    job.matches = job.arena ? scan_arena_alloc0(job.arena, sources->len * sizeof(WordMatches *)) :
+                              g_new0(WordMatches *, sources->len);
+    attachment_scan_run(&job, cancellable);
+
+    // Потоки собирали каждый своё; общий список - в порядке вложений
+    for (guint i = 0; i < sources->len; i++) {
+        if (job.matches[i]) {
+            word_matches_append(matches, job.matches[i]);
+            word_matches_free(job.matches[i]);
+        }
+        found |= job.found[i];
+    }
+
+    if (!job.arena)
+        g_free(job.matches);
+    attachment_scan_job_clear(&job);
+
+    return found;
+}
@@ -0,0 +1,78 @@
+#ifndef ATTACHMENT_SCAN_H
+#define ATTACHMENT_SCAN_H
+
+#include <gio/gio.h>
+#include <camel/camel.h>
+
+#include "word-matcher.h"
+#include "word-matches.h"
+
+// Проверка содержимого вложений: простой текст и CSV читаются потоком,
+// у документов ODF и OOXML текстовые XML-части распаковываются из ZIP
+// прямо в автомат. У архивов ZIP, tar и tar.gz проверяется содержимое
+// текстовых записей, тоже без распаковки на диск. Вложения проверяются
+// параллельно пулом потоков.
+
+// Ограничение по умолчанию на объём текста одного вложения
+#define ATTACHMENT_SCAN_DEFAULT_MAX_BYTES (16 * 1024 * 1024)
+
+typedef enum {
+    ATTACHMENT_KIND_NONE,       // содержимое не проверяется
+    ATTACHMENT_KIND_TEXT,       // text/plain, CSV и прочий текст
+    ATTACHMENT_KIND_MARKUP,     // HTML, XML - текст без тегов
+    ATTACHMENT_KIND_ODF,        // .odt, .ods, .odp
+    ATTACHMENT_KIND_OOXML,      // .docx, .xlsx, .pptx
+    ATTACHMENT_KIND_ARCHIVE     // .zip, .tar, .tar.gz - текстовые записи
+} AttachmentKind;
+
+// Вложение, подготовленное в главном потоке: файл на диске или MIME-часть
+// (у пересылаемых писем файла нет)
+typedef struct {
+    gchar *name;
+    gchar *content_type;
+    AttachmentKind kind;
+    GFile *file;
+    CamelMimePart *mime_part;
+} AttachmentSource;
+
+// display_name и content_type могут быть NULL
+AttachmentSource* attachment_source_new_for_file(GFile *file, const gchar *display_name,
+                                                 const gchar *content_type);
+AttachmentSource* attachment_source_new_for_mime_part(CamelMimePart *part);
+void attachment_source_free(AttachmentSource *source);
+
+AttachmentKind attachment_kind_classify(const gchar *name, const gchar *content_type);
+
+// Проверка одного вложения в текущем потоке. Объём проверяемого текста
+// ограничен max_bytes; остальное не читается.
+gboolean attachment_scan_source(AttachmentSource *source, const WordMatcher *matcher,
+                                guint64 max_bytes, GCancellable *cancellable,
+                                guint *word_index, GError **error);
+// То же со сбором всех совпадений: они дописываются в matches как
+// WORD_MATCH_ATTACHMENT с номером вложения source_index
+gboolean attachment_scan_source_collect(AttachmentSource *source, const WordMatcher *matcher,
+                                        guint64 max_bytes, GCancellable *cancellable,
+                                        WordMatches *matches, guint source_index,
+                                        GError **error);
+
+// Имена файлов внутри архива (ATTACHMENT_KIND_ARCHIVE): у ZIP читается
+// только оглавление, у tar - заголовки записей. С matches - все совпадения
+// как WORD_MATCH_ATTACHMENT_NAME с номером вложения source_index, без -
+// до первого совпадения (слово в *word_index).
+gboolean attachment_scan_archive_names(AttachmentSource *source, const WordMatcher *matcher,
+                                       GCancellable *cancellable, WordMatches *matches,
+                                       guint source_index, guint *word_index);
+
+// Параллельная проверка всех вложений. После первого совпадения остальные
+// задачи отменяются. Возвращает TRUE и номер вложения (первого по порядку
+// среди найденных) и слова.
+gboolean attachment_scan_all(GPtrArray *sources, const WordMatcher *matcher,
+                             guint64 max_bytes, GCancellable *cancellable,
+                             guint *source_index, guint *word_index);
+// Параллельная проверка всех вложений до конца, со всеми совпадениями
+// в порядке вложений
+gboolean attachment_scan_all_collect(GPtrArray *sources, const WordMatcher *matcher,
+                                     guint64 max_bytes, GCancellable *cancellable,
+                                     WordMatches *matches);
+
+#endif /* ATTACHMENT_SCAN_H */
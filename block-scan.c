@@ -0,0 +1,218 @@
+#include <string.h>
+
+#include "block-scan.h"
+#include "fast-hash.h"
+
+// Блок закрывается на конце строки, если он не короче минимума и хвост
+// строки "выпал" по хэшу (в среднем раз в 8 строк), либо если он длиннее
+// максимума. Одна длинная строка остаётся одним блоком.
+#define BLOCK_MIN_SIZE 1024
+#define BLOCK_MAX_SIZE (16 * 1024)
+#define BLOCK_BOUNDARY_MASK 7
+#define BLOCK_BOUNDARY_TAIL 16
+
+// Черновик редко бывает больше нескольких тысяч блоков; при переполнении
+// (долгая правка большого письма) кэш начинается заново
+#define BLOCK_CACHE_MAX_ENTRIES (256 * 1024)
+
+struct _BlockScanCache {
+    gint ref_count;
+    GMutex lock;
+    guint64 dictionary_version;
+    GHashTable *blocks;     // хэш блока (guint64*) -> GArray BlockMatch или NULL
+};
+
+// Совпадение в блоке; смещение конца - от начала блока
+typedef struct {
+    guint32 word_index;
+    guint32 end;
+} BlockMatch;
+
+static void
+block_matches_free(gpointer data)
+{
+    if (data)
+        g_array_unref(data);
+}
+
+BlockScanCache*
+block_scan_cache_new(void)
+{
+    BlockScanCache *cache = g_new0(BlockScanCache, 1);
+
+    cache->ref_count = 1;
+    g_mutex_init(&cache->lock);
+    cache->blocks = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free,
+                                          block_matches_free);
+
+    return cache;
+}
+
+BlockScanCache*
+block_scan_cache_ref(BlockScanCache *cache)
+{
+    g_return_val_if_fail(cache != NULL, NULL);
+
+    g_atomic_int_inc(&cache->ref_count);
+    return cache;
+}
+
+void
+block_scan_cache_unref(BlockScanCache *cache)
+{
+    if (!cache || !g_atomic_int_dec_and_test(&cache->ref_count))
+        return;
+
+    g_hash_table_unref(cache->blocks);
+    g_mutex_clear(&cache->lock);
+    g_free(cache);
+}
+
+static gsize
+block_scan_next_boundary(const gchar *text, gsize len)
+{
+    gsize pos = 0;
+
+    while (pos < len) {
+        const gchar *nl = memchr(text + pos, '\n', len - pos);
+        gsize line_end = nl ? (gsize)(nl - text) + 1 : len;
+        gsize tail = MIN(line_end, BLOCK_BOUNDARY_TAIL);
+
+        pos = line_end;
+
+        if (pos >= BLOCK_MAX_SIZE)
+            break;
+        if (pos >= BLOCK_MIN_SIZE &&
+            (fast_hash64((const guint8 *)text + line_end - tail, tail) & BLOCK_BOUNDARY_MASK) == 0)
+            break;
+    }
+
+    return pos;
+}
+
+// Совпадения блока, начинающегося с pos: в matches (если задан) и первое
+// слово в *first (WORD_MATCHER_NONE, если блок чистый)
+static void
+block_matches_report(GArray *block, gsize pos, WordMatches *matches, guint *first)
+{
+    *first = block ? g_array_index(block, BlockMatch, 0).word_index : WORD_MATCHER_NONE;
+
+    for (guint i = 0; matches && block && i < block->len; i++) {
+        const BlockMatch *match = &g_array_index(block, BlockMatch, i);
+
+        word_matches_collect(match->word_index, pos + match->end, matches);
+    }
+}
+
+// Записи могут удаляться другим потоком, поэтому результат разбирается под замком
+static gboolean
+block_scan_lookup(BlockScanCache *cache, guint64 hash, gsize pos, WordMatches *matches,
+                  guint *first)
+{
+    gpointer value;
+    gboolean hit;
+
+    g_mutex_lock(&cache->lock);
+    hit = g_hash_table_lookup_extended(cache->blocks, &hash, NULL, &value);
+    if (hit)
+        block_matches_report(value, pos, matches, first);
+    g_mutex_unlock(&cache->lock);
+
+    return hit;
+}
+
+// Забирает block
+static void
+block_scan_store(BlockScanCache *cache, guint64 version, guint64 hash, GArray *block)
+{
+    guint64 *key = g_new(guint64, 1);
+
+    *key = hash;
+
+    g_mutex_lock(&cache->lock);
+    // Результат по старому словарю уже не нужен
+    if (cache->dictionary_version != version) {
+        g_free(key);
+        block_matches_free(block);
+    } else {
+        if (g_hash_table_size(cache->blocks) >= BLOCK_CACHE_MAX_ENTRIES)
+            g_hash_table_remove_all(cache->blocks);
+        g_hash_table_replace(cache->blocks, key, block);
+    }
+    g_mutex_unlock(&cache->lock);
+}
+
+static void
+block_scan_collect(guint word_index, guint64 end, gpointer user_data)
+{
+    GArray **block = user_data;
+    BlockMatch match = { word_index, (guint32)end };
+
+    if (!*block)
+        *block = g_array_new(FALSE, FALSE, sizeof(BlockMatch));
+    g_array_append_val(*block, match);
+}
+
+// Блок проверяется целиком, со всеми совпадениями: кэш годится и для
+// поиска первого слова, и для сбора. Без matches проход останавливается
+// на первом блоке с совпадением.
+static gboolean
+block_scan_run(BlockScanCache *cache, const WordMatcher *matcher, const gchar *text, gsize len,
+               GCancellable *cancellable, WordMatches *matches, guint *word_index)
+{
+    guint64 version = word_matcher_get_version(matcher);
+    gboolean any = FALSE;
+    gsize pos = 0;
+
+    g_mutex_lock(&cache->lock);
+    if (cache->dictionary_version != version) {
+        g_hash_table_remove_all(cache->blocks);
+        cache->dictionary_version = version;
+    }
+    g_mutex_unlock(&cache->lock);
+
+    while (pos < len) {
+        gsize block_len = block_scan_next_boundary(text + pos, len - pos);
+        guint64 hash = fast_hash64((const guint8 *)text + pos, block_len);
+        guint found = WORD_MATCHER_NONE;
+
+        if (g_cancellable_is_cancelled(cancellable))
+            return FALSE;
+
+        if (!block_scan_lookup(cache, hash, pos, matches, &found)) {
+            GArray *block = NULL;
+
+            word_matcher_search_all(matcher, text + pos, block_len, block_scan_collect, &block);
+            block_matches_report(block, pos, matches, &found);
+            block_scan_store(cache, version, hash, block);
+        }
+
+        if (found != WORD_MATCHER_NONE) {
+            if (!any && word_index)
+                *word_index = found;
+            any = TRUE;
+            if (!matches)
+                return TRUE;
+        }
+
+        pos += block_len;
+    }
+
+    return any;
+}
+
+gboolean
+block_scan_cache_scan(BlockScanCache *cache, const WordMatcher *matcher,
+                      const gchar *text, gsize len,
+                      GCancellable *cancellable, guint *word_index)
+{
+    return block_scan_run(cache, matcher, text, len, cancellable, NULL, word_index);
+}
+
+gboolean
+block_scan_cache_collect(BlockScanCache *cache, const WordMatcher *matcher,
+                         const gchar *text, gsize len,
+                         GCancellable *cancellable, WordMatches *matches)
+{
+    return block_scan_run(cache, matcher, text, len, cancellable, matches, NULL);
+}
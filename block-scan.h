@@ -0,0 +1,35 @@
+#ifndef BLOCK_SCAN_H
+#define BLOCK_SCAN_H
+
+#include <gio/gio.h>
+
+#include "word-matcher.h"
+#include "word-matches.h"
+
+// Инкрементальная проверка текста, который правится понемногу (черновик
+// в композере). Текст режется на блоки по границам строк, причём границы
+// определяются содержимым, а не смещением: правка в одном месте меняет
+// только один-два блока. Результат каждого блока запоминается по его хэшу,
+// и при повторной проверке автомат проходит лишь по изменившимся блокам.
+//
+// Слова словаря не содержат перевода строки, поэтому совпадение никогда
+// не пересекает границу блока и результат совпадает с проверкой целиком.
+typedef struct _BlockScanCache BlockScanCache;
+
+BlockScanCache* block_scan_cache_new(void);
+BlockScanCache* block_scan_cache_ref(BlockScanCache *cache);
+void block_scan_cache_unref(BlockScanCache *cache);
+
+// Можно вызывать из нескольких потоков. При смене словаря кэш сбрасывается.
+// Возвращает TRUE и индекс первого по тексту найденного слова.
+gboolean block_scan_cache_scan(BlockScanCache *cache, const WordMatcher *matcher,
+                               const gchar *text, gsize len,
+                               GCancellable *cancellable, guint *word_index);
+// Все совпадения текста - в matches (смещения от начала text); блоки,
+// проверенные раньше, берутся из кэша вместе с их совпадениями.
+// FALSE, если совпадений нет или проверка отменена.
+gboolean block_scan_cache_collect(BlockScanCache *cache, const WordMatcher *matcher,
+                                  const gchar *text, gsize len,
+                                  GCancellable *cancellable, WordMatches *matches);
+
+#endif /* BLOCK_SCAN_H */
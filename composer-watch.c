@@ -0,0 +1,306 @@
+#include <camel/camel.h>
+#include <evolution/e-util/e-util.h>
+#include <evolution/composer/e-msg-composer.h>
+
+#include "attachment-checker.h"
+#include "attachment-scan.h"
+#include "composer-watch.h"
+#include "markup-text.h"
+#include "presend-scan.h"
+#include "scan-policy.h"
+
+#define COMPOSER_WATCH_KEY "attachment-checker-watch"
+
+// Задержка после последней правки; вложения проверяются раньше - их
+// добавляют редко, а проверка содержимого дольше
+#define BODY_DEBOUNCE_MS 800
+#define ATTACHMENTS_DEBOUNCE_MS 300
+
+struct _ComposerWatch {
+    gint ref_count;
+    EMsgComposer *composer;         // не владеет; NULL после закрытия окна
+    EContentEditor *editor;
+    EAttachmentStore *store;
+    BlockScanCache *blocks;
+    GCancellable *cancellable;
+    guint body_source_id;
+    guint attachments_source_id;
+    gboolean body_pending;
+    gboolean attachments_pending;
+    gboolean running;
+};
+
+// Данные одной фоновой проверки, собранные в главном потоке
+typedef struct {
+    ScanPolicy *policy;             // держит автомат живым, пока идёт проверка
+    WordMatcher *matcher;
+    BlockScanCache *blocks;
+    GByteArray *text;               // NULL - текст не проверяется
+    GPtrArray *attachments;         // AttachmentSource; NULL - вложения не проверяются
+    guint64 max_attachment_bytes;
+} WatchJob;
+
+static void composer_watch_start(ComposerWatch *watch);
+
+static ComposerWatch*
+composer_watch_ref(ComposerWatch *watch)
+{
+    g_atomic_int_inc(&watch->ref_count);
+    return watch;
+}
+
+static void
+composer_watch_unref(ComposerWatch *watch)
+{
+    if (!g_atomic_int_dec_and_test(&watch->ref_count))
+        return;
+
+    block_scan_cache_unref(watch->blocks);
+    g_object_unref(watch->cancellable);
+    g_free(watch);
+}
+
+static void
+watch_job_free(gpointer data)
+{
+    WatchJob *job = data;
+
+    scan_policy_unref(job->policy);
+    block_scan_cache_unref(job->blocks);
+    if (job->text)
+        g_byte_array_unref(job->text);
+    if (job->attachments)
+        g_ptr_array_unref(job->attachments);
+    g_free(job);
+}
+
+static void
+watch_job_thread(GTask *task, gpointer source_object,
+                 gpointer task_data, GCancellable *cancellable)
+{
+    WatchJob *job = task_data;
+    guint word_index;
+
+    // Найденное слово здесь не сообщается: результат остаётся в кэшах
+    // и будет взят проверкой перед отправкой
+    if (job->text && block_scan_cache_scan(job->blocks, job->matcher,
+                                           (const gchar *)job->text->data, job->text->len,
+                                           cancellable, &word_index))
+        g_debug("Background scan: message text contains '%s'",
+                word_matcher_get_word(job->matcher, word_index));
+
+    if (job->attachments)
+        attachment_scan_all(job->attachments, job->matcher, job->max_attachment_bytes,
+                            cancellable, NULL, NULL);
+
+    g_task_return_boolean(task, TRUE);
+    (void)source_object;
+}
+
+static void
+watch_job_done(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    ComposerWatch *watch = user_data;
+
+    watch->running = FALSE;
+
+    // Пока шла проверка, могли прийти новые правки
+    if (watch->composer)
+        composer_watch_start(watch);
+
+    composer_watch_unref(watch);
+    (void)source_object;
+    (void)result;
+}
+
+static WatchJob*
+watch_job_new(ComposerWatch *watch)
+{
+    ScanPolicy *policy = scan_policy_get();
+    PresendScanFlags flags = scan_policy_get_flags(policy);
+    WatchJob *job;
+
+    if (!scan_policy_get_matcher(policy)) {
+        scan_policy_unref(policy);
+        return NULL;
+    }
+
+    job = g_new0(WatchJob, 1);
+    job->policy = policy;
+    job->matcher = scan_policy_get_matcher(policy);
+    job->blocks = block_scan_cache_ref(watch->blocks);
+
+    if (watch->body_pending && (flags & PRESEND_SCAN_MESSAGE_BODY)) {
+        job->text = e_msg_composer_get_raw_message_text(watch->composer);
+        // HTML проверяется при отправке через разбор разметки, кэш
+        // блоков для него не используется
+        if (job->text && (job->text->len == 0 ||
+                          markup_text_is_html((const gchar *)job->text->data, job->text->len)))
+            g_clear_pointer(&job->text, g_byte_array_unref);
+    }
+
+    if (watch->attachments_pending && (flags & PRESEND_SCAN_ATTACHMENT_CONTENTS)) {
+        GList *attachments = e_attachment_store_get_attachments(watch->store);
+
+        job->attachments = g_ptr_array_new_with_free_func((GDestroyNotify)attachment_source_free);
+        job->max_attachment_bytes = scan_policy_get_max_attachment_bytes(policy);
+
+        // Уже проверенные вложения найдутся в кэше и не будут прочитаны
+        for (GList *item = attachments; item; item = item->next) {
+            g_ptr_array_add(job->attachments,
+                            presend_attachment_source_new(E_ATTACHMENT(item->data)));
+        }
+        g_list_free_full(attachments, g_object_unref);
+    }
+
+    watch->body_pending = FALSE;
+    watch->attachments_pending = FALSE;
+
+    return job;
+}
+
+// Одновременно идёт не больше одной фоновой проверки на композер
+static void
+composer_watch_start(ComposerWatch *watch)
+{
+    WatchJob *job;
+    GTask *task;
+
+    if (watch->running || !(watch->body_pending || watch->attachments_pending))
+        return;
+
+    job = watch_job_new(watch);
+    if (!job)
+        return;
+
+    if (!job->text && !job->attachments) {
+        watch_job_free(job);
+        return;
+    }
+
+    watch->running = TRUE;
+    task = g_task_new(NULL, watch->cancellable, watch_job_done, composer_watch_ref(watch));
+    g_task_set_task_data(task, job, watch_job_free);
+    g_task_set_priority(task, G_PRIORITY_LOW);
+    g_task_run_in_thread(task, watch_job_thread);
+    g_object_unref(task);
+}
+
+static gboolean
+body_timeout_cb(gpointer user_data)
+{
+    ComposerWatch *watch = user_data;
+
+    watch->body_source_id = 0;
+    watch->body_pending = TRUE;
+    composer_watch_start(watch);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+attachments_timeout_cb(gpointer user_data)
+{
+    ComposerWatch *watch = user_data;
+
+    watch->attachments_source_id = 0;
+    watch->attachments_pending = TRUE;
+    composer_watch_start(watch);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+content_changed_cb(EContentEditor *editor, ComposerWatch *watch)
+{
+    if (watch->body_source_id)
+        g_source_remove(watch->body_source_id);
+    watch->body_source_id = g_timeout_add(BODY_DEBOUNCE_MS, body_timeout_cb, watch);
+
+    (void)editor;
+}
+
+// Новое вложение или окончание его загрузки (строка обновляется).
+// Удаление вложения перепроверки не требует.
+static void
+attachments_changed_cb(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter,
+                       ComposerWatch *watch)
+{
+    if (watch->attachments_source_id)
+        g_source_remove(watch->attachments_source_id);
+    watch->attachments_source_id = g_timeout_add(ATTACHMENTS_DEBOUNCE_MS,
+                                                 attachments_timeout_cb, watch);
+
+    (void)model;
+    (void)path;
+    (void)iter;
+}
+
+// Окно композера закрыто: отключаемся от сигналов и отменяем проверку.
+// Сама структура живёт, пока на неё ссылается незавершённая задача.
+static void
+composer_watch_detach(gpointer data)
+{
+    ComposerWatch *watch = data;
+
+    if (watch->body_source_id)
+        g_source_remove(watch->body_source_id);
+    if (watch->attachments_source_id)
+        g_source_remove(watch->attachments_source_id);
+
+    g_signal_handlers_disconnect_by_data(watch->editor, watch);
+    g_signal_handlers_disconnect_by_data(watch->store, watch);
+    g_clear_object(&watch->editor);
+    g_clear_object(&watch->store);
+
+    g_cancellable_cancel(watch->cancellable);
+    watch->composer = NULL;
+
+    composer_watch_unref(watch);
+}
+
+void
+composer_watch_attach(EMsgComposer *composer)
+{
+    ComposerWatch *watch;
+    EHTMLEditor *html_editor;
+    EAttachmentView *view;
+
+    if (composer_watch_get(composer))
+        return;
+
+    html_editor = e_msg_composer_get_editor(composer);
+    view = e_msg_composer_get_attachment_view(composer);
+    if (!html_editor || !view)
+        return;
+
+    watch = g_new0(ComposerWatch, 1);
+    watch->ref_count = 1;
+    watch->composer = composer;
+    watch->editor = g_object_ref(e_html_editor_get_content_editor(html_editor));
+    watch->store = g_object_ref(e_attachment_view_get_store(view));
+    watch->blocks = block_scan_cache_new();
+    watch->cancellable = g_cancellable_new();
+
+    g_signal_connect(watch->editor, "content-changed",
+                     G_CALLBACK(content_changed_cb), watch);
+    g_signal_connect(watch->store, "row-inserted",
+                     G_CALLBACK(attachments_changed_cb), watch);
+    g_signal_connect(watch->store, "row-changed",
+                     G_CALLBACK(attachments_changed_cb), watch);
+
+    g_object_set_data_full(G_OBJECT(composer), COMPOSER_WATCH_KEY, watch,
+                           composer_watch_detach);
+}
+
+ComposerWatch*
+composer_watch_get(EMsgComposer *composer)
+{
+    return g_object_get_data(G_OBJECT(composer), COMPOSER_WATCH_KEY);
+}
+
+BlockScanCache*
+composer_watch_get_block_cache(ComposerWatch *watch)
+{
+    return watch->blocks;
+}
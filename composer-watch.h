@@ -0,0 +1,22 @@
+#ifndef COMPOSER_WATCH_H
+#define COMPOSER_WATCH_H
+
+#include <gio/gio.h>
+
+#include "block-scan.h"
+
+// Фоновая проверка черновика, пока пользователь пишет письмо.
+// Правки текста и добавление вложений запускают (с задержкой, чтобы не
+// работать на каждое нажатие клавиши) проверку в рабочем потоке. Её
+// результаты оседают в кэшах: блоков текста (BlockScanCache) и вложений
+// (attachment-cache), - так что к нажатию "Отправить" перепроверять
+// остаётся только то, что изменилось после последней фоновой проверки.
+typedef struct _ComposerWatch ComposerWatch;
+
+// Вызывается из главного потока при создании окна композера
+void composer_watch_attach(EMsgComposer *composer);
+// NULL, если композер открыт до включения плагина
+ComposerWatch* composer_watch_get(EMsgComposer *composer);
+BlockScanCache* composer_watch_get_block_cache(ComposerWatch *watch);
+
+#endif /* COMPOSER_WATCH_H */
@@ -0,0 +1,341 @@
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "dictionary-file.h"
+#include "fast-hash.h"
+#include "word-matcher-private.h"
+
+#define DICTIONARY_BYTE_ORDER 0x01020304u
+#define DICTIONARY_FLAG_CASE_SENSITIVE (1u << 0)
+#define DICTIONARY_FLAG_BOUNDARIES (1u << 1)
+#define DICTIONARY_FLAG_NORMALIZE (1u << 2)
+
+#define ALIGN8(x) (((x) + 7) & ~(gsize)7)
+
+// Заголовок файла; за ним идут секции, каждая выровнена на 8 байт
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 byte_order;
+    guint32 flags;
+    guint32 n_states;
+    guint32 n_edges;
+    guint32 n_words;
+    guint32 word_data_size;
+    guint32 n_dfas;
+    guint32 n_dfa_next;
+    guint32 n_dfa_accept_start;
+    guint32 n_dfa_accept_rules;
+    guint32 n_token_slots;
+    guint32 n_token_blocks;
+    guint64 source_size;
+    gint64 source_mtime;
+    guint64 payload_size;
+    guint64 checksum;
+} DictionaryFileHeader;
+
+// Раскладка секций, вычисляется одинаково при записи и при загрузке
+typedef struct {
+    gsize root_next;
+    gsize edge_start;
+    gsize edge_target;
+    gsize fail;
+    gsize output;
+    gsize output_link;
+    gsize word_offsets;
+    gsize dfas;
+    gsize dfa_next;
+    gsize dfa_accept_start;
+    gsize dfa_accept_rules;
+    gsize token_hashes;
+    gsize token_bloom;
+    gsize token_words;
+    gsize edge_bytes;
+    gsize word_data;
+    gsize prefilter;
+    gsize total;
+} DictionaryLayout;
+
+static void
+dictionary_layout(DictionaryLayout *layout, const DictionaryFileHeader *header)
+{
+    gsize offset = 0;
+
+    layout->root_next = offset;   offset += ALIGN8(256 * sizeof(guint32));
+    layout->edge_start = offset;  offset += ALIGN8(((gsize)header->n_states + 1) * sizeof(guint32));
+    layout->edge_target = offset; offset += ALIGN8((gsize)header->n_edges * sizeof(guint32));
+    layout->fail = offset;        offset += ALIGN8((gsize)header->n_states * sizeof(guint32));
+    layout->output = offset;      offset += ALIGN8((gsize)header->n_states * sizeof(guint32));
+    layout->output_link = offset; offset += ALIGN8((gsize)header->n_states * sizeof(guint32));
+    layout->word_offsets = offset; offset += ALIGN8((gsize)header->n_words * sizeof(guint32));
+    layout->dfas = offset;        offset += ALIGN8((gsize)header->n_dfas * sizeof(WordRegexDfa));
+    layout->dfa_next = offset;    offset += ALIGN8((gsize)header->n_dfa_next * sizeof(guint32));
+    layout->dfa_accept_start = offset;
+    offset += ALIGN8((gsize)header->n_dfa_accept_start * sizeof(guint32));
+    layout->dfa_accept_rules = offset;
+    offset += ALIGN8((gsize)header->n_dfa_accept_rules * sizeof(guint32));
+    layout->token_hashes = offset; offset += ALIGN8((gsize)header->n_token_slots * sizeof(guint64));
+    layout->token_bloom = offset;
+    offset += ALIGN8((gsize)header->n_token_blocks * WORD_TOKEN_BLOOM_WORDS * sizeof(guint64));
+    layout->token_words = offset; offset += ALIGN8((gsize)header->n_token_slots * sizeof(guint32));
+    layout->edge_bytes = offset;  offset += ALIGN8(header->n_edges);
+    layout->word_data = offset;   offset += ALIGN8(header->word_data_size);
+    layout->prefilter = offset;   offset += ALIGN8(sizeof(WordPrefilter));
+    layout->total = offset;
+}
+
+static gboolean
+dictionary_source_stat(const gchar *source_path, guint64 *size, gint64 *mtime)
+{
+    GStatBuf st;
+
+    if (!source_path || g_stat(source_path, &st) != 0)
+        return FALSE;
+
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return TRUE;
+}
+
+gchar**
+dictionary_file_load_words(const gchar *path)
+{
+    gchar *contents = NULL;
+    gchar **lines;
+    GPtrArray *words_array;
+
+    if (!path || !g_file_get_contents(path, &contents, NULL, NULL))
+        return NULL;
+
+    words_array = g_ptr_array_new();
+    lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+
+    for (gint i = 0; lines[i]; i++) {
+        // Удаляем пробелы и переводы строк
+        gchar *word = g_strstrip(lines[i]);
+        if (strlen(word) > 0 && word[0] != '#') { // Пропускаем комментарии
+            g_ptr_array_add(words_array, g_strdup(word));
+        }
+    }
+    g_strfreev(lines);
+
+    g_ptr_array_add(words_array, NULL);
+    return (gchar **)g_ptr_array_free(words_array, FALSE);
+}
+
+gchar*
+dictionary_file_binary_path(const gchar *source_path)
+{
+    if (g_str_has_suffix(source_path, ".conf")) {
+        gsize len = strlen(source_path) - strlen(".conf");
+        gchar *base = g_strndup(source_path, len);
+        gchar *path = g_strconcat(base, DICTIONARY_FILE_SUFFIX, NULL);
+        g_free(base);
+        return path;
+    }
+
+    return g_strconcat(source_path, DICTIONARY_FILE_SUFFIX, NULL);
+}
+
+gboolean
+dictionary_file_write(const gchar *path, const WordMatcher *matcher,
+                      const gchar *source_path, GError **error)
+{
+    DictionaryFileHeader header;
+    DictionaryLayout layout;
+    guint8 *buffer, *payload;
+    gboolean ok;
+
+    g_return_val_if_fail(path != NULL, FALSE);
+    g_return_val_if_fail(matcher != NULL, FALSE);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DICTIONARY_FILE_MAGIC, sizeof(header.magic));
+    header.version = DICTIONARY_FILE_VERSION;
+    header.byte_order = DICTIONARY_BYTE_ORDER;
+    header.flags = (matcher->case_sensitive ? DICTIONARY_FLAG_CASE_SENSITIVE : 0) |
+                   (matcher->boundaries ? DICTIONARY_FLAG_BOUNDARIES : 0) |
+                   (matcher->normalize ? DICTIONARY_FLAG_NORMALIZE : 0);
+    header.n_states = matcher->n_states;
+    header.n_edges = matcher->n_edges;
+    header.n_words = matcher->n_words;
+    header.word_data_size = matcher->word_data_size;
+    header.n_dfas = matcher->n_dfas;
+    header.n_dfa_next = matcher->n_dfa_next;
+    header.n_dfa_accept_start = matcher->n_dfa_accept_start;
+    header.n_dfa_accept_rules = matcher->n_dfa_accept_rules;
+    header.n_token_slots = matcher->tokens.n_slots;
+    header.n_token_blocks = matcher->tokens.n_blocks;
+    dictionary_source_stat(source_path, &header.source_size, &header.source_mtime);
+
+    dictionary_layout(&layout, &header);
+
+    buffer = g_malloc0(sizeof(header) + layout.total);
+    payload = buffer + sizeof(header);
+
+    memcpy(payload + layout.root_next, matcher->root_next, 256 * sizeof(guint32));
+    memcpy(payload + layout.edge_start, matcher->edge_start,
+           ((gsize)matcher->n_states + 1) * sizeof(guint32));
+    memcpy(payload + layout.edge_target, matcher->edge_target,
+           (gsize)matcher->n_edges * sizeof(guint32));
+    memcpy(payload + layout.fail, matcher->fail, (gsize)matcher->n_states * sizeof(guint32));
+    memcpy(payload + layout.output, matcher->output, (gsize)matcher->n_states * sizeof(guint32));
+    memcpy(payload + layout.output_link, matcher->output_link,
+           (gsize)matcher->n_states * sizeof(guint32));
+    memcpy(payload + layout.word_offsets, matcher->word_offsets,
+           (gsize)matcher->n_words * sizeof(guint32));
+    if (matcher->n_dfas > 0) {
+        memcpy(payload + layout.dfas, matcher->dfas, (gsize)matcher->n_dfas * sizeof(WordRegexDfa));
+        memcpy(payload + layout.dfa_next, matcher->dfa_next,
+               (gsize)matcher->n_dfa_next * sizeof(guint32));
+        memcpy(payload + layout.dfa_accept_start, matcher->dfa_accept_start,
+               (gsize)matcher->n_dfa_accept_start * sizeof(guint32));
+        memcpy(payload + layout.dfa_accept_rules, matcher->dfa_accept_rules,
+               (gsize)matcher->n_dfa_accept_rules * sizeof(guint32));
+    }
+    if (matcher->tokens.n_slots > 0) {
+        memcpy(payload + layout.token_hashes, matcher->tokens.hashes,
+               (gsize)matcher->tokens.n_slots * sizeof(guint64));
+        memcpy(payload + layout.token_bloom, matcher->tokens.bloom,
+               (gsize)matcher->tokens.n_blocks * WORD_TOKEN_BLOOM_WORDS * sizeof(guint64));
+        memcpy(payload + layout.token_words, matcher->tokens.words,
+               (gsize)matcher->tokens.n_slots * sizeof(guint32));
+    }
+    memcpy(payload + layout.edge_bytes, matcher->edge_bytes, matcher->n_edges);
+    memcpy(payload + layout.word_data, matcher->word_data, matcher->word_data_size);
+    memcpy(payload + layout.prefilter, matcher->prefilter, sizeof(WordPrefilter));
+
+    header.payload_size = layout.total;
+    header.checksum = fast_hash64(payload, layout.total);
+    memcpy(buffer, &header, sizeof(header));
+
+    // g_file_set_contents пишет через временный файл и rename, поэтому
+    // уже отображённые в память копии остаются целыми
+    ok = g_file_set_contents(path, (const gchar *)buffer,
+                             sizeof(header) + layout.total, error);
+    g_free(buffer);
+
+    return ok;
+}
+
+WordMatcher*
+dictionary_file_map(const gchar *path, const gchar *source_path, GError **error)
+{
+    GMappedFile *mapped;
+    const guint8 *data, *payload;
+    gsize length;
+    DictionaryFileHeader header;
+    DictionaryLayout layout;
+    WordMatcher *matcher;
+    guint64 source_size;
+    gint64 source_mtime;
+
+    mapped = g_mapped_file_new(path, FALSE, error);
+    if (!mapped)
+        return NULL;
+
+    data = (const guint8 *)g_mapped_file_get_contents(mapped);
+    length = g_mapped_file_get_length(mapped);
+
+    if (!data || length < sizeof(header)) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                    "%s: file is too short", path);
+        goto fail;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, DICTIONARY_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.byte_order != DICTIONARY_BYTE_ORDER) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                    "%s: not a compiled dictionary", path);
+        goto fail;
+    }
+
+    if (header.version != DICTIONARY_FILE_VERSION) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                    "%s: unsupported version %u", path, header.version);
+        goto fail;
+    }
+
+    // Текстовый файл изменился после компиляции
+    if (dictionary_source_stat(source_path, &source_size, &source_mtime) &&
+        (source_size != header.source_size || source_mtime != header.source_mtime)) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                    "%s: stale, %s has changed", path, source_path);
+        goto fail;
+    }
+
+    dictionary_layout(&layout, &header);
+
+    if (header.n_states == 0 || header.n_dfas > WORD_MATCHER_MAX_DFAS ||
+        (header.n_token_slots == 0) != (header.n_token_blocks == 0) ||
+        header.payload_size != layout.total ||
+        length - sizeof(header) != layout.total) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                    "%s: truncated or malformed", path);
+        goto fail;
+    }
+
+    payload = data + sizeof(header);
+
+    if (fast_hash64(payload, layout.total) != header.checksum) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                    "%s: checksum mismatch", path);
+        goto fail;
+    }
+
+    // Таблицы ДКА должны лежать внутри своих секций
+    for (guint32 i = 0; i < header.n_dfas; i++) {
+        const WordRegexDfa *dfa = (const WordRegexDfa *)(payload + layout.dfas) + i;
+
+        if ((guint64)dfa->table + (guint64)dfa->n_states * dfa->n_classes > header.n_dfa_next ||
+            (guint64)dfa->accept + dfa->n_states + 1 > header.n_dfa_accept_start) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                        "%s: truncated or malformed", path);
+            goto fail;
+        }
+    }
+
+    matcher = g_new0(WordMatcher, 1);
+    matcher->mapped = mapped;
+    matcher->case_sensitive = (header.flags & DICTIONARY_FLAG_CASE_SENSITIVE) != 0;
+    matcher->boundaries = (header.flags & DICTIONARY_FLAG_BOUNDARIES) != 0;
+    matcher->normalize = (header.flags & DICTIONARY_FLAG_NORMALIZE) != 0;
+    matcher->n_words = header.n_words;
+    matcher->word_offsets = (const guint32 *)(payload + layout.word_offsets);
+    matcher->word_data = (const gchar *)(payload + layout.word_data);
+    matcher->word_data_size = header.word_data_size;
+    matcher->n_states = header.n_states;
+    matcher->n_edges = header.n_edges;
+    matcher->root_next = (const guint32 *)(payload + layout.root_next);
+    matcher->edge_start = (const guint32 *)(payload + layout.edge_start);
+    matcher->edge_bytes = payload + layout.edge_bytes;
+    matcher->edge_target = (const guint32 *)(payload + layout.edge_target);
+    matcher->fail = (const guint32 *)(payload + layout.fail);
+    matcher->output = (const guint32 *)(payload + layout.output);
+    matcher->output_link = (const guint32 *)(payload + layout.output_link);
+    matcher->n_dfas = header.n_dfas;
+    matcher->dfas = (const WordRegexDfa *)(payload + layout.dfas);
+    matcher->n_dfa_next = header.n_dfa_next;
+    matcher->dfa_next = (const guint32 *)(payload + layout.dfa_next);
+    matcher->n_dfa_accept_start = header.n_dfa_accept_start;
+    matcher->dfa_accept_start = (const guint32 *)(payload + layout.dfa_accept_start);
+    matcher->n_dfa_accept_rules = header.n_dfa_accept_rules;
+    matcher->dfa_accept_rules = (const guint32 *)(payload + layout.dfa_accept_rules);
+    matcher->tokens.n_slots = header.n_token_slots;
+    matcher->tokens.n_blocks = header.n_token_blocks;
+    matcher->tokens.hashes = (const guint64 *)(payload + layout.token_hashes);
+    matcher->tokens.bloom = (const guint64 *)(payload + layout.token_bloom);
+    matcher->tokens.words = (const guint32 *)(payload + layout.token_words);
+    matcher->prefilter = (const WordPrefilter *)(payload + layout.prefilter);
+    word_matcher_update_version(matcher);
+
+    return matcher;
+
+fail:
+    g_mapped_file_unref(mapped);
+    return NULL;
+}
@@ -0,0 +1,33 @@
+#ifndef DICTIONARY_FILE_H
+#define DICTIONARY_FILE_H
+
+#include <glib.h>
+
+#include "word-matcher.h"
+
+// Формат скомпилированного словаря (words.bin).
+// Версия меняется при любом изменении раскладки секций.
+#define DICTIONARY_FILE_MAGIC "ACDICT\0"
+#define DICTIONARY_FILE_VERSION 5
+#define DICTIONARY_FILE_SUFFIX ".bin"
+
+// Чтение текстового words.conf: одно слово или правило (word-rules.h)
+// на строку, # - комментарий.
+// Возвращает NULL, если файл не удалось прочитать.
+gchar** dictionary_file_load_words(const gchar *path);
+
+// Путь к скомпилированному словарю рядом с текстовым (words.conf -> words.bin)
+gchar* dictionary_file_binary_path(const gchar *source_path);
+
+// Запись автомата в файл. Размер и время изменения source_path сохраняются
+// в заголовке, чтобы при загрузке распознать устаревший файл.
+gboolean dictionary_file_write(const gchar *path, const WordMatcher *matcher,
+                               const gchar *source_path, GError **error);
+
+// Отображение файла в память только для чтения. Автомат работает прямо
+// по отображённым данным. Возвращает NULL, если файла нет, он повреждён
+// или старше source_path.
+WordMatcher* dictionary_file_map(const gchar *path, const gchar *source_path,
+                                 GError **error);
+
+#endif /* DICTIONARY_FILE_H */
@@ -0,0 +1,30 @@
+#ifndef FAST_HASH_H
+#define FAST_HASH_H
+
+#include <string.h>
+#include <glib.h>
+
+// Быстрая некриптографическая 64-битная свёртка по 8-байтным словам.
+// Годится для контрольных сумм и ключей кэша, не для защиты от подделки.
+static inline guint64
+fast_hash64(const guint8 *data, gsize len)
+{
+    guint64 hash = 0xcbf29ce484222325ull ^ len;
+    gsize i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        guint64 word;
+        memcpy(&word, data + i, sizeof(word));
+        hash ^= word;
+        hash *= 0x9e3779b97f4a7c15ull;
+        hash ^= hash >> 29;
+    }
+    for (; i < len; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+#endif /* FAST_HASH_H */
@@ -0,0 +1,557 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "attachment-scan.h"
+#include "fast-hash.h"
+#include "folder-audit.h"
+#include "message-scan.h"
+
+#define FOLDER_AUDIT_MAGIC "ACAUDIT"
+#define FOLDER_AUDIT_VERSION 1
+#define FOLDER_AUDIT_BYTE_ORDER 0x01020304u
+
+#define FOLDER_AUDIT_DEFAULT_CPU_PERCENT 25
+// Писем в очереди пула на один поток: чтение не убегает вперёд проверки
+#define FOLDER_AUDIT_QUEUE_PER_WORKER 2
+// Контрольная точка сбрасывается на диск раз в столько писем
+#define FOLDER_AUDIT_FLUSH_EVERY 64
+// Размер письма для ограничения скорости, если сводка папки его не знает
+#define FOLDER_AUDIT_UNKNOWN_SIZE (64 * 1024)
+
+// Заголовок контрольной точки; за ним - ключи проверенных писем (guint64)
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 byte_order;
+    guint64 dictionary_version;
+    guint64 options_hash;
+} FolderAuditHeader;
+
+struct _FolderAudit {
+    WordDictionary *dictionary;
+    const WordMatcher *matcher;
+    FolderAuditOptions options;
+    gchar *report_path;
+    gchar *checkpoint_path;
+
+    // Файлы, очередь и паузы потоков - под lock
+    GMutex lock;
+    GCond cond;             // место в очереди, отмена
+    FILE *report;
+    FILE *checkpoint;
+    guint unflushed;
+    guint in_flight;        // писем в очереди пула и в работе
+    GCancellable *cancellable;
+
+    // Счётчики для folder_audit_get_progress (атомарно)
+    gint total;
+    gint done;
+    gint skipped;
+    gint found;
+    gint errors;
+};
+
+// Письмо в очереди пула
+typedef struct {
+    CamelFolder *folder;
+    gchar *uid;
+    guint64 key;
+} AuditItem;
+
+static void
+audit_item_free(AuditItem *item)
+{
+    g_object_unref(item->folder);
+    g_free(item->uid);
+    g_free(item);
+}
+
+// Папка в отметках и отчёте: учётная запись и полное имя
+static gchar*
+folder_audit_folder_id(CamelFolder *folder, gboolean display)
+{
+    CamelService *store = CAMEL_SERVICE(camel_folder_get_parent_store(folder));
+    const gchar *account = store ? (display ? camel_service_get_display_name(store) :
+                                              camel_service_get_uid(store)) : NULL;
+
+    return g_strconcat(account ? account : "", "/", camel_folder_get_full_name(folder), NULL);
+}
+
+static guint64
+folder_audit_key(const gchar *folder_id, const gchar *uid)
+{
+    gchar *id = g_strconcat(folder_id, "\n", uid, NULL);
+    guint64 key = fast_hash64((const guint8 *)id, strlen(id));
+
+    g_free(id);
+    return key;
+}
+
+FolderAudit*
+folder_audit_new(WordDictionary *dictionary, const WordMatcher *matcher,
+                 const FolderAuditOptions *options,
+                 const gchar *report_path, const gchar *checkpoint_path)
+{
+    FolderAudit *audit;
+
+    g_return_val_if_fail(matcher != NULL, NULL);
+    g_return_val_if_fail(report_path != NULL && checkpoint_path != NULL, NULL);
+
+    audit = g_new0(FolderAudit, 1);
+    audit->dictionary = dictionary ? word_dictionary_ref(dictionary) : NULL;
+    audit->matcher = matcher;
+    audit->options = *options;
+    audit->report_path = g_strdup(report_path);
+    audit->checkpoint_path = g_strdup(checkpoint_path);
+
+    if (audit->options.cpu_percent == 0 || audit->options.cpu_percent > 100)
+        audit->options.cpu_percent = FOLDER_AUDIT_DEFAULT_CPU_PERCENT;
+    if (audit->options.max_workers == 0)
+        audit->options.max_workers = MAX(1, g_get_num_processors() / 2);
+
+    g_mutex_init(&audit->lock);
+    g_cond_init(&audit->cond);
+
+    return audit;
+}
+
+void
+folder_audit_free(FolderAudit *audit)
+{
+    if (!audit)
+        return;
+
+    if (audit->report)
+        fclose(audit->report);
+    if (audit->checkpoint)
+        fclose(audit->checkpoint);
+    g_clear_object(&audit->cancellable);
+    g_mutex_clear(&audit->lock);
+    g_cond_clear(&audit->cond);
+    g_free(audit->report_path);
+    g_free(audit->checkpoint_path);
+    word_dictionary_unref(audit->dictionary);
+    g_free(audit);
+}
+
+void
+folder_audit_get_progress(FolderAudit *audit, FolderAuditProgress *progress)
+{
+    progress->total = g_atomic_int_get(&audit->total);
+    progress->done = g_atomic_int_get(&audit->done);
+    progress->skipped = g_atomic_int_get(&audit->skipped);
+    progress->found = g_atomic_int_get(&audit->found);
+    progress->errors = g_atomic_int_get(&audit->errors);
+}
+
+// Контрольная точка прежнего запуска подходит, только если проверка шла
+// с тем же словарём и настройками
+static void
+folder_audit_header(FolderAudit *audit, FolderAuditHeader *header)
+{
+    const FolderAuditOptions *options = &audit->options;
+    guint64 flags[4] = { options->check_body, options->check_attachment_names,
+                         options->check_attachment_contents, options->max_attachment_bytes };
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, FOLDER_AUDIT_MAGIC, sizeof(header->magic));
+    header->version = FOLDER_AUDIT_VERSION;
+    header->byte_order = FOLDER_AUDIT_BYTE_ORDER;
+    header->dictionary_version = word_matcher_get_version(audit->matcher);
+    header->options_hash = fast_hash64((const guint8 *)flags, sizeof(flags));
+}
+
+// Ключи писем, проверенных в прошлые запуски (указывают в contents).
+// Без отчёта отметки бесполезны: найденное раньше потерялось бы.
+// *length - сколько байт файла занимают целые записи.
+static GHashTable*
+folder_audit_load_checkpoint(FolderAudit *audit, const FolderAuditHeader *header,
+                             gchar **contents, gsize *length)
+{
+    GHashTable *done = g_hash_table_new(g_int64_hash, g_int64_equal);
+    guint64 *keys;
+    gsize n_keys;
+
+    *length = 0;
+
+    if (!g_file_test(audit->report_path, G_FILE_TEST_IS_REGULAR) ||
+        !g_file_get_contents(audit->checkpoint_path, contents, length, NULL) ||
+        *length < sizeof(*header) || memcmp(*contents, header, sizeof(*header)) != 0) {
+        *length = 0;
+        return done;
+    }
+
+    keys = (guint64 *)(*contents + sizeof(*header));
+    n_keys = (*length - sizeof(*header)) / sizeof(guint64);
+    for (gsize i = 0; i < n_keys; i++)
+        g_hash_table_add(done, &keys[i]);
+
+    // Запись, оборванная на середине, будет перезаписана
+    *length = sizeof(*header) + n_keys * sizeof(guint64);
+    return done;
+}
+
+static FILE*
+folder_audit_open(const gchar *path, const gchar *mode, GError **error)
+{
+    gchar *dir = g_path_get_dirname(path);
+    FILE *file;
+
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    file = g_fopen(path, mode);
+    if (!file) {
+        gint saved_errno = errno;
+
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                    "%s: %s", path, g_strerror(saved_errno));
+    }
+
+    return file;
+}
+
+// Продолжение дописывает отчёт и отметки (с конца последней целой
+// записи), новый запуск начинает оба файла заново
+static gboolean
+folder_audit_open_files(FolderAudit *audit, const FolderAuditHeader *header,
+                        gsize checkpoint_length, GError **error)
+{
+    gboolean resume = checkpoint_length > 0;
+
+    audit->report = folder_audit_open(audit->report_path, resume ? "ab" : "wb", error);
+    if (!audit->report)
+        return FALSE;
+
+    audit->checkpoint = folder_audit_open(audit->checkpoint_path, resume ? "r+b" : "wb", error);
+    if (!audit->checkpoint)
+        return FALSE;
+
+    if (resume) {
+        fseek(audit->checkpoint, (long)checkpoint_length, SEEK_SET);
+    } else {
+        fputs("# folder\tuid\tdate\tmessage-id\tsubject\twhere\tattachment\tword\n",
+              audit->report);
+        fwrite(header, sizeof(*header), 1, audit->checkpoint);
+        fflush(audit->report);
+        fflush(audit->checkpoint);
+    }
+
+    return TRUE;
+}
+
+// Поле TSV: табуляции и переводы строк внутри значения - пробелы
+static void
+tsv_append(GString *out, const gchar *value, gboolean last)
+{
+    for (const gchar *p = value ? value : ""; *p; p++)
+        g_string_append_c(out, (*p == '\t' || *p == '\n' || *p == '\r') ? ' ' : *p);
+    g_string_append_c(out, last ? '\n' : '\t');
+}
+
+static void
+folder_audit_report_line(FolderAudit *audit, GString *lines, AuditItem *item,
+                         CamelMimeMessage *message, CamelMessageInfo *info,
+                         const gchar *where, const gchar *attachment, guint word_index)
+{
+    gchar *folder = folder_audit_folder_id(item->folder, TRUE);
+    gint64 sent = info ? camel_message_info_get_date_sent(info) : 0;
+    GDateTime *date = sent > 0 ? g_date_time_new_from_unix_local(sent) : NULL;
+    gchar *date_text = date ? g_date_time_format(date, "%Y-%m-%d %H:%M") : NULL;
+
+    tsv_append(lines, folder, FALSE);
+    tsv_append(lines, item->uid, FALSE);
+    tsv_append(lines, date_text, FALSE);
+    tsv_append(lines, camel_mime_message_get_message_id(message), FALSE);
+    tsv_append(lines, camel_mime_message_get_subject(message), FALSE);
+    tsv_append(lines, where, FALSE);
+    tsv_append(lines, attachment, FALSE);
+    tsv_append(lines, word_matcher_get_word(audit->matcher, word_index), TRUE);
+
+    if (date)
+        g_date_time_unref(date);
+    g_free(date_text);
+    g_free(folder);
+}
+
+// Те же проверки, что и перед отправкой: текст, имена вложений (и файлов
+// в архивах), содержимое вложений. Строки отчёта - в lines.
+static void
+folder_audit_scan_message(FolderAudit *audit, AuditItem *item, CamelMimeMessage *message,
+                          CamelMessageInfo *info, GString *lines)
+{
+    const FolderAuditOptions *options = &audit->options;
+    const WordMatcher *matcher = audit->matcher;
+    GCancellable *cancellable = audit->cancellable;
+    GPtrArray *sources;
+    guint word_index;
+
+    if (options->check_body &&
+        message_scan_text(CAMEL_MIME_PART(message), matcher, 0, cancellable, &word_index, NULL))
+        folder_audit_report_line(audit, lines, item, message, info, "body", NULL, word_index);
+
+    if (!options->check_attachment_names && !options->check_attachment_contents)
+        return;
+
+    sources = g_ptr_array_new_with_free_func((GDestroyNotify)attachment_source_free);
+    message_scan_collect_attachments(CAMEL_MIME_PART(message), sources);
+
+    for (guint i = 0; i < sources->len && !g_cancellable_is_cancelled(cancellable); i++) {
+        AttachmentSource *source = g_ptr_array_index(sources, i);
+
+        if (options->check_attachment_names &&
+            ((source->name && word_matcher_search(matcher, source->name, -1, &word_index)) ||
+             attachment_scan_archive_names(source, matcher, cancellable, NULL, 0, &word_index)))
+            folder_audit_report_line(audit, lines, item, message, info, "attachment-name",
+                                     source->name, word_index);
+
+        if (options->check_attachment_contents &&
+            attachment_scan_source(source, matcher, options->max_attachment_bytes, cancellable,
+                                   &word_index, NULL))
+            folder_audit_report_line(audit, lines, item, message, info, "attachment",
+                                     source->name, word_index);
+    }
+
+    g_ptr_array_unref(sources);
+}
+
+// Строки отчёта и отметка письма пишутся вместе: прерванное письмо не
+// отмечено и при следующем запуске проверяется (и попадает в отчёт) заново
+static void
+folder_audit_commit(FolderAudit *audit, AuditItem *item, GString *lines)
+{
+    g_mutex_lock(&audit->lock);
+
+    if (lines->len > 0)
+        fwrite(lines->str, 1, lines->len, audit->report);
+    fwrite(&item->key, sizeof(item->key), 1, audit->checkpoint);
+
+    // Отчёт на диске не отстаёт от отметок
+    if (++audit->unflushed >= FOLDER_AUDIT_FLUSH_EVERY || lines->len > 0) {
+        fflush(audit->report);
+        fflush(audit->checkpoint);
+        audit->unflushed = 0;
+    }
+
+    g_mutex_unlock(&audit->lock);
+}
+
+// Ожидание до срока или до отмены
+static void
+folder_audit_pause(FolderAudit *audit, gint64 usec)
+{
+    gint64 deadline = g_get_monotonic_time() + usec;
+
+    g_mutex_lock(&audit->lock);
+    while (!g_cancellable_is_cancelled(audit->cancellable) &&
+           g_cond_wait_until(&audit->cond, &audit->lock, deadline))
+        ;
+    g_mutex_unlock(&audit->lock);
+}
+
+static void
+folder_audit_cancelled(GCancellable *cancellable, gpointer user_data)
+{
+    FolderAudit *audit = user_data;
+
+    g_mutex_lock(&audit->lock);
+    g_cond_broadcast(&audit->cond);
+    g_mutex_unlock(&audit->lock);
+
+    (void)cancellable;
+}
+
+static void
+folder_audit_worker(gpointer data, gpointer user_data)
+{
+    FolderAudit *audit = user_data;
+    AuditItem *item = data;
+    gint64 started = g_get_monotonic_time();
+    CamelMimeMessage *message = NULL;
+    GError *error = NULL;
+
+    if (!g_cancellable_is_cancelled(audit->cancellable))
+        message = camel_folder_get_message_sync(item->folder, item->uid, audit->cancellable,
+                                                &error);
+
+    if (message) {
+        CamelMessageInfo *info = camel_folder_get_message_info(item->folder, item->uid);
+        GString *lines = g_string_new(NULL);
+
+        folder_audit_scan_message(audit, item, message, info, lines);
+
+        if (!g_cancellable_is_cancelled(audit->cancellable)) {
+            folder_audit_commit(audit, item, lines);
+            if (lines->len > 0)
+                g_atomic_int_inc(&audit->found);
+            g_atomic_int_inc(&audit->done);
+        }
+
+        g_string_free(lines, TRUE);
+        g_clear_object(&info);
+        g_object_unref(message);
+    } else if (!g_cancellable_is_cancelled(audit->cancellable)) {
+        g_debug("Audit: message %s in %s not read: %s", item->uid,
+                camel_folder_get_full_name(item->folder),
+                error ? error->message : "no message");
+        g_atomic_int_inc(&audit->errors);
+    }
+    g_clear_error(&error);
+
+    // Поток занят проверкой не больше cpu_percent времени: после письма
+    // он отдыхает пропорционально затраченному
+    folder_audit_pause(audit, (g_get_monotonic_time() - started) *
+                              (100 - audit->options.cpu_percent) / audit->options.cpu_percent);
+
+    g_mutex_lock(&audit->lock);
+    audit->in_flight--;
+    g_cond_broadcast(&audit->cond);
+    g_mutex_unlock(&audit->lock);
+
+    audit_item_free(item);
+}
+
+// Письма папок, не отмеченные в контрольной точке
+static void
+folder_audit_collect(FolderAudit *audit, GPtrArray *folders, GHashTable *done, GPtrArray *items)
+{
+    for (guint i = 0; i < folders->len; i++) {
+        CamelFolder *folder = g_ptr_array_index(folders, i);
+        gchar *folder_id = folder_audit_folder_id(folder, FALSE);
+        GPtrArray *uids = camel_folder_get_uids(folder);
+
+        for (guint j = 0; uids && j < uids->len; j++) {
+            const gchar *uid = g_ptr_array_index(uids, j);
+            guint64 key = folder_audit_key(folder_id, uid);
+            AuditItem *item;
+
+            if (g_hash_table_contains(done, &key)) {
+                g_atomic_int_inc(&audit->skipped);
+                continue;
+            }
+
+            item = g_new(AuditItem, 1);
+            item->folder = g_object_ref(folder);
+            item->uid = g_strdup(uid);
+            item->key = key;
+            g_ptr_array_add(items, item);
+        }
+
+        if (uids)
+            camel_folder_free_uids(folder, uids);
+        g_free(folder_id);
+    }
+
+    g_atomic_int_set(&audit->total, items->len);
+}
+
+// Письма выдаются пулу не быстрее max_read_bytes_per_sec: следующее - когда
+// "оплачено" чтение предыдущего
+static void
+folder_audit_pace(FolderAudit *audit, AuditItem *item, gint64 *next_read)
+{
+    guint64 rate = audit->options.max_read_bytes_per_sec;
+    CamelMessageInfo *info;
+    guint64 size = 0;
+    gint64 now;
+
+    if (rate == 0)
+        return;
+
+    info = camel_folder_get_message_info(item->folder, item->uid);
+    if (info) {
+        size = camel_message_info_get_size(info);
+        g_object_unref(info);
+    }
+    if (size == 0)
+        size = FOLDER_AUDIT_UNKNOWN_SIZE;
+
+    now = g_get_monotonic_time();
+    if (*next_read > now)
+        folder_audit_pause(audit, *next_read - now);
+
+    *next_read = MAX(*next_read, now) + (gint64)(size * G_USEC_PER_SEC / rate);
+}
+
+gboolean
+folder_audit_run(FolderAudit *audit, GPtrArray *folders, GCancellable *cancellable,
+                 GError **error)
+{
+    FolderAuditHeader header;
+    GHashTable *done;
+    GPtrArray *items;
+    GThreadPool *pool;
+    gchar *contents = NULL;
+    gsize checkpoint_length;
+    gulong handler_id;
+    gint64 next_read = 0;
+    guint limit, i;
+
+    g_return_val_if_fail(audit != NULL && folders != NULL, FALSE);
+    g_return_val_if_fail(audit->report == NULL, FALSE);
+
+    g_clear_object(&audit->cancellable);
+    audit->cancellable = cancellable ? g_object_ref(cancellable) : g_cancellable_new();
+
+    folder_audit_header(audit, &header);
+    done = folder_audit_load_checkpoint(audit, &header, &contents, &checkpoint_length);
+
+    if (!folder_audit_open_files(audit, &header, checkpoint_length, error)) {
+        g_hash_table_unref(done);
+        g_free(contents);
+        return FALSE;
+    }
+
+    items = g_ptr_array_new();
+    folder_audit_collect(audit, folders, done, items);
+    g_hash_table_unref(done);
+    g_free(contents);
+
+    handler_id = g_cancellable_connect(audit->cancellable, G_CALLBACK(folder_audit_cancelled),
+                                       audit, NULL);
+
+    pool = g_thread_pool_new(folder_audit_worker, audit, (gint)audit->options.max_workers,
+                             FALSE, NULL);
+    limit = audit->options.max_workers * FOLDER_AUDIT_QUEUE_PER_WORKER;
+
+    for (i = 0; i < items->len; i++) {
+        AuditItem *item = g_ptr_array_index(items, i);
+        gboolean cancelled;
+
+        folder_audit_pace(audit, item, &next_read);
+
+        // Очередь пула ограничена: письма не читаются впрок
+        g_mutex_lock(&audit->lock);
+        while (audit->in_flight >= limit && !g_cancellable_is_cancelled(audit->cancellable))
+            g_cond_wait(&audit->cond, &audit->lock);
+        cancelled = g_cancellable_is_cancelled(audit->cancellable);
+        if (!cancelled)
+            audit->in_flight++;
+        g_mutex_unlock(&audit->lock);
+
+        if (cancelled)
+            break;
+
+        g_thread_pool_push(pool, item, NULL);
+    }
+
+    // Не выданные пулу письма остаются неотмеченными
+    for (; i < items->len; i++)
+        audit_item_free(g_ptr_array_index(items, i));
+    g_ptr_array_unref(items);
+
+    g_thread_pool_free(pool, FALSE, TRUE);
+    g_cancellable_disconnect(audit->cancellable, handler_id);
+
+    fflush(audit->report);
+    fflush(audit->checkpoint);
+    fclose(audit->report);
+    fclose(audit->checkpoint);
+    audit->report = NULL;
+    audit->checkpoint = NULL;
+
+    return !g_cancellable_set_error_if_cancelled(audit->cancellable, error);
+}
@@ -0,0 +1,56 @@
+#ifndef FOLDER_AUDIT_H
+#define FOLDER_AUDIT_H
+
+#include <camel/camel.h>
+
+#include "word-dictionary.h"
+
+// Проверка уже отправленной почты: письма папок (Отправленные, Исходящие)
+// проходят тот же разбор и тот же автомат, что и проверка перед отправкой.
+//
+// Письма проверяются пулом из нескольких потоков в фоне, с ограничениями,
+// чтобы не мешать работе: доля времени, которую поток занят проверкой, и
+// скорость чтения писем. Каждое проверенное письмо отмечается в файле
+// контрольной точки по UID, поэтому прерванная проверка продолжается с
+// того же места. Контрольная точка действительна для того же словаря и тех
+// же настроек; при их смене проверка начинается заново.
+//
+// Отчёт - TSV, одна строка на место совпадения:
+//   папка  UID  дата  Message-ID  тема  место  вложение  слово
+// место - body, attachment-name или attachment.
+
+typedef struct {
+    gboolean check_body;
+    gboolean check_attachment_names;
+    gboolean check_attachment_contents;
+    guint64 max_attachment_bytes;   // предел текста одного вложения
+    guint max_workers;              // 0 - половина ядер
+    guint cpu_percent;              // доля времени потока на проверку; 0 - 25%
+    guint64 max_read_bytes_per_sec; // скорость чтения писем; 0 - без ограничения
+} FolderAuditOptions;
+
+typedef struct {
+    guint total;            // писем к проверке в этот раз
+    guint done;             // из них проверено
+    guint skipped;          // проверены в прошлый раз (контрольная точка)
+    guint found;            // писем с совпадениями
+    guint errors;           // не удалось прочитать; проверятся в следующий раз
+} FolderAuditProgress;
+
+typedef struct _FolderAudit FolderAudit;
+
+// Автомат принадлежит словарю; проверка держит ссылку на словарь
+FolderAudit* folder_audit_new(WordDictionary *dictionary, const WordMatcher *matcher,
+                              const FolderAuditOptions *options,
+                              const gchar *report_path, const gchar *checkpoint_path);
+void folder_audit_free(FolderAudit *audit);
+
+// Проверка папок (CamelFolder) до конца или до отмены. Блокирует вызвавший
+// поток - вызывается не из главного. FALSE - отменено или отчёт не записать.
+gboolean folder_audit_run(FolderAudit *audit, GPtrArray *folders,
+                          GCancellable *cancellable, GError **error);
+
+// Можно вызывать из любого потока во время проверки
+void folder_audit_get_progress(FolderAudit *audit, FolderAuditProgress *progress);
+
+#endif /* FOLDER_AUDIT_H */
@@ -0,0 +1,63 @@
+#include <stdio.h>
+
+#include "forbidden-words.h"
+#include "dictionary-file.h"
+
+// Загрузка запрещённых слов из GSettings
+gchar**
+load_forbidden_words(GSettings *settings)
+{
+    gchar **words = NULL;
+    gchar config_path[512];
+
+    // Сначала пробуем системный файл
+    words = dictionary_file_load_words(CONFIG_FILE);
+
+    // Если нет системного, пробуем пользовательский
+    if (!words) {
+        snprintf(config_path, sizeof(config_path), "%s/%s",
+                 g_get_home_dir(), USER_CONFIG_FILE);
+        words = dictionary_file_load_words(config_path);
+    }
+
+    if (!words) {
+        // Значения по умолчанию, если нет файлов
+        const gchar *default_words[] = {
+            "confidential", "secret", "password", "private", "internal", "draft", NULL
+        };
+        words = g_strdupv((gchar **)default_words);
+    }
+
+    (void)settings;
+    return words;
+}
+
+// Проверка текста на запрещённые слова
+gboolean
+check_text_for_forbidden_words(const gchar *text, WordMatcher *matcher,
+                                 gchar **found_word)
+{
+    if (!text || !matcher || word_matcher_get_n_words(matcher) == 0)
+        return FALSE;
+    
+    guint word_index = 0;
+    gboolean found;
+    
+    // Один проход по тексту для всех слов сразу
+    found = word_matcher_search(matcher, text, -1, &word_index);
+    if (found && found_word) {
+        *found_word = g_strdup(word_matcher_get_word(matcher, word_index));
+    }
+    
+    return found;
+}
+
+// Сбор всех запрещённых слов в тексте
+guint
+collect_forbidden_words(const gchar *text, const WordMatcher *matcher, WordMatches *matches)
+{
+    if (!text || !matcher || word_matcher_get_n_words(matcher) == 0)
+        return 0;
+
+    return word_matcher_search_all(matcher, text, -1, word_matches_collect, matches);
+}
@@ -0,0 +1,23 @@
+#ifndef FORBIDDEN_WORDS_H
+#define FORBIDDEN_WORDS_H
+
+#include <gio/gio.h>
+
+#include "word-matcher.h"
+#include "word-matches.h"
+
+// Путь к конфигурационному файлу
+#define CONFIG_FILE "/etc/evolution-attachment-checker/words.conf"
+#define USER_CONFIG_FILE ".config/evolution-attachment-checker/words.conf"
+
+// Список слов: системный файл, затем пользовательский, затем значения
+// по умолчанию. Не требует GTK, используется и плагином, и утилитами.
+gchar** load_forbidden_words(GSettings *settings);
+gboolean check_text_for_forbidden_words(const gchar *text, WordMatcher *matcher,
+                                         gchar **found_word);
+// Все совпадения в тексте за один проход - в matches, с местом, заданным
+// word_matches_set_place(). Возвращает их число.
+guint collect_forbidden_words(const gchar *text, const WordMatcher *matcher,
+                              WordMatches *matches);
+
+#endif /* FORBIDDEN_WORDS_H */
@@ -0,0 +1,247 @@
+#include <string.h>
+
+#include <glib/gi18n.h>
+#include <camel/camel.h>
+#include <evolution/shell/e-shell.h>
+#include <evolution/mail/e-mail-backend.h>
+
+#include "folder-audit.h"
+#include "mail-audit.h"
+#include "scan-policy.h"
+
+// Проверка идёт в фоне, пока пользователь работает: не больше четверти
+// времени каждого потока и не быстрее 8 МБ/с чтения писем
+#define MAIL_AUDIT_CPU_PERCENT 25
+#define MAIL_AUDIT_READ_BYTES_PER_SEC (8 * 1024 * 1024)
+
+// Поля меняются только в главном потоке. Проверка принадлежит состоянию
+// и остаётся после завершения, чтобы окно настроек показало итог.
+typedef struct {
+    FolderAudit *audit;         // текущая или последняя проверка
+    GCancellable *cancellable;  // NULL - проверка не идёт
+    gchar *result;              // почему последняя не дошла до конца
+    gboolean shutdown;          // плагин отключён, проверку освободит её завершение
+} MailAuditState;
+
+static MailAuditState mail_audit_state;
+
+static void
+mail_audit_add_folder(GPtrArray *folders, CamelFolder *folder)
+{
+    if (folder && !g_ptr_array_find(folders, folder, NULL))
+        g_ptr_array_add(folders, g_object_ref(folder));
+}
+
+// Локальные папки и папки отправленных учётных записей. Удалённую папку
+// может понадобиться открыть по сети, поэтому - в рабочем потоке.
+static GPtrArray*
+mail_audit_collect_folders(EMailSession *session, GCancellable *cancellable)
+{
+    GPtrArray *folders = g_ptr_array_new_with_free_func(g_object_unref);
+    ESourceRegistry *registry = e_mail_session_get_registry(session);
+    GList *sources = e_source_registry_list_enabled(registry, E_SOURCE_EXTENSION_MAIL_SUBMISSION);
+
+    mail_audit_add_folder(folders, e_mail_session_get_local_folder(session,
+                                                                   E_MAIL_LOCAL_FOLDER_SENT));
+    mail_audit_add_folder(folders, e_mail_session_get_local_folder(session,
+                                                                   E_MAIL_LOCAL_FOLDER_OUTBOX));
+
+    for (GList *link = sources; link && !g_cancellable_is_cancelled(cancellable);
+         link = link->next) {
+        ESourceMailSubmission *extension =
+            e_source_get_extension(E_SOURCE(link->data), E_SOURCE_EXTENSION_MAIL_SUBMISSION);
+        gchar *uri = e_source_mail_submission_dup_sent_folder(extension);
+        CamelFolder *folder;
+        GError *error = NULL;
+
+        if (!uri)
+            continue;
+
+        folder = e_mail_session_uri_to_folder_sync(session, uri, 0, cancellable, &error);
+        if (folder) {
+            mail_audit_add_folder(folders, folder);
+            g_object_unref(folder);
+        } else {
+            g_debug("Audit: folder %s not opened: %s", uri,
+                    error ? error->message : "unknown error");
+        }
+
+        g_clear_error(&error);
+        g_free(uri);
+    }
+
+    g_list_free_full(sources, g_object_unref);
+    return folders;
+}
+
+static void
+mail_audit_thread(GTask *task, gpointer source_object, gpointer task_data,
+                  GCancellable *cancellable)
+{
+    FolderAudit *audit = g_object_get_data(G_OBJECT(task), "folder-audit");
+    GPtrArray *folders = mail_audit_collect_folders(task_data, cancellable);
+    GError *error = NULL;
+
+    if (folder_audit_run(audit, folders, cancellable, &error))
+        g_task_return_boolean(task, TRUE);
+    else
+        g_task_return_error(task, error);
+
+    g_ptr_array_unref(folders);
+
+    (void)source_object;
+}
+
+static void
+mail_audit_done(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    MailAuditState *state = &mail_audit_state;
+    GError *error = NULL;
+
+    if (state->shutdown) {
+        folder_audit_free(state->audit);
+        memset(state, 0, sizeof(*state));
+        return;
+    }
+
+    g_clear_object(&state->cancellable);
+
+    if (!g_task_propagate_boolean(G_TASK(result), &error)) {
+        state->result = g_strdup(g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED) ?
+                                 _("остановлена") : error->message);
+        g_error_free(error);
+    }
+
+    (void)source_object;
+    (void)user_data;
+}
+
+gchar*
+mail_audit_dup_report_path(void)
+{
+    return g_build_filename(g_get_user_data_dir(), MAIL_AUDIT_DIR, MAIL_AUDIT_REPORT_FILE, NULL);
+}
+
+void
+mail_audit_start(void)
+{
+    MailAuditState *state = &mail_audit_state;
+    EShell *shell = e_shell_get_default();
+    EShellBackend *backend = shell ? e_shell_get_backend_by_name(shell, "mail") : NULL;
+    FolderAuditOptions options = { 0 };
+    PresendScanFlags flags;
+    ScanPolicy *policy;
+    gchar *report, *checkpoint;
+    GTask *task;
+
+    if (state->cancellable || state->shutdown)
+        return;
+
+    folder_audit_free(state->audit);
+    state->audit = NULL;
+    g_clear_pointer(&state->result, g_free);
+
+    if (!backend) {
+        state->result = g_strdup(_("почта недоступна"));
+        return;
+    }
+
+    policy = scan_policy_get();
+    if (!scan_policy_get_matcher(policy)) {
+        state->result = g_strdup(_("словарь пуст"));
+        scan_policy_unref(policy);
+        return;
+    }
+
+    // Те же проверки, что включены для отправки
+    flags = scan_policy_get_flags(policy);
+    options.check_body = (flags & PRESEND_SCAN_MESSAGE_BODY) != 0;
+    options.check_attachment_names = (flags & PRESEND_SCAN_ATTACHMENT_NAMES) != 0;
+    options.check_attachment_contents = (flags & PRESEND_SCAN_ATTACHMENT_CONTENTS) != 0;
+    options.max_attachment_bytes = scan_policy_get_max_attachment_bytes(policy);
+    options.cpu_percent = MAIL_AUDIT_CPU_PERCENT;
+    options.max_read_bytes_per_sec = MAIL_AUDIT_READ_BYTES_PER_SEC;
+
+    report = mail_audit_dup_report_path();
+    checkpoint = g_build_filename(g_get_user_cache_dir(), MAIL_AUDIT_DIR,
+                                  MAIL_AUDIT_CHECKPOINT_FILE, NULL);
+
+    state->audit = folder_audit_new(scan_policy_get_dictionary(policy),
+                                    scan_policy_get_matcher(policy), &options, report, checkpoint);
+    state->cancellable = g_cancellable_new();
+
+    task = g_task_new(NULL, state->cancellable, mail_audit_done, NULL);
+    g_task_set_task_data(task, g_object_ref(e_mail_backend_get_session(E_MAIL_BACKEND(backend))),
+                         g_object_unref);
+    g_object_set_data(G_OBJECT(task), "folder-audit", state->audit);
+    g_task_run_in_thread(task, mail_audit_thread);
+    g_object_unref(task);
+
+    g_free(report);
+    g_free(checkpoint);
+    scan_policy_unref(policy);
+}
+
+void
+mail_audit_stop(void)
+{
+    if (mail_audit_state.cancellable)
+        g_cancellable_cancel(mail_audit_state.cancellable);
+}
+
+gboolean
+mail_audit_is_running(void)
+{
+    return mail_audit_state.cancellable != NULL;
+}
+
+gchar*
+mail_audit_dup_status(void)
+{
+    MailAuditState *state = &mail_audit_state;
+    FolderAuditProgress progress;
+    GString *status;
+
+    if (!state->audit)
+        return state->result ? g_strdup_printf(_("Проверка не запущена: %s"), state->result) :
+                               NULL;
+
+    folder_audit_get_progress(state->audit, &progress);
+    status = g_string_new(NULL);
+
+    if (state->cancellable)
+        g_string_printf(status, _("Проверено %u из %u писем"), progress.done, progress.total);
+    else if (state->result)
+        g_string_printf(status, _("Проверка %s: проверено %u из %u писем"), state->result,
+                        progress.done, progress.total);
+    else
+        g_string_printf(status, _("Проверка завершена: %u писем"), progress.done);
+
+    if (progress.skipped > 0)
+        g_string_append_printf(status, _(", ранее проверено %u"), progress.skipped);
+    if (progress.found > 0)
+        g_string_append_printf(status, _("; с совпадениями: %u"), progress.found);
+    if (progress.errors > 0)
+        g_string_append_printf(status, _("; не прочитано: %u"), progress.errors);
+
+    return g_string_free(status, FALSE);
+}
+
+void
+mail_audit_shutdown(void)
+{
+    MailAuditState *state = &mail_audit_state;
+
+    // Рабочий поток ещё держит проверку - её освободит mail_audit_done
+    if (state->cancellable) {
+        state->shutdown = TRUE;
+        g_cancellable_cancel(state->cancellable);
+        g_clear_object(&state->cancellable);
+        g_clear_pointer(&state->result, g_free);
+        return;
+    }
+
+    folder_audit_free(state->audit);
+    g_free(state->result);
+    memset(state, 0, sizeof(*state));
+}
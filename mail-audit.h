@@ -0,0 +1,26 @@
+#ifndef MAIL_AUDIT_H
+#define MAIL_AUDIT_H
+
+#include <glib.h>
+
+// Проверка уже отправленной почты из окна настроек (folder-audit.h).
+// Папки - локальные «Отправленные» и «Исходящие» и папки отправленных
+// всех включённых учётных записей. Настройки и словарь - из текущего
+// снимка (scan-policy.h). Отчёт:
+// ~/.local/share/evolution-attachment-checker/audit.tsv
+
+#define MAIL_AUDIT_DIR "evolution-attachment-checker"
+#define MAIL_AUDIT_REPORT_FILE "audit.tsv"
+#define MAIL_AUDIT_CHECKPOINT_FILE "audit-checkpoint"
+
+// Вызываются из главного потока
+void mail_audit_start(void);
+void mail_audit_stop(void);
+gboolean mail_audit_is_running(void);
+// Состояние для окна настроек; NULL - проверка не запускалась
+gchar* mail_audit_dup_status(void);
+gchar* mail_audit_dup_report_path(void);
+// Отключение плагина: идущая проверка отменяется
+void mail_audit_shutdown(void);
+
+#endif /* MAIL_AUDIT_H */
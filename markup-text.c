@@ -0,0 +1,406 @@
+#include <string.h>
+
+#include "markup-text.h"
+
+enum {
+    MARKUP_STATE_TEXT,
+    MARKUP_STATE_TAG_OPEN,
+    MARKUP_STATE_TAG_NAME,
+    MARKUP_STATE_TAG,
+    MARKUP_STATE_ENTITY,
+    MARKUP_STATE_COMMENT,
+    MARKUP_STATE_RAW
+};
+
+// Сколько байт в начале текста смотрит markup_text_is_html
+#define MARKUP_SNIFF_BYTES 1024
+
+// Элементы, граница которых разделяет слова (локальное имя, без префикса)
+static const gchar * const block_elements[] = {
+    "p", "h", "br", "tab", "s", "tr", "td", "th", "tc", "li", "div",
+    "si", "row", "c", "table-row", "table-cell", "list-item", "line-break",
+    NULL
+};
+
+// То же для HTML: строчные элементы (b, span, a) слова не разделяют
+static const gchar * const html_block_elements[] = {
+    "p", "br", "div", "li", "tr", "td", "th", "h1", "h2", "h3", "h4", "h5", "h6",
+    "table", "ul", "ol", "dl", "dt", "dd", "blockquote", "pre", "hr", "caption",
+    "section", "article", "header", "footer", "nav", "aside", "main", "address",
+    "figure", "figcaption", "center", "option", "body",
+    NULL
+};
+
+// Элементы HTML, содержимое которых не показывается
+static const gchar * const html_raw_elements[] = {
+    "script", "style", "title", NULL
+};
+
+// Именованные сущности; c = 0 - невидимый символ, в текст не попадает
+typedef struct {
+    const gchar *name;
+    gunichar c;
+} MarkupEntity;
+
+static const MarkupEntity markup_entities[] = {
+    { "amp", '&' }, { "lt", '<' }, { "gt", '>' }, { "quot", '"' }, { "apos", '\'' },
+    { "nbsp", ' ' }, { "ensp", ' ' }, { "emsp", ' ' }, { "thinsp", ' ' },
+    { "shy", 0 }, { "zwj", 0 }, { "zwnj", 0 }, { "lrm", 0 }, { "rlm", 0 },
+    { "ndash", 0x2013 }, { "mdash", 0x2014 }, { "hellip", 0x2026 }, { "bull", 0x2022 },
+    { "middot", 0x00B7 }, { "laquo", 0x00AB }, { "raquo", 0x00BB },
+    { "lsquo", 0x2018 }, { "rsquo", 0x2019 }, { "ldquo", 0x201C }, { "rdquo", 0x201D },
+    { "copy", 0x00A9 }, { "reg", 0x00AE }, { "euro", 0x20AC }, { "times", 0x00D7 },
+    { "deg", 0x00B0 }
+};
+
+void
+markup_text_init(MarkupText *markup, MarkupTextSink sink, gpointer user_data)
+{
+    memset(markup, 0, G_STRUCT_OFFSET(MarkupText, out));
+    markup->sink = sink;
+    markup->user_data = user_data;
+    markup->state = MARKUP_STATE_TEXT;
+}
+
+void
+markup_text_init_html(MarkupText *markup, MarkupTextSink sink, gpointer user_data)
+{
+    markup_text_init(markup, sink, user_data);
+    markup->html = TRUE;
+    markup->space = TRUE;
+}
+
+static void
+markup_text_flush(MarkupText *markup)
+{
+    if (markup->n_out > 0 && !markup->stopped)
+        markup->stopped = !markup->sink(markup->out, markup->n_out, markup->user_data);
+    markup->n_out = 0;
+}
+
+static inline void
+markup_text_emit(MarkupText *markup, const gchar *data, gsize len)
+{
+    if (markup->n_out + len > sizeof(markup->out)) {
+        markup_text_flush(markup);
+
+        // Длинный кусок текста уходит приёмнику без копирования
+        if (len > sizeof(markup->out)) {
+            if (!markup->stopped)
+                markup->stopped = !markup->sink(data, len, markup->user_data);
+            return;
+        }
+    }
+    memcpy(markup->out + markup->n_out, data, len);
+    markup->n_out += len;
+}
+
+// Имя тега в списке; в HTML регистр не важен
+static const gchar*
+markup_text_find_name(MarkupText *markup, const gchar * const *names)
+{
+    const gchar *local;
+
+    if (markup->n_name == 0 || markup->n_name >= sizeof(markup->name))
+        return NULL;
+
+    markup->name[markup->n_name] = '\0';
+    local = strrchr(markup->name, ':');
+    local = local ? local + 1 : markup->name;
+
+    for (guint i = 0; names[i]; i++) {
+        if (markup->html ? g_ascii_strcasecmp(local, names[i]) == 0
+                         : strcmp(local, names[i]) == 0)
+            return names[i];
+    }
+
+    return NULL;
+}
+
+static void
+markup_text_emit_newline(MarkupText *markup)
+{
+    markup_text_emit(markup, "\n", 1);
+    markup->space = TRUE;
+}
+
+// Конец имени тега: разделитель слов для блочных элементов и начало
+// пропуска содержимого <script> и подобных
+static void
+markup_text_end_name(MarkupText *markup)
+{
+    if (markup_text_find_name(markup, markup->html ? html_block_elements : block_elements))
+        markup_text_emit_newline(markup);
+
+    markup->raw = NULL;
+    if (markup->html && !markup->closing)
+        markup->raw = markup_text_find_name(markup, html_raw_elements);
+
+    markup->attr_value = FALSE;
+    markup->quote = 0;
+    markup->slash = FALSE;
+}
+
+// '>' в конце тега: дальше текст или пропускаемое содержимое
+static void
+markup_text_end_tag(MarkupText *markup)
+{
+    if (markup->raw && !markup->slash) {
+        markup->state = MARKUP_STATE_RAW;
+        markup->n_raw = 0;
+    } else {
+        markup->state = MARKUP_STATE_TEXT;
+        markup->raw = NULL;
+    }
+}
+
+// Раскрытие &name; или &#N; - нераспознанная сущность выводится как есть
+static void
+markup_text_emit_entity(MarkupText *markup)
+{
+    const gchar *name = markup->entity;
+    gchar utf8[6];
+    gunichar c = 0;
+
+    markup->entity[markup->n_entity] = '\0';
+    markup->space = FALSE;
+
+    if (name[0] == '#') {
+        gchar *end = NULL;
+
+        if (name[1] == 'x' || name[1] == 'X')
+            c = (gunichar)g_ascii_strtoull(name + 2, &end, 16);
+        else
+            c = (gunichar)g_ascii_strtoull(name + 1, &end, 10);
+
+        if (!end || *end || end == name + 1 || !g_unichar_validate(c) || c == 0)
+            c = 0;
+    } else {
+        for (guint i = 0; i < G_N_ELEMENTS(markup_entities); i++) {
+            if (strcmp(name, markup_entities[i].name) == 0) {
+                // Невидимый символ: слово вокруг него не разрывается
+                if (!markup_entities[i].c)
+                    return;
+                c = markup_entities[i].c;
+                break;
+            }
+        }
+    }
+
+    if (c) {
+        markup_text_emit(markup, utf8, g_unichar_to_utf8(c, utf8));
+    } else {
+        markup_text_emit(markup, "&", 1);
+        markup_text_emit(markup, markup->entity, markup->n_entity);
+        markup_text_emit(markup, ";", 1);
+    }
+}
+
+gboolean
+markup_text_feed(MarkupText *markup, const gchar *data, gsize len)
+{
+    const gchar *p = data;
+    const gchar *end = data + len;
+
+    while (p < end && !markup->stopped) {
+        gchar c = *p;
+
+        switch (markup->state) {
+        case MARKUP_STATE_TEXT: {
+            // Обычный текст копируется блоком до ближайшего '<' или '&'
+            // (в HTML - и до пробела, серия которых сворачивается в один)
+            const gchar *run = p;
+
+            if (markup->html) {
+                while (p < end && *p != '<' && *p != '&' && !g_ascii_isspace(*p))
+                    p++;
+            } else {
+                while (p < end && *p != '<' && *p != '&')
+                    p++;
+            }
+            if (p > run) {
+                markup_text_emit(markup, run, p - run);
+                markup->space = FALSE;
+            }
+            if (p == end)
+                break;
+
+            if (*p == '<') {
+                markup->state = MARKUP_STATE_TAG_OPEN;
+            } else if (*p != '&') {
+                if (!markup->space)
+                    markup_text_emit(markup, " ", 1);
+                markup->space = TRUE;
+            } else {
+                markup->state = MARKUP_STATE_ENTITY;
+                markup->n_entity = 0;
+            }
+            p++;
+            break;
+        }
+
+        case MARKUP_STATE_TAG_OPEN:
+            // Как в токенизаторе HTML: тег начинается, только если за '<'
+            // идёт буква, '/', '!' или '?'. Иначе ("x < 5", "a <b" с
+            // пробелом) '<' - обычный текст, а символ разбирается заново.
+            if (g_ascii_isalpha(c) || c == '/' || c == '!' || c == '?') {
+                markup->state = MARKUP_STATE_TAG_NAME;
+                markup->n_name = 0;
+                markup->closing = FALSE;
+            } else {
+                markup_text_emit(markup, "<", 1);
+                markup->space = FALSE;
+                markup->state = MARKUP_STATE_TEXT;
+            }
+            break;
+
+        case MARKUP_STATE_TAG_NAME:
+            if (c == '/' && markup->n_name == 0) {
+                markup->closing = TRUE;
+                p++;
+            } else if (c == '>' || c == '/' || g_ascii_isspace(c)) {
+                markup_text_end_name(markup);
+                if (c == '>')
+                    markup_text_end_tag(markup);
+                else
+                    markup->state = MARKUP_STATE_TAG;
+                markup->slash = c == '/';
+                p++;
+            } else {
+                if (markup->n_name < sizeof(markup->name) - 1)
+                    markup->name[markup->n_name] = c;
+                markup->n_name = MIN(markup->n_name + 1, sizeof(markup->name));
+                p++;
+
+                // Комментарий может содержать '>' и теги - идёт до "-->"
+                if (markup->n_name == 3 && memcmp(markup->name, "!--", 3) == 0) {
+                    markup->state = MARKUP_STATE_COMMENT;
+                    markup->n_dashes = 0;
+                }
+            }
+            break;
+
+        case MARKUP_STATE_TAG:
+            // Атрибуты пропускаются; '>' внутри значения в кавычках тег не закрывает
+            for (; p < end; p++) {
+                c = *p;
+                if (markup->quote) {
+                    if (c == markup->quote)
+                        markup->quote = 0;
+                } else if (c == '>') {
+                    break;
+                } else if (markup->attr_value && (c == '"' || c == '\'')) {
+                    markup->quote = c;
+                    markup->attr_value = FALSE;
+                } else if (!g_ascii_isspace(c)) {
+                    markup->attr_value = c == '=';
+                    markup->slash = c == '/';
+                }
+            }
+            if (p == end)
+                break;
+            markup_text_end_tag(markup);
+            p++;
+            break;
+
+        case MARKUP_STATE_COMMENT:
+            if (c == '>' && markup->n_dashes >= 2)
+                markup->state = MARKUP_STATE_TEXT;
+            markup->n_dashes = (c == '-') ? markup->n_dashes + 1 : 0;
+            p++;
+            break;
+
+        case MARKUP_STATE_RAW:
+            // Содержимое <script>/<style> пропускается до "</имя" и
+            // следующего за ним '>', '/' или пробела
+            if (markup->n_raw == 0) {
+                p = memchr(p, '<', end - p);
+                if (!p)
+                    return !markup->stopped;
+                markup->n_raw = 1;
+                p++;
+            } else if (markup->n_raw >= 2 && markup->raw[markup->n_raw - 2] == '\0' &&
+                       (c == '>' || c == '/' || g_ascii_isspace(c))) {
+                // Символ разбирается уже как часть закрывающего тега
+                markup->state = MARKUP_STATE_TAG;
+                markup->raw = NULL;
+                markup->attr_value = FALSE;
+                markup->quote = 0;
+                markup->slash = FALSE;
+            } else if (g_ascii_tolower(c) ==
+                       (markup->n_raw == 1 ? '/' : markup->raw[markup->n_raw - 2])) {
+                markup->n_raw++;
+                p++;
+            } else {
+                // Текущий символ проверяется заново: он может начинать "</"
+                markup->n_raw = 0;
+            }
+            break;
+
+        case MARKUP_STATE_ENTITY:
+            if (c == ';') {
+                markup_text_emit_entity(markup);
+                markup->state = MARKUP_STATE_TEXT;
+                p++;
+            } else if ((g_ascii_isalnum(c) || c == '#') &&
+                       markup->n_entity < sizeof(markup->entity) - 1) {
+                markup->entity[markup->n_entity++] = c;
+                p++;
+            } else {
+                // Не сущность: '&' и собранное выводятся как текст,
+                // текущий символ разбирается заново
+                markup_text_emit(markup, "&", 1);
+                markup_text_emit(markup, markup->entity, markup->n_entity);
+                markup->state = MARKUP_STATE_TEXT;
+            }
+            break;
+        }
+    }
+
+    return !markup->stopped;
+}
+
+gboolean
+markup_text_is_html(const gchar *data, gsize len)
+{
+    static const gchar * const markers[] = {
+        "<!doctype html", "<html", "<head", "<body", "<div", "<p>", "<p ", "<br", "<span",
+        "<table", "<meta", "<style", NULL
+    };
+    gchar *start;
+    gboolean html = FALSE;
+
+    // Текст в UTF-8 может начинаться с BOM, дальше - сразу с тега
+    if (len >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        data += 3;
+        len -= 3;
+    }
+    while (len > 0 && g_ascii_isspace(*data)) {
+        data++;
+        len--;
+    }
+    if (len == 0 || *data != '<')
+        return FALSE;
+
+    start = g_ascii_strdown(data, MIN(len, MARKUP_SNIFF_BYTES));
+    for (guint i = 0; markers[i] && !html; i++)
+        html = strstr(start, markers[i]) != NULL;
+    g_free(start);
+
+    return html;
+}
+
+gboolean
+markup_text_finish(MarkupText *markup)
+{
+    if (markup->state == MARKUP_STATE_ENTITY) {
+        markup_text_emit(markup, "&", 1);
+        markup_text_emit(markup, markup->entity, markup->n_entity);
+    } else if (markup->state == MARKUP_STATE_TAG_OPEN) {
+        markup_text_emit(markup, "<", 1);
+    }
+    markup->state = MARKUP_STATE_TEXT;
+    markup_text_flush(markup);
+
+    return !markup->stopped;
+}
@@ -0,0 +1,53 @@
+#ifndef MARKUP_TEXT_H
+#define MARKUP_TEXT_H
+
+#include <glib.h>
+
+// Потоковое извлечение текста из XML-разметки (content.xml, document.xml).
+// Теги отбрасываются, сущности раскрываются, на границах абзацев и ячеек
+// вставляется перевод строки, чтобы слова соседних абзацев не склеивались.
+// Текст отдаётся приёмнику блоками, без сборки документа в памяти.
+//
+// В режиме HTML приёмник получает только видимый текст: содержимое
+// <script>, <style> и <title> и комментарии пропускаются, атрибуты (в том
+// числе data:-адреса встроенных картинок и inline CSS) тоже, имена тегов
+// не зависят от регистра, а пробелы и переводы строк исходника
+// сворачиваются в один пробел, как при показе письма.
+
+// Приёмник текста; FALSE - остановить разбор
+typedef gboolean (*MarkupTextSink)(const gchar *data, gsize len, gpointer user_data);
+
+#define MARKUP_TEXT_BUFFER 4096
+
+typedef struct {
+    MarkupTextSink sink;
+    gpointer user_data;
+    gboolean html;
+    guint state;
+    gchar name[16];         // начало имени текущего тега
+    guint n_name;
+    gboolean closing;       // тег </...>
+    gboolean attr_value;    // в теге после '=': кавычка открывает значение
+    gchar quote;            // кавычка текущего значения атрибута
+    gboolean slash;         // последний символ тега - '/' (пустой элемент)
+    const gchar *raw;       // элемент, содержимое которого пропускается
+    guint n_raw;            // совпавшие символы "</имя" внутри него
+    guint n_dashes;         // '-' подряд внутри комментария
+    gboolean space;         // последним выведен пробел (HTML)
+    gchar entity[12];       // незавершённая сущность &...;
+    guint n_entity;
+    gboolean stopped;
+    gsize n_out;
+    gchar out[MARKUP_TEXT_BUFFER];
+} MarkupText;
+
+void markup_text_init(MarkupText *markup, MarkupTextSink sink, gpointer user_data);
+void markup_text_init_html(MarkupText *markup, MarkupTextSink sink, gpointer user_data);
+// FALSE, если приёмник остановил разбор
+gboolean markup_text_feed(MarkupText *markup, const gchar *data, gsize len);
+gboolean markup_text_finish(MarkupText *markup);
+
+// Похож ли текст на HTML-документ (по началу, без разбора целиком)
+gboolean markup_text_is_html(const gchar *data, gsize len);
+
+#endif /* MARKUP_TEXT_H */
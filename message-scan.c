@@ -0,0 +1,279 @@
+#include <camel/camel.h>
+
+#include "message-scan.h"
+
+// Письма, у которых текстовых частей меньше этого (в закодированном виде),
+// проверяются в текущем потоке: запуск пула дороже самой проверки
+#define MESSAGE_SCAN_PARALLEL_BYTES (256 * 1024)
+
+// Текстовая часть, найденная обходом, и результат её проверки
+typedef struct {
+    CamelMimePart *part;
+    gboolean html;
+    gboolean found;
+    guint word_index;
+    guint64 scanned;
+    WordMatches *matches;   // при сборе - свои у каждой части
+} MessageScanLeaf;
+
+// Общее состояние проверки частей одного письма
+typedef struct {
+    const WordMatcher *matcher;
+    GArray *leaves;         // MessageScanLeaf
+    gboolean collect;
+    ScanArena *arena;       // при сборе - область памяти общего списка
+    gssize budget;          // остаток текста на всё письмо (атомарно)
+    GCancellable *stop;     // отменяется пользователем или первым совпадением
+} MessageScanJob;
+
+// Обход дерева частей без декодирования. Тип проверяется у содержимого:
+// у multipart и message/rfc822 сама часть - обычный CamelMimePart.
+static void
+message_scan_walk(CamelMimePart *part, guint depth, GArray *leaves,
+                  guint *n_parts, gsize *encoded)
+{
+    CamelDataWrapper *content;
+    CamelContentType *content_type;
+    MessageScanLeaf leaf = { 0 };
+    GByteArray *bytes;
+
+    if (!part)
+        return;
+
+    if (depth > MESSAGE_SCAN_MAX_DEPTH || *n_parts >= MESSAGE_SCAN_MAX_PARTS) {
+        g_debug("MIME part skipped: depth %u, %u parts walked", depth, *n_parts);
+        return;
+    }
+    (*n_parts)++;
+
+    content = camel_medium_get_content(CAMEL_MEDIUM(part));
+    if (!content)
+        return;
+
+    if (CAMEL_IS_MULTIPART(content)) {
+        CamelMultipart *multipart = CAMEL_MULTIPART(content);
+        guint n = camel_multipart_get_number(multipart);
+
+        g_debug("Multipart with %u parts at depth %u", n, depth);
+
+        for (guint i = 0; i < n; i++)
+            message_scan_walk(camel_multipart_get_part(multipart, i), depth + 1,
+                              leaves, n_parts, encoded);
+        return;
+    }
+
+    // Вложенное или пересланное письмо: его текст - тоже текст письма
+    if (CAMEL_IS_MIME_MESSAGE(content)) {
+        message_scan_walk(CAMEL_MIME_PART(content), depth + 1, leaves, n_parts, encoded);
+        return;
+    }
+
+    // Файлы проверяются как вложения (message_scan_collect_attachments)
+    if (camel_mime_part_get_filename(part))
+        return;
+
+    content_type = camel_mime_part_get_content_type(part);
+    if (!content_type || !camel_content_type_is(content_type, "text", "*"))
+        return;
+
+    leaf.part = part;
+    leaf.html = camel_content_type_is(content_type, "text", "html");
+    g_array_append_val(leaves, leaf);
+
+    bytes = camel_data_wrapper_get_byte_array(content);
+    if (bytes)
+        *encoded += bytes->len;
+}
+
+// Декодирование одной части прямо в автомат
+static void
+message_scan_leaf(MessageScanJob *job, MessageScanLeaf *leaf)
+{
+    CamelDataWrapper *content = camel_medium_get_content(CAMEL_MEDIUM(leaf->part));
+    GOutputStream *stream;
+    GError *error = NULL;
+
+    if (g_cancellable_is_cancelled(job->stop))
+        return;
+
+    stream = scan_output_stream_new(job->matcher);
+    scan_output_stream_set_budget(SCAN_OUTPUT_STREAM(stream), &job->budget);
+    if (job->collect) {
+        leaf->matches = word_matches_new_in(job->arena);
+        word_matches_set_place(leaf->matches, WORD_MATCH_BODY, 0);
+        scan_output_stream_set_matches(SCAN_OUTPUT_STREAM(stream), leaf->matches);
+    }
+
+    // Из HTML в автомат идёт только видимый текст
+    if (leaf->html)
+        scan_output_stream_begin_html(SCAN_OUTPUT_STREAM(stream));
+
+    // Остановка после найденного слова, по отмене или по пределу - не ошибка
+    if (camel_data_wrapper_decode_to_output_stream_sync(content, stream, job->stop, &error) < 0 &&
+        error && !scan_output_stream_get_match(SCAN_OUTPUT_STREAM(stream), NULL) &&
+        !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
+        !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE)) {
+        g_warning("Error decoding data wrapper: %s", error->message);
+    }
+    g_clear_error(&error);
+
+    // Закрытие завершает разбор HTML и последнее слово части
+    g_output_stream_close(stream, NULL, NULL);
+    leaf->found = scan_output_stream_get_match(SCAN_OUTPUT_STREAM(stream), &leaf->word_index);
+    leaf->scanned = scan_output_stream_get_bytes_scanned(SCAN_OUTPUT_STREAM(stream));
+
+    if (leaf->found)
+        g_cancellable_cancel(job->stop);
+
+    g_object_unref(stream);
+}
+
+static void
+message_scan_worker(gpointer data, gpointer user_data)
+{
+    MessageScanJob *job = user_data;
+
+    message_scan_leaf(job, &g_array_index(job->leaves, MessageScanLeaf,
+                                          GPOINTER_TO_UINT(data) - 1));
+}
+
+static void
+message_scan_cancelled(GCancellable *cancellable, gpointer user_data)
+{
+    g_cancellable_cancel(G_CANCELLABLE(user_data));
+    (void)cancellable;
+}
+
+static gboolean
+message_scan_run(CamelMimePart *part, const WordMatcher *matcher, guint64 max_bytes,
+                 GCancellable *cancellable, WordMatches *matches,
+                 guint *word_index, guint64 *bytes_scanned)
+{
+    MessageScanJob job = { 0 };
+    gulong handler_id = 0;
+    guint n_parts = 0;
+    gsize encoded = 0;
+    guint64 base = 0, scanned = 0;
+    gboolean found = FALSE;
+
+    if (!max_bytes)
+        max_bytes = MESSAGE_SCAN_DEFAULT_MAX_BYTES;
+
+    job.matcher = matcher;
+    job.leaves = g_array_new(FALSE, TRUE, sizeof(MessageScanLeaf));
+    job.collect = matches != NULL;
+    job.arena = matches ? word_matches_get_arena(matches) : NULL;
+    job.budget = (gssize)MIN(max_bytes, (guint64)G_MAXSSIZE);
+
+    message_scan_walk(part, 0, job.leaves, &n_parts, &encoded);
+
+    if (job.leaves->len > 0) {
+        job.stop = g_cancellable_new();
+        if (cancellable)
+            handler_id = g_cancellable_connect(cancellable, G_CALLBACK(message_scan_cancelled),
+                                               g_object_ref(job.stop), g_object_unref);
+
+        // Части раскладываются по ядрам; первое совпадение отменяет остальные
+        // (при сборе отменяет только пользователь)
+        if (job.leaves->len > 1 && encoded >= MESSAGE_SCAN_PARALLEL_BYTES) {
+            GThreadPool *pool = g_thread_pool_new(message_scan_worker, &job,
+                                                  (gint)MIN(job.leaves->len,
+                                                            g_get_num_processors()),
+                                                  FALSE, NULL);
+
+            for (guint i = 0; i < job.leaves->len; i++)
+                g_thread_pool_push(pool, GUINT_TO_POINTER(i + 1), NULL);
+            g_thread_pool_free(pool, FALSE, TRUE);
+        } else {
+            for (guint i = 0; i < job.leaves->len; i++)
+                message_scan_leaf(&job, &g_array_index(job.leaves, MessageScanLeaf, i));
+        }
+
+        if (handler_id)
+            g_cancellable_disconnect(cancellable, handler_id);
+        g_object_unref(job.stop);
+    }
+
+    // Результаты в порядке частей; смещения - как если бы части шли одним
+    // текстом через перевод строки
+    for (guint i = 0; i < job.leaves->len; i++) {
+        MessageScanLeaf *leaf = &g_array_index(job.leaves, MessageScanLeaf, i);
+
+        if (leaf->matches) {
+            if (word_matches_get_total(leaf->matches) > 0)
+                found = TRUE;
+            word_matches_append_at(matches, leaf->matches, base);
+            word_matches_free(leaf->matches);
+        } else if (leaf->found && !found) {
+            if (word_index)
+                *word_index = leaf->word_index;
+            found = TRUE;
+        }
+
+        base += leaf->scanned + 1;
+        scanned += leaf->scanned;
+    }
+
+    g_debug("Message text: %u text parts of %u, %" G_GUINT64_FORMAT " bytes scanned",
+            job.leaves->len, n_parts, scanned);
+
+    if (bytes_scanned)
+        *bytes_scanned = scanned;
+
+    g_array_unref(job.leaves);
+
+    return found;
+}
+
+gboolean
+message_scan_text(CamelMimePart *part, const WordMatcher *matcher,
+                  guint64 max_bytes, GCancellable *cancellable,
+                  guint *word_index, guint64 *bytes_scanned)
+{
+    return message_scan_run(part, matcher, max_bytes, cancellable, NULL,
+                            word_index, bytes_scanned);
+}
+
+gboolean
+message_scan_text_collect(CamelMimePart *part, const WordMatcher *matcher,
+                          guint64 max_bytes, GCancellable *cancellable,
+                          WordMatches *matches, guint64 *bytes_scanned)
+{
+    return message_scan_run(part, matcher, max_bytes, cancellable, matches,
+                            NULL, bytes_scanned);
+}
+
+static void
+message_scan_collect_attachments_real(CamelMimePart *part, guint depth, GPtrArray *sources)
+{
+    CamelDataWrapper *content;
+
+    if (!part || depth > MESSAGE_SCAN_MAX_DEPTH)
+        return;
+
+    content = camel_medium_get_content(CAMEL_MEDIUM(part));
+
+    if (content && CAMEL_IS_MULTIPART(content)) {
+        CamelMultipart *multipart = CAMEL_MULTIPART(content);
+        guint n_parts = camel_multipart_get_number(multipart);
+
+        for (guint i = 0; i < n_parts; i++)
+            message_scan_collect_attachments_real(camel_multipart_get_part(multipart, i),
+                                                  depth + 1, sources);
+        return;
+    }
+
+    if (camel_mime_part_get_filename(part))
+        g_ptr_array_add(sources, attachment_source_new_for_mime_part(part));
+
+    // Вложения пересланного письма
+    if (content && CAMEL_IS_MIME_MESSAGE(content))
+        message_scan_collect_attachments_real(CAMEL_MIME_PART(content), depth + 1, sources);
+}
+
+// Сбор вложений письма (частей с именем файла) для проверки содержимого
+void
+message_scan_collect_attachments(CamelMimePart *part, GPtrArray *sources)
+{
+    message_scan_collect_attachments_real(part, 0, sources);
+}
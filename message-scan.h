@@ -0,0 +1,42 @@
+#ifndef MESSAGE_SCAN_H
+#define MESSAGE_SCAN_H
+
+#include <gio/gio.h>
+
+#include "attachment-scan.h"
+#include "scan-output-stream.h"
+
+// Извлечение текста из MIME-структуры письма (Camel) без GTK:
+// используется и проверкой перед отправкой, и пакетной утилитой.
+//
+// Дерево частей обходится без декодирования: multipart, вложенные и
+// пересылаемые письма (message/rfc822) раскрываются, нетекстовые части
+// пропускаются не читая. Текстовые части декодируются прямо в автомат,
+// крупные письма - параллельно по частям. Совпадения и смещения такие же,
+// как при последовательной проверке частей, разделённых переводом строки.
+
+// Ограничение по умолчанию на объём декодированного текста всего письма
+#define MESSAGE_SCAN_DEFAULT_MAX_BYTES (64 * 1024 * 1024)
+// Глубина вложенности multipart и писем в письмах
+#define MESSAGE_SCAN_MAX_DEPTH 16
+// Частей, которые обходятся в одном письме; остальные пропускаются
+#define MESSAGE_SCAN_MAX_PARTS 1024
+
+// Проверка текста письма; max_bytes - 0 для значения по умолчанию.
+// Возвращает TRUE и слово из первой по порядку части среди найденных
+// (после совпадения остальные части не проверяются). bytes_scanned
+// (может быть NULL) - сколько байт текста прошло через автомат.
+gboolean message_scan_text(CamelMimePart *part, const WordMatcher *matcher,
+                           guint64 max_bytes, GCancellable *cancellable,
+                           guint *word_index, guint64 *bytes_scanned);
+// То же со сбором всех совпадений: они дописываются в matches как
+// WORD_MATCH_BODY
+gboolean message_scan_text_collect(CamelMimePart *part, const WordMatcher *matcher,
+                                   guint64 max_bytes, GCancellable *cancellable,
+                                   WordMatches *matches, guint64 *bytes_scanned);
+
+// Части с именем файла добавляются в sources как AttachmentSource,
+// в том числе вложения пересылаемых писем
+void message_scan_collect_attachments(CamelMimePart *part, GPtrArray *sources);
+
+#endif /* MESSAGE_SCAN_H */
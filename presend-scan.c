@@ -0,0 +1,338 @@
+#include <string.h>
+
+#include <camel/camel.h>
+#include <evolution/e-util/e-util.h>
+#include <evolution/composer/e-msg-composer.h>
+
+#include "attachment-checker.h"
+#include "attachment-scan.h"
+#include "markup-text.h"
+#include "message-scan.h"
+#include "presend-scan.h"
+#include "scan-output-stream.h"
+
+// Размер блока при подаче готового текста: отмена срабатывает между блоками
+#define PRESEND_SCAN_CHUNK (64 * 1024)
+
+struct _PresendScan {
+    ScanArena *arena;               // временные данные проверки, включая её саму
+    WordDictionary *dictionary;     // держит автомат живым, пока идёт проверка
+    WordMatcher *matcher;
+    PresendScanFlags flags;
+    guint64 max_attachment_bytes;
+
+    // Данные, полученные из композера в главном потоке
+    GPtrArray *attachments;         // AttachmentSource
+    GByteArray *raw_text;
+    CamelMimeMessage *message;
+    gchar *text;
+
+    BlockScanCache *blocks;         // кэш фоновой проверки черновика
+    ScanOutputStream *stream;
+    guint64 bytes_total;            // 0 - объём заранее неизвестен
+    gint scanning_attachments;      // идёт проверка содержимого вложений (атомарно)
+    WordMatches *matches;           // все совпадения: имена, текст, вложения
+    ScanTiming timing;              // этапы рабочего потока
+};
+
+// Подача готового текста блоками
+static void
+scan_buffer(ScanOutputStream *stream, const gchar *data, gsize len, GCancellable *cancellable)
+{
+    while (len > 0 && !scan_output_stream_get_match(stream, NULL)) {
+        gsize n = MIN(len, PRESEND_SCAN_CHUNK);
+        
+        if (!g_output_stream_write_all(G_OUTPUT_STREAM(stream), data, n,
+                                       NULL, cancellable, NULL))
+            break;
+        data += n;
+        len -= n;
+    }
+}
+
+AttachmentSource*
+presend_attachment_source_new(EAttachment *attachment)
+{
+    AttachmentSource *source;
+    GFileInfo *info = e_attachment_ref_file_info(attachment);
+    GFile *file = e_attachment_ref_file(attachment);
+    CamelMimePart *mime_part = e_attachment_ref_mime_part(attachment);
+    const gchar *content_type = info ? g_file_info_get_content_type(info) : NULL;
+    
+    // Файл на диске читается напрямую; у пересылаемых вложений его нет
+    if (file) {
+        source = attachment_source_new_for_file(file, NULL, content_type);
+    } else if (mime_part) {
+        source = attachment_source_new_for_mime_part(mime_part);
+        if (!source->name && info && g_file_info_get_display_name(info)) {
+            source->name = g_strdup(g_file_info_get_display_name(info));
+            source->kind = attachment_kind_classify(source->name, source->content_type);
+        }
+    } else {
+        source = g_new0(AttachmentSource, 1);
+        if (info && g_file_info_get_display_name(info))
+            source->name = g_strdup(g_file_info_get_display_name(info));
+    }
+    
+    g_clear_object(&file);
+    g_clear_object(&mime_part);
+    g_clear_object(&info);
+    return source;
+}
+
+PresendScan*
+presend_scan_new(EMsgComposer *composer, WordDictionary *dictionary,
+                 WordMatcher *matcher, PresendScanFlags flags,
+                 guint64 max_attachment_bytes)
+{
+    ScanArena *arena = scan_arena_acquire();
+    PresendScan *scan = scan_arena_alloc0(arena, sizeof(PresendScan));
+    
+    scan->arena = arena;
+    scan->dictionary = word_dictionary_ref(dictionary);
+    scan->matcher = matcher;
+    scan->flags = flags;
+    scan->max_attachment_bytes = max_attachment_bytes;
+    scan->matches = word_matches_new_in(arena);
+    scan->stream = SCAN_OUTPUT_STREAM(scan_output_stream_new(matcher));
+    scan_output_stream_set_matches(scan->stream, scan->matches);
+    scan->attachments = g_ptr_array_new_with_free_func((GDestroyNotify)attachment_source_free);
+    
+    // Вложения берутся из модели GTK - только в главном потоке
+    if (flags & (PRESEND_SCAN_ATTACHMENT_NAMES | PRESEND_SCAN_ATTACHMENT_CONTENTS)) {
+        EAttachmentView *view = e_msg_composer_get_attachment_view(composer);
+        if (view) {
+            EAttachmentStore *store = e_attachment_view_get_store(view);
+            GList *attachments = store ? e_attachment_store_get_attachments(store) : NULL;
+            
+            for (GList *item = attachments; item; item = item->next) {
+                g_ptr_array_add(scan->attachments,
+                                presend_attachment_source_new(E_ATTACHMENT(item->data)));
+            }
+            g_list_free_full(attachments, g_object_unref);
+        }
+    }
+    
+    if (!(flags & PRESEND_SCAN_MESSAGE_BODY))
+        return scan;
+    
+    g_debug("Getting message text from composer");
+    
+    // Способ 1: Пробуем получить через raw message text
+    scan->raw_text = e_msg_composer_get_raw_message_text(composer);
+    
+    if (scan->raw_text && scan->raw_text->len > 0) {
+        g_debug("Got raw message text, length: %u", scan->raw_text->len);
+        scan->bytes_total = scan->raw_text->len;
+        return scan;
+    }
+    
+    g_clear_pointer(&scan->raw_text, g_byte_array_unref);
+    
+    // Способ 2: Camel MIME сообщение, декодируется в рабочем потоке
+    g_object_get(composer, "message", &scan->message, NULL);
+    
+    // Способ 3: свойство composer, если в сообщении текста не окажется
+    g_object_get(composer, "text", &scan->text, NULL);
+    
+    return scan;
+}
+
+void
+presend_scan_free(PresendScan *scan)
+{
+    if (!scan)
+        return;
+    
+    g_ptr_array_unref(scan->attachments);
+    if (scan->raw_text)
+        g_byte_array_unref(scan->raw_text);
+    g_clear_object(&scan->message);
+    g_free(scan->text);
+    g_clear_object(&scan->stream);
+    g_clear_pointer(&scan->blocks, block_scan_cache_unref);
+    word_dictionary_unref(scan->dictionary);
+    // Совпадения и сама проверка уходят вместе с областью
+    scan_arena_release(scan->arena);
+}
+
+static void
+presend_scan_attachment_names(PresendScan *scan, GCancellable *cancellable)
+{
+    for (guint i = 0; i < scan->attachments->len; i++) {
+        AttachmentSource *source = g_ptr_array_index(scan->attachments, i);
+        
+        if (g_cancellable_is_cancelled(cancellable))
+            return;
+        
+        word_matches_set_place(scan->matches, WORD_MATCH_ATTACHMENT_NAME, i);
+        collect_forbidden_words(source->name, scan->matcher, scan->matches);
+        
+        // Упаковка в архив не должна скрывать имена файлов
+        attachment_scan_archive_names(source, scan->matcher, cancellable, scan->matches, i, NULL);
+    }
+}
+
+static void
+presend_scan_attachment_contents(PresendScan *scan, GCancellable *cancellable)
+{
+    g_atomic_int_set(&scan->scanning_attachments, 1);
+    
+    if (attachment_scan_all_collect(scan->attachments, scan->matcher, scan->max_attachment_bytes,
+                                    cancellable, scan->matches))
+        g_debug("Forbidden words found inside attachments");
+    
+    g_atomic_int_set(&scan->scanning_attachments, 0);
+}
+
+static void
+presend_scan_message_body(PresendScan *scan, GCancellable *cancellable)
+{
+    ScanOutputStream *stream = scan->stream;
+    
+    word_matches_set_place(scan->matches, WORD_MATCH_BODY, 0);
+    
+    if (scan->raw_text && markup_text_is_html((const gchar *)scan->raw_text->data,
+                                              scan->raw_text->len)) {
+        // Разметка режется на блоки не по тегам, поэтому кэш блоков
+        // здесь не используется: текст идёт через разбор HTML целиком
+        scan->timing.extraction = SCAN_EXTRACTION_RAW_TEXT;
+        scan_output_stream_begin_html(stream);
+        scan_buffer(stream, (const gchar *)scan->raw_text->data, scan->raw_text->len,
+                    cancellable);
+        scan_output_stream_end_html(stream);
+    } else if (scan->raw_text && scan->blocks) {
+        // Фоновая проверка уже прошла по большей части текста:
+        // автомат запускается только по изменившимся блокам
+        scan->timing.extraction = SCAN_EXTRACTION_RAW_TEXT;
+        scan->timing.bytes_scanned = scan->raw_text->len;
+        block_scan_cache_collect(scan->blocks, scan->matcher,
+                                 (const gchar *)scan->raw_text->data, scan->raw_text->len,
+                                 cancellable, scan->matches);
+        return;
+    } else if (scan->raw_text) {
+        scan->timing.extraction = SCAN_EXTRACTION_RAW_TEXT;
+        scan_buffer(stream, (const gchar *)scan->raw_text->data, scan->raw_text->len,
+                    cancellable);
+    } else {
+        if (scan->message) {
+            guint64 scanned = 0;
+            
+            // Части письма проверяются каждая своим автоматом, без общего потока
+            g_debug("Got Camel message");
+            message_scan_text_collect(CAMEL_MIME_PART(scan->message), scan->matcher, 0,
+                                      cancellable, scan->matches, &scanned);
+            if (scanned > 0) {
+                scan->timing.extraction = SCAN_EXTRACTION_MESSAGE;
+                scan->timing.bytes_scanned = scanned;
+                g_debug("Scanned message text length: %" G_GUINT64_FORMAT, scanned);
+                return;
+            }
+        }
+        
+        if (scan->text && *scan->text) {
+            g_debug("Got text from composer property, length: %lu", strlen(scan->text));
+            scan->timing.extraction = SCAN_EXTRACTION_TEXT_PROPERTY;
+            scan_buffer(stream, scan->text, strlen(scan->text), cancellable);
+        }
+    }
+    
+    scan->timing.bytes_scanned = scan_output_stream_get_bytes_scanned(stream);
+    g_debug("Scanned message text length: %" G_GUINT64_FORMAT, scan->timing.bytes_scanned);
+    
+    // Совпадения уже в scan->matches; закрытие завершает последнее слово
+    g_output_stream_close(G_OUTPUT_STREAM(stream), NULL, NULL);
+}
+
+static void
+presend_scan_thread(GTask *task, gpointer source_object,
+                    gpointer task_data, GCancellable *cancellable)
+{
+    PresendScan *scan = task_data;
+    GError *error = NULL;
+    gint64 started = scan_timing_begin();
+    
+    // Проверяется всё: пользователю показываются все совпадения сразу.
+    // Сначала дешёвые проверки, содержимое вложений - последним.
+    if (scan->flags & PRESEND_SCAN_ATTACHMENT_NAMES)
+        presend_scan_attachment_names(scan, cancellable);
+    
+    if (scan->flags & PRESEND_SCAN_MESSAGE_BODY)
+        presend_scan_message_body(scan, cancellable);
+    
+    scan_timing_end(&scan->timing, SCAN_PHASE_MATCHING, started);
+    
+    if (scan->flags & PRESEND_SCAN_ATTACHMENT_CONTENTS) {
+        started = scan_timing_begin();
+        presend_scan_attachment_contents(scan, cancellable);
+        scan_timing_end(&scan->timing, SCAN_PHASE_ATTACHMENTS, started);
+    }
+    
+    scan->timing.n_attachments = scan->attachments->len;
+    scan->timing.found = word_matches_get_total(scan->matches) > 0;
+    
+    if (g_cancellable_set_error_if_cancelled(cancellable, &error))
+        g_task_return_error(task, error);
+    else
+        g_task_return_boolean(task, TRUE);
+    
+    (void)source_object;
+}
+
+void
+presend_scan_set_block_cache(PresendScan *scan, BlockScanCache *cache)
+{
+    g_clear_pointer(&scan->blocks, block_scan_cache_unref);
+    scan->blocks = cache ? block_scan_cache_ref(cache) : NULL;
+}
+
+void
+presend_scan_run_async(PresendScan *scan, GCancellable *cancellable,
+                       GAsyncReadyCallback callback, gpointer user_data)
+{
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+    
+    g_task_set_task_data(task, scan, NULL);
+    g_task_run_in_thread(task, presend_scan_thread);
+    g_object_unref(task);
+}
+
+gboolean
+presend_scan_finish(PresendScan *scan, GAsyncResult *result, GError **error)
+{
+    (void)scan;
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+gdouble
+presend_scan_get_progress(PresendScan *scan)
+{
+    if (!scan->bytes_total || g_atomic_int_get(&scan->scanning_attachments))
+        return -1.0;
+    
+    return MIN(1.0, (gdouble)scan_output_stream_get_progress(scan->stream) / scan->bytes_total);
+}
+
+const WordMatches*
+presend_scan_get_matches(PresendScan *scan)
+{
+    return scan->matches;
+}
+
+GPtrArray*
+presend_scan_get_attachments(PresendScan *scan)
+{
+    return scan->attachments;
+}
+
+const ScanTiming*
+presend_scan_get_timing(PresendScan *scan)
+{
+    return &scan->timing;
+}
+
+ScanArena*
+presend_scan_get_arena(PresendScan *scan)
+{
+    return scan->arena;
+}
@@ -0,0 +1,49 @@
+#ifndef PRESEND_SCAN_H
+#define PRESEND_SCAN_H
+
+#include <gio/gio.h>
+
+#include "attachment-scan.h"
+#include "block-scan.h"
+#include "scan-arena.h"
+#include "scan-timing.h"
+#include "word-dictionary.h"
+
+// Проверка письма перед отправкой, вынесенная из главного потока.
+// presend_scan_new() забирает из композера всё, что требует главного
+// потока (текст, MIME-сообщение, список вложений), а декодирование и
+// поиск выполняются в рабочем потоке GTask.
+typedef struct _PresendScan PresendScan;
+
+typedef enum {
+    PRESEND_SCAN_ATTACHMENT_NAMES    = 1 << 0,
+    PRESEND_SCAN_ATTACHMENT_CONTENTS = 1 << 1,
+    PRESEND_SCAN_MESSAGE_BODY        = 1 << 2
+} PresendScanFlags;
+
+// max_attachment_bytes - предел текста одного вложения (0 - по умолчанию)
+PresendScan* presend_scan_new(EMsgComposer *composer, WordDictionary *dictionary,
+                              WordMatcher *matcher, PresendScanFlags flags,
+                              guint64 max_attachment_bytes);
+void presend_scan_free(PresendScan *scan);
+// Вложение композера в виде, пригодном для проверки в рабочем потоке
+AttachmentSource* presend_attachment_source_new(EAttachment *attachment);
+// Текст письма проверяется по блокам с учётом результатов фоновой проверки
+void presend_scan_set_block_cache(PresendScan *scan, BlockScanCache *cache);
+
+void presend_scan_run_async(PresendScan *scan, GCancellable *cancellable,
+                            GAsyncReadyCallback callback, gpointer user_data);
+// FALSE, если проверка отменена или не выполнена
+gboolean presend_scan_finish(PresendScan *scan, GAsyncResult *result, GError **error);
+
+// Доля выполненной работы 0..1 или -1, если общий объём неизвестен
+gdouble presend_scan_get_progress(PresendScan *scan);
+// Все найденные совпадения; номера вложений - индексы в списке вложений
+const WordMatches* presend_scan_get_matches(PresendScan *scan);
+GPtrArray* presend_scan_get_attachments(PresendScan *scan);
+// Время этапов рабочего потока; читается после завершения проверки
+const ScanTiming* presend_scan_get_timing(PresendScan *scan);
+// Область памяти проверки: живёт до presend_scan_free()
+ScanArena* presend_scan_get_arena(PresendScan *scan);
+
+#endif /* PRESEND_SCAN_H */
@@ -0,0 +1,221 @@
+#include <string.h>
+
+#include "scan-arena.h"
+
+// Обычный блок; больший запрос получает отдельный блок своего размера
+#define SCAN_ARENA_BLOCK_SIZE (64 * 1024)
+// Столько блоков переживает сброс, остальное возвращается в кучу
+#define SCAN_ARENA_KEEP_BYTES (1024 * 1024)
+#define SCAN_ARENA_ALIGN (2 * sizeof(gpointer))
+
+typedef struct _ScanArenaBlock ScanArenaBlock;
+
+struct _ScanArenaBlock {
+    ScanArenaBlock *next;
+    gsize size;             // байт данных после заголовка
+    gsize used;
+};
+
+struct _ScanArena {
+    GMutex lock;
+    ScanArenaBlock *blocks;     // занятые; текущий - первый
+    ScanArenaBlock *spare;      // свободные после сброса
+    gsize used;
+};
+
+// Заголовок блока занимает место, кратное выравниванию
+#define SCAN_ARENA_HEADER ((sizeof(ScanArenaBlock) + SCAN_ARENA_ALIGN - 1) & \
+                           ~(SCAN_ARENA_ALIGN - 1))
+
+static ScanArena *scan_arena_cached;
+
+static inline gchar*
+scan_arena_block_data(ScanArenaBlock *block)
+{
+    return (gchar *)block + SCAN_ARENA_HEADER;
+}
+
+static void
+scan_arena_free_blocks(ScanArenaBlock *block)
+{
+    while (block) {
+        ScanArenaBlock *next = block->next;
+
+        g_free(block);
+        block = next;
+    }
+}
+
+ScanArena*
+scan_arena_new(void)
+{
+    ScanArena *arena = g_new0(ScanArena, 1);
+
+    g_mutex_init(&arena->lock);
+    return arena;
+}
+
+void
+scan_arena_free(ScanArena *arena)
+{
+    if (!arena)
+        return;
+
+    scan_arena_free_blocks(arena->blocks);
+    scan_arena_free_blocks(arena->spare);
+    g_mutex_clear(&arena->lock);
+    g_free(arena);
+}
+
+// Блок, в котором поместится size: сначала из свободных, затем из кучи
+static ScanArenaBlock*
+scan_arena_take_block(ScanArena *arena, gsize size)
+{
+    ScanArenaBlock **link = &arena->spare;
+    ScanArenaBlock *block;
+
+    for (; *link; link = &(*link)->next) {
+        if ((*link)->size >= size) {
+            block = *link;
+            *link = block->next;
+            block->used = 0;
+            return block;
+        }
+    }
+
+    size = MAX(size, SCAN_ARENA_BLOCK_SIZE - SCAN_ARENA_HEADER);
+    block = g_malloc(SCAN_ARENA_HEADER + size);
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+gpointer
+scan_arena_alloc(ScanArena *arena, gsize size)
+{
+    ScanArenaBlock *block;
+    gpointer data;
+
+    size = MAX((size + SCAN_ARENA_ALIGN - 1) & ~(SCAN_ARENA_ALIGN - 1), SCAN_ARENA_ALIGN);
+
+    g_mutex_lock(&arena->lock);
+
+    block = arena->blocks;
+    if (block && block->size - block->used < size && size > SCAN_ARENA_BLOCK_SIZE / 4) {
+        // Крупный запрос - в свой блок позади текущего: остаток текущего
+        // ещё пригодится мелким
+        ScanArenaBlock *large = scan_arena_take_block(arena, size);
+
+        large->next = block->next;
+        block->next = large;
+        block = large;
+    } else if (!block || block->size - block->used < size) {
+        block = scan_arena_take_block(arena, size);
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    data = scan_arena_block_data(block) + block->used;
+    block->used += size;
+
+    arena->used += size;
+
+    g_mutex_unlock(&arena->lock);
+
+    return data;
+}
+
+gpointer
+scan_arena_alloc0(ScanArena *arena, gsize size)
+{
+    return memset(scan_arena_alloc(arena, size), 0, size);
+}
+
+gchar*
+scan_arena_strdup(ScanArena *arena, const gchar *str)
+{
+    gsize len;
+
+    if (!str)
+        return NULL;
+
+    len = strlen(str) + 1;
+    return memcpy(scan_arena_alloc(arena, len), str, len);
+}
+
+void
+scan_arena_reset(ScanArena *arena)
+{
+    ScanArenaBlock *block;
+    gsize kept = 0;
+
+    g_mutex_lock(&arena->lock);
+
+    block = arena->blocks;
+    for (ScanArenaBlock *spare = arena->spare; spare; spare = spare->next)
+        kept += spare->size;
+
+    // Блоки большой проверки не держим до конца работы плагина
+    while (block) {
+        ScanArenaBlock *next = block->next;
+
+        if (kept + block->size <= SCAN_ARENA_KEEP_BYTES) {
+            block->next = arena->spare;
+            arena->spare = block;
+            kept += block->size;
+        } else {
+            g_free(block);
+        }
+        block = next;
+    }
+
+    arena->blocks = NULL;
+    arena->used = 0;
+
+    g_mutex_unlock(&arena->lock);
+}
+
+gsize
+scan_arena_get_used(ScanArena *arena)
+{
+    gsize used;
+
+    g_mutex_lock(&arena->lock);
+    used = arena->used;
+    g_mutex_unlock(&arena->lock);
+
+    return used;
+}
+
+ScanArena*
+scan_arena_acquire(void)
+{
+    ScanArena *arena = g_atomic_pointer_get(&scan_arena_cached);
+
+    if (arena && g_atomic_pointer_compare_and_exchange(&scan_arena_cached, arena, NULL))
+        return arena;
+
+    return scan_arena_new();
+}
+
+void
+scan_arena_release(ScanArena *arena)
+{
+    if (!arena)
+        return;
+
+    scan_arena_reset(arena);
+
+    // Место уже занято областью другой проверки - эта не нужна
+    if (!g_atomic_pointer_compare_and_exchange(&scan_arena_cached, NULL, arena))
+        scan_arena_free(arena);
+}
+
+void
+scan_arena_cache_clear(void)
+{
+    ScanArena *arena = g_atomic_pointer_get(&scan_arena_cached);
+
+    if (arena && g_atomic_pointer_compare_and_exchange(&scan_arena_cached, arena, NULL))
+        scan_arena_free(arena);
+}
@@ -0,0 +1,36 @@
+#ifndef SCAN_ARENA_H
+#define SCAN_ARENA_H
+
+#include <glib.h>
+
+// Область памяти одной проверки: временные данные (совпадения, массивы
+// заданий по частям и вложениям, служебные таблицы отчёта) выделяются
+// сдвигом указателя в крупных блоках и освобождаются все сразу.
+// Отдельных free нет. Выделять можно из нескольких потоков.
+typedef struct _ScanArena ScanArena;
+
+ScanArena* scan_arena_new(void);
+void scan_arena_free(ScanArena *arena);
+
+// Выравнивание - как у malloc; alloc0 заполняет нулями
+gpointer scan_arena_alloc(ScanArena *arena, gsize size);
+gpointer scan_arena_alloc0(ScanArena *arena, gsize size);
+gchar* scan_arena_strdup(ScanArena *arena, const gchar *str);
+
+// Всё выделенное становится недействительным; блоки остаются для
+// следующей проверки (больше 1 МБ блоков возвращается в кучу)
+void scan_arena_reset(ScanArena *arena);
+
+// Выдано с последнего сброса
+gsize scan_arena_get_used(ScanArena *arena);
+
+// Область, переиспользуемая между проверками: в установившемся режиме
+// проверка не запрашивает у кучи новых блоков. Занятая область (две
+// проверки одновременно) - вторая получает новую.
+ScanArena* scan_arena_acquire(void);
+// Сбрасывает и возвращает область для следующей проверки
+void scan_arena_release(ScanArena *arena);
+// Освобождение сохранённой области при выключении плагина
+void scan_arena_cache_clear(void);
+
+#endif /* SCAN_ARENA_H */
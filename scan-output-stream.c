@@ -0,0 +1,189 @@
+#include "markup-text.h"
+#include "scan-output-stream.h"
+
+struct _ScanOutputStream {
+    GOutputStream parent_instance;
+
+    const WordMatcher *matcher;
+    WordMatcherScan scan;
+    gboolean found;
+    guint word_index;
+    MarkupText *html;       // не NULL - записанное идёт через разбор HTML
+    guint64 written;        // байт записано (до удаления разметки)
+    gssize *budget;         // общий остаток байт у нескольких потоков (атомарно)
+    gint progress_kb;       // для чтения из другого потока (атомарно)
+};
+
+G_DEFINE_TYPE(ScanOutputStream, scan_output_stream, G_TYPE_OUTPUT_STREAM)
+
+// Видимый текст из разбора HTML; FALSE останавливает разбор после совпадения
+static gboolean
+scan_output_stream_feed(const gchar *data, gsize len, gpointer user_data)
+{
+    ScanOutputStream *stream = user_data;
+
+    if (!stream->found)
+        stream->found = word_matcher_scan_feed(stream->matcher, &stream->scan,
+                                               data, len, &stream->word_index);
+
+    return !stream->found;
+}
+
+static gssize
+scan_output_stream_write_fn(GOutputStream *output, const void *buffer, gsize count,
+                            GCancellable *cancellable, GError **error)
+{
+    ScanOutputStream *stream = SCAN_OUTPUT_STREAM(output);
+
+    if (g_cancellable_set_error_if_cancelled(cancellable, error))
+        return -1;
+
+    if (stream->budget && !stream->found) {
+        gssize left = (gssize)g_atomic_pointer_add(stream->budget, -(gssize)count);
+
+        if (left <= 0) {
+            g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                                "Text size limit reached, scan stopped");
+            return -1;
+        }
+        // Проверяется только остаток бюджета, следующая запись получит ошибку
+        count = MIN(count, (gsize)left);
+    }
+
+    if (!stream->found) {
+        if (stream->html)
+            markup_text_feed(stream->html, buffer, count);
+        else
+            scan_output_stream_feed(buffer, count, stream);
+        stream->written += count;
+        g_atomic_int_set(&stream->progress_kb, (gint)MIN(stream->written >> 10, G_MAXINT));
+    }
+
+    if (stream->found) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                            "Forbidden word found, scan stopped");
+        return -1;
+    }
+
+    return count;
+}
+
+// Закрытие - конец текста: граница последнего слова для правил word:
+static gboolean
+scan_output_stream_close_fn(GOutputStream *output, GCancellable *cancellable, GError **error)
+{
+    ScanOutputStream *stream = SCAN_OUTPUT_STREAM(output);
+
+    scan_output_stream_end_html(stream);
+
+    if (!stream->found)
+        stream->found = word_matcher_scan_finish(stream->matcher, &stream->scan,
+                                                 &stream->word_index);
+
+    (void)cancellable;
+    (void)error;
+    return TRUE;
+}
+
+static void
+scan_output_stream_finalize(GObject *object)
+{
+    ScanOutputStream *stream = SCAN_OUTPUT_STREAM(object);
+
+    g_free(stream->html);
+
+    G_OBJECT_CLASS(scan_output_stream_parent_class)->finalize(object);
+}
+
+static void
+scan_output_stream_class_init(ScanOutputStreamClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    GOutputStreamClass *stream_class = G_OUTPUT_STREAM_CLASS(klass);
+
+    object_class->finalize = scan_output_stream_finalize;
+    stream_class->write_fn = scan_output_stream_write_fn;
+    stream_class->close_fn = scan_output_stream_close_fn;
+}
+
+static void
+scan_output_stream_init(ScanOutputStream *stream)
+{
+    word_matcher_scan_init(&stream->scan);
+}
+
+GOutputStream*
+scan_output_stream_new(const WordMatcher *matcher)
+{
+    ScanOutputStream *stream = g_object_new(SCAN_TYPE_OUTPUT_STREAM, NULL);
+
+    stream->matcher = matcher;
+
+    return G_OUTPUT_STREAM(stream);
+}
+
+gboolean
+scan_output_stream_get_match(ScanOutputStream *stream, guint *word_index)
+{
+    g_return_val_if_fail(SCAN_IS_OUTPUT_STREAM(stream), FALSE);
+
+    if (stream->found && word_index)
+        *word_index = stream->word_index;
+
+    return stream->found;
+}
+
+void
+scan_output_stream_set_matches(ScanOutputStream *stream, WordMatches *matches)
+{
+    g_return_if_fail(SCAN_IS_OUTPUT_STREAM(stream));
+
+    word_matcher_scan_set_func(&stream->scan, matches ? word_matches_collect : NULL, matches);
+}
+
+void
+scan_output_stream_set_budget(ScanOutputStream *stream, gssize *budget)
+{
+    g_return_if_fail(SCAN_IS_OUTPUT_STREAM(stream));
+
+    stream->budget = budget;
+}
+
+void
+scan_output_stream_begin_html(ScanOutputStream *stream)
+{
+    g_return_if_fail(SCAN_IS_OUTPUT_STREAM(stream));
+
+    if (!stream->html)
+        stream->html = g_new(MarkupText, 1);
+    markup_text_init_html(stream->html, scan_output_stream_feed, stream);
+}
+
+void
+scan_output_stream_end_html(ScanOutputStream *stream)
+{
+    g_return_if_fail(SCAN_IS_OUTPUT_STREAM(stream));
+
+    if (!stream->html)
+        return;
+
+    // Остаток буфера разбора - последний видимый текст
+    markup_text_finish(stream->html);
+    g_clear_pointer(&stream->html, g_free);
+}
+
+guint64
+scan_output_stream_get_bytes_scanned(ScanOutputStream *stream)
+{
+    g_return_val_if_fail(SCAN_IS_OUTPUT_STREAM(stream), 0);
+
+    return stream->scan.offset;
+}
+
+guint64
+scan_output_stream_get_progress(ScanOutputStream *stream)
+{
+    g_return_val_if_fail(SCAN_IS_OUTPUT_STREAM(stream), 0);
+
+    return (guint64)g_atomic_int_get(&stream->progress_kb) << 10;
+}
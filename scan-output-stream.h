@@ -0,0 +1,41 @@
+#ifndef SCAN_OUTPUT_STREAM_H
+#define SCAN_OUTPUT_STREAM_H
+
+#include <gio/gio.h>
+
+#include "word-matcher.h"
+#include "word-matches.h"
+
+// Поток вывода, который ничего не хранит: каждый записанный блок сразу
+// проходит через автомат. Camel декодирует части письма прямо в него,
+// поэтому пиковая память не зависит от размера письма.
+#define SCAN_TYPE_OUTPUT_STREAM (scan_output_stream_get_type())
+G_DECLARE_FINAL_TYPE(ScanOutputStream, scan_output_stream, SCAN, OUTPUT_STREAM, GOutputStream)
+
+GOutputStream* scan_output_stream_new(const WordMatcher *matcher);
+
+// После совпадения запись завершается ошибкой G_IO_ERROR_CANCELLED,
+// чтобы декодер не тратил время на остаток письма. Окончательный
+// результат - после g_output_stream_close(): слово в самом конце текста
+// распознаётся только при закрытии.
+gboolean scan_output_stream_get_match(ScanOutputStream *stream, guint *word_index);
+// Режим сбора: все совпадения дописываются в matches (с местом, заданным
+// word_matches_set_place), запись не прерывается, а get_match всегда FALSE.
+// Вызывается до первой записи.
+void scan_output_stream_set_matches(ScanOutputStream *stream, WordMatches *matches);
+// Общий предел текста для нескольких потоков (частей одного письма):
+// *budget - сколько байт ещё можно проверить, уменьшается атомарно при
+// каждой записи. Когда он исчерпан, запись завершается ошибкой
+// G_IO_ERROR_NO_SPACE. NULL - без предела.
+void scan_output_stream_set_budget(ScanOutputStream *stream, gssize *budget);
+// HTML: между begin и end записанное идёт через разбор HTML (markup-text.h),
+// автомат видит только видимый текст. Промежуточная строка не строится.
+void scan_output_stream_begin_html(ScanOutputStream *stream);
+void scan_output_stream_end_html(ScanOutputStream *stream);
+// Сколько байт текста прошло через автомат (у HTML - без разметки)
+guint64 scan_output_stream_get_bytes_scanned(ScanOutputStream *stream);
+// Приблизительный объём записанного (с точностью до КБ), можно вызывать
+// из любого потока
+guint64 scan_output_stream_get_progress(ScanOutputStream *stream);
+
+#endif /* SCAN_OUTPUT_STREAM_H */
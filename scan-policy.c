@@ -0,0 +1,240 @@
+#include <string.h>
+
+#include <camel/camel.h>
+#include <evolution/e-util/e-util.h>
+#include <evolution/composer/e-msg-composer.h>
+
+#include "attachment-checker.h"
+#include "scan-policy.h"
+#include "scan-timing.h"
+#include "word-profile.h"
+
+struct _ScanPolicy {
+    gint ref_count;
+    PresendScanFlags flags;
+    WordMatcherFlags matcher_flags;
+    guint64 max_attachment_bytes;
+    WordDictionary *dictionary;
+    WordMatcher *matcher;           // NULL - словарь пуст
+};
+
+// Состояние на время жизни плагина. Поля меняются только в главном потоке;
+// current публикуется атомарно, чтобы снимок был виден целиком.
+typedef struct {
+    ScanPolicy *current;
+    GSettings *settings;
+    gulong changed_id;
+    guint rebuild_source_id;
+    gboolean initialized;
+} PolicyState;
+
+static PolicyState policy_state;
+
+ScanPolicy*
+scan_policy_ref(ScanPolicy *policy)
+{
+    if (policy)
+        g_atomic_int_inc(&policy->ref_count);
+    return policy;
+}
+
+void
+scan_policy_unref(ScanPolicy *policy)
+{
+    if (!policy || !g_atomic_int_dec_and_test(&policy->ref_count))
+        return;
+
+    word_dictionary_unref(policy->dictionary);
+    g_free(policy);
+}
+
+PresendScanFlags
+scan_policy_get_flags(ScanPolicy *policy)
+{
+    return policy->flags;
+}
+
+WordMatcherFlags
+scan_policy_get_matcher_flags(ScanPolicy *policy)
+{
+    return policy->matcher_flags;
+}
+
+guint64
+scan_policy_get_max_attachment_bytes(ScanPolicy *policy)
+{
+    return policy->max_attachment_bytes;
+}
+
+WordDictionary*
+scan_policy_get_dictionary(ScanPolicy *policy)
+{
+    return policy->dictionary;
+}
+
+WordMatcher*
+scan_policy_get_matcher(ScanPolicy *policy)
+{
+    return policy->matcher;
+}
+
+// Снимок собирается целиком до публикации. Значения GSettings уже в памяти,
+// автомат скомпилирован фоновой загрузкой словаря. Автомата для нового
+// режима ещё нет (сменили регистр или нормализацию) - без compile он
+// заказывается в фоне и возвращается NULL: остаётся прежний снимок, новый
+// соберётся по готовности словаря. Компиляция большого словаря в главном
+// потоке заморозила бы интерфейс. С compile (снимка ещё нет вовсе) автомат
+// компилируется здесь.
+static ScanPolicy*
+scan_policy_build(GSettings *settings, gboolean compile)
+{
+    WordDictionary *dictionary = word_dictionary_cache_get();
+    WordMatcherFlags matcher_flags = attachment_checker_get_matcher_flags(settings);
+    WordMatcher *matcher = NULL;
+    ScanPolicy *policy;
+
+    if (!word_dictionary_is_empty(dictionary) &&
+        !word_dictionary_peek_matcher(dictionary, matcher_flags, &matcher)) {
+        if (!compile) {
+            word_dictionary_cache_request_matcher(matcher_flags);
+            word_dictionary_unref(dictionary);
+            return NULL;
+        }
+        matcher = word_dictionary_get_matcher(dictionary, matcher_flags);
+    }
+
+    policy = g_new0(ScanPolicy, 1);
+    policy->ref_count = 1;
+
+    if (g_settings_get_boolean(settings, KEY_CHECK_ATTACHMENTS))
+        policy->flags |= PRESEND_SCAN_ATTACHMENT_NAMES;
+    if (g_settings_get_boolean(settings, KEY_CHECK_ATTACHMENT_CONTENTS))
+        policy->flags |= PRESEND_SCAN_ATTACHMENT_CONTENTS;
+    if (g_settings_get_boolean(settings, KEY_CHECK_MESSAGE_BODY))
+        policy->flags |= PRESEND_SCAN_MESSAGE_BODY;
+
+    policy->matcher_flags = matcher_flags;
+    policy->max_attachment_bytes =
+        (guint64)g_settings_get_uint(settings, KEY_MAX_ATTACHMENT_SIZE) * 1024 * 1024;
+
+    policy->dictionary = dictionary;
+    policy->matcher = matcher;
+
+    // Профиль включается до публикации снимка, пока автомат не ушёл в
+    // рабочие потоки
+    if (policy->matcher && scan_timing_profile_rules())
+        word_profile_enable(policy->matcher);
+
+    return policy;
+}
+
+// Прежний снимок освобождается, когда его отпустят начатые проверки
+static void
+scan_policy_publish(ScanPolicy *policy)
+{
+    ScanPolicy *old = g_atomic_pointer_get(&policy_state.current);
+
+    g_atomic_pointer_set(&policy_state.current, policy);
+    scan_policy_unref(old);
+}
+
+static gboolean
+scan_policy_rebuild_idle(gpointer user_data)
+{
+    ScanPolicy *policy;
+
+    policy_state.rebuild_source_id = 0;
+    policy = scan_policy_build(policy_state.settings, FALSE);
+    if (policy) {
+        scan_policy_publish(policy);
+        g_debug("Scan policy rebuilt");
+    } else {
+        g_debug("Scan policy waits for the matcher");
+    }
+
+    (void)user_data;
+    return G_SOURCE_REMOVE;
+}
+
+// Окно настроек пишет несколько ключей подряд - снимок строится один раз
+static void
+scan_policy_schedule_rebuild(void)
+{
+    if (!policy_state.rebuild_source_id)
+        policy_state.rebuild_source_id = g_idle_add(scan_policy_rebuild_idle, NULL);
+}
+
+static void
+scan_policy_settings_changed(GSettings *settings, const gchar *key, gpointer user_data)
+{
+    // Снимка ещё нет: первый scan_policy_get() прочитает свежие значения,
+    // а сборка сейчас загрузила бы словарь в главном потоке
+    if (g_atomic_pointer_get(&policy_state.current))
+        scan_policy_schedule_rebuild();
+
+    (void)settings;
+    (void)key;
+    (void)user_data;
+}
+
+// Словарь перечитан: автомат для текущего режима уже скомпилирован (в том
+// числе заказанный scan_policy_build)
+static void
+scan_policy_dictionary_changed(gpointer user_data)
+{
+    scan_policy_schedule_rebuild();
+    (void)user_data;
+}
+
+void
+scan_policy_init(void)
+{
+    if (policy_state.initialized)
+        return;
+
+    policy_state.initialized = TRUE;
+    policy_state.settings = g_settings_new(ATTACHMENT_CHECKER_SCHEMA_ID);
+    policy_state.changed_id = g_signal_connect(policy_state.settings, "changed",
+                                               G_CALLBACK(scan_policy_settings_changed),
+                                               NULL);
+
+    word_dictionary_cache_set_notify(scan_policy_dictionary_changed, NULL);
+    word_dictionary_cache_init(attachment_checker_get_matcher_flags(policy_state.settings));
+}
+
+void
+scan_policy_shutdown(void)
+{
+    if (policy_state.rebuild_source_id)
+        g_source_remove(policy_state.rebuild_source_id);
+
+    if (policy_state.initialized) {
+        g_signal_handler_disconnect(policy_state.settings, policy_state.changed_id);
+        g_clear_object(&policy_state.settings);
+        word_dictionary_cache_set_notify(NULL, NULL);
+        word_dictionary_cache_shutdown();
+    }
+
+    scan_policy_unref(g_atomic_pointer_get(&policy_state.current));
+    memset(&policy_state, 0, sizeof(policy_state));
+}
+
+ScanPolicy*
+scan_policy_get(void)
+{
+    ScanPolicy *policy = g_atomic_pointer_get(&policy_state.current);
+
+    // Фоновая загрузка словаря ещё не завершилась (или плагин не
+    // включался) - снимок строится здесь, дальше он уже готов
+    if (!policy) {
+        GSettings *settings = policy_state.settings ?
+                              g_object_ref(policy_state.settings) :
+                              g_settings_new(ATTACHMENT_CHECKER_SCHEMA_ID);
+
+        policy = scan_policy_build(settings, TRUE);
+        scan_policy_publish(policy);
+        g_object_unref(settings);
+    }
+
+    return scan_policy_ref(policy);
+}
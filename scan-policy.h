@@ -0,0 +1,34 @@
+#ifndef SCAN_POLICY_H
+#define SCAN_POLICY_H
+
+#include <gio/gio.h>
+
+#include "presend-scan.h"
+#include "word-dictionary.h"
+
+// Всё, что определяет проверку: включённые проверки, режим автомата,
+// предел вложения и словарь с готовым автоматом - одним снимком.
+// Снимок неизменяем после публикации и защищён счётчиком ссылок, поэтому
+// рабочие потоки читают его без блокировок; при изменении настроек или
+// words.conf строится новый снимок и подменяет текущий, а уже начатые
+// проверки доживают со своим.
+typedef struct _ScanPolicy ScanPolicy;
+
+ScanPolicy* scan_policy_ref(ScanPolicy *policy);
+void scan_policy_unref(ScanPolicy *policy);
+
+PresendScanFlags scan_policy_get_flags(ScanPolicy *policy);
+WordMatcherFlags scan_policy_get_matcher_flags(ScanPolicy *policy);
+// Предел текста одного вложения в байтах
+guint64 scan_policy_get_max_attachment_bytes(ScanPolicy *policy);
+WordDictionary* scan_policy_get_dictionary(ScanPolicy *policy);
+// Автомат для режима снимка; NULL - словарь пуст и проверять нечего
+WordMatcher* scan_policy_get_matcher(ScanPolicy *policy);
+
+// Текущий снимок на время жизни плагина. Вызывается из главного потока;
+// в рабочие потоки передаётся ссылка на полученный снимок.
+void scan_policy_init(void);
+void scan_policy_shutdown(void);
+ScanPolicy* scan_policy_get(void);
+
+#endif /* SCAN_POLICY_H */
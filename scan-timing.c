@@ -0,0 +1,305 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#ifdef HAVE_SYSPROF
+#include <sysprof-capture.h>
+#endif
+
+#include "scan-timing.h"
+#include "word-profile.h"
+
+#define SCAN_TIMING_LOG_DOMAIN "attachment-checker"
+#define SCAN_TIMING_ENV "ATTACHMENT_CHECKER_TRACE"
+#define SCAN_TIMING_STATS_DIR "evolution-attachment-checker"
+#define SCAN_TIMING_STATS_FILE "stats"
+#define SCAN_TIMING_STATS_GROUP "presend"
+#define SCAN_TIMING_RULES_FILE "rule-profile"
+
+typedef enum {
+    SCAN_TRACE_LOG   = 1 << 0,
+    SCAN_TRACE_MARKS = 1 << 1,
+    SCAN_TRACE_STATS = 1 << 2,
+    SCAN_TRACE_RULES = 1 << 3
+} ScanTraceFlags;
+
+static const GDebugKey scan_trace_keys[] = {
+    { "log", SCAN_TRACE_LOG },
+    { "marks", SCAN_TRACE_MARKS },
+    { "stats", SCAN_TRACE_STATS },
+    { "rules", SCAN_TRACE_RULES }
+};
+
+static const gchar *scan_phase_names[SCAN_N_PHASES] = {
+    "settings", "dictionary", "extraction", "matching", "attachments", "dialog", "total"
+};
+
+static const gchar *scan_extraction_names[SCAN_N_EXTRACTIONS] = {
+    "none", "raw-text", "message", "text-property"
+};
+
+typedef struct {
+    guint flags;
+    gint trace_marker;          // ftrace trace_marker для perf/trace-cmd, -1 - нет
+    GMutex lock;
+    GKeyFile *stats;
+    gchar *stats_path;
+} ScanTrace;
+
+static ScanTrace scan_trace = { 0, -1, { 0 }, NULL, NULL };
+
+static ScanTimingObserver scan_timing_observer;
+static gpointer scan_timing_observer_data;
+
+const gchar*
+scan_phase_get_name(ScanPhase phase)
+{
+    g_return_val_if_fail(phase < SCAN_N_PHASES, NULL);
+
+    return scan_phase_names[phase];
+}
+
+const gchar*
+scan_extraction_get_name(ScanExtraction extraction)
+{
+    g_return_val_if_fail(extraction < SCAN_N_EXTRACTIONS, NULL);
+
+    return scan_extraction_names[extraction];
+}
+
+void
+scan_timing_merge(ScanTiming *timing, const ScanTiming *worker)
+{
+    for (guint phase = 0; phase < SCAN_N_PHASES; phase++) {
+        if (!worker->started[phase])
+            continue;
+        if (!timing->started[phase])
+            timing->started[phase] = worker->started[phase];
+        timing->elapsed[phase] += worker->elapsed[phase];
+    }
+
+    if (worker->extraction != SCAN_EXTRACTION_NONE)
+        timing->extraction = worker->extraction;
+    timing->bytes_scanned += worker->bytes_scanned;
+    timing->n_attachments += worker->n_attachments;
+    timing->found |= worker->found;
+    timing->cancelled |= worker->cancelled;
+}
+
+void
+scan_timing_init(void)
+{
+    ScanTrace *trace = &scan_trace;
+    const gchar *env = g_getenv(SCAN_TIMING_ENV);
+
+    if (!env || !*env)
+        return;
+
+    trace->flags = g_parse_debug_string(env, scan_trace_keys, G_N_ELEMENTS(scan_trace_keys));
+
+    if (trace->flags & SCAN_TRACE_MARKS) {
+        trace->trace_marker = g_open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC, 0);
+        if (trace->trace_marker < 0)
+            trace->trace_marker = g_open("/sys/kernel/debug/tracing/trace_marker",
+                                         O_WRONLY | O_CLOEXEC, 0);
+    }
+
+    if (trace->flags & SCAN_TRACE_STATS) {
+        gchar *dir = g_build_filename(g_get_user_cache_dir(), SCAN_TIMING_STATS_DIR, NULL);
+
+        g_mkdir_with_parents(dir, 0700);
+        g_mutex_init(&trace->lock);
+        trace->stats_path = g_build_filename(dir, SCAN_TIMING_STATS_FILE, NULL);
+        trace->stats = g_key_file_new();
+        // Счётчики продолжаются с прошлого запуска
+        g_key_file_load_from_file(trace->stats, trace->stats_path, G_KEY_FILE_NONE, NULL);
+        g_free(dir);
+    }
+}
+
+void
+scan_timing_shutdown(void)
+{
+    ScanTrace *trace = &scan_trace;
+
+    if (trace->trace_marker >= 0)
+        close(trace->trace_marker);
+    trace->trace_marker = -1;
+
+    if (trace->stats) {
+        g_key_file_unref(trace->stats);
+        trace->stats = NULL;
+        g_clear_pointer(&trace->stats_path, g_free);
+        g_mutex_clear(&trace->lock);
+    }
+
+    trace->flags = 0;
+}
+
+static void
+scan_timing_log(const ScanTiming *timing)
+{
+    gchar values[SCAN_N_PHASES][24];
+    gchar keys[SCAN_N_PHASES][40];
+    gchar bytes[24], attachments[16], arena[24];
+    GLogField fields[SCAN_N_PHASES + 7];
+    gchar *message;
+    gsize n = 0;
+
+    message = g_strdup_printf("Presend scan: %" G_GINT64_FORMAT " us total, %s, "
+                              "%" G_GUINT64_FORMAT " bytes, %u attachments%s%s",
+                              timing->elapsed[SCAN_PHASE_TOTAL],
+                              scan_extraction_get_name(timing->extraction),
+                              timing->bytes_scanned, timing->n_attachments,
+                              timing->found ? ", found" : "",
+                              timing->cancelled ? ", cancelled" : "");
+
+    fields[n++] = (GLogField){ "MESSAGE", message, -1 };
+    fields[n++] = (GLogField){ "GLIB_DOMAIN", SCAN_TIMING_LOG_DOMAIN, -1 };
+    fields[n++] = (GLogField){ "ATTACHMENT_CHECKER_EXTRACTION",
+                               scan_extraction_get_name(timing->extraction), -1 };
+
+    g_snprintf(bytes, sizeof(bytes), "%" G_GUINT64_FORMAT, timing->bytes_scanned);
+    fields[n++] = (GLogField){ "ATTACHMENT_CHECKER_BYTES", bytes, -1 };
+    g_snprintf(attachments, sizeof(attachments), "%u", timing->n_attachments);
+    fields[n++] = (GLogField){ "ATTACHMENT_CHECKER_ATTACHMENTS", attachments, -1 };
+    g_snprintf(arena, sizeof(arena), "%" G_GSIZE_FORMAT, timing->arena_bytes);
+    fields[n++] = (GLogField){ "ATTACHMENT_CHECKER_ARENA_BYTES", arena, -1 };
+
+    for (guint phase = 0; phase < SCAN_N_PHASES; phase++) {
+        gchar *upper = g_ascii_strup(scan_phase_names[phase], -1);
+
+        g_snprintf(keys[phase], sizeof(keys[phase]), "ATTACHMENT_CHECKER_%s_US", upper);
+        g_snprintf(values[phase], sizeof(values[phase]), "%" G_GINT64_FORMAT,
+                   timing->elapsed[phase]);
+        fields[n++] = (GLogField){ keys[phase], values[phase], -1 };
+        g_free(upper);
+    }
+
+    g_log_structured_array(G_LOG_LEVEL_MESSAGE, fields, n);
+    g_free(message);
+}
+
+// Метки пишутся после проверки, с исходными отметками времени: sysprof
+// принимает время начала, а в ftrace оно передаётся текстом
+static void
+scan_timing_marks(const ScanTiming *timing)
+{
+    for (guint phase = 0; phase < SCAN_N_PHASES; phase++) {
+        if (!timing->started[phase])
+            continue;
+
+#ifdef HAVE_SYSPROF
+        sysprof_collector_mark(timing->started[phase] * 1000, timing->elapsed[phase] * 1000,
+                               SCAN_TIMING_LOG_DOMAIN, scan_phase_names[phase], NULL);
+#endif
+
+        if (scan_trace.trace_marker >= 0) {
+            gchar line[128];
+            gint len = g_snprintf(line, sizeof(line),
+                                  "attachment-checker: phase=%s start_us=%" G_GINT64_FORMAT
+                                  " duration_us=%" G_GINT64_FORMAT "\n",
+                                  scan_phase_names[phase], timing->started[phase],
+                                  timing->elapsed[phase]);
+
+            if (write(scan_trace.trace_marker, line, MIN(len, (gint)sizeof(line) - 1)) < 0)
+                break;
+        }
+    }
+}
+
+static void
+scan_timing_stats_add(GKeyFile *stats, const gchar *key, guint64 value)
+{
+    guint64 current = g_key_file_get_uint64(stats, SCAN_TIMING_STATS_GROUP, key, NULL);
+
+    g_key_file_set_uint64(stats, SCAN_TIMING_STATS_GROUP, key, current + value);
+}
+
+static void
+scan_timing_stats(const ScanTiming *timing)
+{
+    ScanTrace *trace = &scan_trace;
+    gchar key[64];
+
+    g_mutex_lock(&trace->lock);
+
+    scan_timing_stats_add(trace->stats, "scans", 1);
+    scan_timing_stats_add(trace->stats, "found", timing->found ? 1 : 0);
+    scan_timing_stats_add(trace->stats, "cancelled", timing->cancelled ? 1 : 0);
+    scan_timing_stats_add(trace->stats, "bytes", timing->bytes_scanned);
+    scan_timing_stats_add(trace->stats, "attachments", timing->n_attachments);
+    if (timing->arena_bytes > g_key_file_get_uint64(trace->stats, SCAN_TIMING_STATS_GROUP,
+                                                    "arena-max-bytes", NULL))
+        g_key_file_set_uint64(trace->stats, SCAN_TIMING_STATS_GROUP, "arena-max-bytes",
+                              timing->arena_bytes);
+
+    g_snprintf(key, sizeof(key), "extraction-%s", scan_extraction_names[timing->extraction]);
+    scan_timing_stats_add(trace->stats, key, 1);
+
+    for (guint phase = 0; phase < SCAN_N_PHASES; phase++) {
+        guint64 max;
+
+        g_snprintf(key, sizeof(key), "%s-us", scan_phase_names[phase]);
+        scan_timing_stats_add(trace->stats, key, timing->elapsed[phase]);
+
+        g_snprintf(key, sizeof(key), "%s-max-us", scan_phase_names[phase]);
+        max = g_key_file_get_uint64(trace->stats, SCAN_TIMING_STATS_GROUP, key, NULL);
+        if ((guint64)timing->elapsed[phase] > max)
+            g_key_file_set_uint64(trace->stats, SCAN_TIMING_STATS_GROUP, key, timing->elapsed[phase]);
+    }
+
+    g_key_file_save_to_file(trace->stats, trace->stats_path, NULL);
+
+    g_mutex_unlock(&trace->lock);
+}
+
+void
+scan_timing_set_observer(ScanTimingObserver observer, gpointer user_data)
+{
+    scan_timing_observer = observer;
+    scan_timing_observer_data = user_data;
+}
+
+void
+scan_timing_report(const ScanTiming *timing)
+{
+    if (scan_timing_observer)
+        scan_timing_observer(timing, scan_timing_observer_data);
+
+    if (G_LIKELY(!scan_trace.flags))
+        return;
+
+    if (scan_trace.flags & SCAN_TRACE_LOG)
+        scan_timing_log(timing);
+    if (scan_trace.flags & SCAN_TRACE_MARKS)
+        scan_timing_marks(timing);
+    if (scan_trace.flags & SCAN_TRACE_STATS)
+        scan_timing_stats(timing);
+}
+
+gboolean
+scan_timing_profile_rules(void)
+{
+    return (scan_trace.flags & SCAN_TRACE_RULES) != 0;
+}
+
+void
+scan_timing_save_rule_profile(WordMatcher *matcher)
+{
+    GError *error = NULL;
+    gchar *path;
+
+    if (G_LIKELY(!(scan_trace.flags & SCAN_TRACE_RULES)) || !word_profile_is_enabled(matcher))
+        return;
+
+    path = g_build_filename(g_get_user_cache_dir(), SCAN_TIMING_STATS_DIR, SCAN_TIMING_RULES_FILE,
+                            NULL);
+    if (!word_profile_save(matcher, path, &error)) {
+        g_warning("Rule profile not saved: %s", error->message);
+        g_error_free(error);
+    }
+
+    g_free(path);
+}
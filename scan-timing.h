@@ -0,0 +1,85 @@
+#ifndef SCAN_TIMING_H
+#define SCAN_TIMING_H
+
+#include <glib.h>
+
+#include "word-matcher.h"
+
+// Время этапов одной проверки перед отправкой (микросекунды, монотонные
+// часы) и счётчики. Этапы рабочего потока (поиск, вложения) пишутся до
+// завершения задачи, главный поток читает их после - синхронизация не нужна.
+typedef enum {
+    SCAN_PHASE_SETTINGS,        // снимок настроек и словаря (ScanPolicy)
+    SCAN_PHASE_DICTIONARY,      // словарь и автомат отдельно от снимка; у плагина входит в settings
+    SCAN_PHASE_EXTRACTION,      // текст и список вложений из композера
+    SCAN_PHASE_MATCHING,        // имена вложений и текст, вместе с разбором MIME
+    SCAN_PHASE_ATTACHMENTS,     // содержимое вложений
+    SCAN_PHASE_DIALOG,          // предупреждение пользователю
+    SCAN_PHASE_TOTAL,
+    SCAN_N_PHASES
+} ScanPhase;
+
+// Каким способом получен текст письма
+typedef enum {
+    SCAN_EXTRACTION_NONE,
+    SCAN_EXTRACTION_RAW_TEXT,       // e_msg_composer_get_raw_message_text()
+    SCAN_EXTRACTION_MESSAGE,        // Camel MIME-сообщение композера
+    SCAN_EXTRACTION_TEXT_PROPERTY,  // свойство "text"
+    SCAN_N_EXTRACTIONS
+} ScanExtraction;
+
+typedef struct {
+    gint64 started[SCAN_N_PHASES];  // 0 - этап не выполнялся
+    gint64 elapsed[SCAN_N_PHASES];
+    ScanExtraction extraction;
+    guint64 bytes_scanned;          // текст письма
+    guint n_attachments;
+    gsize arena_bytes;              // временные данные проверки (ScanArena)
+    gboolean found;
+    gboolean cancelled;
+} ScanTiming;
+
+typedef void (*ScanTimingObserver)(const ScanTiming *timing, gpointer user_data);
+
+const gchar* scan_phase_get_name(ScanPhase phase);
+const gchar* scan_extraction_get_name(ScanExtraction extraction);
+
+static inline gint64
+scan_timing_begin(void)
+{
+    return g_get_monotonic_time();
+}
+
+static inline void
+scan_timing_end(ScanTiming *timing, ScanPhase phase, gint64 started)
+{
+    if (!timing)
+        return;
+    if (!timing->started[phase])
+        timing->started[phase] = started;
+    timing->elapsed[phase] += g_get_monotonic_time() - started;
+}
+
+// Этапы и счётчики рабочего потока переносятся в общий замер хука
+void scan_timing_merge(ScanTiming *timing, const ScanTiming *worker);
+
+// Вывод замеров включается переменной окружения ATTACHMENT_CHECKER_TRACE
+// (через запятую): log - строка структурированного журнала на каждую
+// проверку, marks - метки для sysprof/perf, stats - накопительные
+// счётчики в ~/.cache/evolution-attachment-checker/stats, rules - профиль
+// стоимости правил (word-profile.h) в ~/.cache/evolution-attachment-checker/
+// rule-profile, all - всё. Без неё отчёт сводится к проверке одного флага.
+void scan_timing_init(void);
+void scan_timing_shutdown(void);
+
+// Собирать ли профиль правил: автоматы снимков настроек включают его сами
+gboolean scan_timing_profile_rules(void);
+// Дописывание профиля автомата в файл после проверки; из главного потока
+void scan_timing_save_rule_profile(WordMatcher *matcher);
+
+// Наблюдатель получает время каждой завершённой проверки (стенд замера
+// задержки отправки). Устанавливается до первой проверки.
+void scan_timing_set_observer(ScanTimingObserver observer, gpointer user_data);
+void scan_timing_report(const ScanTiming *timing);
+
+#endif /* SCAN_TIMING_H */
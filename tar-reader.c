@@ -0,0 +1,426 @@
+#include <string.h>
+#include <zlib.h>
+
+#include "tar-reader.h"
+
+#define TAR_BLOCK   512
+#define TAR_CHUNK   (64 * 1024)
+
+// Имена из заголовков GNU и pax длиннее этого считаются повреждением
+#define TAR_MAX_NAME    4096
+#define TAR_MAX_PAX     (64 * 1024)
+
+// Отношение сжатия проверяется, когда распаковано хотя бы столько:
+// маленький архив из нулей сжимается сильно и честно
+#define TAR_RATIO_MIN_BYTES (1024 * 1024)
+
+struct _TarReader {
+    GInputStream *stream;
+    gboolean gzip;
+    z_stream zs;
+    gboolean inflating;
+    gboolean member_end;    // gzip: текущий член закончился, дальше может быть конец
+    guchar *in;             // сжатые данные
+    guchar *buffer;         // распакованные данные для приёмника и пропуска
+    guint64 total_in;
+    guint64 total_out;
+    guint64 max_total;
+    guint max_ratio;
+
+    gchar *name;
+    guint64 size;
+    guint64 data_left;      // непрочитанные байты текущего файла
+    guint64 padding;        // выравнивание файла до блока
+    gboolean finished;
+};
+
+TarReader*
+tar_reader_new(GInputStream *stream, gboolean gzip)
+{
+    TarReader *reader = g_new0(TarReader, 1);
+
+    reader->stream = g_object_ref(stream);
+    reader->gzip = gzip;
+    reader->buffer = g_malloc(TAR_CHUNK);
+
+    if (gzip) {
+        reader->in = g_malloc(TAR_CHUNK);
+        // 16 + MAX_WBITS - заголовок и контрольная сумма gzip
+        reader->inflating = inflateInit2(&reader->zs, 16 + MAX_WBITS) == Z_OK;
+    }
+
+    return reader;
+}
+
+void
+tar_reader_free(TarReader *reader)
+{
+    if (!reader)
+        return;
+
+    if (reader->inflating)
+        inflateEnd(&reader->zs);
+    g_object_unref(reader->stream);
+    g_free(reader->in);
+    g_free(reader->buffer);
+    g_free(reader->name);
+    g_free(reader);
+}
+
+void
+tar_reader_set_limits(TarReader *reader, guint64 max_total, guint max_ratio)
+{
+    reader->max_total = max_total;
+    reader->max_ratio = max_ratio;
+}
+
+// Распаковка gzip; несколько членов подряд читаются как один поток
+static gssize
+tar_reader_inflate(TarReader *reader, guchar *buffer, gsize len,
+                   GCancellable *cancellable, GError **error)
+{
+    z_stream *zs = &reader->zs;
+
+    if (!reader->inflating) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "inflateInit failed");
+        return -1;
+    }
+
+    zs->next_out = buffer;
+    zs->avail_out = (uInt)len;
+
+    while (zs->avail_out == len) {
+        gint ret;
+
+        if (zs->avail_in == 0) {
+            gssize n_read = g_input_stream_read(reader->stream, reader->in, TAR_CHUNK,
+                                                cancellable, error);
+
+            if (n_read < 0)
+                return -1;
+            if (n_read == 0) {
+                if (reader->member_end)
+                    return 0;
+                g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Truncated gzip data");
+                return -1;
+            }
+
+            reader->total_in += n_read;
+            zs->next_in = reader->in;
+            zs->avail_in = (uInt)n_read;
+        }
+
+        ret = inflate(zs, Z_NO_FLUSH);
+
+        if (ret == Z_STREAM_END) {
+            reader->member_end = TRUE;
+            inflateReset(zs);
+        } else if (ret == Z_OK) {
+            reader->member_end = FALSE;
+        } else if (ret != Z_BUF_ERROR) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Broken gzip data");
+            return -1;
+        }
+    }
+
+    return (gssize)(len - zs->avail_out);
+}
+
+// Чтение распакованного архива с проверкой пределов
+static gssize
+tar_reader_read(TarReader *reader, guchar *buffer, gsize len,
+                GCancellable *cancellable, GError **error)
+{
+    gssize n_read;
+
+    if (reader->gzip) {
+        n_read = tar_reader_inflate(reader, buffer, len, cancellable, error);
+    } else {
+        n_read = g_input_stream_read(reader->stream, buffer, len, cancellable, error);
+        if (n_read > 0)
+            reader->total_in += n_read;
+    }
+
+    if (n_read <= 0)
+        return n_read;
+
+    reader->total_out += n_read;
+
+    if (reader->max_total && reader->total_out > reader->max_total) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                    "Archive is larger than %" G_GUINT64_FORMAT " bytes unpacked",
+                    reader->max_total);
+        return -1;
+    }
+
+    if (reader->gzip && reader->max_ratio && reader->total_out >= TAR_RATIO_MIN_BYTES &&
+        reader->total_out / MAX(reader->total_in, 1) > reader->max_ratio) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                    "Archive compression ratio is above %u", reader->max_ratio);
+        return -1;
+    }
+
+    return n_read;
+}
+
+// Ровно len байт; *n_read меньше len только в конце архива
+static gboolean
+tar_reader_read_all(TarReader *reader, guchar *buffer, gsize len, gsize *n_read,
+                    GCancellable *cancellable, GError **error)
+{
+    *n_read = 0;
+
+    while (*n_read < len) {
+        gssize n = tar_reader_read(reader, buffer + *n_read, len - *n_read, cancellable, error);
+
+        if (n < 0)
+            return FALSE;
+        if (n == 0)
+            break;
+        *n_read += n;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+tar_reader_skip(TarReader *reader, guint64 len, GCancellable *cancellable, GError **error)
+{
+    while (len > 0) {
+        gsize n_read;
+
+        if (!tar_reader_read_all(reader, reader->buffer, (gsize)MIN(len, TAR_CHUNK), &n_read,
+                                 cancellable, error))
+            return FALSE;
+        if (n_read == 0) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Truncated tar archive");
+            return FALSE;
+        }
+        len -= n_read;
+    }
+
+    return TRUE;
+}
+
+// Числа в заголовке: восьмеричные с пробелами и нулями или base-256 (GNU)
+static guint64
+tar_parse_number(const guchar *field, gsize len)
+{
+    guint64 value = 0;
+
+    if (field[0] & 0x80) {
+        for (gsize i = 1; i < len; i++)
+            value = (value << 8) | field[i];
+        return value;
+    }
+
+    for (gsize i = 0; i < len; i++) {
+        if (field[i] == ' ' && value == 0)
+            continue;
+        if (field[i] < '0' || field[i] > '7')
+            break;
+        value = (value << 3) | (guint64)(field[i] - '0');
+    }
+
+    return value;
+}
+
+static gboolean
+tar_header_valid(const guchar *header)
+{
+    guint64 sum = 0;
+
+    // Поле контрольной суммы считается заполненным пробелами
+    for (guint i = 0; i < TAR_BLOCK; i++)
+        sum += (i >= 148 && i < 156) ? ' ' : header[i];
+
+    return sum == tar_parse_number(header + 148, 8);
+}
+
+static gboolean
+tar_header_is_zero(const guchar *header)
+{
+    for (guint i = 0; i < TAR_BLOCK; i++) {
+        if (header[i])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+// Запись pax: "<длина> path=<имя>\n"; остальные ключи не нужны
+static gchar*
+tar_pax_path(const gchar *data, gsize len)
+{
+    const gchar *p = data, *end = data + len;
+
+    while (p < end) {
+        const gchar *space = memchr(p, ' ', end - p);
+        guint64 record = g_ascii_strtoull(p, NULL, 10);
+
+        if (!space || record == 0 || record > (guint64)(end - p))
+            break;
+
+        if (g_str_has_prefix(space + 1, "path=") && p[record - 1] == '\n') {
+            const gchar *value = space + 1 + strlen("path=");
+
+            if (value < p + record)
+                return g_strndup(value, p + record - 1 - value);
+        }
+
+        p += record;
+    }
+
+    return NULL;
+}
+
+// Содержимое служебной записи (длинное имя) целиком
+static gchar*
+tar_reader_read_meta(TarReader *reader, guint64 size, guint64 limit,
+                     GCancellable *cancellable, GError **error)
+{
+    guint64 padded = (size + TAR_BLOCK - 1) & ~(guint64)(TAR_BLOCK - 1);
+    gchar *data;
+    gsize n_read;
+
+    if (size > limit) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Broken tar header");
+        return NULL;
+    }
+
+    data = g_malloc(padded + 1);
+    if (!tar_reader_read_all(reader, (guchar *)data, padded, &n_read, cancellable, error) ||
+        n_read != padded) {
+        if (error && !*error)
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Truncated tar archive");
+        g_free(data);
+        return NULL;
+    }
+    data[size] = '\0';
+
+    return data;
+}
+
+gboolean
+tar_reader_next(TarReader *reader, GCancellable *cancellable, GError **error)
+{
+    guchar header[TAR_BLOCK];
+    gchar *long_name = NULL;
+
+    if (reader->finished)
+        return FALSE;
+
+    // Непрочитанный остаток предыдущего файла
+    if (!tar_reader_skip(reader, reader->data_left + reader->padding, cancellable, error))
+        return FALSE;
+    reader->data_left = reader->padding = 0;
+    g_clear_pointer(&reader->name, g_free);
+
+    for (;;) {
+        guint64 size, padded;
+        gsize n_read;
+        gchar type;
+
+        if (!tar_reader_read_all(reader, header, TAR_BLOCK, &n_read, cancellable, error))
+            break;
+
+        // Конец архива - нулевой блок; архив, обрезанный по границе, тоже принимается
+        if (n_read == 0 || (n_read == TAR_BLOCK && tar_header_is_zero(header))) {
+            reader->finished = TRUE;
+            break;
+        }
+
+        if (n_read < TAR_BLOCK || !tar_header_valid(header)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Not a tar archive");
+            break;
+        }
+
+        size = tar_parse_number(header + 124, 12);
+        padded = (size + TAR_BLOCK - 1) & ~(guint64)(TAR_BLOCK - 1);
+        type = (gchar)header[156];
+
+        if (type == 'L' || type == 'x') {
+            gchar *meta = tar_reader_read_meta(reader, size,
+                                               type == 'L' ? TAR_MAX_NAME : TAR_MAX_PAX,
+                                               cancellable, error);
+            if (!meta)
+                break;
+
+            g_free(long_name);
+            long_name = (type == 'L') ? g_strdup(meta) : tar_pax_path(meta, size);
+            g_free(meta);
+            continue;
+        }
+
+        // Обычные файлы; каталоги, ссылки и устройства пропускаются
+        if (type != '0' && type != '\0' && type != '7') {
+            if (!tar_reader_skip(reader, padded, cancellable, error))
+                break;
+            g_clear_pointer(&long_name, g_free);
+            continue;
+        }
+
+        if (long_name) {
+            reader->name = g_steal_pointer(&long_name);
+        } else if (memcmp(header + 257, "ustar", 5) == 0 && header[345]) {
+            gchar *prefix = g_strndup((const gchar *)header + 345, 155);
+            gchar *name = g_strndup((const gchar *)header, 100);
+
+            reader->name = g_strconcat(prefix, "/", name, NULL);
+            g_free(prefix);
+            g_free(name);
+        } else {
+            reader->name = g_strndup((const gchar *)header, 100);
+        }
+
+        reader->size = size;
+        reader->data_left = size;
+        reader->padding = padded - size;
+        return TRUE;
+    }
+
+    g_free(long_name);
+    return FALSE;
+}
+
+const gchar*
+tar_reader_get_name(TarReader *reader)
+{
+    return reader->name;
+}
+
+guint64
+tar_reader_get_size(TarReader *reader)
+{
+    return reader->size;
+}
+
+gboolean
+tar_reader_extract(TarReader *reader, guint64 max_bytes,
+                   TarReaderSink sink, gpointer user_data,
+                   GCancellable *cancellable, GError **error)
+{
+    guint64 left = max_bytes ? MIN(max_bytes, reader->data_left) : reader->data_left;
+
+    while (left > 0) {
+        gsize n_read;
+
+        if (!tar_reader_read_all(reader, reader->buffer, (gsize)MIN(left, TAR_CHUNK), &n_read,
+                                 cancellable, error))
+            return FALSE;
+
+        if (n_read == 0) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                        "Truncated tar entry '%s'", reader->name);
+            return FALSE;
+        }
+
+        reader->data_left -= n_read;
+        left -= n_read;
+
+        if (!sink((const gchar *)reader->buffer, n_read, user_data))
+            break;
+    }
+
+    return TRUE;
+}
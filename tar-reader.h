@@ -0,0 +1,38 @@
+#ifndef TAR_READER_H
+#define TAR_READER_H
+
+#include <gio/gio.h>
+
+// Чтение архивов tar и tar.gz одним проходом от начала до конца, без
+// временных файлов и без произвольного доступа: записи перебираются по
+// порядку, содержимое нужных распаковывается блоками в приёмник, остальное
+// пропускается. Понимает ustar, длинные имена GNU и pax.
+typedef struct _TarReader TarReader;
+
+// Приёмник содержимого записи; FALSE - остановить чтение записи
+typedef gboolean (*TarReaderSink)(const gchar *data, gsize len, gpointer user_data);
+
+// gzip - архив сжат целиком (.tar.gz, .tgz)
+TarReader* tar_reader_new(GInputStream *stream, gboolean gzip);
+void tar_reader_free(TarReader *reader);
+
+// Защита от архивных бомб: предел объёма распакованного архива (вместе с
+// пропущенными записями) и отношения распакованного к сжатому (для gzip).
+// Превышение - ошибка G_IO_ERROR_NO_SPACE или G_IO_ERROR_INVALID_DATA.
+// 0 - без ограничения.
+void tar_reader_set_limits(TarReader *reader, guint64 max_total, guint max_ratio);
+
+// Переход к следующему файлу (каталоги и ссылки пропускаются). FALSE -
+// конец архива или ошибка (тогда установлен error).
+gboolean tar_reader_next(TarReader *reader, GCancellable *cancellable, GError **error);
+const gchar* tar_reader_get_name(TarReader *reader);
+guint64 tar_reader_get_size(TarReader *reader);
+
+// Содержимое текущего файла не более max_bytes (0 - без ограничения).
+// Остановка приёмником или по лимиту не считается ошибкой; непрочитанный
+// остаток пропускается при переходе к следующему файлу.
+gboolean tar_reader_extract(TarReader *reader, guint64 max_bytes,
+                            TarReaderSink sink, gpointer user_data,
+                            GCancellable *cancellable, GError **error);
+
+#endif /* TAR_READER_H */
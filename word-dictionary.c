@@ -0,0 +1,478 @@
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "forbidden-words.h"
+#include "word-dictionary.h"
+#include "dictionary-file.h"
+
+// Задержка перед перечитыванием: редакторы пишут файл в несколько событий
+#define RELOAD_DELAY_MS 500
+
+struct _WordDictionary {
+    gint ref_count;
+    gchar **words;
+    gboolean words_borrowed;    // words указывают в отображённый файл словаря
+    WordMatcher *matchers[WORD_MATCHER_N_MODES];    // [WordMatcherFlags]
+    guint built_modes;          // биты 1 << mode: автомат строился (мог не получиться)
+};
+
+// Фоновое перечитывание. Результат кладётся сюда до завершения задачи,
+// чтобы главный поток мог дождаться его, не крутя цикл событий.
+typedef struct {
+    guint modes;
+    GMutex lock;
+    GCond cond;
+    WordDictionary *dict;       // под lock; NULL - уже забран
+    gboolean done;              // под lock
+} DictionaryReload;
+
+// Состояние кэша. Все поля используются только из главного потока.
+typedef struct {
+    WordDictionary *current;
+    GFileMonitor *monitors[4];
+    GCancellable *cancellable;
+    guint reload_source_id;
+    GTask *reload_task;         // идущее перечитывание
+    gboolean reload_pending;
+    guint reload_pending_modes;
+    gboolean initialized;
+    WordDictionaryCacheNotify notify;
+    gpointer notify_data;
+} DictionaryCache;
+
+static DictionaryCache dictionary_cache;
+
+static void dictionary_cache_start_reload(guint modes);
+
+// Скомпилированный словарь рядом с текстовым. Пара файлов выбирается так же,
+// как в load_forbidden_words: системная, если она есть, иначе пользовательская.
+static WordMatcher*
+dictionary_map_binary(void)
+{
+    gchar *user_source = g_build_filename(g_get_home_dir(), USER_CONFIG_FILE, NULL);
+    const gchar *sources[] = { CONFIG_FILE, user_source };
+    WordMatcher *matcher = NULL;
+
+    for (guint i = 0; i < G_N_ELEMENTS(sources) && !matcher; i++) {
+        gchar *binary = dictionary_file_binary_path(sources[i]);
+        gboolean have_source = g_file_test(sources[i], G_FILE_TEST_EXISTS);
+        gboolean have_binary = g_file_test(binary, G_FILE_TEST_EXISTS);
+        GError *error = NULL;
+
+        if (have_binary) {
+            matcher = dictionary_file_map(binary, sources[i], &error);
+            if (!matcher) {
+                g_debug("Compiled dictionary ignored: %s", error->message);
+                g_clear_error(&error);
+            }
+        }
+        g_free(binary);
+
+        // Устаревший или повреждённый файл - читаем текст этой же пары
+        if (have_source || have_binary)
+            break;
+    }
+
+    g_free(user_source);
+    return matcher;
+}
+
+WordDictionary*
+word_dictionary_load(void)
+{
+    WordDictionary *dict = g_new0(WordDictionary, 1);
+    WordMatcher *mapped;
+
+    dict->ref_count = 1;
+
+    mapped = dictionary_map_binary();
+    if (mapped) {
+        dict->matchers[word_matcher_get_flags(mapped)] = mapped;
+        dict->built_modes = 1u << word_matcher_get_flags(mapped);
+        return dict;
+    }
+
+    dict->words = load_forbidden_words(NULL);
+
+    return dict;
+}
+
+WordDictionary*
+word_dictionary_ref(WordDictionary *dict)
+{
+    if (dict)
+        g_atomic_int_inc(&dict->ref_count);
+    return dict;
+}
+
+void
+word_dictionary_unref(WordDictionary *dict)
+{
+    if (!dict || !g_atomic_int_dec_and_test(&dict->ref_count))
+        return;
+
+    if (dict->words_borrowed)
+        g_free(dict->words);
+    else
+        g_strfreev(dict->words);
+    for (guint mode = 0; mode < WORD_MATCHER_N_MODES; mode++)
+        word_matcher_free(dict->matchers[mode]);
+    g_free(dict);
+}
+
+// Автомат, загруженный из файла словаря (когда текстового списка нет)
+static WordMatcher*
+word_dictionary_get_mapped(WordDictionary *dict)
+{
+    for (guint mode = 0; mode < WORD_MATCHER_N_MODES; mode++) {
+        if (dict->matchers[mode])
+            return dict->matchers[mode];
+    }
+
+    return NULL;
+}
+
+gchar**
+word_dictionary_get_words(WordDictionary *dict)
+{
+    if (!dict)
+        return NULL;
+
+    // Словарь из файла: список строится из указателей в отображённую память
+    if (!dict->words) {
+        WordMatcher *mapped = word_dictionary_get_mapped(dict);
+        guint n_words = word_matcher_get_n_words(mapped);
+
+        dict->words = g_new0(gchar *, n_words + 1);
+        for (guint i = 0; i < n_words; i++)
+            dict->words[i] = (gchar *)word_matcher_get_word(mapped, i);
+        dict->words_borrowed = TRUE;
+    }
+
+    return dict->words;
+}
+
+gboolean
+word_dictionary_is_empty(WordDictionary *dict)
+{
+    if (!dict)
+        return TRUE;
+
+    if (!dict->words) {
+        WordMatcher *mapped = word_dictionary_get_mapped(dict);
+        return word_matcher_get_n_words(mapped) == 0;
+    }
+
+    return !dict->words[0];
+}
+
+WordMatcher*
+word_dictionary_get_matcher(WordDictionary *dict, WordMatcherFlags flags)
+{
+    if (!dict)
+        return NULL;
+
+    // С нормализацией регистр не учитывается: один автомат на оба режима
+    if (flags & WORD_MATCHER_NORMALIZE)
+        flags &= ~WORD_MATCHER_CASE_SENSITIVE;
+
+    if (!(dict->built_modes & (1u << flags))) {
+        dict->matchers[flags] = word_matcher_new_full(word_dictionary_get_words(dict), flags);
+        dict->built_modes |= 1u << flags;
+    }
+
+    return dict->matchers[flags];
+}
+
+gboolean
+word_dictionary_peek_matcher(WordDictionary *dict, WordMatcherFlags flags, WordMatcher **matcher)
+{
+    *matcher = NULL;
+    if (!dict)
+        return TRUE;
+
+    if (flags & WORD_MATCHER_NORMALIZE)
+        flags &= ~WORD_MATCHER_CASE_SENSITIVE;
+
+    if (!(dict->built_modes & (1u << flags)))
+        return FALSE;
+
+    *matcher = dict->matchers[flags];
+    return TRUE;
+}
+
+// Режимы, для которых автомат компилируется заранее (биты 1 << WordMatcherFlags)
+static guint
+dictionary_cache_used_modes(void)
+{
+    guint modes = 0;
+
+    if (dictionary_cache.current) {
+        for (guint mode = 0; mode < WORD_MATCHER_N_MODES; mode++) {
+            if (dictionary_cache.current->built_modes & (1u << mode))
+                modes |= 1u << mode;
+        }
+    }
+
+    return modes;
+}
+
+static void
+dictionary_reload_thread(GTask *task, gpointer source_object,
+                         gpointer task_data, GCancellable *cancellable)
+{
+    DictionaryReload *reload = task_data;
+    WordDictionary *dict = word_dictionary_load();
+
+    // Компилируем заранее, чтобы отправка не платила за построение автомата
+    for (guint mode = 0; mode < WORD_MATCHER_N_MODES; mode++) {
+        if (reload->modes & (1u << mode))
+            word_dictionary_get_matcher(dict, mode);
+    }
+
+    g_mutex_lock(&reload->lock);
+    reload->dict = dict;
+    reload->done = TRUE;
+    g_cond_broadcast(&reload->cond);
+    g_mutex_unlock(&reload->lock);
+
+    g_task_return_boolean(task, TRUE);
+
+    (void)source_object;
+    (void)cancellable;
+}
+
+static void
+dictionary_reload_done(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    GTask *task = G_TASK(result);
+    DictionaryReload *reload = g_task_get_task_data(task);
+    WordDictionary *dict;
+
+    // Забран word_dictionary_cache_get, если тот дождался загрузки сам
+    g_mutex_lock(&reload->lock);
+    dict = reload->dict;
+    reload->dict = NULL;
+    g_mutex_unlock(&reload->lock);
+
+    // Кэш уже закрыт - результат никому не нужен
+    if (g_cancellable_is_cancelled(g_task_get_cancellable(task))) {
+        word_dictionary_unref(dict);
+        return;
+    }
+
+    g_clear_object(&dictionary_cache.reload_task);
+
+    if (dict) {
+        WordDictionary *old = dictionary_cache.current;
+        dictionary_cache.current = dict;
+        word_dictionary_unref(old);
+        g_debug("Forbidden words dictionary reloaded");
+
+        if (dictionary_cache.notify)
+            dictionary_cache.notify(dictionary_cache.notify_data);
+    }
+
+    if (dictionary_cache.reload_pending) {
+        guint modes = dictionary_cache_used_modes() | dictionary_cache.reload_pending_modes;
+
+        dictionary_cache.reload_pending = FALSE;
+        dictionary_cache.reload_pending_modes = 0;
+        dictionary_cache_start_reload(modes);
+    }
+
+    (void)source_object;
+    (void)user_data;
+}
+
+static void
+dictionary_reload_free(gpointer data)
+{
+    DictionaryReload *reload = data;
+
+    word_dictionary_unref(reload->dict);
+    g_mutex_clear(&reload->lock);
+    g_cond_clear(&reload->cond);
+    g_free(reload);
+}
+
+static void
+dictionary_cache_start_reload(guint modes)
+{
+    DictionaryReload *reload;
+
+    // Файл поменялся (или понадобился новый режим) во время перечитывания -
+    // повторим после завершения
+    if (dictionary_cache.reload_task) {
+        dictionary_cache.reload_pending = TRUE;
+        dictionary_cache.reload_pending_modes |= modes;
+        return;
+    }
+
+    reload = g_new0(DictionaryReload, 1);
+    reload->modes = modes;
+    g_mutex_init(&reload->lock);
+    g_cond_init(&reload->cond);
+
+    // Ссылка кэша на задачу - чтобы дождаться её в word_dictionary_cache_get
+    dictionary_cache.reload_task = g_task_new(NULL, dictionary_cache.cancellable,
+                                              dictionary_reload_done, NULL);
+    g_task_set_task_data(dictionary_cache.reload_task, reload, dictionary_reload_free);
+    g_task_run_in_thread(dictionary_cache.reload_task, dictionary_reload_thread);
+}
+
+static gboolean
+dictionary_reload_timeout(gpointer user_data)
+{
+    dictionary_cache.reload_source_id = 0;
+    dictionary_cache_start_reload(dictionary_cache_used_modes());
+
+    (void)user_data;
+    return G_SOURCE_REMOVE;
+}
+
+static void
+dictionary_file_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                        GFileMonitorEvent event_type, gpointer user_data)
+{
+    switch (event_type) {
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+    case G_FILE_MONITOR_EVENT_RENAMED:
+        break;
+    default:
+        return;
+    }
+
+    if (dictionary_cache.reload_source_id)
+        g_source_remove(dictionary_cache.reload_source_id);
+    dictionary_cache.reload_source_id =
+        g_timeout_add(RELOAD_DELAY_MS, dictionary_reload_timeout, NULL);
+
+    (void)monitor;
+    (void)file;
+    (void)other_file;
+    (void)user_data;
+}
+
+static GFileMonitor*
+dictionary_monitor_path(const gchar *path)
+{
+    GFile *file = g_file_new_for_path(path);
+    GError *error = NULL;
+    GFileMonitor *monitor;
+
+    monitor = g_file_monitor_file(file, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+    if (monitor) {
+        g_signal_connect(monitor, "changed", G_CALLBACK(dictionary_file_changed), NULL);
+    } else {
+        g_debug("Cannot monitor %s: %s", path, error ? error->message : "unknown error");
+        g_clear_error(&error);
+    }
+
+    g_object_unref(file);
+    return monitor;
+}
+
+void
+word_dictionary_cache_init(WordMatcherFlags flags)
+{
+    gchar *user_path;
+    gchar *binary_path;
+
+    if (dictionary_cache.initialized)
+        return;
+
+    dictionary_cache.initialized = TRUE;
+    dictionary_cache.cancellable = g_cancellable_new();
+
+    user_path = g_build_filename(g_get_home_dir(), USER_CONFIG_FILE, NULL);
+    dictionary_cache.monitors[0] = dictionary_monitor_path(CONFIG_FILE);
+    dictionary_cache.monitors[1] = dictionary_monitor_path(user_path);
+
+    // Скомпилированные словари тоже отслеживаются
+    binary_path = dictionary_file_binary_path(CONFIG_FILE);
+    dictionary_cache.monitors[2] = dictionary_monitor_path(binary_path);
+    g_free(binary_path);
+    binary_path = dictionary_file_binary_path(user_path);
+    dictionary_cache.monitors[3] = dictionary_monitor_path(binary_path);
+    g_free(binary_path);
+    g_free(user_path);
+
+    // Первая загрузка тоже идёт в фоне, с автоматом для текущего режима
+    if (flags & WORD_MATCHER_NORMALIZE)
+        flags &= ~WORD_MATCHER_CASE_SENSITIVE;
+    dictionary_cache_start_reload(1u << flags);
+}
+
+void
+word_dictionary_cache_set_notify(WordDictionaryCacheNotify notify, gpointer user_data)
+{
+    dictionary_cache.notify = notify;
+    dictionary_cache.notify_data = user_data;
+}
+
+void
+word_dictionary_cache_shutdown(void)
+{
+    if (!dictionary_cache.initialized)
+        return;
+
+    if (dictionary_cache.reload_source_id)
+        g_source_remove(dictionary_cache.reload_source_id);
+
+    g_cancellable_cancel(dictionary_cache.cancellable);
+    g_clear_object(&dictionary_cache.cancellable);
+    g_clear_object(&dictionary_cache.reload_task);
+
+    for (guint i = 0; i < G_N_ELEMENTS(dictionary_cache.monitors); i++)
+        g_clear_object(&dictionary_cache.monitors[i]);
+
+    word_dictionary_unref(dictionary_cache.current);
+    memset(&dictionary_cache, 0, sizeof(dictionary_cache));
+}
+
+WordDictionary*
+word_dictionary_cache_get(void)
+{
+    // Первая фоновая загрузка ещё идёт - дожидаемся её, а не читаем и
+    // компилируем словарь второй раз. Задача потом увидит, что словарь
+    // уже забран.
+    if (!dictionary_cache.current && dictionary_cache.reload_task) {
+        DictionaryReload *reload = g_task_get_task_data(dictionary_cache.reload_task);
+
+        g_mutex_lock(&reload->lock);
+        while (!reload->done)
+            g_cond_wait(&reload->cond, &reload->lock);
+        dictionary_cache.current = reload->dict;
+        reload->dict = NULL;
+        g_mutex_unlock(&reload->lock);
+    }
+
+    // Плагин не включался - читаем словарь синхронно
+    if (!dictionary_cache.current)
+        dictionary_cache.current = word_dictionary_load();
+
+    return word_dictionary_ref(dictionary_cache.current);
+}
+
+void
+word_dictionary_cache_request_matcher(WordMatcherFlags flags)
+{
+    if (flags & WORD_MATCHER_NORMALIZE)
+        flags &= ~WORD_MATCHER_CASE_SENSITIVE;
+
+    // Режим уже заказан идущим или отложенным перечитыванием
+    if (dictionary_cache.reload_task) {
+        DictionaryReload *reload = g_task_get_task_data(dictionary_cache.reload_task);
+
+        if ((reload->modes | dictionary_cache.reload_pending_modes) & (1u << flags))
+            return;
+    }
+
+    dictionary_cache_start_reload(dictionary_cache_used_modes() | (1u << flags));
+}
@@ -0,0 +1,38 @@
+#ifndef WORD_DICTIONARY_H
+#define WORD_DICTIONARY_H
+
+#include <glib.h>
+
+#include "word-matcher.h"
+
+// Загруженный словарь запрещённых слов вместе со скомпилированными автоматами.
+// Объект неизменяем после публикации и защищён счётчиком ссылок.
+typedef struct _WordDictionary WordDictionary;
+
+WordDictionary* word_dictionary_load(void);
+WordDictionary* word_dictionary_ref(WordDictionary *dict);
+void word_dictionary_unref(WordDictionary *dict);
+
+gchar** word_dictionary_get_words(WordDictionary *dict);
+gboolean word_dictionary_is_empty(WordDictionary *dict);
+// Автомат для нужного режима (регистр, нормализация); при первом
+// обращении компилируется
+WordMatcher* word_dictionary_get_matcher(WordDictionary *dict, WordMatcherFlags flags);
+// То же без компиляции: FALSE - автомат для режима ещё не строился.
+// Для словаря, который уже используется в других потоках.
+gboolean word_dictionary_peek_matcher(WordDictionary *dict, WordMatcherFlags flags,
+                                      WordMatcher **matcher);
+
+// Кэш словаря на время жизни плагина. Вызывается из главного потока.
+void word_dictionary_cache_init(WordMatcherFlags flags);
+void word_dictionary_cache_shutdown(void);
+// Текущий словарь; пока идёт первая фоновая загрузка - дожидается её
+WordDictionary* word_dictionary_cache_get(void);
+// Перечитывание в фоне с автоматом для ещё не скомпилированного режима;
+// по готовности вызывается notify
+void word_dictionary_cache_request_matcher(WordMatcherFlags flags);
+// Вызывается после того, как перечитанный словарь стал текущим
+typedef void (*WordDictionaryCacheNotify)(gpointer user_data);
+void word_dictionary_cache_set_notify(WordDictionaryCacheNotify notify, gpointer user_data);
+
+#endif /* WORD_DICTIONARY_H */
@@ -0,0 +1,161 @@
+#ifndef WORD_MATCHER_PRIVATE_H
+#define WORD_MATCHER_PRIVATE_H
+
+#include "word-matcher.h"
+#include "word-prefilter.h"
+#include "word-profile.h"
+#include "word-tokens.h"
+
+// Граница слова в потоке, который видят автоматы правил. Байт 0xFF не
+// встречается в корректном UTF-8; сырой 0xFF из текста подаётся как 0xFE.
+#define WORD_MATCHER_MARKER 0xFF
+#define WORD_MATCHER_RAW_FF 0xFE
+
+// Ограничение на число состояний одного ДКА регулярных правил
+#define WORD_REGEX_MAX_DFA_STATES 8192
+
+// ДКА группы регулярных правил. Таблица переходов и списки совпавших
+// правил лежат в общих массивах автомата, здесь только смещения.
+// Состояние 0 - начальное: ни одно правило не начато.
+typedef struct {
+    guint32 n_states;
+    guint32 n_classes;
+    guint32 table;                 // начало таблицы n_states * n_classes в dfa_next
+    guint32 accept;                // начало n_states + 1 элементов в dfa_accept_start
+    guint8 classes[256];           // класс байта
+} WordRegexDfa;
+
+// Внутреннее представление автомата. Все массивы плоские, чтобы автомат
+// можно было использовать прямо из отображённого в память файла словаря.
+struct _WordMatcher {
+    gboolean case_sensitive;
+    gboolean boundaries;           // в поток вставляются границы слов
+    gboolean normalize;            // литералы ищутся в нормализованном тексте
+    guint64 version;               // отпечаток списка слов и режима регистра
+    GMappedFile *mapped;           // владелец памяти, если автомат загружен из файла
+
+    guint32 n_words;
+    const guint32 *word_offsets;   // смещения исходных слов в word_data
+    const gchar *word_data;        // слова, завершённые нулём
+    guint32 word_data_size;
+
+    guint32 n_states;
+    guint32 n_edges;
+    const guint32 *root_next;      // 256 переходов корня
+    const guint32 *edge_start;     // n_states + 1, начало переходов состояния
+    const guint8 *edge_bytes;      // отсортированные байты переходов
+    const guint32 *edge_target;    // целевые состояния
+    const guint32 *fail;           // суффиксные ссылки
+    const guint32 *output;         // индекс слова, заканчивающегося в состоянии
+    const guint32 *output_link;    // ближайшее по суффиксным ссылкам состояние со словом
+
+    guint32 n_dfas;                // не больше WORD_MATCHER_MAX_DFAS
+    const WordRegexDfa *dfas;
+    guint32 n_dfa_next;
+    const guint32 *dfa_next;       // переходы всех ДКА
+    guint32 n_dfa_accept_start;
+    const guint32 *dfa_accept_start; // для каждого состояния - начало списка в dfa_accept_rules
+    guint32 n_dfa_accept_rules;
+    const guint32 *dfa_accept_rules; // индексы правил, совпавших в состоянии
+
+    WordTokenIndex tokens;         // идентификаторы id:; n_slots == 0 - их нет
+
+    const WordPrefilter *prefilter; // отсев участков без возможных начал слов
+
+    WordProfile *profile;          // стоимость правил (word-profile.h); NULL - не собирается
+};
+
+// Пересчёт отпечатка после заполнения word_data (в т.ч. из файла словаря)
+void word_matcher_update_version(WordMatcher *matcher);
+
+// Длина UTF-8 последовательности по первому байту; 0 - байт не начинает символ
+static inline guint
+utf8_sequence_length(guchar c)
+{
+    if (c < 0x80)
+        return 1;
+    if (c < 0xC2)
+        return 0;
+    if (c < 0xE0)
+        return 2;
+    if (c < 0xF0)
+        return 3;
+    if (c < 0xF5)
+        return 4;
+    return 0;
+}
+
+// Декодирование полной последовательности; (gunichar)-1 для некорректной
+static inline gunichar
+utf8_decode(const guchar *p, guint len)
+{
+    gunichar c;
+
+    switch (len) {
+    case 1:
+        return (p[0] < 0x80) ? p[0] : (gunichar)-1;
+    case 2:
+        if ((p[1] & 0xC0) != 0x80)
+            return (gunichar)-1;
+        return ((p[0] & 0x1F) << 6) | (p[1] & 0x3F);
+    case 3:
+        if ((p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80)
+            return (gunichar)-1;
+        c = ((p[0] & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+        return (c < 0x800) ? (gunichar)-1 : c;
+    case 4:
+        if ((p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80 || (p[3] & 0xC0) != 0x80)
+            return (gunichar)-1;
+        c = ((p[0] & 0x07) << 18) | ((p[1] & 0x3F) << 12) | ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+        return (c < 0x10000 || c > 0x10FFFF) ? (gunichar)-1 : c;
+    default:
+        return (gunichar)-1;
+    }
+}
+
+// Посимвольное приведение к нижнему регистру. Одна и та же функция
+// применяется к словам при компиляции и к тексту при сканировании,
+// поэтому обе стороны всегда свёрнуты одинаково.
+static inline gunichar
+fold_char(gunichar c)
+{
+    if (c < 0x80)
+        return (c - 'A' < 26u) ? c + ('a' - 'A') : c;
+
+    // Кириллица без обращения к таблицам Unicode: А-Я, Ѐ-Џ
+    if (c >= 0x0410 && c <= 0x042F)
+        return c + 0x20;
+    if (c >= 0x0400 && c <= 0x040F)
+        return c + 0x50;
+    if (c >= 0x0430 && c <= 0x045F)
+        return c;
+
+    return g_unichar_tolower(c);
+}
+
+// Символы слова для границ и \w: ASCII-буквы, цифры и '_', латиница
+// с диакритикой, греческий и кириллица. Диапазоны те же, что у \w в
+// регулярных правилах, иначе граница и класс разошлись бы.
+static const gunichar word_char_ranges[][2] = {
+    { '0', '9' }, { 'A', 'Z' }, { '_', '_' }, { 'a', 'z' },
+    { 0x00C0, 0x00D6 }, { 0x00D8, 0x00F6 }, { 0x00F8, 0x024F },
+    { 0x0370, 0x03FF }, { 0x0400, 0x052F }
+};
+
+static inline gboolean
+word_char_is_word(gunichar c)
+{
+    if (c < 0x80)
+        return (c - '0' < 10u) || ((c | 0x20) - 'a' < 26u) || c == '_';
+
+    for (guint i = 4; i < G_N_ELEMENTS(word_char_ranges); i++) {
+        if (c < word_char_ranges[i][0])
+            return FALSE;
+        if (c <= word_char_ranges[i][1])
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+#endif /* WORD_MATCHER_PRIVATE_H */
@@ -0,0 +1,1329 @@
+#include <string.h>
+
+#include "fast-hash.h"
+#include "word-matcher-private.h"
+#include "word-rules.h"
+
+// Порог, после которого переходы состояния ищутся двоичным поиском
+#define LINEAR_EDGE_SCAN 8
+
+// Узел временного бора, используемого только при компиляции
+typedef struct {
+    guint32 first_child;
+    guint32 next_sibling;
+    guint32 output;
+    guint8 byte;
+} TrieNode;
+
+#define TRIE_NODE(nodes, i) (&g_array_index((nodes), TrieNode, (i)))
+
+static guint32
+trie_find_child(GArray *nodes, guint32 parent, guint8 byte)
+{
+    guint32 child = TRIE_NODE(nodes, parent)->first_child;
+
+    while (child != WORD_MATCHER_NONE) {
+        TrieNode *node = TRIE_NODE(nodes, child);
+        if (node->byte == byte)
+            return child;
+        if (node->byte > byte)
+            break;
+        child = node->next_sibling;
+    }
+
+    return WORD_MATCHER_NONE;
+}
+
+// Добавление потомка с сохранением сортировки по байту
+static guint32
+trie_add_child(GArray *nodes, guint32 parent, guint8 byte)
+{
+    TrieNode new_node = { WORD_MATCHER_NONE, WORD_MATCHER_NONE, WORD_MATCHER_NONE, byte };
+    guint32 index = nodes->len;
+    guint32 prev = WORD_MATCHER_NONE;
+    guint32 child;
+
+    g_array_append_val(nodes, new_node);
+
+    child = TRIE_NODE(nodes, parent)->first_child;
+    while (child != WORD_MATCHER_NONE && TRIE_NODE(nodes, child)->byte < byte) {
+        prev = child;
+        child = TRIE_NODE(nodes, child)->next_sibling;
+    }
+
+    TRIE_NODE(nodes, index)->next_sibling = child;
+    if (prev == WORD_MATCHER_NONE)
+        TRIE_NODE(nodes, parent)->first_child = index;
+    else
+        TRIE_NODE(nodes, prev)->next_sibling = index;
+
+    return index;
+}
+
+static void
+trie_insert(GArray *nodes, const gchar *word, guint32 word_index)
+{
+    guint32 state = 0;
+
+    for (const guchar *p = (const guchar *)word; *p; p++) {
+        guint32 next = trie_find_child(nodes, state, *p);
+        if (next == WORD_MATCHER_NONE)
+            next = trie_add_child(nodes, state, *p);
+        state = next;
+    }
+
+    // Дубликаты сообщаются по первому вхождению в списке
+    if (state != 0 && TRIE_NODE(nodes, state)->output == WORD_MATCHER_NONE)
+        TRIE_NODE(nodes, state)->output = word_index;
+}
+
+// Перевод бора в плоские массивы и расчёт суффиксных ссылок (обход в ширину)
+static void
+word_matcher_compile(WordMatcher *matcher, GArray *nodes)
+{
+    guint32 n_states = nodes->len;
+    guint32 *root_next, *edge_start, *edge_target, *fail, *output, *output_link;
+    guint8 *edge_bytes;
+    guint32 *queue;
+    guint32 head = 0, tail = 0;
+    guint32 n_edges = 0;
+
+    root_next = g_new0(guint32, 256);
+    edge_start = g_new0(guint32, n_states + 1);
+    fail = g_new0(guint32, n_states);
+    output = g_new(guint32, n_states);
+    output_link = g_new(guint32, n_states);
+
+    for (guint32 s = 0; s < n_states; s++) {
+        edge_start[s] = n_edges;
+        output[s] = TRIE_NODE(nodes, s)->output;
+        output_link[s] = WORD_MATCHER_NONE;
+        for (guint32 c = TRIE_NODE(nodes, s)->first_child; c != WORD_MATCHER_NONE;
+             c = TRIE_NODE(nodes, c)->next_sibling)
+            n_edges++;
+    }
+    edge_start[n_states] = n_edges;
+
+    edge_bytes = g_new(guint8, MAX(n_edges, 1));
+    edge_target = g_new(guint32, MAX(n_edges, 1));
+
+    for (guint32 s = 0, e = 0; s < n_states; s++) {
+        for (guint32 c = TRIE_NODE(nodes, s)->first_child; c != WORD_MATCHER_NONE;
+             c = TRIE_NODE(nodes, c)->next_sibling, e++) {
+            edge_bytes[e] = TRIE_NODE(nodes, c)->byte;
+            edge_target[e] = c;
+        }
+    }
+
+    queue = g_new(guint32, n_states);
+    for (guint32 c = TRIE_NODE(nodes, 0)->first_child; c != WORD_MATCHER_NONE;
+         c = TRIE_NODE(nodes, c)->next_sibling) {
+        root_next[TRIE_NODE(nodes, c)->byte] = c;
+        queue[tail++] = c;
+    }
+
+    while (head < tail) {
+        guint32 u = queue[head++];
+
+        for (guint32 c = TRIE_NODE(nodes, u)->first_child; c != WORD_MATCHER_NONE;
+             c = TRIE_NODE(nodes, c)->next_sibling) {
+            guint8 byte = TRIE_NODE(nodes, c)->byte;
+            guint32 f = fail[u];
+            guint32 target;
+
+            while (f != 0 && trie_find_child(nodes, f, byte) == WORD_MATCHER_NONE)
+                f = fail[f];
+
+            target = trie_find_child(nodes, f, byte);
+            fail[c] = (target != WORD_MATCHER_NONE) ? target : 0;
+
+            f = fail[c];
+            output_link[c] = (output[f] != WORD_MATCHER_NONE) ? f : output_link[f];
+            queue[tail++] = c;
+        }
+    }
+
+    g_free(queue);
+
+    matcher->n_states = n_states;
+    matcher->n_edges = n_edges;
+    matcher->root_next = root_next;
+    matcher->edge_start = edge_start;
+    matcher->edge_bytes = edge_bytes;
+    matcher->edge_target = edge_target;
+    matcher->fail = fail;
+    matcher->output = output;
+    matcher->output_link = output_link;
+}
+
+// Прообразы свёртки: для каждого символа из keys - все символы, которые
+// сворачиваются в него (включая его самого). Ключ - gunichar, значение - GArray.
+static GHashTable*
+fold_preimages(GHashTable *keys)
+{
+    GHashTable *preimages = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                                  (GDestroyNotify)g_array_unref);
+    gunichar limit = 0xFFFF;
+    GHashTableIter iter;
+    gpointer key;
+
+    g_hash_table_iter_init(&iter, keys);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (GPOINTER_TO_UINT(key) > 0xFFFF)
+            limit = 0x10FFFF;
+    }
+
+    for (gunichar c = 0; c <= limit; c++) {
+        gunichar folded;
+        GArray *list;
+
+        if (c >= 0xD800 && c <= 0xDFFF)
+            continue;
+
+        folded = fold_char(c);
+        if (!g_hash_table_contains(keys, GUINT_TO_POINTER(folded)))
+            continue;
+
+        list = g_hash_table_lookup(preimages, GUINT_TO_POINTER(folded));
+        if (!list) {
+            list = g_array_new(FALSE, FALSE, sizeof(gunichar));
+            g_hash_table_insert(preimages, GUINT_TO_POINTER(folded), list);
+        }
+        g_array_append_val(list, c);
+    }
+
+    return preimages;
+}
+
+// Первый символ свёрнутого текста: код и длина; (gunichar)-1 - сырой байт
+static gunichar
+folded_char_at(const gchar *p, guint *len)
+{
+    guint n = utf8_sequence_length((guchar)*p);
+    gunichar c = (n == 1) ? (guchar)*p : utf8_decode((const guchar *)p, n);
+
+    *len = (n == 0 || c == (gunichar)-1) ? 1 : n;
+    return (n == 0) ? (gunichar)-1 : c;
+}
+
+// Заполнение префильтра для регистронезависимого режима. Начала слов
+// берутся в исходном тексте, поэтому для первого символа перебираются все
+// его прообразы свёртки, а для второго - первые байты его прообразов.
+static void
+word_matcher_build_folded_prefilter(WordPrefilter *prefilter, GPtrArray *folded_words)
+{
+    GHashTable *keys = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GHashTable *preimages;
+
+    for (guint i = 0; i < folded_words->len; i++) {
+        const gchar *word = g_ptr_array_index(folded_words, i);
+        guint len;
+        gunichar c;
+
+        if (!*word)
+            continue;
+        c = folded_char_at(word, &len);
+        if (c != (gunichar)-1)
+            g_hash_table_add(keys, GUINT_TO_POINTER(c));
+        if (word[len]) {
+            c = folded_char_at(word + len, &len);
+            if (c != (gunichar)-1)
+                g_hash_table_add(keys, GUINT_TO_POINTER(c));
+        }
+    }
+
+    preimages = fold_preimages(keys);
+
+    for (guint i = 0; i < folded_words->len && prefilter->enabled; i++) {
+        const gchar *word = g_ptr_array_index(folded_words, i);
+        guint first_len, second_len;
+        gunichar first, second;
+        GArray *first_raw, *second_raw = NULL;
+        guint8 second_bytes[256];
+
+        if (!*word)
+            continue;
+
+        first = folded_char_at(word, &first_len);
+
+        // Сырой байт в начале слова сканер подаёт без изменений
+        if (first == (gunichar)-1) {
+            if (((guchar)word[0] & 0xC0) == 0x80)
+                word_prefilter_disable(prefilter);
+            else
+                word_prefilter_add(prefilter, (const guchar *)word, 1);
+            continue;
+        }
+
+        // Возможные первые байты второго символа
+        memset(second_bytes, 0, sizeof(second_bytes));
+        if (word[first_len]) {
+            second = folded_char_at(word + first_len, &second_len);
+            if (second == (gunichar)-1) {
+                second_bytes[(guchar)word[first_len]] = 1;
+            } else {
+                second_raw = g_hash_table_lookup(preimages, GUINT_TO_POINTER(second));
+                for (guint k = 0; second_raw && k < second_raw->len; k++) {
+                    gchar buf[6];
+                    g_unichar_to_utf8(g_array_index(second_raw, gunichar, k), buf);
+                    second_bytes[(guchar)buf[0]] = 1;
+                }
+            }
+        }
+
+        first_raw = g_hash_table_lookup(preimages, GUINT_TO_POINTER(first));
+        for (guint k = 0; first_raw && k < first_raw->len; k++) {
+            guchar seq[6];
+            gint n = g_unichar_to_utf8(g_array_index(first_raw, gunichar, k), (gchar *)seq);
+
+            if (n >= 2) {
+                word_prefilter_add(prefilter, seq, 2);
+            } else if (!word[first_len]) {
+                word_prefilter_add(prefilter, seq, 1);
+            } else {
+                for (guint b = 0; b < 256; b++) {
+                    if (second_bytes[b]) {
+                        seq[1] = b;
+                        word_prefilter_add(prefilter, seq, 2);
+                    }
+                }
+            }
+        }
+    }
+
+    g_hash_table_unref(preimages);
+    g_hash_table_unref(keys);
+}
+
+static void
+word_matcher_build_prefilter(WordMatcher *matcher, GPtrArray *literals)
+{
+    WordPrefilter *prefilter = g_new(WordPrefilter, 1);
+
+    word_prefilter_init(prefilter);
+
+    if (matcher->n_dfas > 0 || matcher->normalize || matcher->tokens.n_slots > 0) {
+        // Начала регулярных правил и нормализованных слов префильтр не описывает,
+        // а идентификаторы id: проверяются у каждого слова текста
+        word_prefilter_disable(prefilter);
+    } else if (matcher->case_sensitive) {
+        for (guint i = 0; i < literals->len; i++) {
+            const gchar *literal = g_ptr_array_index(literals, i);
+            word_prefilter_add(prefilter, (const guchar *)literal, literal[1] ? 2 : 1);
+        }
+    } else {
+        word_matcher_build_folded_prefilter(prefilter, literals);
+    }
+
+    word_prefilter_finish(prefilter);
+    matcher->prefilter = prefilter;
+}
+
+// Исходные слова хранятся одним блоком со смещениями, как и в файле словаря
+static void
+word_matcher_store_words(WordMatcher *matcher, gchar **words)
+{
+    GString *data = g_string_new(NULL);
+    guint32 *offsets;
+
+    matcher->n_words = words ? g_strv_length(words) : 0;
+    offsets = g_new(guint32, MAX(matcher->n_words, 1));
+
+    for (guint i = 0; i < matcher->n_words; i++) {
+        offsets[i] = data->len;
+        g_string_append_len(data, words[i], strlen(words[i]) + 1);
+    }
+
+    matcher->word_offsets = offsets;
+    matcher->word_data_size = data->len;
+    matcher->word_data = g_string_free(data, FALSE);
+    word_matcher_update_version(matcher);
+}
+
+void
+word_matcher_update_version(WordMatcher *matcher)
+{
+    matcher->version = fast_hash64((const guint8 *)matcher->word_data, matcher->word_data_size) ^
+                       ((guint64)matcher->n_words << 1) ^ (matcher->case_sensitive ? 1 : 0) ^
+                       ((guint64)WORD_RULES_SYNTAX_VERSION << 56) ^
+                       (matcher->normalize ? (guint64)WORD_NORMALIZE_VERSION << 48 : 0);
+}
+
+static void
+word_matcher_take_tables(WordMatcher *matcher, WordRegexTables *tables)
+{
+    matcher->n_dfas = tables->dfas->len;
+    matcher->n_dfa_next = tables->next->len;
+    matcher->n_dfa_accept_start = tables->accept_start->len;
+    matcher->n_dfa_accept_rules = tables->accept_rules->len;
+    matcher->dfas = (const WordRegexDfa *)g_array_free(tables->dfas, FALSE);
+    matcher->dfa_next = (const guint32 *)g_array_free(tables->next, FALSE);
+    matcher->dfa_accept_start = (const guint32 *)g_array_free(tables->accept_start, FALSE);
+    matcher->dfa_accept_rules = (const guint32 *)g_array_free(tables->accept_rules, FALSE);
+    memset(tables, 0, sizeof(*tables));
+}
+
+// Литерал в нормализованном виде; FALSE - от него ничего не осталось
+static gboolean
+word_matcher_normalize_literal(WordRule *rule)
+{
+    gchar *normalized = word_normalize_string(rule->literal);
+
+    g_free(rule->literal);
+    rule->literal = normalized;
+    return *normalized != '\0';
+}
+
+WordMatcher*
+word_matcher_new(gchar **words, gboolean case_sensitive)
+{
+    return word_matcher_new_full(words, case_sensitive ? WORD_MATCHER_CASE_SENSITIVE : 0);
+}
+
+WordMatcher*
+word_matcher_new_full(gchar **words, WordMatcherFlags flags)
+{
+    WordMatcher *matcher = g_new0(WordMatcher, 1);
+    GArray *nodes = g_array_new(FALSE, FALSE, sizeof(TrieNode));
+    TrieNode root = { WORD_MATCHER_NONE, WORD_MATCHER_NONE, WORD_MATCHER_NONE, 0 };
+    GPtrArray *literals = g_ptr_array_new();
+    GPtrArray *regexes = g_ptr_array_new();
+    GArray *regex_rules = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GPtrArray *tokens = g_ptr_array_new();
+    GArray *token_rules = g_array_new(FALSE, FALSE, sizeof(guint32));
+    WordRegexTables tables;
+    WordRule *rules;
+
+    // Таблицы нормализации рассчитаны на свёрнутый текст
+    matcher->normalize = (flags & WORD_MATCHER_NORMALIZE) != 0;
+    matcher->case_sensitive = !matcher->normalize && (flags & WORD_MATCHER_CASE_SENSITIVE);
+    word_matcher_store_words(matcher, words);
+
+    g_array_append_val(nodes, root);
+    rules = g_new0(WordRule, MAX(matcher->n_words, 1));
+
+    // Правила разбираются (и слова сворачиваются) один раз, при компиляции
+    for (guint i = 0; i < matcher->n_words; i++) {
+        GError *error = NULL;
+
+        if (!word_rule_compile(&rules[i], words[i], matcher->case_sensitive, &error)) {
+            g_warning("Attachment checker: ignoring rule '%s': %s", words[i], error->message);
+            g_error_free(error);
+            continue;
+        }
+        // Идентификаторы сверяются с исходными словами текста, без нормализации
+        if (matcher->normalize && rules[i].literal && rules[i].kind != WORD_RULE_TOKEN &&
+            !word_matcher_normalize_literal(&rules[i])) {
+            g_warning("Attachment checker: ignoring rule '%s': nothing left after normalization",
+                      words[i]);
+            word_rule_clear(&rules[i]);
+            continue;
+        }
+        if (word_rule_needs_boundaries(&rules[i]))
+            matcher->boundaries = TRUE;
+    }
+
+    // Маркеры границ вставляются во все литералы сразу, иначе литерал
+    // без маркеров не совпал бы с потоком, где они есть
+    for (guint i = 0; i < matcher->n_words; i++) {
+        if (rules[i].kind == WORD_RULE_TOKEN && rules[i].literal) {
+            g_ptr_array_add(tokens, rules[i].literal);
+            g_array_append_val(token_rules, i);
+        } else if (rules[i].literal) {
+            if (matcher->boundaries) {
+                gchar *marked = word_rule_literal_with_markers(&rules[i]);
+                trie_insert(nodes, marked, i);
+                g_free(marked);
+            } else {
+                trie_insert(nodes, rules[i].literal, i);
+            }
+            g_ptr_array_add(literals, rules[i].literal);
+        } else if (rules[i].regex) {
+            g_ptr_array_add(regexes, rules[i].regex);
+            g_array_append_val(regex_rules, i);
+        }
+    }
+
+    word_matcher_compile(matcher, nodes);
+
+    word_regex_tables_init(&tables);
+    word_regex_compile((WordRegex **)regexes->pdata, (const guint32 *)regex_rules->data,
+                       regexes->len, &tables);
+    word_matcher_take_tables(matcher, &tables);
+
+    word_token_index_build(&matcher->tokens, (const gchar **)tokens->pdata,
+                           (const guint32 *)token_rules->data, tokens->len);
+
+    word_matcher_build_prefilter(matcher, literals);
+
+    for (guint i = 0; i < matcher->n_words; i++)
+        word_rule_clear(&rules[i]);
+    g_free(rules);
+    g_array_free(nodes, TRUE);
+    g_array_unref(regex_rules);
+    g_ptr_array_unref(regexes);
+    g_array_unref(token_rules);
+    g_ptr_array_unref(tokens);
+    g_ptr_array_unref(literals);
+
+    return matcher;
+}
+
+void
+word_matcher_free(WordMatcher *matcher)
+{
+    if (!matcher)
+        return;
+
+    word_profile_free(matcher->profile);
+
+    // Автомат из файла ссылается на отображённую память и ничего не выделял
+    if (matcher->mapped) {
+        g_mapped_file_unref(matcher->mapped);
+    } else {
+        g_free((gpointer)matcher->word_offsets);
+        g_free((gpointer)matcher->word_data);
+        g_free((gpointer)matcher->root_next);
+        g_free((gpointer)matcher->edge_start);
+        g_free((gpointer)matcher->edge_bytes);
+        g_free((gpointer)matcher->edge_target);
+        g_free((gpointer)matcher->fail);
+        g_free((gpointer)matcher->output);
+        g_free((gpointer)matcher->output_link);
+        g_free((gpointer)matcher->dfas);
+        g_free((gpointer)matcher->dfa_next);
+        g_free((gpointer)matcher->dfa_accept_start);
+        g_free((gpointer)matcher->dfa_accept_rules);
+        word_token_index_clear(&matcher->tokens);
+        g_free((gpointer)matcher->prefilter);
+    }
+    g_free(matcher);
+}
+
+gboolean
+word_matcher_is_case_sensitive(const WordMatcher *matcher)
+{
+    return matcher ? matcher->case_sensitive : TRUE;
+}
+
+WordMatcherFlags
+word_matcher_get_flags(const WordMatcher *matcher)
+{
+    if (!matcher)
+        return WORD_MATCHER_CASE_SENSITIVE;
+
+    return (matcher->case_sensitive ? WORD_MATCHER_CASE_SENSITIVE : 0) |
+           (matcher->normalize ? WORD_MATCHER_NORMALIZE : 0);
+}
+
+guint
+word_matcher_get_n_words(const WordMatcher *matcher)
+{
+    return matcher ? matcher->n_words : 0;
+}
+
+const gchar*
+word_matcher_get_word(const WordMatcher *matcher, guint index)
+{
+    if (!matcher || index >= matcher->n_words)
+        return NULL;
+
+    return matcher->word_data + matcher->word_offsets[index];
+}
+
+guint64
+word_matcher_get_version(const WordMatcher *matcher)
+{
+    return matcher ? matcher->version : 0;
+}
+
+static inline guint32
+word_matcher_find_edge(const WordMatcher *matcher, guint32 state, guint8 byte)
+{
+    guint32 lo = matcher->edge_start[state];
+    guint32 hi = matcher->edge_start[state + 1];
+
+    if (hi - lo <= LINEAR_EDGE_SCAN) {
+        for (; lo < hi; lo++) {
+            if (matcher->edge_bytes[lo] == byte)
+                return matcher->edge_target[lo];
+        }
+        return WORD_MATCHER_NONE;
+    }
+
+    while (lo < hi) {
+        guint32 mid = lo + (hi - lo) / 2;
+        if (matcher->edge_bytes[mid] < byte)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < matcher->edge_start[state + 1] && matcher->edge_bytes[lo] == byte)
+        return matcher->edge_target[lo];
+
+    return WORD_MATCHER_NONE;
+}
+
+static inline guint32
+word_matcher_next_state(const WordMatcher *matcher, guint32 state, guint8 byte)
+{
+    while (state != 0) {
+        guint32 next = word_matcher_find_edge(matcher, state, byte);
+        if (next != WORD_MATCHER_NONE)
+            return next;
+        state = matcher->fail[state];
+    }
+
+    return matcher->root_next[byte];
+}
+
+// Шаг автомата литералов: состояние со словом или WORD_MATCHER_NONE
+static inline guint32
+word_matcher_step(const WordMatcher *matcher, WordProfileCall *profile, guint32 *state,
+                  guint8 byte)
+{
+    guint32 next = word_matcher_next_state(matcher, *state, byte);
+
+    *state = next;
+    if (G_UNLIKELY(profile != NULL))
+        word_profile_call_step(profile, profile->state_owner[next]);
+    return (matcher->output[next] != WORD_MATCHER_NONE) ? next : matcher->output_link[next];
+}
+
+// Совпадение в состоянии hit, end - смещение конца совпадения в тексте.
+// При поиске первого слова оно запоминается и поиск останавливается, при
+// сборе сообщаются все слова, оканчивающиеся здесь (по суффиксным ссылкам).
+static gboolean
+word_matcher_report(const WordMatcher *matcher, WordMatcherScan *scan, guint32 hit,
+                    guint64 end, guint *word_index)
+{
+    if (!scan->func) {
+        if (G_UNLIKELY(scan->profile != NULL))
+            word_profile_call_hit(scan->profile, matcher->output[hit]);
+        if (word_index)
+            *word_index = matcher->output[hit];
+        return TRUE;
+    }
+
+    for (; hit != WORD_MATCHER_NONE; hit = matcher->output_link[hit]) {
+        if (G_UNLIKELY(scan->profile != NULL))
+            word_profile_call_hit(scan->profile, matcher->output[hit]);
+        scan->func(matcher->output[hit], end, scan->func_data);
+    }
+
+    return FALSE;
+}
+
+// То же для принимающего состояния ДКА: accept - границы списка его правил.
+// Правила из списка prev (он тоже отсортирован) уже сообщены и пропускаются.
+static gboolean
+word_matcher_report_dfa(const WordMatcher *matcher, WordMatcherScan *scan,
+                        const guint32 *accept, const guint32 *prev,
+                        guint64 end, guint *word_index)
+{
+    guint32 j = prev[0];
+
+    if (!scan->func) {
+        if (G_UNLIKELY(scan->profile != NULL))
+            word_profile_call_hit(scan->profile, matcher->dfa_accept_rules[accept[0]]);
+        if (word_index)
+            *word_index = matcher->dfa_accept_rules[accept[0]];
+        return TRUE;
+    }
+
+    for (guint32 i = accept[0]; i < accept[1]; i++) {
+        guint32 rule = matcher->dfa_accept_rules[i];
+
+        while (j < prev[1] && matcher->dfa_accept_rules[j] < rule)
+            j++;
+        if (j < prev[1] && matcher->dfa_accept_rules[j] == rule)
+            continue;
+        if (G_UNLIKELY(scan->profile != NULL))
+            word_profile_call_hit(scan->profile, rule);
+        scan->func(rule, end, scan->func_data);
+    }
+
+    return FALSE;
+}
+
+static inline gboolean
+word_matcher_feed_byte(const WordMatcher *matcher, WordMatcherScan *scan, guint32 *state,
+                       guint8 byte, guint64 end, guint *word_index)
+{
+    guint32 hit = word_matcher_step(matcher, scan->profile, state, byte);
+
+    return hit != WORD_MATCHER_NONE && word_matcher_report(matcher, scan, hit, end, word_index);
+}
+
+// Байты одного символа исходного текста (например, свёрнутого): все
+// совпадения оканчиваются там же, где символ
+static gboolean
+word_matcher_run_at(const WordMatcher *matcher, WordMatcherScan *scan, guint32 *state,
+                    const guchar *p, gsize len, guint64 end, guint *word_index)
+{
+    gboolean found = FALSE;
+
+    for (gsize i = 0; i < len; i++)
+        found |= word_matcher_feed_byte(matcher, scan, state, p[i], end,
+                                        found ? NULL : word_index);
+
+    return found;
+}
+
+// Прогон байтов без преобразования; base - смещение p в тексте.
+// Пока автомат в корне, префильтр пропускает участки без возможных
+// начал слов целиком.
+static gboolean
+word_matcher_run(const WordMatcher *matcher, WordMatcherScan *scan,
+                 const guchar *p, gsize len, guint64 base, guint *word_index)
+{
+    const guchar *start = p, *end = p + len;
+    const WordPrefilter *prefilter = matcher->prefilter;
+    gboolean use_prefilter = prefilter && prefilter->enabled;
+    WordProfileCall *profile = scan->profile;
+    guint32 state = scan->state;
+    gboolean found = FALSE;
+
+    while (p < end && !found) {
+        guint32 hit;
+
+        if (use_prefilter && state == 0) {
+            p = word_prefilter_skip(prefilter, p, end);
+            if (p == end)
+                break;
+        }
+
+        hit = word_matcher_step(matcher, profile, &state, *p++);
+        if (hit != WORD_MATCHER_NONE)
+            found = word_matcher_report(matcher, scan, hit, base + (p - start), word_index);
+    }
+
+    scan->state = state;
+    return found;
+}
+
+// Подача одного полного многобайтного символа со свёрткой регистра,
+// at - смещение символа в тексте. Возвращает число поглощённых байт: для
+// некорректной последовательности подаётся только первый байт как есть.
+static inline guint
+word_matcher_step_char(const WordMatcher *matcher, WordMatcherScan *scan, guint32 *state,
+                       const guchar *seq, guint len, guint64 at,
+                       guint *word_index, gboolean *found)
+{
+    gunichar c = utf8_decode(seq, len);
+    gunichar folded;
+    gchar buf[6];
+
+    if (c == (gunichar)-1) {
+        *found = word_matcher_feed_byte(matcher, scan, state, seq[0], at + 1, word_index);
+        return 1;
+    }
+
+    folded = fold_char(c);
+    if (folded == c) {
+        *found = word_matcher_run_at(matcher, scan, state, seq, len, at + len, word_index);
+    } else {
+        gint n = g_unichar_to_utf8(folded, buf);
+        *found = word_matcher_run_at(matcher, scan, state, (const guchar *)buf, n, at + len,
+                                     word_index);
+    }
+
+    return len;
+}
+
+// Регистронезависимый прогон: свёртка на лету, без копий текста.
+// ASCII обрабатывается напрямую, многобайтные символы декодируются.
+static gboolean
+word_matcher_run_folded(const WordMatcher *matcher, WordMatcherScan *scan,
+                        const guchar *p, gsize len, guint64 base, guint *word_index)
+{
+    const guchar *start = p, *end = p + len;
+    const WordPrefilter *prefilter = matcher->prefilter;
+    gboolean use_prefilter = prefilter && prefilter->enabled;
+    guint32 state = scan->state;
+    gboolean found = FALSE;
+
+    while (p < end && !found) {
+        guint64 at;
+        guchar c;
+        guint seq;
+
+        // В корне автомата и на границе символа - можно пропускать
+        if (use_prefilter && state == 0) {
+            p = word_prefilter_skip(prefilter, p, end);
+            if (p == end)
+                break;
+        }
+
+        c = *p;
+        at = base + (p - start);
+
+        if (c < 0x80) {
+            found = word_matcher_feed_byte(matcher, scan, &state,
+                                           ((guint)(c - 'A') < 26u) ? c + ('a' - 'A') : c,
+                                           at + 1, word_index);
+            p++;
+            continue;
+        }
+
+        seq = utf8_sequence_length(c);
+        if (seq == 0) {
+            found = word_matcher_feed_byte(matcher, scan, &state, c, at + 1, word_index);
+            p++;
+            continue;
+        }
+
+        // Символ разрезан границей блока - дочитаем в следующем вызове
+        if ((gsize)(end - p) < seq) {
+            memcpy(scan->pending, p, end - p);
+            scan->n_pending = end - p;
+            break;
+        }
+
+        p += word_matcher_step_char(matcher, scan, &state, p, seq, at, word_index, &found);
+    }
+
+    scan->state = state;
+    return found;
+}
+
+// Подача байта всем ДКА регулярных правил; found - совпадение на этом
+// байте уже найдено. ДКА продвигаются и после совпадения, чтобы их
+// состояния не отставали.
+//
+// Правило сообщается один раз на серию подряд идущих принимающих позиций
+// ("INV-12345" для inv-\d+ - одно совпадение, а не по каждой цифре):
+// dfa_reported - состояние, правила которого уже сообщены. Оно меняется на
+// каждой принимающей позиции и на границе символа; внутри многобайтного
+// символа ДКА не принимает, но серию это не прерывает.
+static inline gboolean
+word_matcher_step_dfas(const WordMatcher *matcher, WordMatcherScan *scan,
+                       guint8 byte, guint64 end, gboolean found, guint *word_index)
+{
+    gboolean boundary;
+
+    if (matcher->n_dfas == 0)
+        return found;
+
+    if (byte >= 0xC0 && byte != WORD_MATCHER_MARKER)
+        scan->dfa_char_left = MAX(utf8_sequence_length(byte), 1) - 1;
+    else if (byte >= 0x80 && byte < 0xC0 && scan->dfa_char_left > 0)
+        scan->dfa_char_left--;
+    else
+        scan->dfa_char_left = 0;
+    boundary = scan->dfa_char_left == 0;
+
+    for (guint i = 0; i < matcher->n_dfas; i++) {
+        const WordRegexDfa *dfa = &matcher->dfas[i];
+        guint32 next = matcher->dfa_next[dfa->table + scan->dfa_state[i] * dfa->n_classes +
+                                         dfa->classes[byte]];
+        const guint32 *accept = matcher->dfa_accept_start + dfa->accept + next;
+        const guint32 *prev = matcher->dfa_accept_start + dfa->accept + scan->dfa_reported[i];
+
+        scan->dfa_state[i] = next;
+        if (accept[0] != accept[1] || boundary)
+            scan->dfa_reported[i] = next;
+        if (G_UNLIKELY(scan->profile != NULL))
+            word_profile_call_step(scan->profile,
+                                   scan->profile->dfa_owner[dfa->accept + next]);
+        if (!found && accept[0] != accept[1])
+            found = word_matcher_report_dfa(matcher, scan, accept, prev, end, word_index);
+    }
+
+    return found;
+}
+
+// Подача байта автомату литералов и всем ДКА
+static inline gboolean
+word_matcher_step_rules(const WordMatcher *matcher, WordMatcherScan *scan,
+                        guint8 byte, guint64 end, guint *word_index)
+{
+    gboolean found = word_matcher_feed_byte(matcher, scan, &scan->state, byte, end, word_index);
+
+    return word_matcher_step_dfas(matcher, scan, byte, end, found, word_index);
+}
+
+// Байт исходного текста; при нормализации он нужен только ДКА
+static inline gboolean
+word_matcher_step_source(const WordMatcher *matcher, WordMatcherScan *scan,
+                         guint8 byte, guint64 end, gboolean found, guint *word_index)
+{
+    if (matcher->normalize)
+        return word_matcher_step_dfas(matcher, scan, byte, end, found, word_index);
+
+    return word_matcher_step_rules(matcher, scan, byte, end, found ? NULL : word_index) || found;
+}
+
+// Конец слова текста (end - смещение сразу за ним): поиск в индексе
+// идентификаторов. Слишком длинное слово в индексе заведомо отсутствует.
+static gboolean
+word_matcher_token_end(const WordMatcher *matcher, WordMatcherScan *scan,
+                       guint64 end, guint *word_index)
+{
+    gboolean too_long = scan->token_len > WORD_TOKEN_MAX_BYTES;
+    guint32 rule;
+
+    scan->token_len = 0;
+    if (too_long ||
+        !word_token_index_lookup(&matcher->tokens, word_token_hash_finish(scan->token_hash),
+                                 &rule))
+        return FALSE;
+
+    if (G_UNLIKELY(scan->profile != NULL))
+        word_profile_call_hit(scan->profile, rule);
+
+    if (!scan->func) {
+        if (word_index)
+            *word_index = rule;
+        return TRUE;
+    }
+
+    scan->func(rule, end, scan->func_data);
+    return FALSE;
+}
+
+// Символ для индекса идентификаторов: байты буквы (свёрнутые, если регистр
+// не важен) продолжают хэш слова, первый не-буквенный символ слово завершает
+static inline gboolean
+word_matcher_step_token(const WordMatcher *matcher, WordMatcherScan *scan, gboolean word,
+                        const guchar *bytes, guint n, guint64 at, guint *word_index)
+{
+    if (!word)
+        return scan->token_len > 0 && word_matcher_token_end(matcher, scan, at, word_index);
+
+    if (scan->token_len == 0)
+        scan->token_hash = WORD_TOKEN_HASH_INIT;
+    if (scan->token_len <= WORD_TOKEN_MAX_BYTES) {
+        scan->token_hash = word_token_hash_update(scan->token_hash, bytes, n);
+        scan->token_len += n;
+    }
+
+    return FALSE;
+}
+
+// Нормализованный поток идёт только в автомат литералов, со своими
+// маркерами границ: слово "s e c r e t" в нём уже одно
+typedef struct {
+    const WordMatcher *matcher;
+    WordMatcherScan *scan;
+    guint *word_index;
+    gboolean found;
+} WordMatcherNormalized;
+
+static void
+word_matcher_feed_normalized(gunichar c, gboolean word, guint64 at, guint len, gpointer user_data)
+{
+    WordMatcherNormalized *ctx = user_data;
+    const WordMatcher *matcher = ctx->matcher;
+    WordMatcherScan *scan = ctx->scan;
+    guchar buf[6];
+    gint n = g_unichar_to_utf8(c, (gchar *)buf);
+
+    if (matcher->boundaries && word != scan->norm_prev_word)
+        ctx->found |= word_matcher_feed_byte(matcher, scan, &scan->state, WORD_MATCHER_MARKER, at,
+                                             ctx->found ? NULL : ctx->word_index);
+    scan->norm_prev_word = word;
+
+    ctx->found |= word_matcher_run_at(matcher, scan, &scan->state, buf, n, at + len,
+                                      ctx->found ? NULL : ctx->word_index);
+}
+
+// Подача одного символа в режиме правил: маркер границы слова, если класс
+// символа сменился, затем его байты (свёрнутые, если регистр не важен).
+// at - смещение символа в тексте: совпадение, закрытое маркером, кончается
+// перед символом, остальные - после него. Возвращает число поглощённых
+// байт; 0 - символ не полон, и при can_wait он дочитывается из следующего блока.
+static inline guint
+word_matcher_rules_char(const WordMatcher *matcher, WordMatcherScan *scan,
+                        const guchar *p, gsize avail, gboolean can_wait, guint64 at,
+                        guint *word_index, gboolean *found)
+{
+    guint len = utf8_sequence_length(*p);
+    gunichar c = (gunichar)-1;
+    const guchar *bytes = p;
+    guchar buf[6];
+    gboolean word = FALSE;
+    guint n;
+
+    if (len > avail) {
+        if (can_wait)
+            return 0;
+        len = 0;
+    }
+    if (len > 0)
+        c = utf8_decode(p, len);
+
+    if (c == (gunichar)-1) {
+        // Некорректный байт подаётся как есть и в слово не входит
+        buf[0] = (*p == WORD_MATCHER_MARKER) ? WORD_MATCHER_RAW_FF : *p;
+        bytes = buf;
+        len = n = 1;
+    } else {
+        word = word_char_is_word(c);
+        n = len;
+        if (!matcher->case_sensitive) {
+            gunichar folded = fold_char(c);
+            if (folded != c) {
+                n = g_unichar_to_utf8(folded, (gchar *)buf);
+                bytes = buf;
+            }
+        }
+    }
+
+    if (matcher->tokens.n_slots > 0)
+        *found |= word_matcher_step_token(matcher, scan, word, bytes, n, at,
+                                          *found ? NULL : word_index);
+
+    if (matcher->normalize) {
+        WordMatcherNormalized ctx = { matcher, scan, word_index, *found };
+
+        // Некорректный байт для нормализации - обычный не-буквенный символ
+        word_normalize_push(&scan->normalize, (c == (gunichar)-1) ? 0xFFFD : fold_char(c),
+                            at, len, word_matcher_feed_normalized, &ctx);
+        *found = ctx.found;
+
+        if (matcher->n_dfas == 0)
+            return len;
+    }
+
+    if (matcher->boundaries && word != scan->prev_word)
+        *found |= word_matcher_step_source(matcher, scan, WORD_MATCHER_MARKER, at,
+                                           *found, word_index);
+    scan->prev_word = word;
+
+    for (guint i = 0; i < n; i++)
+        *found |= word_matcher_step_source(matcher, scan, bytes[i], at + len,
+                                           *found, word_index);
+
+    return len;
+}
+
+// Класс символа перед позицией, на которую перескочил префильтр
+static gboolean
+word_matcher_word_before(const guchar *start, const guchar *pos, gboolean before_start)
+{
+    const guchar *q = pos;
+    gunichar c = (gunichar)-1;
+
+    if (pos == start)
+        return before_start;
+
+    do {
+        q--;
+    } while (q > start && (*q & 0xC0) == 0x80 && pos - q < 4);
+
+    if (utf8_sequence_length(*q) == (guint)(pos - q))
+        c = utf8_decode(q, pos - q);
+
+    return c != (gunichar)-1 && word_char_is_word(c);
+}
+
+// Начало символа, оборванного концом блока, или end, если последний
+// символ блока полный
+static const guchar*
+word_matcher_incomplete_tail(const guchar *start, const guchar *end)
+{
+    const guchar *q = end;
+    guint seq;
+
+    while (q > start && end - q < 3 && (q[-1] & 0xC0) == 0x80)
+        q--;
+    if (q == start)
+        return end;
+
+    seq = utf8_sequence_length(q[-1]);
+    return (seq > (guint)(end - q + 1)) ? q - 1 : end;
+}
+
+// Прогон в режиме правил: посимвольно, с маркерами границ слов и ДКА.
+// Префильтр работает, только пока нет регулярных правил.
+static gboolean
+word_matcher_run_rules(const WordMatcher *matcher, WordMatcherScan *scan,
+                       const guchar *p, gsize len, guint64 base, guint *word_index)
+{
+    const guchar *start = p, *end = p + len;
+    const WordPrefilter *prefilter = matcher->prefilter;
+    gboolean use_prefilter = prefilter && prefilter->enabled && matcher->n_dfas == 0;
+    gboolean found = FALSE;
+
+    while (p < end && !found) {
+        guint used;
+
+        if (use_prefilter && scan->state == 0) {
+            const guchar *next = word_prefilter_skip(prefilter, p, end);
+
+            // Оборванный символ в конце блока дочитывается со следующим
+            // блоком (через pending), а класс берётся у последнего полного
+            if (next == end)
+                next = word_matcher_incomplete_tail(p, end);
+
+            if (next != p) {
+                scan->prev_word = word_matcher_word_before(start, next, scan->prev_word);
+                p = next;
+                if (p == end)
+                    break;
+            }
+        }
+
+        used = word_matcher_rules_char(matcher, scan, p, end - p, TRUE, base + (p - start),
+                                       word_index, &found);
+        if (used == 0) {
+            memcpy(scan->pending, p, end - p);
+            scan->n_pending = end - p;
+            break;
+        }
+        p += used;
+    }
+
+    return found;
+}
+
+// Досборка символа, разрезанного границей предыдущего блока: недостающие
+// байты берутся из начала нового. FALSE - символ всё ещё не полон.
+static gboolean
+word_matcher_complete_pending(WordMatcherScan *scan, const guchar **p, gsize *len)
+{
+    guint seq = utf8_sequence_length((guchar)scan->pending[0]);
+
+    while (scan->n_pending < seq && *len > 0 && (**p & 0xC0) == 0x80) {
+        scan->pending[scan->n_pending++] = *(*p)++;
+        (*len)--;
+    }
+
+    return scan->n_pending >= seq || *len > 0;
+}
+
+static gboolean
+word_matcher_feed_rules(const WordMatcher *matcher, WordMatcherScan *scan,
+                        const guchar *p, gsize len, guint64 base, guint *word_index)
+{
+    const guchar *block = p;
+    gboolean found = FALSE;
+
+    if (scan->n_pending > 0) {
+        const guchar *pending = (const guchar *)scan->pending;
+        guint64 at = base - scan->n_pending;
+        guint n, used = 0;
+
+        if (!word_matcher_complete_pending(scan, &p, &len))
+            return FALSE;
+
+        n = scan->n_pending;
+        scan->n_pending = 0;
+
+        while (used < n)
+            used += word_matcher_rules_char(matcher, scan, pending + used, n - used, FALSE,
+                                            at + used, found ? NULL : word_index, &found);
+
+        if (found)
+            return TRUE;
+    }
+
+    return word_matcher_run_rules(matcher, scan, p, len, base + (p - block), word_index);
+}
+
+static inline gboolean
+word_matcher_has_rules(const WordMatcher *matcher)
+{
+    return matcher->boundaries || matcher->n_dfas > 0 || matcher->normalize ||
+           matcher->tokens.n_slots > 0;
+}
+
+void
+word_matcher_scan_init(WordMatcherScan *scan)
+{
+    memset(scan, 0, sizeof(*scan));
+}
+
+void
+word_matcher_scan_set_func(WordMatcherScan *scan, WordMatcherMatchFunc func, gpointer user_data)
+{
+    scan->func = func;
+    scan->func_data = user_data;
+}
+
+static gboolean
+word_matcher_feed(const WordMatcher *matcher, WordMatcherScan *scan,
+                  const gchar *data, gsize len, guint *word_index)
+{
+    const guchar *p = (const guchar *)data;
+    const guchar *block = p;
+    guint64 base;
+
+    if (!matcher || !scan || !data ||
+        (matcher->n_states <= 1 && matcher->n_dfas == 0 && matcher->tokens.n_slots == 0))
+        return FALSE;
+
+    base = scan->offset;
+    scan->offset += len;
+
+    if (word_matcher_has_rules(matcher))
+        return word_matcher_feed_rules(matcher, scan, p, len, base, word_index);
+
+    if (matcher->case_sensitive)
+        return word_matcher_run(matcher, scan, p, len, base, word_index);
+
+    if (scan->n_pending > 0) {
+        const guchar *pending = (const guchar *)scan->pending;
+        guint seq = utf8_sequence_length(pending[0]);
+        guint64 at = base - scan->n_pending;
+        guint n, used = 0;
+        gboolean found = FALSE;
+
+        if (!word_matcher_complete_pending(scan, &p, &len))
+            return FALSE;
+
+        n = scan->n_pending;
+        scan->n_pending = 0;
+
+        if (n == seq)
+            used = word_matcher_step_char(matcher, scan, &scan->state, pending, seq, at,
+                                          word_index, &found);
+
+        // Оборванная последовательность подаётся байтами как есть
+        if (!found && used < n)
+            found = word_matcher_run_at(matcher, scan, &scan->state, pending + used, n - used,
+                                        at + n, word_index);
+
+        if (found)
+            return TRUE;
+    }
+
+    return word_matcher_run_folded(matcher, scan, p, len, base + (p - block), word_index);
+}
+
+static gboolean
+word_matcher_finish(const WordMatcher *matcher, WordMatcherScan *scan, guint *word_index)
+{
+    guint64 at;
+    gboolean found = FALSE;
+    guint used = 0;
+
+    if (!matcher || !scan || !word_matcher_has_rules(matcher))
+        return FALSE;
+
+    // Оборванный в конце текста символ подаётся байтами как есть
+    at = scan->offset - scan->n_pending;
+    while (used < scan->n_pending)
+        used += word_matcher_rules_char(matcher, scan, (const guchar *)scan->pending + used,
+                                        scan->n_pending - used, FALSE, at + used,
+                                        found ? NULL : word_index, &found);
+    scan->n_pending = 0;
+
+    // Слово в самом конце текста - тоже целое
+    if (scan->token_len > 0)
+        found |= word_matcher_token_end(matcher, scan, scan->offset, found ? NULL : word_index);
+
+    if (matcher->normalize) {
+        WordMatcherNormalized ctx = { matcher, scan, word_index, found };
+
+        word_normalize_flush(&scan->normalize, word_matcher_feed_normalized, &ctx);
+        found = ctx.found;
+
+        if (matcher->boundaries && scan->norm_prev_word)
+            found |= word_matcher_feed_byte(matcher, scan, &scan->state, WORD_MATCHER_MARKER,
+                                            scan->offset, found ? NULL : word_index);
+        scan->norm_prev_word = FALSE;
+    }
+
+    // Конец текста - граница последнего слова
+    if (matcher->boundaries && scan->prev_word) {
+        found |= word_matcher_step_source(matcher, scan, WORD_MATCHER_MARKER, scan->offset,
+                                          found, word_index);
+        scan->prev_word = FALSE;
+    }
+
+    return found;
+}
+
+// С профилем стоимости правил каждый вызов считает свои шаги и время и
+// переносит их в профиль автомата (word-profile.h)
+gboolean
+word_matcher_scan_feed(const WordMatcher *matcher, WordMatcherScan *scan,
+                       const gchar *data, gsize len, guint *word_index)
+{
+    gboolean found;
+
+    if (G_LIKELY(!matcher || !matcher->profile || !scan))
+        return word_matcher_feed(matcher, scan, data, len, word_index);
+
+    scan->profile = word_profile_call_begin(matcher->profile);
+    found = word_matcher_feed(matcher, scan, data, len, word_index);
+    if (scan->profile)
+        word_profile_call_end(scan->profile, len);
+    scan->profile = NULL;
+
+    return found;
+}
+
+gboolean
+word_matcher_scan_finish(const WordMatcher *matcher, WordMatcherScan *scan, guint *word_index)
+{
+    gboolean found;
+
+    if (G_LIKELY(!matcher || !matcher->profile || !scan))
+        return word_matcher_finish(matcher, scan, word_index);
+
+    scan->profile = word_profile_call_begin(matcher->profile);
+    found = word_matcher_finish(matcher, scan, word_index);
+    if (scan->profile)
+        word_profile_call_end(scan->profile, 0);
+    scan->profile = NULL;
+
+    return found;
+}
+
+gboolean
+word_matcher_search(const WordMatcher *matcher, const gchar *text,
+                    gssize len, guint *word_index)
+{
+    WordMatcherScan scan;
+
+    if (!text)
+        return FALSE;
+
+    if (len < 0)
+        len = strlen(text);
+
+    word_matcher_scan_init(&scan);
+    return word_matcher_scan_feed(matcher, &scan, text, len, word_index) ||
+           word_matcher_scan_finish(matcher, &scan, word_index);
+}
+
+typedef struct {
+    WordMatcherMatchFunc func;
+    gpointer user_data;
+    guint n_matches;
+} WordMatcherCounter;
+
+static void
+word_matcher_count_match(guint word_index, guint64 end, gpointer user_data)
+{
+    WordMatcherCounter *counter = user_data;
+
+    counter->n_matches++;
+    if (counter->func)
+        counter->func(word_index, end, counter->user_data);
+}
+
+guint
+word_matcher_search_all(const WordMatcher *matcher, const gchar *text, gssize len,
+                        WordMatcherMatchFunc func, gpointer user_data)
+{
+    WordMatcherCounter counter = { func, user_data, 0 };
+    WordMatcherScan scan;
+
+    if (!text)
+        return 0;
+
+    if (len < 0)
+        len = strlen(text);
+
+    word_matcher_scan_init(&scan);
+    word_matcher_scan_set_func(&scan, word_matcher_count_match, &counter);
+    word_matcher_scan_feed(matcher, &scan, text, len, NULL);
+    word_matcher_scan_finish(matcher, &scan, NULL);
+
+    return counter.n_matches;
+}
@@ -0,0 +1,94 @@
+#ifndef WORD_MATCHER_H
+#define WORD_MATCHER_H
+
+#include <glib.h>
+
+#include "word-normalize.h"
+
+// Признак отсутствия совпадения / перехода в автомате
+#define WORD_MATCHER_NONE G_MAXUINT32
+
+// Сколько ДКА регулярных правил может идти по тексту одновременно
+#define WORD_MATCHER_MAX_DFAS 4
+
+// Скомпилированный автомат по списку запрещённых слов и правил (см.
+// word-rules.h): Ахо-Корасик для литералов, ДКА для регулярных правил и
+// хэш-индекс идентификаторов (word-tokens.h). Строится один раз и находит
+// все слова за один линейный проход по тексту.
+typedef struct _WordMatcher WordMatcher;
+
+// Режимы автомата. Нормализация (word-normalize.h) применяется к
+// литеральным правилам и всегда идёт без учёта регистра; регулярные
+// правила видят исходный (свёрнутый) текст.
+typedef enum {
+    WORD_MATCHER_CASE_SENSITIVE = 1 << 0,
+    WORD_MATCHER_NORMALIZE = 1 << 1
+} WordMatcherFlags;
+
+#define WORD_MATCHER_N_MODES 4
+
+WordMatcher* word_matcher_new(gchar **words, gboolean case_sensitive);
+WordMatcher* word_matcher_new_full(gchar **words, WordMatcherFlags flags);
+void word_matcher_free(WordMatcher *matcher);
+
+gboolean word_matcher_is_case_sensitive(const WordMatcher *matcher);
+// Режим, с которым автомат построен на самом деле (с нормализацией
+// флага регистра в нём нет)
+WordMatcherFlags word_matcher_get_flags(const WordMatcher *matcher);
+guint word_matcher_get_n_words(const WordMatcher *matcher);
+const gchar* word_matcher_get_word(const WordMatcher *matcher, guint index);
+// Отпечаток словаря: одинаков для одинаковых списков слов и режима регистра,
+// в том числе у автомата, загруженного из скомпилированного файла
+guint64 word_matcher_get_version(const WordMatcher *matcher);
+
+// Поиск первого (по позиции окончания) слова в тексте.
+// len < 0 означает строку, завершённую нулём.
+// Для регистронезависимого автомата текст сворачивается на лету, без копий.
+gboolean word_matcher_search(const WordMatcher *matcher, const gchar *text,
+                             gssize len, guint *word_index);
+
+// Сбор всех совпадений: номер слова и смещение конца совпадения от начала
+// текста (байт сразу за ним)
+typedef void (*WordMatcherMatchFunc)(guint word_index, guint64 end, gpointer user_data);
+
+// Счётчики профиля стоимости правил для одного вызова (word-profile.h)
+typedef struct _WordProfileCall WordProfileCall;
+
+// Потоковый поиск: текст подаётся блоками произвольного размера, состояние
+// автомата (и разрезанный границей UTF-8 символ) переносится между блоками.
+typedef struct {
+    guint32 state;
+    guint32 dfa_state[WORD_MATCHER_MAX_DFAS];
+    guint32 dfa_reported[WORD_MATCHER_MAX_DFAS]; // правила этого состояния уже сообщены
+    guint dfa_char_left;    // байт до конца текущего символа (для ДКА)
+    guint64 offset;         // сколько байт подано всего
+    gchar pending[4];       // незавершённый UTF-8 символ с конца прошлого блока
+    guint n_pending;
+    gboolean prev_word;     // последний поданный символ - буква слова
+    gboolean norm_prev_word; // то же для нормализованного потока
+    guint64 token_hash;     // хэш текущего слова для идентификаторов id:
+    guint token_len;        // его длина в байтах, 0 - не внутри слова
+    WordNormalizeState normalize;
+    WordMatcherMatchFunc func;  // NULL - поиск до первого совпадения
+    gpointer func_data;
+    WordProfileCall *profile;   // только на время вызова; NULL - без профиля
+} WordMatcherScan;
+
+void word_matcher_scan_init(WordMatcherScan *scan);
+// Режим сбора: каждое совпадение (все слова, оканчивающиеся в одной позиции,
+// в том числе вложенные) сообщается func, а поиск идёт до конца текста.
+// feed и finish тогда всегда возвращают FALSE.
+void word_matcher_scan_set_func(WordMatcherScan *scan, WordMatcherMatchFunc func,
+                                gpointer user_data);
+gboolean word_matcher_scan_feed(const WordMatcher *matcher, WordMatcherScan *scan,
+                                const gchar *data, gsize len, guint *word_index);
+// Конец текста: правила на целые слова совпадают и в самом конце, поэтому
+// после последнего блока поиск нужно завершить
+gboolean word_matcher_scan_finish(const WordMatcher *matcher, WordMatcherScan *scan,
+                                  guint *word_index);
+
+// Все совпадения в тексте за один проход; возвращает их число
+guint word_matcher_search_all(const WordMatcher *matcher, const gchar *text, gssize len,
+                              WordMatcherMatchFunc func, gpointer user_data);
+
+#endif /* WORD_MATCHER_H */
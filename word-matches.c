@@ -0,0 +1,248 @@
+#include <string.h>
+
+#include "word-matches.h"
+
+typedef struct {
+    guint word_index;
+    guint count;
+} WordCount;
+
+struct _WordMatches {
+    ScanArena *arena;       // NULL - обычная куча
+    WordMatch *stored;
+    guint n_stored;
+    guint stored_size;
+    WordCount *words;       // по первому появлению
+    guint n_words;
+    guint words_size;
+    guint *word_slots;      // открытая адресация: позиция в words + 1, 0 - пусто
+    guint slots_mask;
+    guint total;
+    WordMatchPlace place;
+    guint source;
+};
+
+static gpointer
+word_matches_alloc(WordMatches *matches, gsize size)
+{
+    return matches->arena ? scan_arena_alloc0(matches->arena, size) : g_malloc0(size);
+}
+
+static void
+word_matches_release(WordMatches *matches, gpointer data)
+{
+    if (!matches->arena)
+        g_free(data);
+}
+
+// Массив вдвое больше; прежний в области памяти просто остаётся до сброса
+static gpointer
+word_matches_grow(WordMatches *matches, gpointer data, guint len, guint *size, gsize element)
+{
+    guint new_size = MAX(*size * 2, 16);
+    gpointer grown = word_matches_alloc(matches, new_size * element);
+
+    if (len)
+        memcpy(grown, data, len * element);
+    word_matches_release(matches, data);
+
+    *size = new_size;
+    return grown;
+}
+
+WordMatches*
+word_matches_new(void)
+{
+    return word_matches_new_in(NULL);
+}
+
+WordMatches*
+word_matches_new_in(ScanArena *arena)
+{
+    WordMatches *matches = arena ? scan_arena_alloc0(arena, sizeof(WordMatches)) :
+                                   g_new0(WordMatches, 1);
+
+    matches->arena = arena;
+    return matches;
+}
+
+void
+word_matches_free(WordMatches *matches)
+{
+    if (!matches || matches->arena)
+        return;
+
+    g_free(matches->stored);
+    g_free(matches->words);
+    g_free(matches->word_slots);
+    g_free(matches);
+}
+
+ScanArena*
+word_matches_get_arena(const WordMatches *matches)
+{
+    return matches->arena;
+}
+
+void
+word_matches_set_place(WordMatches *matches, WordMatchPlace place, guint source)
+{
+    matches->place = place;
+    matches->source = source;
+}
+
+void
+word_matches_get_place(const WordMatches *matches, WordMatchPlace *place, guint *source)
+{
+    *place = matches->place;
+    *source = matches->source;
+}
+
+static inline guint
+word_matches_slot_hash(guint word_index)
+{
+    return word_index * 2654435761u;
+}
+
+// Таблица держится заполненной не больше чем наполовину
+static void
+word_matches_rehash(WordMatches *matches)
+{
+    guint mask = MAX((matches->slots_mask + 1) * 2, 32) - 1;
+    guint *slots = word_matches_alloc(matches, (mask + 1) * sizeof(guint));
+
+    for (guint i = 0; i < matches->n_words; i++) {
+        guint pos = word_matches_slot_hash(matches->words[i].word_index) & mask;
+
+        while (slots[pos])
+            pos = (pos + 1) & mask;
+        slots[pos] = i + 1;
+    }
+
+    word_matches_release(matches, matches->word_slots);
+    matches->word_slots = slots;
+    matches->slots_mask = mask;
+}
+
+static void
+word_matches_count(WordMatches *matches, guint word_index, guint count)
+{
+    guint pos, slot;
+
+    if (!matches->word_slots || (matches->n_words + 1) * 2 > matches->slots_mask + 1)
+        word_matches_rehash(matches);
+
+    pos = word_matches_slot_hash(word_index) & matches->slots_mask;
+    while ((slot = matches->word_slots[pos]) &&
+           matches->words[slot - 1].word_index != word_index)
+        pos = (pos + 1) & matches->slots_mask;
+
+    if (slot == 0) {
+        if (matches->n_words == matches->words_size)
+            matches->words = word_matches_grow(matches, matches->words, matches->n_words,
+                                               &matches->words_size, sizeof(WordCount));
+        matches->words[matches->n_words].word_index = word_index;
+        matches->words[matches->n_words].count = 0;
+        slot = ++matches->n_words;
+        matches->word_slots[pos] = slot;
+    }
+
+    matches->words[slot - 1].count += count;
+    matches->total += count;
+}
+
+// Место под n сохраняемых совпадений
+static void
+word_matches_reserve(WordMatches *matches, guint n)
+{
+    while (matches->n_stored + n > matches->stored_size)
+        matches->stored = word_matches_grow(matches, matches->stored, matches->n_stored,
+                                            &matches->stored_size, sizeof(WordMatch));
+}
+
+void
+word_matches_add(WordMatches *matches, guint word_index, WordMatchPlace place,
+                 guint source, guint64 offset)
+{
+    word_matches_count(matches, word_index, 1);
+
+    if (matches->n_stored < WORD_MATCHES_MAX_STORED) {
+        WordMatch match = { word_index, place, source, offset };
+
+        word_matches_reserve(matches, 1);
+        matches->stored[matches->n_stored++] = match;
+    }
+}
+
+void
+word_matches_collect(guint word_index, guint64 end, gpointer user_data)
+{
+    WordMatches *matches = user_data;
+
+    word_matches_add(matches, word_index, matches->place, matches->source, end);
+}
+
+void
+word_matches_append(WordMatches *dest, const WordMatches *src)
+{
+    word_matches_append_at(dest, src, 0);
+}
+
+void
+word_matches_append_at(WordMatches *dest, const WordMatches *src, guint64 base)
+{
+    guint room = WORD_MATCHES_MAX_STORED - MIN(dest->n_stored, WORD_MATCHES_MAX_STORED);
+    guint n = MIN(room, src->n_stored);
+
+    for (guint i = 0; i < src->n_words; i++)
+        word_matches_count(dest, src->words[i].word_index, src->words[i].count);
+
+    if (n == 0)
+        return;
+
+    word_matches_reserve(dest, n);
+    memcpy(dest->stored + dest->n_stored, src->stored, n * sizeof(WordMatch));
+    for (guint i = 0; base && i < n; i++)
+        dest->stored[dest->n_stored + i].offset += base;
+    dest->n_stored += n;
+}
+
+guint
+word_matches_get_total(const WordMatches *matches)
+{
+    return matches ? matches->total : 0;
+}
+
+guint
+word_matches_get_n_stored(const WordMatches *matches)
+{
+    return matches ? matches->n_stored : 0;
+}
+
+const WordMatch*
+word_matches_get(const WordMatches *matches, guint index)
+{
+    g_return_val_if_fail(matches && index < matches->n_stored, NULL);
+
+    return &matches->stored[index];
+}
+
+guint
+word_matches_get_n_words(const WordMatches *matches)
+{
+    return matches ? matches->n_words : 0;
+}
+
+guint
+word_matches_get_word(const WordMatches *matches, guint index, guint *count)
+{
+    const WordCount *entry;
+
+    g_return_val_if_fail(matches && index < matches->n_words, 0);
+
+    entry = &matches->words[index];
+    if (count)
+        *count = entry->count;
+
+    return entry->word_index;
+}
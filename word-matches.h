@@ -0,0 +1,60 @@
+#ifndef WORD_MATCHES_H
+#define WORD_MATCHES_H
+
+#include <glib.h>
+
+#include "scan-arena.h"
+
+// Все совпадения одной проверки: для каждого - слово, где найдено и смещение.
+// Собирается за один проход (word_matcher_scan_set_func) и показывается
+// пользователю целиком, без повторного поиска.
+typedef enum {
+    WORD_MATCH_BODY,                // текст письма
+    WORD_MATCH_ATTACHMENT_NAME,     // имя вложения
+    WORD_MATCH_ATTACHMENT           // текст вложения
+} WordMatchPlace;
+
+typedef struct {
+    guint word_index;
+    WordMatchPlace place;
+    guint source;           // номер вложения; для текста письма 0
+    guint64 offset;         // конец совпадения от начала текста, байт
+} WordMatch;
+
+// Мест хранится не больше этого числа (письмо из одних запрещённых слов
+// не должно съесть память), счётчики по словам полные всегда
+#define WORD_MATCHES_MAX_STORED 1000
+
+typedef struct _WordMatches WordMatches;
+
+WordMatches* word_matches_new(void);
+// Список и его массивы - в области памяти проверки; word_matches_free()
+// для такого списка ничего не делает, память уходит со сбросом области
+WordMatches* word_matches_new_in(ScanArena *arena);
+void word_matches_free(WordMatches *matches);
+// Область списка (NULL - куча): в ней же создаются списки частей проверки
+ScanArena* word_matches_get_arena(const WordMatches *matches);
+
+// Место для следующих совпадений, приходящих через word_matches_collect()
+void word_matches_set_place(WordMatches *matches, WordMatchPlace place, guint source);
+void word_matches_get_place(const WordMatches *matches, WordMatchPlace *place, guint *source);
+// WordMatcherMatchFunc; user_data - WordMatches
+void word_matches_collect(guint word_index, guint64 end, gpointer user_data);
+void word_matches_add(WordMatches *matches, guint word_index, WordMatchPlace place,
+                      guint source, guint64 offset);
+// Дописывает совпадения src в конец dest
+void word_matches_append(WordMatches *dest, const WordMatches *src);
+// То же, но смещения src отсчитаны от base в тексте dest (часть письма,
+// проверенная отдельно)
+void word_matches_append_at(WordMatches *dest, const WordMatches *src, guint64 base);
+
+// Всего совпадений, включая не сохранённые
+guint word_matches_get_total(const WordMatches *matches);
+guint word_matches_get_n_stored(const WordMatches *matches);
+const WordMatch* word_matches_get(const WordMatches *matches, guint index);
+
+// Найденные слова в порядке первого появления и число совпадений каждого
+guint word_matches_get_n_words(const WordMatches *matches);
+guint word_matches_get_word(const WordMatches *matches, guint index, guint *count);
+
+#endif /* WORD_MATCHES_H */
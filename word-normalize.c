@@ -0,0 +1,230 @@
+#include <string.h>
+
+#include "word-matcher-private.h"
+#include "word-normalize.h"
+
+// Замены ASCII после свёртки регистра: 0 - символ не меняется, ' ' - разделитель.
+// Перевод строки разделителем не считается: правила действуют в пределах строки.
+static const gchar normalize_ascii[128] = {
+    ['\t'] = ' ', ['\v'] = ' ', ['\f'] = ' ', [' '] = ' ',
+    ['"'] = ' ', ['\''] = ' ', ['*'] = ' ', ['+'] = ' ', [','] = ' ', ['-'] = ' ',
+    ['.'] = ' ', ['/'] = ' ', [':'] = ' ', [';'] = ' ', ['='] = ' ', ['\\'] = ' ',
+    ['^'] = ' ', ['_'] = ' ', ['`'] = ' ', ['|'] = ' ', ['~'] = ' ',
+    ['0'] = 'o', ['1'] = 'i', ['3'] = 'e', ['4'] = 'a', ['5'] = 's', ['7'] = 't',
+    ['8'] = 'b', ['@'] = 'a', ['$'] = 's', ['l'] = 'i'
+};
+
+// Диапазоны остальных символов (после свёртки), отсортированы по началу.
+// to: 0 - выбросить, ' ' - разделитель, иначе буква-замена.
+typedef struct {
+    gunichar first;
+    gunichar last;
+    gunichar to;
+} NormalizeRange;
+
+static const NormalizeRange normalize_ranges[] = {
+    { 0x00A0, 0x00A0, ' ' },    // неразрывный пробел
+    { 0x00AD, 0x00AD, 0 },      // мягкий перенос
+    { 0x00B7, 0x00B7, ' ' },    // средняя точка
+    { 0x0300, 0x036F, 0 },      // комбинируемые диакритические знаки
+    { 0x03B1, 0x03B1, 'a' },    // греческие α ε ι κ ν ο ρ τ υ χ
+    { 0x03B5, 0x03B5, 'e' },
+    { 0x03B9, 0x03B9, 'i' },
+    { 0x03BA, 0x03BA, 'k' },
+    { 0x03BD, 0x03BD, 'v' },
+    { 0x03BF, 0x03BF, 'o' },
+    { 0x03C1, 0x03C1, 'p' },
+    { 0x03C4, 0x03C4, 't' },
+    { 0x03C5, 0x03C5, 'u' },
+    { 0x03C7, 0x03C7, 'x' },
+    { 0x0430, 0x0430, 'a' },    // кириллические а в е к м н о р с т у х
+    { 0x0432, 0x0432, 'b' },
+    { 0x0435, 0x0435, 'e' },
+    { 0x043A, 0x043A, 'k' },
+    { 0x043C, 0x043C, 'm' },
+    { 0x043D, 0x043D, 'h' },
+    { 0x043E, 0x043E, 'o' },
+    { 0x0440, 0x0440, 'p' },
+    { 0x0441, 0x0441, 'c' },
+    { 0x0442, 0x0442, 't' },
+    { 0x0443, 0x0443, 'y' },
+    { 0x0445, 0x0445, 'x' },
+    { 0x0455, 0x0455, 's' },    // ѕ і ј
+    { 0x0456, 0x0456, 'i' },
+    { 0x0458, 0x0458, 'j' },
+    { 0x04BB, 0x04BB, 'h' },    // һ
+    { 0x04CF, 0x04CF, 'i' },    // ӏ
+    { 0x0501, 0x0501, 'd' },    // ԁ ԛ ԝ
+    { 0x051B, 0x051B, 'q' },
+    { 0x051D, 0x051D, 'w' },
+    { 0x180E, 0x180E, 0 },      // монгольский разделитель гласных
+    { 0x2000, 0x200A, ' ' },    // пробелы разной ширины
+    { 0x200B, 0x200F, 0 },      // нулевой ширины, метки направления
+    { 0x2010, 0x2015, ' ' },    // дефисы и тире
+    { 0x2022, 0x2022, ' ' },    // маркер списка
+    { 0x2024, 0x2024, ' ' },
+    { 0x2027, 0x2027, ' ' },
+    { 0x202A, 0x202E, 0 },      // управление направлением
+    { 0x202F, 0x202F, ' ' },
+    { 0x205F, 0x205F, ' ' },
+    { 0x2060, 0x2064, 0 },      // соединитель слов и невидимые операторы
+    { 0x2066, 0x2069, 0 },
+    { 0x3000, 0x3000, ' ' },    // идеографический пробел
+    { 0xFEFF, 0xFEFF, 0 }       // BOM / неразрывный нулевой ширины
+};
+
+WordNormalizeClass
+word_normalize_char(gunichar c, gunichar *normalized)
+{
+    gunichar to = c;
+
+    // Полноширинные ASCII (Ａ уже свёрнуто в ａ)
+    if (c >= 0xFF01 && c <= 0xFF5E)
+        c = to = c - 0xFEE0;
+
+    if (c < 0x80) {
+        if (normalize_ascii[c])
+            to = normalize_ascii[c];
+    } else if (c >= normalize_ranges[0].first &&
+               c <= normalize_ranges[G_N_ELEMENTS(normalize_ranges) - 1].last) {
+        guint lo = 0, hi = G_N_ELEMENTS(normalize_ranges);
+
+        while (lo < hi) {
+            guint mid = lo + (hi - lo) / 2;
+            if (normalize_ranges[mid].last < c)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if (lo < G_N_ELEMENTS(normalize_ranges) && c >= normalize_ranges[lo].first) {
+            to = normalize_ranges[lo].to;
+            if (to == 0)
+                return WORD_NORMALIZE_DROP;
+        }
+    }
+
+    *normalized = to;
+    if (to == ' ')
+        return WORD_NORMALIZE_SEPARATOR;
+
+    return word_char_is_word(to) ? WORD_NORMALIZE_WORD : WORD_NORMALIZE_OTHER;
+}
+
+void
+word_normalize_init(WordNormalizeState *state)
+{
+    memset(state, 0, sizeof(*state));
+}
+
+// Придержанная буква оказалась целым словом из одной буквы:
+// разделители перед ней выбрасываются ("s e c r e t" -> "secret")
+static void
+word_normalize_release(WordNormalizeState *state, WordNormalizeEmit emit, gpointer user_data)
+{
+    emit(state->held_char, TRUE, state->held_at, state->held_len, user_data);
+    state->held = FALSE;
+    state->token_len = 1;
+}
+
+void
+word_normalize_push(WordNormalizeState *state, gunichar c, guint64 at, guint len,
+                    WordNormalizeEmit emit, gpointer user_data)
+{
+    gunichar normalized = c;
+
+    switch (word_normalize_char(c, &normalized)) {
+    case WORD_NORMALIZE_DROP:
+        return;
+
+    case WORD_NORMALIZE_SEPARATOR:
+        if (state->held)
+            word_normalize_release(state, emit, user_data);
+        if (!state->gap)
+            state->gap_at = at;
+        state->gap = TRUE;
+        return;
+
+    case WORD_NORMALIZE_WORD:
+        if (state->held) {
+            // Вторая буква: придержанная начинает обычное слово
+            emit(' ', FALSE, state->gap_at, 0, user_data);
+            emit(state->held_char, TRUE, state->held_at, state->held_len, user_data);
+            state->held = FALSE;
+            state->token_len = 2;
+        } else if (state->gap && state->token_len == 1) {
+            state->held = TRUE;
+            state->held_char = normalized;
+            state->held_at = at;
+            state->held_len = len;
+            state->gap = FALSE;
+            return;
+        } else if (state->gap) {
+            emit(' ', FALSE, state->gap_at, 0, user_data);
+            state->token_len = 0;
+        }
+        state->gap = FALSE;
+        emit(normalized, TRUE, at, len, user_data);
+        state->token_len = MIN(state->token_len + 1, 2);
+        return;
+
+    case WORD_NORMALIZE_OTHER:
+        if (state->held)
+            word_normalize_release(state, emit, user_data);
+        if (state->gap)
+            emit(' ', FALSE, state->gap_at, 0, user_data);
+        state->gap = FALSE;
+        state->token_len = 0;
+        emit(normalized, FALSE, at, len, user_data);
+        return;
+    }
+}
+
+void
+word_normalize_flush(WordNormalizeState *state, WordNormalizeEmit emit, gpointer user_data)
+{
+    if (state->held)
+        word_normalize_release(state, emit, user_data);
+    if (state->gap)
+        emit(' ', FALSE, state->gap_at, 0, user_data);
+
+    word_normalize_init(state);
+}
+
+static void
+word_normalize_append(gunichar c, gboolean word, guint64 at, guint len, gpointer user_data)
+{
+    g_string_append_unichar(user_data, c);
+
+    (void)word;
+    (void)at;
+    (void)len;
+}
+
+gchar*
+word_normalize_string(const gchar *text)
+{
+    GString *result = g_string_new(NULL);
+    WordNormalizeState state;
+    const guchar *p = (const guchar *)text;
+
+    word_normalize_init(&state);
+
+    while (*p) {
+        guint n = utf8_sequence_length(*p);
+        gunichar c = (n > 0) ? utf8_decode(p, n) : (gunichar)-1;
+
+        // Некорректные байты - как в тексте при сканировании
+        if (c == (gunichar)-1) {
+            c = 0xFFFD;
+            n = 1;
+        }
+
+        word_normalize_push(&state, fold_char(c), p - (const guchar *)text, n,
+                            word_normalize_append, result);
+        p += n;
+    }
+    word_normalize_flush(&state, word_normalize_append, result);
+
+    return g_string_free(result, FALSE);
+}
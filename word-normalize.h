@@ -0,0 +1,59 @@
+#ifndef WORD_NORMALIZE_H
+#define WORD_NORMALIZE_H
+
+#include <glib.h>
+
+// Нормализация текста против маскировки запрещённых слов:
+//
+//   s3cr3t, $ecret        цифры и символы "leet" - буквы (3 -> e, $ -> s)
+//   sеcret                кириллица и греческий, похожие на латиницу, - латиница
+//   ｓｅｃｒｅｔ          полноширинные символы - ASCII
+//   se<U+200B>cret        символы нулевой ширины и мягкий перенос выбрасываются
+//   s e c r e t, s.e.c    разделители между одиночными буквами выбрасываются,
+//                         остальные серии разделителей - один пробел
+//
+// Работает посимвольно на свёрнутом тексте, без буферов: автомат получает
+// нормализованные символы вместе со смещениями исходных, поэтому места
+// совпадений указывают в исходный текст. Слова словаря нормализуются так же.
+
+// Меняется при изменении таблиц (входит в отпечаток словаря)
+#define WORD_NORMALIZE_VERSION 1
+
+typedef enum {
+    WORD_NORMALIZE_DROP,        // символ выбрасывается
+    WORD_NORMALIZE_SEPARATOR,   // разделитель внутри слова или между словами
+    WORD_NORMALIZE_WORD,        // буква слова
+    WORD_NORMALIZE_OTHER        // прочее: конец строки, знаки, некорректные байты
+} WordNormalizeClass;
+
+// Класс и замена для символа свёрнутого текста
+WordNormalizeClass word_normalize_char(gunichar c, gunichar *normalized);
+
+// Получатель нормализованных символов: at и len - место исходного символа.
+// Пробел, заменяющий серию разделителей, приходит с её началом и len = 0.
+typedef void (*WordNormalizeEmit)(gunichar c, gboolean word, guint64 at, guint len,
+                                  gpointer user_data);
+
+// Состояние между символами (и блоками текста). Одиночная буква после
+// разделителей придерживается до следующего символа: только он покажет,
+// склеивать её с предыдущей одиночной буквой или отделить пробелом.
+typedef struct {
+    guint token_len;        // букв в текущем слове: 0, 1 или 2 - "больше одной"
+    gboolean gap;           // после слова были разделители
+    guint64 gap_at;         // где они начались: там же и пробел вместо них
+    gboolean held;          // held_char ждёт следующего символа
+    gunichar held_char;
+    guint64 held_at;
+    guint held_len;
+} WordNormalizeState;
+
+void word_normalize_init(WordNormalizeState *state);
+void word_normalize_push(WordNormalizeState *state, gunichar c, guint64 at, guint len,
+                         WordNormalizeEmit emit, gpointer user_data);
+// Конец текста: придержанная буква и последний разделитель
+void word_normalize_flush(WordNormalizeState *state, WordNormalizeEmit emit, gpointer user_data);
+
+// Нормализация свёрнутой строки целиком (для слов словаря)
+gchar* word_normalize_string(const gchar *text);
+
+#endif /* WORD_NORMALIZE_H */
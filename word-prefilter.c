@@ -0,0 +1,228 @@
+#include <string.h>
+
+#include "word-prefilter.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WORD_PREFILTER_X86 1
+#endif
+
+// Без AVX2 путь SSE2 используется, только если различных первых байт немного
+#define SSE2_MAX_BYTES 4
+
+void
+word_prefilter_init(WordPrefilter *prefilter)
+{
+    memset(prefilter, 0, sizeof(*prefilter));
+    prefilter->enabled = TRUE;
+}
+
+void
+word_prefilter_disable(WordPrefilter *prefilter)
+{
+    prefilter->enabled = FALSE;
+}
+
+void
+word_prefilter_add(WordPrefilter *prefilter, const guchar *seq, guint len)
+{
+    guint8 bucket;
+
+    if (len == 0)
+        return;
+
+    prefilter->first[seq[0]] = 1;
+
+    // Однобайтные начала - корзины 0-3, любой второй байт подходит.
+    // Многобайтные - корзины 4-7 по старшему полубайту второго байта.
+    if (len == 1) {
+        bucket = 1u << ((seq[0] >> 4) & 3);
+        for (gint i = 0; i < 16; i++) {
+            prefilter->lo1[i] |= bucket;
+            prefilter->hi1[i] |= bucket;
+        }
+    } else {
+        bucket = 1u << (4 + ((seq[1] >> 4) & 3));
+        prefilter->lo1[seq[1] & 0x0F] |= bucket;
+        prefilter->hi1[seq[1] >> 4] |= bucket;
+    }
+
+    prefilter->lo0[seq[0] & 0x0F] |= bucket;
+    prefilter->hi0[seq[0] >> 4] |= bucket;
+}
+
+void
+word_prefilter_finish(WordPrefilter *prefilter)
+{
+    guint n = 0;
+
+    for (guint c = 0; c < 256; c++) {
+        if (!prefilter->first[c])
+            continue;
+        if (n < SSE2_MAX_BYTES)
+            prefilter->bytes[n] = c;
+        n++;
+    }
+
+    prefilter->n_bytes = (n <= SSE2_MAX_BYTES) ? n : 0;
+
+    // Пустой словарь или слова могут начинаться почти с любого байта -
+    // фильтр только мешает
+    if (n == 0 || n > 240)
+        prefilter->enabled = FALSE;
+}
+
+static inline gboolean
+prefilter_pair(const WordPrefilter *prefilter, guchar a, guchar b)
+{
+    return (prefilter->lo0[a & 0x0F] & prefilter->hi0[a >> 4] &
+            prefilter->lo1[b & 0x0F] & prefilter->hi1[b >> 4]) != 0;
+}
+
+static inline gboolean
+prefilter_candidate(const WordPrefilter *prefilter, const guchar *p, const guchar *end)
+{
+    if (!prefilter->first[p[0]])
+        return FALSE;
+
+    // Второй байт в следующем блоке - проверить нельзя, считаем кандидатом
+    return p + 1 == end || prefilter_pair(prefilter, p[0], p[1]);
+}
+
+static const guchar*
+prefilter_skip_scalar(const WordPrefilter *prefilter, const guchar *p, const guchar *end)
+{
+    for (; p < end; p++) {
+        if (prefilter_candidate(prefilter, p, end))
+            return p;
+    }
+
+    return end;
+}
+
+#ifdef WORD_PREFILTER_X86
+
+__attribute__((target("sse2")))
+static const guchar*
+prefilter_skip_sse2(const WordPrefilter *prefilter, const guchar *p, const guchar *end)
+{
+    __m128i needles[SSE2_MAX_BYTES];
+    guint n = prefilter->n_bytes;
+
+    for (guint i = 0; i < n; i++)
+        needles[i] = _mm_set1_epi8((gchar)prefilter->bytes[i]);
+
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)p);
+        __m128i eq = _mm_cmpeq_epi8(block, needles[0]);
+        guint mask;
+
+        for (guint i = 1; i < n; i++)
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi8(block, needles[i]));
+
+        mask = (guint)_mm_movemask_epi8(eq);
+        while (mask) {
+            const guchar *hit = p + __builtin_ctz(mask);
+            if (prefilter_candidate(prefilter, hit, end))
+                return hit;
+            mask &= mask - 1;
+        }
+        p += 16;
+    }
+
+    return prefilter_skip_scalar(prefilter, p, end);
+}
+
+// Классификация по полубайтам (схема Teddy): по 32 пары байт за итерацию
+__attribute__((target("avx2")))
+static const guchar*
+prefilter_skip_avx2(const WordPrefilter *prefilter, const guchar *p, const guchar *end)
+{
+    const __m128i lo0_128 = _mm_loadu_si128((const __m128i *)prefilter->lo0);
+    const __m128i hi0_128 = _mm_loadu_si128((const __m128i *)prefilter->hi0);
+    const __m128i lo1_128 = _mm_loadu_si128((const __m128i *)prefilter->lo1);
+    const __m128i hi1_128 = _mm_loadu_si128((const __m128i *)prefilter->hi1);
+    const __m256i lo0 = _mm256_broadcastsi128_si256(lo0_128);
+    const __m256i hi0 = _mm256_broadcastsi128_si256(hi0_128);
+    const __m256i lo1 = _mm256_broadcastsi128_si256(lo1_128);
+    const __m256i hi1 = _mm256_broadcastsi128_si256(hi1_128);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+
+    // Нужен ещё один байт после блока для второго байта пары
+    while (end - p >= 33) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)p);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + 1));
+        __m256i ma = _mm256_and_si256(
+            _mm256_shuffle_epi8(lo0, _mm256_and_si256(a, nibble)),
+            _mm256_shuffle_epi8(hi0, _mm256_and_si256(_mm256_srli_epi16(a, 4), nibble)));
+        __m256i mb = _mm256_and_si256(
+            _mm256_shuffle_epi8(lo1, _mm256_and_si256(b, nibble)),
+            _mm256_shuffle_epi8(hi1, _mm256_and_si256(_mm256_srli_epi16(b, 4), nibble)));
+        guint mask = ~(guint)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_and_si256(ma, mb), zero));
+
+        // Корзины приблизительны - подтверждаем по точной таблице первых байт
+        while (mask) {
+            const guchar *hit = p + __builtin_ctz(mask);
+            if (prefilter->first[*hit])
+                return hit;
+            mask &= mask - 1;
+        }
+        p += 32;
+    }
+
+    return prefilter_skip_scalar(prefilter, p, end);
+}
+
+typedef enum {
+    CPU_LEVEL_UNKNOWN,
+    CPU_LEVEL_SCALAR,
+    CPU_LEVEL_SSE2,
+    CPU_LEVEL_AVX2
+} CpuLevel;
+
+static CpuLevel
+prefilter_cpu_level(void)
+{
+    static gint level = CPU_LEVEL_UNKNOWN;
+    gint cached = g_atomic_int_get(&level);
+
+    if (cached == CPU_LEVEL_UNKNOWN) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            cached = CPU_LEVEL_AVX2;
+        else if (__builtin_cpu_supports("sse2"))
+            cached = CPU_LEVEL_SSE2;
+        else
+            cached = CPU_LEVEL_SCALAR;
+        g_atomic_int_set(&level, cached);
+    }
+
+    return cached;
+}
+
+#endif /* WORD_PREFILTER_X86 */
+
+const guchar*
+word_prefilter_skip(const WordPrefilter *prefilter, const guchar *p, const guchar *end)
+{
+    // Кандидат сразу под курсором - частый случай в плотном тексте
+    if (p >= end || prefilter_candidate(prefilter, p, end))
+        return p;
+
+#ifdef WORD_PREFILTER_X86
+    switch (prefilter_cpu_level()) {
+    case CPU_LEVEL_AVX2:
+        return prefilter_skip_avx2(prefilter, p + 1, end);
+    case CPU_LEVEL_SSE2:
+        if (prefilter->n_bytes > 0)
+            return prefilter_skip_sse2(prefilter, p + 1, end);
+        break;
+    default:
+        break;
+    }
+#endif
+
+    return prefilter_skip_scalar(prefilter, p + 1, end);
+}
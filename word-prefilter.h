@@ -0,0 +1,38 @@
+#ifndef WORD_PREFILTER_H
+#define WORD_PREFILTER_H
+
+#include <glib.h>
+
+// Быстрый отсев участков текста, где не может начаться ни одно слово.
+// Используется автоматом, пока он стоит в корне: всё до ближайшего
+// кандидата пропускается векторными инструкциями (AVX2/SSE2), а точная
+// проверка выполняется только с позиции кандидата.
+//
+// Структура не содержит указателей и хранится в файле словаря как есть.
+typedef struct {
+    guint8 enabled;
+    guint8 n_bytes;         // число различных первых байт, если их не больше 4
+    guint8 bytes[4];        // сами эти байты (для пути SSE2)
+    guint8 reserved[2];
+    guint8 first[256];      // байт может начинать слово
+    // Таблицы по полубайтам для пар (первый байт, второй байт); бит - корзина.
+    // Пара - кандидат, если пересечение всех четырёх масок не пусто.
+    guint8 lo0[16];
+    guint8 hi0[16];
+    guint8 lo1[16];
+    guint8 hi1[16];
+} WordPrefilter;
+
+void word_prefilter_init(WordPrefilter *prefilter);
+// Добавление возможного начала слова в исходном (не свёрнутом) тексте.
+// len == 1 - слово может начинаться с этого байта с любым следующим.
+void word_prefilter_add(WordPrefilter *prefilter, const guchar *seq, guint len);
+// Отключение фильтра (например, если слово начинается с байта продолжения UTF-8)
+void word_prefilter_disable(WordPrefilter *prefilter);
+void word_prefilter_finish(WordPrefilter *prefilter);
+
+// Первая позиция в [p, end), с которой может начинаться слово, или end
+const guchar* word_prefilter_skip(const WordPrefilter *prefilter,
+                                  const guchar *p, const guchar *end);
+
+#endif /* WORD_PREFILTER_H */
@@ -0,0 +1,384 @@
+#include <string.h>
+#include <time.h>
+
+#include <glib/gstdio.h>
+
+#include "word-matcher-private.h"
+#include "word-profile.h"
+
+#define WORD_PROFILE_HEADER \
+    "# attachment-checker rule profile\n" \
+    "# total\tcalls\tbytes\tcpu-ns\tbase-cpu-ns\n" \
+    "# rule\thits\tcandidates\tcpu-ns\trule\n"
+
+struct _WordProfile {
+    guint n_rules;
+    guint32 *state_owner;           // n_states
+    guint32 *dfa_owner;             // n_dfa_accept_start
+
+    GMutex lock;
+    WordProfileCounters *rules;     // n_rules
+    guint64 calls;
+    guint64 bytes;
+    guint64 cpu_ns;
+    guint64 base_ns;
+};
+
+// Буфер вызова на поток. Массивы по правилам между вызовами нулевые,
+// поэтому годятся для любого профиля не больше их размера.
+typedef struct {
+    WordProfileCall call;
+    guint n_rules;
+} WordProfileBuffer;
+
+static void
+word_profile_buffer_free(gpointer data)
+{
+    WordProfileBuffer *buffer = data;
+
+    g_free(buffer->call.candidates);
+    g_free(buffer->call.hits);
+    g_array_unref(buffer->call.touched);
+    g_free(buffer);
+}
+
+static GPrivate word_profile_buffer = G_PRIVATE_INIT(word_profile_buffer_free);
+
+// Процессорное время потока: ожидание и вытеснение в профиль не попадают
+static guint64
+word_profile_thread_time(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return (guint64)g_get_monotonic_time() * 1000;
+
+    return (guint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Правило состояния автомата литералов - наименьшее из правил, которые
+// оканчиваются в нём или ниже по бору. Потомок в боре нумеруется позже
+// родителя, поэтому хватает одного обратного прохода.
+static guint32*
+word_profile_state_owners(const WordMatcher *matcher)
+{
+    guint32 *owner = g_new(guint32, MAX(matcher->n_states, 1));
+
+    for (guint32 s = matcher->n_states; s-- > 0;) {
+        owner[s] = matcher->output[s];
+        for (guint32 e = matcher->edge_start[s]; e < matcher->edge_start[s + 1]; e++)
+            owner[s] = MIN(owner[s], owner[matcher->edge_target[e]]);
+    }
+
+    // Корень - общий проход, а не кандидат
+    owner[0] = WORD_MATCHER_NONE;
+    return owner;
+}
+
+// То же для ДКА: наименьшее правило, достижимое из состояния. Переходы ДКА
+// образуют циклы, поэтому - до неподвижной точки.
+static guint32*
+word_profile_dfa_owners(const WordMatcher *matcher)
+{
+    guint32 *owner = g_new(guint32, MAX(matcher->n_dfa_accept_start, 1));
+
+    for (guint i = 0; i < matcher->n_dfas; i++) {
+        const WordRegexDfa *dfa = &matcher->dfas[i];
+        const guint32 *accept = matcher->dfa_accept_start + dfa->accept;
+        const guint32 *next = matcher->dfa_next + dfa->table;
+        guint32 *own = owner + dfa->accept;
+        gboolean changed = TRUE;
+
+        for (guint32 s = 0; s < dfa->n_states; s++) {
+            own[s] = WORD_MATCHER_NONE;
+            for (guint32 j = accept[s]; j < accept[s + 1]; j++)
+                own[s] = MIN(own[s], matcher->dfa_accept_rules[j]);
+        }
+
+        while (changed) {
+            changed = FALSE;
+            for (guint32 s = 0; s < dfa->n_states; s++) {
+                for (guint32 c = 0; c < dfa->n_classes; c++) {
+                    guint32 target = own[next[s * dfa->n_classes + c]];
+
+                    if (target < own[s]) {
+                        own[s] = target;
+                        changed = TRUE;
+                    }
+                }
+            }
+        }
+
+        own[0] = WORD_MATCHER_NONE;
+    }
+
+    return owner;
+}
+
+void
+word_profile_enable(WordMatcher *matcher)
+{
+    WordProfile *profile;
+
+    if (!matcher || matcher->profile)
+        return;
+
+    profile = g_new0(WordProfile, 1);
+    profile->n_rules = matcher->n_words;
+    profile->state_owner = word_profile_state_owners(matcher);
+    profile->dfa_owner = word_profile_dfa_owners(matcher);
+    profile->rules = g_new0(WordProfileCounters, MAX(profile->n_rules, 1));
+    g_mutex_init(&profile->lock);
+
+    matcher->profile = profile;
+}
+
+gboolean
+word_profile_is_enabled(const WordMatcher *matcher)
+{
+    return matcher && matcher->profile;
+}
+
+void
+word_profile_free(WordProfile *profile)
+{
+    if (!profile)
+        return;
+
+    g_mutex_clear(&profile->lock);
+    g_free(profile->state_owner);
+    g_free(profile->dfa_owner);
+    g_free(profile->rules);
+    g_free(profile);
+}
+
+WordProfileCall*
+word_profile_call_begin(WordProfile *profile)
+{
+    WordProfileBuffer *buffer = g_private_get(&word_profile_buffer);
+    WordProfileCall *call;
+
+    if (!buffer) {
+        buffer = g_new0(WordProfileBuffer, 1);
+        buffer->call.touched = g_array_new(FALSE, FALSE, sizeof(guint32));
+        g_private_set(&word_profile_buffer, buffer);
+    }
+
+    // Вложенный поиск в том же потоке (из обработчика совпадения) не учитывается
+    call = &buffer->call;
+    if (call->profile)
+        return NULL;
+
+    if (buffer->n_rules < profile->n_rules) {
+        g_free(call->candidates);
+        g_free(call->hits);
+        call->candidates = g_new0(guint32, profile->n_rules);
+        call->hits = g_new0(guint32, profile->n_rules);
+        buffer->n_rules = profile->n_rules;
+    }
+
+    call->profile = profile;
+    call->state_owner = profile->state_owner;
+    call->dfa_owner = profile->dfa_owner;
+    call->steps = 0;
+    call->n_hits = 0;
+    call->started_ns = word_profile_thread_time();
+
+    return call;
+}
+
+void
+word_profile_call_end(WordProfileCall *call, gsize bytes)
+{
+    WordProfile *profile = call->profile;
+    guint64 elapsed = word_profile_thread_time() - call->started_ns;
+    guint64 units = call->steps + call->n_hits;
+    gdouble per_unit = units ? (gdouble)elapsed / units : 0;
+    guint64 attributed = 0;
+
+    g_mutex_lock(&profile->lock);
+
+    for (guint i = 0; i < call->touched->len; i++) {
+        guint32 rule = g_array_index(call->touched, guint32, i);
+        WordProfileCounters *counters = &profile->rules[rule];
+        guint64 cpu_ns = (guint64)((call->candidates[rule] + call->hits[rule]) * per_unit);
+
+        counters->hits += call->hits[rule];
+        counters->candidates += call->candidates[rule];
+        counters->cpu_ns += cpu_ns;
+        attributed += cpu_ns;
+
+        call->candidates[rule] = 0;
+        call->hits[rule] = 0;
+    }
+
+    profile->calls++;
+    profile->bytes += bytes;
+    profile->cpu_ns += elapsed;
+    profile->base_ns += elapsed - MIN(attributed, elapsed);
+
+    g_mutex_unlock(&profile->lock);
+
+    g_array_set_size(call->touched, 0);
+    call->profile = NULL;
+}
+
+void
+word_profile_data_init(WordProfileData *data)
+{
+    memset(data, 0, sizeof(*data));
+    data->rules = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+}
+
+void
+word_profile_data_clear(WordProfileData *data)
+{
+    if (data->rules)
+        g_hash_table_unref(data->rules);
+    memset(data, 0, sizeof(*data));
+}
+
+// Счётчики правила в data; rule - уже в виде поля TSV
+static WordProfileCounters*
+word_profile_data_rule(WordProfileData *data, const gchar *rule)
+{
+    WordProfileCounters *counters = g_hash_table_lookup(data->rules, rule);
+
+    if (!counters) {
+        counters = g_new0(WordProfileCounters, 1);
+        g_hash_table_insert(data->rules, g_strdup(rule), counters);
+    }
+
+    return counters;
+}
+
+gboolean
+word_profile_data_load(WordProfileData *data, const gchar *path, GError **error)
+{
+    gchar *contents;
+    gchar **lines;
+    gboolean ok = TRUE;
+
+    if (!g_file_get_contents(path, &contents, NULL, error))
+        return FALSE;
+
+    lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+
+    for (guint i = 0; lines[i] && ok; i++) {
+        gchar **fields;
+
+        if (lines[i][0] == '\0' || lines[i][0] == '#')
+            continue;
+
+        fields = g_strsplit(lines[i], "\t", 5);
+
+        if (g_strv_length(fields) == 5 && strcmp(fields[0], "total") == 0) {
+            data->calls += g_ascii_strtoull(fields[1], NULL, 10);
+            data->bytes += g_ascii_strtoull(fields[2], NULL, 10);
+            data->cpu_ns += g_ascii_strtoull(fields[3], NULL, 10);
+            data->base_ns += g_ascii_strtoull(fields[4], NULL, 10);
+        } else if (g_strv_length(fields) == 5 && strcmp(fields[0], "rule") == 0) {
+            WordProfileCounters *counters = word_profile_data_rule(data, fields[4]);
+
+            counters->hits += g_ascii_strtoull(fields[1], NULL, 10);
+            counters->candidates += g_ascii_strtoull(fields[2], NULL, 10);
+            counters->cpu_ns += g_ascii_strtoull(fields[3], NULL, 10);
+        } else {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                        "%s:%u: not a rule profile record", path, i + 1);
+            ok = FALSE;
+        }
+
+        g_strfreev(fields);
+    }
+
+    g_strfreev(lines);
+    return ok;
+}
+
+static gint
+word_profile_compare_rules(gconstpointer a, gconstpointer b)
+{
+    return strcmp(a, b);
+}
+
+gboolean
+word_profile_save(WordMatcher *matcher, const gchar *path, GError **error)
+{
+    WordProfile *profile = matcher ? matcher->profile : NULL;
+    WordProfileData data;
+    GError *local_error = NULL;
+    GList *rules;
+    GString *out;
+    gchar *dir;
+    gboolean ok;
+
+    if (!profile)
+        return TRUE;
+
+    word_profile_data_init(&data);
+    if (!word_profile_data_load(&data, path, &local_error) &&
+        !g_error_matches(local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+        g_propagate_error(error, local_error);
+        word_profile_data_clear(&data);
+        return FALSE;
+    }
+    g_clear_error(&local_error);
+
+    // Накопленное переносится в файл и в автомате обнуляется
+    g_mutex_lock(&profile->lock);
+
+    for (guint i = 0; i < profile->n_rules; i++) {
+        WordProfileCounters *counters = &profile->rules[i];
+        WordProfileCounters *sum;
+        gchar *rule;
+
+        if (!counters->hits && !counters->candidates && !counters->cpu_ns)
+            continue;
+
+        // Табуляция и переводы строк в правиле разбили бы запись
+        rule = g_strdelimit(g_strdup(word_matcher_get_word(matcher, i)), "\t\r\n", ' ');
+        sum = word_profile_data_rule(&data, rule);
+        sum->hits += counters->hits;
+        sum->candidates += counters->candidates;
+        sum->cpu_ns += counters->cpu_ns;
+        memset(counters, 0, sizeof(*counters));
+        g_free(rule);
+    }
+
+    data.calls += profile->calls;
+    data.bytes += profile->bytes;
+    data.cpu_ns += profile->cpu_ns;
+    data.base_ns += profile->base_ns;
+    profile->calls = profile->bytes = profile->cpu_ns = profile->base_ns = 0;
+
+    g_mutex_unlock(&profile->lock);
+
+    out = g_string_new(WORD_PROFILE_HEADER);
+    g_string_append_printf(out, "total\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT
+                           "\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT "\n",
+                           data.calls, data.bytes, data.cpu_ns, data.base_ns);
+
+    // По тексту правила, чтобы файлы разных запусков удобно сравнивались
+    rules = g_list_sort(g_hash_table_get_keys(data.rules), word_profile_compare_rules);
+    for (GList *link = rules; link; link = link->next) {
+        const WordProfileCounters *counters = g_hash_table_lookup(data.rules, link->data);
+
+        g_string_append_printf(out, "rule\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT
+                               "\t%" G_GUINT64_FORMAT "\t%s\n",
+                               counters->hits, counters->candidates, counters->cpu_ns,
+                               (const gchar *)link->data);
+    }
+    g_list_free(rules);
+
+    dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    ok = g_file_set_contents(path, out->str, out->len, error);
+
+    g_string_free(out, TRUE);
+    word_profile_data_clear(&data);
+    return ok;
+}
@@ -0,0 +1,111 @@
+#ifndef WORD_PROFILE_H
+#define WORD_PROFILE_H
+
+#include <glib.h>
+
+#include "word-matcher.h"
+
+// Профиль стоимости правил словаря (включается по желанию). Для каждого
+// правила считаются:
+//   hits       - совпадения;
+//   candidates - шаги автомата внутри незавершённого совпадения правила:
+//                начало слова нашлось, но дальше текст ещё проверяется;
+//   cpu        - доля процессорного времени поиска.
+// Автомат один на все правила, поэтому время по правилам напрямую не
+// измеряется: время каждого вызова поиска делится между правилами
+// пропорционально их шагам и совпадениям, а шаги в корне автомата и
+// участки, пропущенные префильтром, - общая стоимость прохода (base).
+// Общий префикс нескольких правил (и состояние ДКА, из которого достижимы
+// несколько регулярных правил) считается за правилом, которое раньше в
+// словаре.
+//
+// Профиль копится в автомате по всем вызовам из всех потоков и
+// дописывается в файл (word_profile_save) - сумма по всем проверкам.
+// Профилирование замедляет поиск, поэтому включается только для сбора
+// статистики.
+//
+// Файл - TSV; первое поле - тип записи:
+//   total  вызовов  байт  cpu-ns  base-cpu-ns
+//   rule   совпадений  кандидатов  cpu-ns  правило
+
+// Счётчики одного правила
+typedef struct {
+    guint64 hits;
+    guint64 candidates;
+    guint64 cpu_ns;
+} WordProfileCounters;
+
+// Содержимое файла профиля
+typedef struct {
+    guint64 calls;          // вызовов поиска (блоков текста)
+    guint64 bytes;          // байт текста
+    guint64 cpu_ns;         // процессорное время поиска
+    guint64 base_ns;        // из него - без правил: корень автомата, префильтр
+    GHashTable *rules;      // текст правила -> WordProfileCounters
+} WordProfileData;
+
+// Включение профиля автомата: до того, как автомат начнёт использоваться
+// в других потоках. Повторный вызов ничего не делает.
+void word_profile_enable(WordMatcher *matcher);
+gboolean word_profile_is_enabled(const WordMatcher *matcher);
+
+// Прибавление накопленного к файлу (создаётся при необходимости) и сброс
+// счётчиков автомата. Без включённого профиля ничего не делает.
+gboolean word_profile_save(WordMatcher *matcher, const gchar *path, GError **error);
+
+void word_profile_data_init(WordProfileData *data);
+void word_profile_data_clear(WordProfileData *data);
+// Прибавление файла к data; отсутствующий файл - ошибка G_FILE_ERROR_NOENT
+gboolean word_profile_data_load(WordProfileData *data, const gchar *path, GError **error);
+
+// Для автомата (word-matcher.c). Вызов поиска копит счётчики в буфере
+// потока и переносит их в профиль в word_profile_call_end.
+
+typedef struct _WordProfile WordProfile;
+
+struct _WordProfileCall {
+    WordProfile *profile;
+    const guint32 *state_owner;     // правило состояния автомата литералов
+    const guint32 *dfa_owner;       // то же для состояний ДКА (по dfa->accept)
+    guint32 *candidates;            // по правилам; ненулевые - в touched
+    guint32 *hits;
+    GArray *touched;                // guint32
+    guint64 steps;
+    guint64 n_hits;
+    guint64 started_ns;
+};
+
+void word_profile_free(WordProfile *profile);
+
+WordProfileCall* word_profile_call_begin(WordProfile *profile);
+void word_profile_call_end(WordProfileCall *call, gsize bytes);
+
+static inline void
+word_profile_call_touch(WordProfileCall *call, guint32 rule)
+{
+    if (call->candidates[rule] == 0 && call->hits[rule] == 0)
+        g_array_append_val(call->touched, rule);
+}
+
+// Шаг автомата, приведший в состояние с правилом owner (NONE - корень или
+// состояние, откуда ни одно правило не достижимо)
+static inline void
+word_profile_call_step(WordProfileCall *call, guint32 owner)
+{
+    call->steps++;
+    if (owner == WORD_MATCHER_NONE)
+        return;
+
+    word_profile_call_touch(call, owner);
+    call->candidates[owner]++;
+}
+
+static inline void
+word_profile_call_hit(WordProfileCall *call, guint32 rule)
+{
+    word_profile_call_touch(call, rule);
+    call->hits[rule]++;
+    call->n_hits++;
+}
+
+#endif /* WORD_PROFILE_H */
@@ -0,0 +1,1408 @@
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "word-rules.h"
+#include "word-matcher-private.h"
+
+// Ограничения, при которых размер автомата предсказуем
+#define WORD_REGEX_MAX_REPEAT 32
+#define WORD_REGEX_MAX_DEPTH 32
+#define WORD_REGEX_MAX_NFA_STATES 50000
+
+typedef struct {
+    gunichar lo;
+    gunichar hi;
+} CharRange;
+
+typedef enum {
+    REGEX_CHARSET,
+    REGEX_BOUNDARY,
+    REGEX_CONCAT,
+    REGEX_ALT,
+    REGEX_REPEAT
+} RegexNodeType;
+
+typedef struct _RegexNode RegexNode;
+
+struct _RegexNode {
+    RegexNodeType type;
+    GArray *ranges;         // CharRange, для REGEX_CHARSET
+    GPtrArray *children;    // для REGEX_CONCAT, REGEX_ALT и REGEX_REPEAT
+    gint min;               // для REGEX_REPEAT
+    gint max;               // < 0 - без ограничения
+};
+
+struct _WordRegex {
+    RegexNode *root;
+    gboolean boundaries;    // есть \b
+    gchar *source;
+};
+
+typedef struct {
+    const gchar *pattern;
+    const gchar *p;
+    gboolean case_sensitive;
+    gboolean boundaries;
+    guint depth;
+    GError **error;
+} RegexParser;
+
+static void regex_node_free(RegexNode *node);
+static RegexNode* regex_parse_alt(RegexParser *parser);
+
+static RegexNode*
+regex_node_new(RegexNodeType type)
+{
+    RegexNode *node = g_new0(RegexNode, 1);
+
+    node->type = type;
+    if (type == REGEX_CHARSET)
+        node->ranges = g_array_new(FALSE, FALSE, sizeof(CharRange));
+    else if (type != REGEX_BOUNDARY)
+        node->children = g_ptr_array_new_with_free_func((GDestroyNotify)regex_node_free);
+
+    return node;
+}
+
+static void
+regex_node_free(RegexNode *node)
+{
+    if (!node)
+        return;
+
+    if (node->ranges)
+        g_array_unref(node->ranges);
+    if (node->children)
+        g_ptr_array_unref(node->children);
+    g_free(node);
+}
+
+// Множества символов - списки диапазонов кодов
+
+static void
+ranges_add(GArray *ranges, gunichar lo, gunichar hi)
+{
+    CharRange range = { lo, hi };
+
+    g_array_append_val(ranges, range);
+}
+
+static gint
+range_compare(gconstpointer a, gconstpointer b)
+{
+    const CharRange *ra = a, *rb = b;
+
+    return (ra->lo > rb->lo) - (ra->lo < rb->lo);
+}
+
+static void
+ranges_normalize(GArray *ranges)
+{
+    guint n = 0;
+
+    g_array_sort(ranges, range_compare);
+
+    for (guint i = 0; i < ranges->len; i++) {
+        CharRange range = g_array_index(ranges, CharRange, i);
+        CharRange *last = n > 0 ? &g_array_index(ranges, CharRange, n - 1) : NULL;
+
+        if (last && range.lo <= last->hi + 1)
+            last->hi = MAX(last->hi, range.hi);
+        else
+            g_array_index(ranges, CharRange, n++) = range;
+    }
+
+    g_array_set_size(ranges, n);
+}
+
+static void
+ranges_negate(GArray *ranges)
+{
+    GArray *result = g_array_new(FALSE, FALSE, sizeof(CharRange));
+    gunichar next = 0;
+
+    ranges_normalize(ranges);
+
+    for (guint i = 0; i < ranges->len; i++) {
+        CharRange *range = &g_array_index(ranges, CharRange, i);
+
+        if (range->lo > next)
+            ranges_add(result, next, range->lo - 1);
+        next = range->hi + 1;
+    }
+    if (next <= 0x10FFFF)
+        ranges_add(result, next, 0x10FFFF);
+
+    g_array_set_size(ranges, 0);
+    g_array_append_vals(ranges, result->data, result->len);
+    g_array_unref(result);
+}
+
+static void
+ranges_remove(GArray *ranges, gunichar lo, gunichar hi)
+{
+    GArray *result = g_array_new(FALSE, FALSE, sizeof(CharRange));
+
+    for (guint i = 0; i < ranges->len; i++) {
+        CharRange range = g_array_index(ranges, CharRange, i);
+
+        if (range.hi < lo || range.lo > hi) {
+            g_array_append_val(result, range);
+            continue;
+        }
+        if (range.lo < lo)
+            ranges_add(result, range.lo, lo - 1);
+        if (range.hi > hi)
+            ranges_add(result, hi + 1, range.hi);
+    }
+
+    g_array_set_size(ranges, 0);
+    g_array_append_vals(ranges, result->data, result->len);
+    g_array_unref(result);
+}
+
+// Текст подаётся свёрнутым, поэтому классу достаточно добавить свёрнутые
+// формы своих символов. Для [^...] это делается до отрицания.
+static void
+ranges_fold(GArray *ranges)
+{
+    guint n = ranges->len;
+
+    for (guint i = 0; i < n; i++) {
+        CharRange range = g_array_index(ranges, CharRange, i);
+
+        // Огромные диапазоны (из отрицаний) уже замкнуты по регистру
+        if (range.hi - range.lo > 0x10000)
+            continue;
+
+        for (gunichar c = range.lo; c <= range.hi; c++) {
+            gunichar folded = fold_char(c);
+            if (folded != c)
+                ranges_add(ranges, folded, folded);
+        }
+    }
+
+    ranges_normalize(ranges);
+}
+
+// Правило действует в пределах строки: перевод строки не входит ни в
+// один класс (блочная проверка режет текст по строкам). Суррогаты не
+// кодируются в UTF-8.
+static void
+ranges_finish(GArray *ranges)
+{
+    ranges_normalize(ranges);
+    ranges_remove(ranges, '\n', '\n');
+    ranges_remove(ranges, 0xD800, 0xDFFF);
+}
+
+// Разбор выражения
+
+static gboolean
+regex_fail(RegexParser *parser, const gchar *message)
+{
+    g_set_error(parser->error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                "%s at offset %d", message, (gint)(parser->p - parser->pattern));
+    return FALSE;
+}
+
+static gboolean
+regex_parse_char(RegexParser *parser, gunichar *c)
+{
+    gunichar value = g_utf8_get_char_validated(parser->p, -1);
+
+    if (value == (gunichar)-1 || value == (gunichar)-2)
+        return regex_fail(parser, "invalid UTF-8");
+
+    *c = value;
+    parser->p = g_utf8_next_char(parser->p);
+    return TRUE;
+}
+
+// \d \w \s и их отрицания; FALSE - это не класс
+static gboolean
+regex_class_escape(gchar escape, GArray *ranges)
+{
+    GArray *set = g_array_new(FALSE, FALSE, sizeof(CharRange));
+
+    switch (g_ascii_tolower(escape)) {
+    case 'd':
+        ranges_add(set, '0', '9');
+        break;
+    case 'w':
+        for (guint i = 0; i < G_N_ELEMENTS(word_char_ranges); i++)
+            ranges_add(set, word_char_ranges[i][0], word_char_ranges[i][1]);
+        break;
+    case 's':
+        ranges_add(set, '\t', '\r');
+        ranges_add(set, ' ', ' ');
+        ranges_add(set, 0x00A0, 0x00A0);
+        ranges_add(set, 0x2000, 0x200A);
+        ranges_add(set, 0x202F, 0x202F);
+        ranges_add(set, 0x3000, 0x3000);
+        break;
+    default:
+        g_array_unref(set);
+        return FALSE;
+    }
+
+    if (g_ascii_isupper(escape))
+        ranges_negate(set);
+    g_array_append_vals(ranges, set->data, set->len);
+    g_array_unref(set);
+    return TRUE;
+}
+
+// Экранированный символ после '\'
+static gboolean
+regex_parse_escape(RegexParser *parser, gunichar *c)
+{
+    gchar escape = *parser->p;
+
+    switch (escape) {
+    case 'n': *c = '\n'; break;
+    case 't': *c = '\t'; break;
+    case 'r': *c = '\r'; break;
+    case 'f': *c = '\f'; break;
+    case 'v': *c = '\v'; break;
+    case '\0':
+        return regex_fail(parser, "trailing backslash");
+    default:
+        if (g_ascii_isdigit(escape))
+            return regex_fail(parser, "backreferences are not supported");
+        if (!g_ascii_ispunct(escape))
+            return regex_fail(parser, "unsupported escape sequence");
+        *c = escape;
+        break;
+    }
+
+    parser->p++;
+    return TRUE;
+}
+
+// Символ класса; (gunichar)-1 - вместо символа добавлен класс вроде \d
+static gboolean
+regex_parse_class_char(RegexParser *parser, GArray *ranges, gunichar *c)
+{
+    if (*parser->p != '\\')
+        return regex_parse_char(parser, c);
+
+    parser->p++;
+    if (*parser->p == 'b')
+        return regex_fail(parser, "\\b is not allowed inside a class");
+    if (regex_class_escape(*parser->p, ranges)) {
+        parser->p++;
+        *c = (gunichar)-1;
+        return TRUE;
+    }
+
+    return regex_parse_escape(parser, c);
+}
+
+static RegexNode*
+regex_parse_class(RegexParser *parser)
+{
+    RegexNode *node = regex_node_new(REGEX_CHARSET);
+    gboolean negate = FALSE;
+    gboolean first = TRUE;
+
+    parser->p++;
+    if (*parser->p == '^') {
+        negate = TRUE;
+        parser->p++;
+    }
+
+    // ']' сразу после '[' - обычный символ
+    while (first || *parser->p != ']') {
+        gunichar lo, hi;
+
+        first = FALSE;
+        if (!*parser->p) {
+            regex_fail(parser, "missing ]");
+            goto fail;
+        }
+
+        if (!regex_parse_class_char(parser, node->ranges, &lo))
+            goto fail;
+        if (lo == (gunichar)-1)
+            continue;
+
+        if (parser->p[0] == '-' && parser->p[1] && parser->p[1] != ']') {
+            parser->p++;
+            if (!regex_parse_class_char(parser, node->ranges, &hi))
+                goto fail;
+            if (hi == (gunichar)-1 || hi < lo) {
+                regex_fail(parser, "invalid class range");
+                goto fail;
+            }
+            ranges_add(node->ranges, lo, hi);
+        } else {
+            ranges_add(node->ranges, lo, lo);
+        }
+    }
+    parser->p++;
+
+    if (!parser->case_sensitive)
+        ranges_fold(node->ranges);
+    if (negate)
+        ranges_negate(node->ranges);
+
+    return node;
+
+fail:
+    regex_node_free(node);
+    return NULL;
+}
+
+static RegexNode*
+regex_parse_atom(RegexParser *parser)
+{
+    RegexNode *node;
+    gunichar c;
+
+    switch (*parser->p) {
+    case '(':
+        parser->p++;
+        if (*parser->p == '?') {
+            if (parser->p[1] != ':') {
+                regex_fail(parser, "lookaround and inline flags are not supported");
+                return NULL;
+            }
+            parser->p += 2;
+        }
+        if (++parser->depth > WORD_REGEX_MAX_DEPTH) {
+            regex_fail(parser, "groups are nested too deeply");
+            return NULL;
+        }
+        node = regex_parse_alt(parser);
+        parser->depth--;
+        if (!node)
+            return NULL;
+        if (*parser->p != ')') {
+            regex_fail(parser, "missing )");
+            regex_node_free(node);
+            return NULL;
+        }
+        parser->p++;
+        return node;
+
+    case '[':
+        return regex_parse_class(parser);
+
+    case '.':
+        parser->p++;
+        node = regex_node_new(REGEX_CHARSET);
+        ranges_add(node->ranges, 0, 0x10FFFF);
+        return node;
+
+    case '^':
+    case '$':
+        regex_fail(parser, "anchors are not supported, use \\b");
+        return NULL;
+
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+        regex_fail(parser, "nothing to repeat");
+        return NULL;
+
+    case '\\':
+        parser->p++;
+        if (*parser->p == 'b') {
+            parser->p++;
+            parser->boundaries = TRUE;
+            return regex_node_new(REGEX_BOUNDARY);
+        }
+        if (*parser->p == 'B') {
+            regex_fail(parser, "\\B is not supported");
+            return NULL;
+        }
+
+        node = regex_node_new(REGEX_CHARSET);
+        if (regex_class_escape(*parser->p, node->ranges)) {
+            parser->p++;
+            return node;
+        }
+        if (!regex_parse_escape(parser, &c)) {
+            regex_node_free(node);
+            return NULL;
+        }
+        break;
+
+    default:
+        if (!regex_parse_char(parser, &c))
+            return NULL;
+        node = regex_node_new(REGEX_CHARSET);
+        break;
+    }
+
+    c = parser->case_sensitive ? c : fold_char(c);
+    ranges_add(node->ranges, c, c);
+    return node;
+}
+
+// {n}, {n,}, {n,m}
+static gboolean
+regex_parse_bounds(RegexParser *parser, gint *min, gint *max)
+{
+    const gchar *p = parser->p + 1;
+    gchar *end;
+    guint64 n, m;
+
+    if (!g_ascii_isdigit(*p))
+        return regex_fail(parser, "invalid repeat bounds");
+    n = g_ascii_strtoull(p, &end, 10);
+    p = end;
+    m = n;
+
+    if (*p == ',') {
+        p++;
+        if (*p == '}') {
+            m = G_MAXUINT64;
+        } else if (g_ascii_isdigit(*p)) {
+            m = g_ascii_strtoull(p, &end, 10);
+            p = end;
+        } else {
+            return regex_fail(parser, "invalid repeat bounds");
+        }
+    }
+
+    if (*p != '}' || m < n)
+        return regex_fail(parser, "invalid repeat bounds");
+    if (n > WORD_REGEX_MAX_REPEAT || (m != G_MAXUINT64 && m > WORD_REGEX_MAX_REPEAT))
+        return regex_fail(parser, "repeat bounds over 32 are not supported");
+
+    *min = n;
+    *max = (m == G_MAXUINT64) ? -1 : (gint)m;
+    parser->p = p + 1;
+    return TRUE;
+}
+
+static RegexNode*
+regex_parse_repeat(RegexParser *parser)
+{
+    RegexNode *atom = regex_parse_atom(parser);
+    RegexNode *node;
+    gint min, max;
+
+    if (!atom)
+        return NULL;
+
+    switch (*parser->p) {
+    case '*':
+        min = 0;
+        max = -1;
+        parser->p++;
+        break;
+    case '+':
+        min = 1;
+        max = -1;
+        parser->p++;
+        break;
+    case '?':
+        min = 0;
+        max = 1;
+        parser->p++;
+        break;
+    case '{':
+        if (!regex_parse_bounds(parser, &min, &max)) {
+            regex_node_free(atom);
+            return NULL;
+        }
+        break;
+    default:
+        return atom;
+    }
+
+    // Ленивость не влияет на то, есть ли совпадение
+    if (*parser->p == '?')
+        parser->p++;
+
+    if (*parser->p && strchr("*+?{", *parser->p)) {
+        regex_fail(parser, "multiple repeat");
+        regex_node_free(atom);
+        return NULL;
+    }
+
+    node = regex_node_new(REGEX_REPEAT);
+    node->min = min;
+    node->max = max;
+    g_ptr_array_add(node->children, atom);
+    return node;
+}
+
+static RegexNode*
+regex_parse_concat(RegexParser *parser)
+{
+    RegexNode *node = regex_node_new(REGEX_CONCAT);
+
+    while (*parser->p && *parser->p != '|' && *parser->p != ')') {
+        RegexNode *child = regex_parse_repeat(parser);
+
+        if (!child) {
+            regex_node_free(node);
+            return NULL;
+        }
+        g_ptr_array_add(node->children, child);
+    }
+
+    return node;
+}
+
+static RegexNode*
+regex_parse_alt(RegexParser *parser)
+{
+    RegexNode *node = regex_node_new(REGEX_ALT);
+
+    for (;;) {
+        RegexNode *child = regex_parse_concat(parser);
+
+        if (!child) {
+            regex_node_free(node);
+            return NULL;
+        }
+        g_ptr_array_add(node->children, child);
+
+        if (*parser->p != '|')
+            break;
+        parser->p++;
+    }
+
+    return node;
+}
+
+// Окончательные классы и проверка пустых
+static gboolean
+regex_node_finish(RegexNode *node, GError **error)
+{
+    if (node->type == REGEX_CHARSET) {
+        ranges_finish(node->ranges);
+        if (node->ranges->len == 0) {
+            g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                                "character class matches nothing");
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    for (guint i = 0; node->children && i < node->children->len; i++) {
+        if (!regex_node_finish(g_ptr_array_index(node->children, i), error))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+regex_node_nullable(const RegexNode *node)
+{
+    switch (node->type) {
+    case REGEX_CHARSET:
+        return FALSE;
+    case REGEX_BOUNDARY:
+        return TRUE;
+    case REGEX_CONCAT:
+        for (guint i = 0; i < node->children->len; i++) {
+            if (!regex_node_nullable(g_ptr_array_index(node->children, i)))
+                return FALSE;
+        }
+        return TRUE;
+    case REGEX_ALT:
+        for (guint i = 0; i < node->children->len; i++) {
+            if (regex_node_nullable(g_ptr_array_index(node->children, i)))
+                return TRUE;
+        }
+        return FALSE;
+    case REGEX_REPEAT:
+        return node->min == 0 || regex_node_nullable(g_ptr_array_index(node->children, 0));
+    }
+
+    return FALSE;
+}
+
+// Верхняя оценка числа состояний НКА
+static guint64
+regex_node_size(const RegexNode *node)
+{
+    guint64 size = 2;
+
+    switch (node->type) {
+    case REGEX_CHARSET:
+        // Диапазон кодов раскладывается не более чем на дюжину
+        // последовательностей байтов по 4 состояния
+        return size + (guint64)node->ranges->len * 48;
+    case REGEX_BOUNDARY:
+        return size;
+    case REGEX_CONCAT:
+    case REGEX_ALT:
+        for (guint i = 0; i < node->children->len; i++)
+            size += regex_node_size(g_ptr_array_index(node->children, i)) + 1;
+        return size;
+    case REGEX_REPEAT:
+        return size + regex_node_size(g_ptr_array_index(node->children, 0)) *
+                      (node->max < 0 ? node->min + 1 : node->max);
+    }
+
+    return size;
+}
+
+static WordRegex*
+word_regex_new(const gchar *pattern, gboolean case_sensitive, GError **error)
+{
+    RegexParser parser = { pattern, pattern, case_sensitive, FALSE, 0, error };
+    WordRegex *regex;
+    RegexNode *root;
+
+    root = regex_parse_alt(&parser);
+    if (!root)
+        return NULL;
+
+    if (*parser.p == ')') {
+        regex_fail(&parser, "unmatched )");
+        goto fail;
+    }
+    if (!regex_node_finish(root, error))
+        goto fail;
+    if (regex_node_nullable(root)) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                            "rule matches empty text");
+        goto fail;
+    }
+    if (regex_node_size(root) > WORD_REGEX_MAX_NFA_STATES) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                            "rule is too complex");
+        goto fail;
+    }
+
+    regex = g_new0(WordRegex, 1);
+    regex->root = root;
+    regex->boundaries = parser.boundaries;
+    regex->source = g_strdup(pattern);
+    return regex;
+
+fail:
+    regex_node_free(root);
+    return NULL;
+}
+
+static void
+word_regex_free(WordRegex *regex)
+{
+    if (!regex)
+        return;
+
+    regex_node_free(regex->root);
+    g_free(regex->source);
+    g_free(regex);
+}
+
+// НКА Томпсона на байтах UTF-8
+
+typedef struct {
+    guint8 lo;
+    guint8 hi;
+    guint32 target;
+} NfaEdge;
+
+typedef struct {
+    GArray *edges;          // NfaEdge
+    GArray *eps;            // guint32
+    guint32 rule;           // WORD_MATCHER_NONE - не конечное
+} NfaState;
+
+#define NFA_STATE(nfa, i) (&g_array_index((nfa), NfaState, (i)))
+
+static guint32
+nfa_state_new(GArray *nfa)
+{
+    NfaState state = { NULL, NULL, WORD_MATCHER_NONE };
+
+    g_array_append_val(nfa, state);
+    return nfa->len - 1;
+}
+
+static void
+nfa_add_edge(GArray *nfa, guint32 from, guint8 lo, guint8 hi, guint32 to)
+{
+    NfaState *state = NFA_STATE(nfa, from);
+    NfaEdge edge = { lo, hi, to };
+
+    if (!state->edges)
+        state->edges = g_array_new(FALSE, FALSE, sizeof(NfaEdge));
+    g_array_append_val(state->edges, edge);
+}
+
+static void
+nfa_add_eps(GArray *nfa, guint32 from, guint32 to)
+{
+    NfaState *state = NFA_STATE(nfa, from);
+
+    if (!state->eps)
+        state->eps = g_array_new(FALSE, FALSE, sizeof(guint32));
+    g_array_append_val(state->eps, to);
+}
+
+static void
+nfa_free(GArray *nfa)
+{
+    for (guint i = 0; i < nfa->len; i++) {
+        NfaState *state = NFA_STATE(nfa, i);
+        if (state->edges)
+            g_array_unref(state->edges);
+        if (state->eps)
+            g_array_unref(state->eps);
+    }
+    g_array_unref(nfa);
+}
+
+typedef struct {
+    GArray *nfa;
+    guint32 from;
+    guint32 to;
+} NfaSequence;
+
+// Цепочка состояний для одной последовательности диапазонов байтов
+static void
+nfa_add_sequence(const guint8 *lo, const guint8 *hi, guint len, NfaSequence *sequence)
+{
+    guint32 state = sequence->from;
+
+    for (guint i = 0; i < len; i++) {
+        guint32 next = (i + 1 == len) ? sequence->to : nfa_state_new(sequence->nfa);
+
+        nfa_add_edge(sequence->nfa, state, lo[i], hi[i], next);
+        state = next;
+    }
+}
+
+// Диапазон кодов как набор последовательностей диапазонов байтов UTF-8:
+// сначала делится по длине кодирования, затем так, чтобы младшие байты
+// каждой части пробегали полный интервал продолжений.
+static void
+utf8_range_sequences(gunichar lo, gunichar hi, NfaSequence *sequence)
+{
+    static const gunichar limits[] = { 0x7F, 0x7FF, 0xFFFF };
+    guint8 a[6], b[6];
+    guint len;
+
+    if (lo > hi)
+        return;
+
+    for (guint i = 0; i < G_N_ELEMENTS(limits); i++) {
+        if (lo <= limits[i] && hi > limits[i]) {
+            utf8_range_sequences(lo, limits[i], sequence);
+            utf8_range_sequences(limits[i] + 1, hi, sequence);
+            return;
+        }
+    }
+
+    if (hi < 0x80) {
+        a[0] = lo;
+        b[0] = hi;
+        nfa_add_sequence(a, b, 1, sequence);
+        return;
+    }
+
+    len = (hi <= 0x7FF) ? 2 : (hi <= 0xFFFF) ? 3 : 4;
+
+    for (guint i = 1; i < len; i++) {
+        gunichar m = (1u << (6 * i)) - 1;
+
+        if ((lo & ~m) == (hi & ~m))
+            continue;
+        if ((lo & m) != 0) {
+            utf8_range_sequences(lo, lo | m, sequence);
+            utf8_range_sequences((lo | m) + 1, hi, sequence);
+            return;
+        }
+        if ((hi & m) != m) {
+            utf8_range_sequences(lo, (hi & ~m) - 1, sequence);
+            utf8_range_sequences(hi & ~m, hi, sequence);
+            return;
+        }
+    }
+
+    g_unichar_to_utf8(lo, (gchar *)a);
+    g_unichar_to_utf8(hi, (gchar *)b);
+    nfa_add_sequence(a, b, len, sequence);
+}
+
+// Фрагмент начинается в from; возвращается его конечное состояние
+static guint32
+nfa_build(GArray *nfa, const RegexNode *node, guint32 from)
+{
+    const RegexNode *child;
+    guint32 to, cur;
+
+    switch (node->type) {
+    case REGEX_CHARSET: {
+        NfaSequence sequence = { nfa, from, nfa_state_new(nfa) };
+
+        for (guint i = 0; i < node->ranges->len; i++) {
+            CharRange *range = &g_array_index(node->ranges, CharRange, i);
+            utf8_range_sequences(range->lo, range->hi, &sequence);
+        }
+        return sequence.to;
+    }
+
+    case REGEX_BOUNDARY:
+        to = nfa_state_new(nfa);
+        nfa_add_edge(nfa, from, WORD_MATCHER_MARKER, WORD_MATCHER_MARKER, to);
+        return to;
+
+    case REGEX_CONCAT:
+        cur = from;
+        for (guint i = 0; i < node->children->len; i++)
+            cur = nfa_build(nfa, g_ptr_array_index(node->children, i), cur);
+        return cur;
+
+    case REGEX_ALT:
+        to = nfa_state_new(nfa);
+        for (guint i = 0; i < node->children->len; i++) {
+            guint32 start = nfa_state_new(nfa);
+
+            nfa_add_eps(nfa, from, start);
+            nfa_add_eps(nfa, nfa_build(nfa, g_ptr_array_index(node->children, i), start), to);
+        }
+        return to;
+
+    case REGEX_REPEAT:
+        child = g_ptr_array_index(node->children, 0);
+        cur = from;
+        for (gint i = 0; i < node->min; i++)
+            cur = nfa_build(nfa, child, cur);
+
+        if (node->max < 0) {
+            guint32 loop = nfa_state_new(nfa);
+
+            nfa_add_eps(nfa, cur, loop);
+            nfa_add_eps(nfa, nfa_build(nfa, child, loop), loop);
+            return loop;
+        }
+
+        to = nfa_state_new(nfa);
+        nfa_add_eps(nfa, cur, to);
+        for (gint i = node->min; i < node->max; i++) {
+            cur = nfa_build(nfa, child, cur);
+            nfa_add_eps(nfa, cur, to);
+        }
+        return to;
+    }
+
+    return from;
+}
+
+static gint
+guint32_compare(gconstpointer a, gconstpointer b)
+{
+    guint32 x = *(const guint32 *)a, y = *(const guint32 *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Замыкание по пустым переходам; set - затравки, на выходе -
+// отсортированное множество без повторов
+static void
+nfa_closure(GArray *nfa, GArray *set, guint32 *mark, guint32 stamp)
+{
+    guint n = 0;
+
+    for (guint i = 0; i < set->len; i++) {
+        guint32 s = g_array_index(set, guint32, i);
+
+        if (mark[s] != stamp) {
+            mark[s] = stamp;
+            g_array_index(set, guint32, n++) = s;
+        }
+    }
+    g_array_set_size(set, n);
+
+    for (guint i = 0; i < set->len; i++) {
+        GArray *eps = NFA_STATE(nfa, g_array_index(set, guint32, i))->eps;
+
+        for (guint k = 0; eps && k < eps->len; k++) {
+            guint32 t = g_array_index(eps, guint32, k);
+
+            if (mark[t] != stamp) {
+                mark[t] = stamp;
+                g_array_append_val(set, t);
+            }
+        }
+    }
+
+    g_array_sort(set, guint32_compare);
+}
+
+// Номер состояния ДКА для множества состояний НКА; WORD_MATCHER_NONE -
+// превышен предел числа состояний
+static guint32
+dfa_intern(GHashTable *ids, GPtrArray *sets, GArray *set)
+{
+    GBytes *key = g_bytes_new(set->data, set->len * sizeof(guint32));
+    gpointer value;
+
+    if (g_hash_table_lookup_extended(ids, key, NULL, &value)) {
+        g_bytes_unref(key);
+        return GPOINTER_TO_UINT(value);
+    }
+
+    if (sets->len >= WORD_REGEX_MAX_DFA_STATES) {
+        g_bytes_unref(key);
+        return WORD_MATCHER_NONE;
+    }
+
+    g_hash_table_insert(ids, key, GUINT_TO_POINTER(sets->len));
+    g_ptr_array_add(sets, key);
+    return sets->len - 1;
+}
+
+// Построение ДКА подмножеств. Поиск не привязан к началу: к каждому
+// множеству добавляется старт всех правил. Маркер границы слова не
+// прерывает начатые совпадения и продвигает только переходы \b.
+static gboolean
+word_regex_build_dfa(WordRegex **regexes, const guint32 *rules, guint n,
+                     WordRegexTables *tables)
+{
+    GArray *nfa = g_array_new(FALSE, FALSE, sizeof(NfaState));
+    GArray *set = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GArray *next = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GHashTable *ids = g_hash_table_new(g_bytes_hash, g_bytes_equal);
+    GPtrArray *sets = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+    guint8 boundary[257] = { 0 };
+    WordRegexDfa dfa;
+    guint8 reps[256];
+    guint32 *mark;
+    guint32 stamp = 0, start = 0;
+    guint n_classes = 0;
+    gboolean ok = TRUE;
+
+    nfa_state_new(nfa);
+    for (guint i = 0; i < n; i++) {
+        guint32 rule_start = nfa_state_new(nfa);
+        guint32 end, accept;
+
+        nfa_add_eps(nfa, start, rule_start);
+        end = nfa_build(nfa, regexes[i]->root, rule_start);
+        accept = nfa_state_new(nfa);
+        nfa_add_eps(nfa, end, accept);
+        NFA_STATE(nfa, accept)->rule = rules[i];
+    }
+
+    // Классы байтов: границы всех диапазонов переходов, маркер - отдельно
+    boundary[0] = boundary[WORD_MATCHER_MARKER] = boundary[256] = 1;
+    for (guint s = 0; s < nfa->len; s++) {
+        GArray *edges = NFA_STATE(nfa, s)->edges;
+
+        for (guint k = 0; edges && k < edges->len; k++) {
+            NfaEdge *edge = &g_array_index(edges, NfaEdge, k);
+            boundary[edge->lo] = 1;
+            boundary[edge->hi + 1] = 1;
+        }
+    }
+
+    memset(&dfa, 0, sizeof(dfa));
+    for (guint b = 0; b < 256; b++) {
+        if (b > 0 && boundary[b])
+            n_classes++;
+        dfa.classes[b] = n_classes;
+        if (b == 0 || boundary[b])
+            reps[n_classes] = b;
+    }
+    n_classes++;
+
+    mark = g_new0(guint32, nfa->len);
+
+    g_array_append_val(set, start);
+    nfa_closure(nfa, set, mark, ++stamp);
+    dfa_intern(ids, sets, set);
+
+    for (guint d = 0; d < sets->len && ok; d++) {
+        gsize size;
+        const guint32 *states = g_bytes_get_data(g_ptr_array_index(sets, d), &size);
+        guint n_states = size / sizeof(guint32);
+
+        for (guint k = 0; k < n_classes; k++) {
+            guint8 byte = reps[k];
+            guint32 id;
+
+            g_array_set_size(set, 0);
+            for (guint i = 0; i < n_states; i++) {
+                GArray *edges = NFA_STATE(nfa, states[i])->edges;
+
+                for (guint e = 0; edges && e < edges->len; e++) {
+                    NfaEdge *edge = &g_array_index(edges, NfaEdge, e);
+                    if (edge->lo <= byte && byte <= edge->hi)
+                        g_array_append_val(set, edge->target);
+                }
+            }
+            if (byte == WORD_MATCHER_MARKER)
+                g_array_append_vals(set, states, n_states);
+            g_array_append_val(set, start);
+
+            nfa_closure(nfa, set, mark, ++stamp);
+            id = dfa_intern(ids, sets, set);
+            if (id == WORD_MATCHER_NONE) {
+                ok = FALSE;
+                break;
+            }
+            g_array_append_val(next, id);
+        }
+    }
+
+    if (ok) {
+        dfa.n_states = sets->len;
+        dfa.n_classes = n_classes;
+        dfa.table = tables->next->len;
+        dfa.accept = tables->accept_start->len;
+
+        // Правила, совпавшие в каждом состоянии
+        for (guint d = 0; d < sets->len; d++) {
+            gsize size;
+            const guint32 *states = g_bytes_get_data(g_ptr_array_index(sets, d), &size);
+            guint first = tables->accept_rules->len;
+
+            // Конечные состояния создаются в порядке правил, поэтому
+            // список уже отсортирован
+            g_array_append_val(tables->accept_start, first);
+            for (guint i = 0; i < size / sizeof(guint32); i++) {
+                guint32 rule = NFA_STATE(nfa, states[i])->rule;
+                if (rule != WORD_MATCHER_NONE)
+                    g_array_append_val(tables->accept_rules, rule);
+            }
+        }
+        g_array_append_val(tables->accept_start, tables->accept_rules->len);
+
+        g_array_append_vals(tables->next, next->data, next->len);
+        g_array_append_val(tables->dfas, dfa);
+    }
+
+    g_free(mark);
+    g_hash_table_unref(ids);
+    g_ptr_array_unref(sets);
+    g_array_unref(next);
+    g_array_unref(set);
+    nfa_free(nfa);
+
+    return ok;
+}
+
+static void
+word_regex_compile_group(WordRegex **regexes, const guint32 *rules, guint n,
+                         WordRegexTables *tables)
+{
+    if (n == 0)
+        return;
+
+    if (tables->dfas->len < WORD_MATCHER_MAX_DFAS &&
+        word_regex_build_dfa(regexes, rules, n, tables))
+        return;
+
+    if (n == 1 || tables->dfas->len >= WORD_MATCHER_MAX_DFAS) {
+        for (guint i = 0; i < n; i++)
+            g_warning("Attachment checker: rule 're:%s' is too complex, ignored",
+                      regexes[i]->source);
+        return;
+    }
+
+    word_regex_compile_group(regexes, rules, n / 2, tables);
+    word_regex_compile_group(regexes + n / 2, rules + n / 2, n - n / 2, tables);
+}
+
+void
+word_regex_compile(WordRegex **regexes, const guint32 *rules, guint n,
+                   WordRegexTables *tables)
+{
+    word_regex_compile_group(regexes, rules, n, tables);
+}
+
+void
+word_regex_tables_init(WordRegexTables *tables)
+{
+    tables->dfas = g_array_new(FALSE, FALSE, sizeof(WordRegexDfa));
+    tables->next = g_array_new(FALSE, FALSE, sizeof(guint32));
+    tables->accept_start = g_array_new(FALSE, FALSE, sizeof(guint32));
+    tables->accept_rules = g_array_new(FALSE, FALSE, sizeof(guint32));
+}
+
+void
+word_regex_tables_clear(WordRegexTables *tables)
+{
+    g_clear_pointer(&tables->dfas, g_array_unref);
+    g_clear_pointer(&tables->next, g_array_unref);
+    g_clear_pointer(&tables->accept_start, g_array_unref);
+    g_clear_pointer(&tables->accept_rules, g_array_unref);
+}
+
+// Правила
+
+gchar*
+word_rule_fold(const gchar *text)
+{
+    GString *folded = g_string_sized_new(strlen(text));
+    const guchar *p = (const guchar *)text;
+
+    while (*p) {
+        guint len = utf8_sequence_length(*p);
+        gunichar c = (len == 1) ? *p : utf8_decode(p, len);
+
+        if (len == 0 || c == (gunichar)-1) {
+            g_string_append_c(folded, *p);
+            p++;
+            continue;
+        }
+
+        if (len == 1) {
+            g_string_append_c(folded, (gchar)fold_char(c));
+        } else {
+            gchar buf[6];
+            gint n = g_unichar_to_utf8(fold_char(c), buf);
+            g_string_append_len(folded, buf, n);
+        }
+        p += len;
+    }
+
+    return g_string_free(folded, FALSE);
+}
+
+WordRuleKind
+word_rule_parse(const gchar *rule, const gchar **pattern)
+{
+    static const struct {
+        const gchar *prefix;
+        WordRuleKind kind;
+    } prefixes[] = {
+        { "word:", WORD_RULE_WORD },
+        { "glob:", WORD_RULE_GLOB },
+        { "re:", WORD_RULE_REGEX },
+        { "id:", WORD_RULE_TOKEN }
+    };
+
+    for (guint i = 0; i < G_N_ELEMENTS(prefixes); i++) {
+        if (g_str_has_prefix(rule, prefixes[i].prefix)) {
+            *pattern = rule + strlen(prefixes[i].prefix);
+            return prefixes[i].kind;
+        }
+    }
+
+    *pattern = rule;
+    return WORD_RULE_SUBSTRING;
+}
+
+static gboolean
+text_edge_is_word(const gchar *start, const gchar *end, gboolean last)
+{
+    const gchar *p = last ? g_utf8_find_prev_char(start, end) : start;
+    gunichar c = p ? g_utf8_get_char_validated(p, end - p) : (gunichar)-1;
+
+    if (c == '*' || c == '?')
+        return TRUE;
+    return c != (gunichar)-1 && c != (gunichar)-2 && word_char_is_word(c);
+}
+
+// Шаблон со * и ? внутри переводится в выражение; \b ставится по краям,
+// где шаблон начинается или кончается буквой
+static gchar*
+glob_to_regex(const gchar *glob)
+{
+    const gchar *end = glob + strlen(glob);
+    GString *regex = g_string_new(NULL);
+
+    if (text_edge_is_word(glob, end, FALSE))
+        g_string_append(regex, "\\b");
+
+    for (const gchar *p = glob; *p; p = g_utf8_next_char(p)) {
+        if (*p == '*') {
+            g_string_append(regex, "\\w*");
+        } else if (*p == '?') {
+            g_string_append(regex, "\\w");
+        } else if (g_ascii_ispunct(*p)) {
+            g_string_append_c(regex, '\\');
+            g_string_append_c(regex, *p);
+        } else {
+            g_string_append_len(regex, p, g_utf8_next_char(p) - p);
+        }
+    }
+
+    if (text_edge_is_word(glob, end, TRUE))
+        g_string_append(regex, "\\b");
+
+    return g_string_free(regex, FALSE);
+}
+
+static gchar*
+rule_literal(const gchar *start, gsize len, gboolean case_sensitive)
+{
+    gchar *literal = g_strndup(start, len);
+    gchar *folded;
+
+    if (case_sensitive)
+        return literal;
+
+    folded = word_rule_fold(literal);
+    g_free(literal);
+    return folded;
+}
+
+gboolean
+word_rule_compile(WordRule *rule, const gchar *text, gboolean case_sensitive, GError **error)
+{
+    const gchar *pattern, *start, *end;
+    gchar *regex;
+
+    memset(rule, 0, sizeof(*rule));
+    rule->kind = word_rule_parse(text, &pattern);
+
+    if (!*pattern) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "empty rule");
+        return FALSE;
+    }
+
+    switch (rule->kind) {
+    case WORD_RULE_SUBSTRING:
+        rule->literal = rule_literal(pattern, strlen(pattern), case_sensitive);
+        break;
+
+    case WORD_RULE_WORD:
+        rule->literal = rule_literal(pattern, strlen(pattern), case_sensitive);
+        rule->lead = rule->trail = TRUE;
+        break;
+
+    case WORD_RULE_GLOB:
+        // '*' только по краям - это префикс/суффикс, хватает литерала
+        start = pattern;
+        end = pattern + strlen(pattern);
+        if (*start == '*')
+            start++;
+        if (end > start && end[-1] == '*')
+            end--;
+
+        if (memchr(start, '*', end - start) || strchr(pattern, '?')) {
+            regex = glob_to_regex(pattern);
+            rule->regex = word_regex_new(regex, case_sensitive, error);
+            g_free(regex);
+            return rule->regex != NULL;
+        }
+
+        if (start == end) {
+            g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                                "pattern matches any word");
+            return FALSE;
+        }
+
+        rule->literal = rule_literal(start, end - start, case_sensitive);
+        rule->lead = (start == pattern);
+        rule->trail = (*end == '\0');
+        break;
+
+    case WORD_RULE_REGEX:
+        rule->regex = word_regex_new(pattern, case_sensitive, error);
+        return rule->regex != NULL;
+
+    case WORD_RULE_TOKEN:
+        // Индекс знает только целые слова: фраза или знак внутри не совпали бы никогда
+        for (const gchar *p = pattern; *p; p = g_utf8_next_char(p)) {
+            gunichar c = g_utf8_get_char_validated(p, -1);
+
+            if (c == (gunichar)-1 || c == (gunichar)-2 || !word_char_is_word(c)) {
+                g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                                    "identifier may contain only letters, digits and '_'; "
+                                    "use word: for phrases");
+                return FALSE;
+            }
+        }
+
+        rule->literal = rule_literal(pattern, strlen(pattern), case_sensitive);
+        if (strlen(rule->literal) > WORD_TOKEN_MAX_BYTES) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                        "identifier is longer than %u bytes", WORD_TOKEN_MAX_BYTES);
+            g_clear_pointer(&rule->literal, g_free);
+            return FALSE;
+        }
+        break;
+    }
+
+    return TRUE;
+}
+
+void
+word_rule_clear(WordRule *rule)
+{
+    g_clear_pointer(&rule->literal, g_free);
+    g_clear_pointer(&rule->regex, word_regex_free);
+}
+
+gboolean
+word_rule_needs_boundaries(const WordRule *rule)
+{
+    if (rule->regex)
+        return rule->regex->boundaries;
+
+    return rule->literal && (rule->lead || rule->trail);
+}
+
+gchar*
+word_rule_literal_with_markers(const WordRule *rule)
+{
+    GString *marked = g_string_sized_new(strlen(rule->literal) + 4);
+    const guchar *p = (const guchar *)rule->literal;
+    gint prev = -1;         // класс предыдущего символа, -1 - начало
+
+    while (*p) {
+        guint len = utf8_sequence_length(*p);
+        gunichar c = (len > 0) ? utf8_decode(p, len) : (gunichar)-1;
+        gboolean word = FALSE;
+
+        if (c == (gunichar)-1)
+            len = 1;
+        else
+            word = word_char_is_word(c);
+
+        // Сканер ставит маркер при каждой смене класса символа
+        if ((prev < 0) ? (word && rule->lead) : (word != prev))
+            g_string_append_c(marked, (gchar)WORD_MATCHER_MARKER);
+
+        if (len == 1 && *p == WORD_MATCHER_MARKER)
+            g_string_append_c(marked, (gchar)WORD_MATCHER_RAW_FF);
+        else
+            g_string_append_len(marked, (const gchar *)p, len);
+
+        prev = word;
+        p += len;
+    }
+
+    if (prev > 0 && rule->trail)
+        g_string_append_c(marked, (gchar)WORD_MATCHER_MARKER);
+
+    return g_string_free(marked, FALSE);
+}
+
+gboolean
+word_rule_validate(const gchar *rule, gboolean case_sensitive, GError **error)
+{
+    WordRule compiled;
+    gboolean ok;
+
+    g_return_val_if_fail(rule != NULL, FALSE);
+
+    ok = word_rule_compile(&compiled, rule, case_sensitive, error);
+
+    // Отдельное правило должно помещаться в один ДКА
+    if (ok && compiled.regex) {
+        WordRegexTables tables;
+        guint32 index = 0;
+
+        word_regex_tables_init(&tables);
+        if (!word_regex_build_dfa(&compiled.regex, &index, 1, &tables)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                        "rule needs more than %u automaton states",
+                        WORD_REGEX_MAX_DFA_STATES);
+            ok = FALSE;
+        }
+        word_regex_tables_clear(&tables);
+    }
+
+    word_rule_clear(&compiled);
+    return ok;
+}
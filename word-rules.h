@@ -0,0 +1,78 @@
+#ifndef WORD_RULES_H
+#define WORD_RULES_H
+
+#include <glib.h>
+
+// Язык правил words.conf. Строка без префикса - подстрока, как раньше:
+//
+//   секрет                    подстрока ("секретарь" тоже совпадёт)
+//   word:секрет               целое слово
+//   glob:секрет*              шаблон слова: * - любые буквы/цифры, ? - одна
+//   re:договор\s*№\s*\d{4,8}  регулярное выражение (безопасное подмножество)
+//   id:PRJ_4471               идентификатор: целое слово из букв, цифр и '_'
+//
+// Все правила компилируются в один автомат: литеральные (подстроки, слова,
+// шаблоны с * только по краям) - в автомат Ахо-Корасик с маркерами границ
+// слов, остальные - в общий ДКА. Идентификаторы id: не занимают места в
+// автомате и ищутся по хэшу слова (word-tokens.h), поэтому их можно держать
+// миллионами. Всё идёт по тексту одним проходом, поиск линейный и без
+// возвратов.
+typedef enum {
+    WORD_RULE_SUBSTRING,
+    WORD_RULE_WORD,
+    WORD_RULE_GLOB,
+    WORD_RULE_REGEX,
+    WORD_RULE_TOKEN
+} WordRuleKind;
+
+// Меняется при изменении смысла правил (входит в отпечаток словаря)
+#define WORD_RULES_SYNTAX_VERSION 2
+
+// Вид правила и его текст без префикса
+WordRuleKind word_rule_parse(const gchar *rule, const gchar **pattern);
+
+// Проверка правила до сохранения: синтаксис и размер автомата.
+// Ошибочные правила при компиляции словаря пропускаются с предупреждением.
+gboolean word_rule_validate(const gchar *rule, gboolean case_sensitive, GError **error);
+
+// Дальнейшее - для компиляции автомата (word-matcher.c)
+
+typedef struct _WordRegex WordRegex;
+
+typedef struct {
+    WordRuleKind kind;
+    gchar *literal;         // литеральное правило или идентификатор; свёрнуто,
+                            // если регистр не важен
+    gboolean lead;          // граница слова перед литералом
+    gboolean trail;         // и после него
+    WordRegex *regex;       // регулярное выражение или сложный шаблон
+} WordRule;
+
+gboolean word_rule_compile(WordRule *rule, const gchar *text, gboolean case_sensitive,
+                           GError **error);
+void word_rule_clear(WordRule *rule);
+gboolean word_rule_needs_boundaries(const WordRule *rule);
+// Литерал в том виде, в каком его видит автомат: с маркерами границ слов
+gchar* word_rule_literal_with_markers(const WordRule *rule);
+
+// Свёртка регистра литерала; некорректные байты остаются как есть
+gchar* word_rule_fold(const gchar *text);
+
+// Таблицы ДКА регулярных правил, передаются автомату целиком
+typedef struct {
+    GArray *dfas;           // WordRegexDfa
+    GArray *next;           // guint32
+    GArray *accept_start;   // guint32
+    GArray *accept_rules;   // guint32
+} WordRegexTables;
+
+void word_regex_tables_init(WordRegexTables *tables);
+void word_regex_tables_clear(WordRegexTables *tables);
+
+// Сборка ДКА по выражениям (rules - индексы правил для отчёта). Если
+// общий автомат слишком велик, правила делятся на несколько ДКА, которые
+// всё равно идут по тексту одним проходом.
+void word_regex_compile(WordRegex **regexes, const guint32 *rules, guint n,
+                        WordRegexTables *tables);
+
+#endif /* WORD_RULES_H */
@@ -0,0 +1,114 @@
+#include <string.h>
+
+#include "word-tokens.h"
+
+// Бит фильтра Блума на слово словаря и бит, проверяемых на запрос:
+// доля ложных прохождений фильтра около 1-2%
+#define WORD_TOKEN_BLOOM_BITS 10
+#define WORD_TOKEN_BLOOM_K 6
+
+// Отображение 32 бит хэша на [0, n) без деления
+static inline guint32
+word_token_range(guint32 bits, guint32 n)
+{
+    return (guint32)(((guint64)bits * n) >> 32);
+}
+
+static inline const guint64*
+word_token_bloom_block(const WordTokenIndex *index, guint64 hash)
+{
+    return index->bloom + (gsize)word_token_range((guint32)hash, index->n_blocks) *
+                          WORD_TOKEN_BLOOM_WORDS;
+}
+
+// Биты внутри блока - девятибитные куски ещё раз перемешанного хэша
+static inline guint64
+word_token_bloom_bits(guint64 hash)
+{
+    return hash * 0x9e3779b97f4a7c15ull;
+}
+
+void
+word_token_index_build(WordTokenIndex *index, const gchar **tokens,
+                       const guint32 *rules, guint n)
+{
+    guint64 *hashes, *bloom;
+    guint32 *words;
+
+    memset(index, 0, sizeof(*index));
+    if (n == 0)
+        return;
+
+    // Заполнение не выше 2/3: при линейном пробировании поиск
+    // присутствующего слова - 2 пробы в среднем
+    index->n_slots = n + n / 2 + 1;
+    index->n_blocks = ((guint64)n * WORD_TOKEN_BLOOM_BITS + 511) / 512;
+
+    hashes = g_new0(guint64, index->n_slots);
+    words = g_new(guint32, index->n_slots);
+    bloom = g_new0(guint64, (gsize)index->n_blocks * WORD_TOKEN_BLOOM_WORDS);
+
+    index->hashes = hashes;
+    index->words = words;
+    index->bloom = bloom;
+
+    for (guint i = 0; i < n; i++) {
+        guint64 hash = word_token_hash_finish(
+            word_token_hash_update(WORD_TOKEN_HASH_INIT, (const guchar *)tokens[i],
+                                   strlen(tokens[i])));
+        guint64 *block = (guint64 *)word_token_bloom_block(index, hash);
+        guint64 bits = word_token_bloom_bits(hash);
+        guint32 slot = word_token_range((guint32)(hash >> 32), index->n_slots);
+
+        while (hashes[slot] != 0 && hashes[slot] != hash)
+            slot = (slot + 1 < index->n_slots) ? slot + 1 : 0;
+
+        if (hashes[slot] == hash)
+            continue;
+
+        hashes[slot] = hash;
+        words[slot] = rules[i];
+
+        for (guint k = 0; k < WORD_TOKEN_BLOOM_K; k++, bits >>= 9)
+            block[(bits & 511) >> 6] |= (guint64)1 << (bits & 63);
+    }
+}
+
+void
+word_token_index_clear(WordTokenIndex *index)
+{
+    g_free((gpointer)index->hashes);
+    g_free((gpointer)index->words);
+    g_free((gpointer)index->bloom);
+    memset(index, 0, sizeof(*index));
+}
+
+gboolean
+word_token_index_lookup(const WordTokenIndex *index, guint64 hash, guint32 *rule)
+{
+    const guint64 *block;
+    guint64 bits;
+    guint32 slot;
+
+    if (index->n_slots == 0)
+        return FALSE;
+
+    // Большинство слов текста отсекается здесь, не трогая таблицу
+    block = word_token_bloom_block(index, hash);
+    bits = word_token_bloom_bits(hash);
+    for (guint k = 0; k < WORD_TOKEN_BLOOM_K; k++, bits >>= 9) {
+        if (!(block[(bits & 511) >> 6] & ((guint64)1 << (bits & 63))))
+            return FALSE;
+    }
+
+    slot = word_token_range((guint32)(hash >> 32), index->n_slots);
+    while (index->hashes[slot] != 0) {
+        if (index->hashes[slot] == hash) {
+            *rule = index->words[slot];
+            return TRUE;
+        }
+        slot = (slot + 1 < index->n_slots) ? slot + 1 : 0;
+    }
+
+    return FALSE;
+}
@@ -0,0 +1,76 @@
+#ifndef WORD_TOKENS_H
+#define WORD_TOKENS_H
+
+#include <glib.h>
+
+// Индекс целых слов для правил id: (word-rules.h). Словарь из сотен
+// тысяч или миллионов идентификаторов (номера договоров, коды проектов) в
+// бор Ахо-Корасик не кладётся: на миллион слов он занимает сотни
+// мегабайт. Вместо этого сканер на лету считает хэш каждого слова текста,
+// а индекс отвечает, есть ли этот хэш в словаре: сначала блочный фильтр
+// Блума (одна кэш-линия на запрос), затем таблица с открытой адресацией.
+// Ячейка таблицы - 12 байт (хэш и номер слова), ячеек в полтора раза больше
+// слов: на слово словаря около 18 байт таблицы и 10 бит фильтра, миллион
+// идентификаторов занимает ~20 МБ и ищется за постоянное время.
+//
+// Сами слова в индексе не хранятся, совпадение сверяется по 64-битному
+// хэшу: ложное срабатывание на миллионном словаре - порядка 1e-13 на
+// слово текста.
+
+// Более длинное слово (в байтах свёрнутого текста) в индекс не попадает
+// и в тексте не ищется
+#define WORD_TOKEN_MAX_BYTES 256
+
+// Слов фильтра на блок: блок - 512 бит, одна кэш-линия
+#define WORD_TOKEN_BLOOM_WORDS 8
+
+// Хэш слова набирается побайтно по ходу сканирования (FNV-1a) и
+// перемешивается перед поиском в индексе
+#define WORD_TOKEN_HASH_INIT 0xcbf29ce484222325ull
+
+static inline guint64
+word_token_hash_update(guint64 hash, const guchar *bytes, guint len)
+{
+    for (guint i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+// Младшие биты FNV распределены плохо, а индекс берёт и старшую, и
+// младшую половину. 0 означает пустую ячейку таблицы и не выдаётся.
+static inline guint64
+word_token_hash_finish(guint64 hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+
+    return hash ? hash : 1;
+}
+
+// Плоские массивы индекса; у автомата из файла словаря они указывают в
+// отображённую память
+typedef struct {
+    guint32 n_slots;
+    guint32 n_blocks;
+    const guint64 *hashes;  // n_slots; 0 - пустая ячейка
+    const guint32 *words;   // n_slots; номер правила
+    const guint64 *bloom;   // n_blocks * WORD_TOKEN_BLOOM_WORDS
+} WordTokenIndex;
+
+// Построение по свёрнутым словам; rules - номера правил для отчёта.
+// Повторы сообщаются по первому правилу, как и в автомате литералов.
+void word_token_index_build(WordTokenIndex *index, const gchar **tokens,
+                            const guint32 *rules, guint n);
+// Только для построенного здесь индекса
+void word_token_index_clear(WordTokenIndex *index);
+
+// hash - результат word_token_hash_finish
+gboolean word_token_index_lookup(const WordTokenIndex *index, guint64 hash, guint32 *rule);
+
+#endif /* WORD_TOKENS_H */
@@ -0,0 +1,443 @@
+#include <string.h>
+#include <zlib.h>
+
+#include "zip-reader.h"
+
+#define ZIP_EOCD_SIGNATURE          0x06054b50u
+#define ZIP64_EOCD_LOCATOR_SIGNATURE 0x07064b50u
+#define ZIP64_EOCD_SIGNATURE        0x06064b50u
+#define ZIP_CENTRAL_SIGNATURE       0x02014b50u
+#define ZIP_LOCAL_SIGNATURE         0x04034b50u
+
+#define ZIP_EOCD_SIZE       22
+#define ZIP_CENTRAL_SIZE    46
+#define ZIP_LOCAL_SIZE      30
+#define ZIP_MAX_COMMENT     0xffff
+
+#define ZIP_METHOD_STORED   0
+#define ZIP_METHOD_DEFLATE  8
+#define ZIP_FLAG_ENCRYPTED  (1u << 0)
+
+// Защита от повреждённых архивов: оглавление читается в память целиком
+#define ZIP_MAX_DIRECTORY   (64 * 1024 * 1024)
+
+#define ZIP_CHUNK (64 * 1024)
+
+typedef struct {
+    gchar *name;
+    guint16 method;
+    guint16 flags;
+    guint64 compressed_size;
+    guint64 size;
+    guint64 local_offset;
+} ZipEntry;
+
+struct _ZipReader {
+    GInputStream *stream;
+    GArray *entries;        // ZipEntry
+};
+
+static inline guint16
+read_u16(const guchar *p)
+{
+    return (guint16)(p[0] | (p[1] << 8));
+}
+
+static inline guint32
+read_u32(const guchar *p)
+{
+    return (guint32)p[0] | ((guint32)p[1] << 8) | ((guint32)p[2] << 16) | ((guint32)p[3] << 24);
+}
+
+static inline guint64
+read_u64(const guchar *p)
+{
+    return (guint64)read_u32(p) | ((guint64)read_u32(p + 4) << 32);
+}
+
+static gboolean
+zip_read_at(ZipReader *reader, goffset offset, gpointer buffer, gsize len,
+            GCancellable *cancellable, GError **error)
+{
+    gsize n_read = 0;
+
+    if (!g_seekable_seek(G_SEEKABLE(reader->stream), offset, G_SEEK_SET, cancellable, error))
+        return FALSE;
+
+    if (!g_input_stream_read_all(reader->stream, buffer, len, &n_read, cancellable, error))
+        return FALSE;
+
+    if (n_read != len) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Unexpected end of ZIP archive");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+zip_entry_clear(gpointer data)
+{
+    g_free(((ZipEntry *)data)->name);
+}
+
+// Поиск записи конца оглавления в последних 64 КБ файла
+static gboolean
+zip_find_directory(ZipReader *reader, goffset file_size, guint64 *dir_offset,
+                   guint64 *dir_size, guint64 *n_entries,
+                   GCancellable *cancellable, GError **error)
+{
+    gsize tail_len = (gsize)MIN(file_size, ZIP_EOCD_SIZE + ZIP_MAX_COMMENT);
+    goffset tail_start = file_size - tail_len;
+    guchar *tail = g_malloc(tail_len);
+    const guchar *eocd = NULL;
+    gboolean ok = FALSE;
+
+    if (!zip_read_at(reader, tail_start, tail, tail_len, cancellable, error))
+        goto out;
+
+    for (gssize i = (gssize)tail_len - ZIP_EOCD_SIZE; i >= 0; i--) {
+        if (read_u32(tail + i) == ZIP_EOCD_SIGNATURE) {
+            eocd = tail + i;
+            break;
+        }
+    }
+
+    if (!eocd) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Not a ZIP archive");
+        goto out;
+    }
+
+    *n_entries = read_u16(eocd + 10);
+    *dir_size = read_u32(eocd + 12);
+    *dir_offset = read_u32(eocd + 16);
+
+    // ZIP64: настоящие значения лежат в отдельной записи перед локатором
+    if ((*n_entries == 0xffff || *dir_size == 0xffffffffu || *dir_offset == 0xffffffffu) &&
+        eocd - tail >= 20 && read_u32(eocd - 20) == ZIP64_EOCD_LOCATOR_SIGNATURE) {
+        guchar record[56];
+        guint64 record_offset = read_u64(eocd - 20 + 8);
+
+        if (!zip_read_at(reader, (goffset)record_offset, record, sizeof(record), cancellable, error))
+            goto out;
+
+        if (read_u32(record) != ZIP64_EOCD_SIGNATURE) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Broken ZIP64 directory");
+            goto out;
+        }
+
+        *n_entries = read_u64(record + 32);
+        *dir_size = read_u64(record + 40);
+        *dir_offset = read_u64(record + 48);
+    }
+
+    if (*dir_size > ZIP_MAX_DIRECTORY || *dir_offset + *dir_size > (guint64)file_size) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Broken ZIP directory");
+        goto out;
+    }
+
+    ok = TRUE;
+
+out:
+    g_free(tail);
+    return ok;
+}
+
+// Дополнительное поле ZIP64 с 64-битными размерами и смещением
+static void
+zip_entry_apply_zip64(ZipEntry *entry, const guchar *extra, gsize extra_len)
+{
+    while (extra_len >= 4) {
+        guint16 id = read_u16(extra);
+        guint16 len = read_u16(extra + 2);
+        const guchar *field = extra + 4;
+        const guchar *end;
+
+        if ((gsize)len + 4 > extra_len)
+            return;
+
+        end = field + len;
+
+        if (id == 0x0001) {
+            if (entry->size == 0xffffffffu && field + 8 <= end) {
+                entry->size = read_u64(field);
+                field += 8;
+            }
+            if (entry->compressed_size == 0xffffffffu && field + 8 <= end) {
+                entry->compressed_size = read_u64(field);
+                field += 8;
+            }
+            if (entry->local_offset == 0xffffffffu && field + 8 <= end)
+                entry->local_offset = read_u64(field);
+            return;
+        }
+
+        extra += 4 + len;
+        extra_len -= 4 + len;
+    }
+}
+
+ZipReader*
+zip_reader_new(GInputStream *stream, GCancellable *cancellable, GError **error)
+{
+    ZipReader *reader;
+    goffset file_size;
+    guint64 dir_offset, dir_size, n_entries;
+    guchar *directory = NULL;
+    const guchar *p, *end;
+
+    g_return_val_if_fail(G_IS_SEEKABLE(stream) && g_seekable_can_seek(G_SEEKABLE(stream)), NULL);
+
+    reader = g_new0(ZipReader, 1);
+    reader->stream = g_object_ref(stream);
+    reader->entries = g_array_new(FALSE, TRUE, sizeof(ZipEntry));
+    g_array_set_clear_func(reader->entries, zip_entry_clear);
+
+    // Размер файла - через конец потока, так работает и с потоком в памяти
+    if (!g_seekable_seek(G_SEEKABLE(stream), 0, G_SEEK_END, cancellable, error))
+        goto fail;
+    file_size = g_seekable_tell(G_SEEKABLE(stream));
+
+    if (file_size < ZIP_EOCD_SIZE) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Not a ZIP archive");
+        goto fail;
+    }
+
+    if (!zip_find_directory(reader, file_size, &dir_offset, &dir_size, &n_entries,
+                            cancellable, error))
+        goto fail;
+
+    directory = g_malloc(dir_size ? dir_size : 1);
+    if (!zip_read_at(reader, (goffset)dir_offset, directory, dir_size, cancellable, error))
+        goto fail;
+
+    p = directory;
+    end = directory + dir_size;
+
+    for (guint64 i = 0; i < n_entries; i++) {
+        ZipEntry entry = { 0 };
+        guint16 name_len, extra_len, comment_len;
+
+        if (end - p < ZIP_CENTRAL_SIZE || read_u32(p) != ZIP_CENTRAL_SIGNATURE)
+            break;
+
+        name_len = read_u16(p + 28);
+        extra_len = read_u16(p + 30);
+        comment_len = read_u16(p + 32);
+
+        if ((gsize)(end - p) < (gsize)ZIP_CENTRAL_SIZE + name_len + extra_len + comment_len)
+            break;
+
+        entry.flags = read_u16(p + 8);
+        entry.method = read_u16(p + 10);
+        entry.compressed_size = read_u32(p + 20);
+        entry.size = read_u32(p + 24);
+        entry.local_offset = read_u32(p + 42);
+        entry.name = g_strndup((const gchar *)p + ZIP_CENTRAL_SIZE, name_len);
+        zip_entry_apply_zip64(&entry, p + ZIP_CENTRAL_SIZE + name_len, extra_len);
+
+        g_array_append_val(reader->entries, entry);
+        p += ZIP_CENTRAL_SIZE + name_len + extra_len + comment_len;
+    }
+
+    g_free(directory);
+    return reader;
+
+fail:
+    g_free(directory);
+    zip_reader_free(reader);
+    return NULL;
+}
+
+ZipReader*
+zip_reader_clone(ZipReader *reader, GInputStream *stream)
+{
+    ZipReader *clone;
+
+    g_return_val_if_fail(G_IS_SEEKABLE(stream) && g_seekable_can_seek(G_SEEKABLE(stream)), NULL);
+
+    clone = g_new0(ZipReader, 1);
+    clone->stream = g_object_ref(stream);
+    clone->entries = g_array_ref(reader->entries);
+
+    return clone;
+}
+
+void
+zip_reader_free(ZipReader *reader)
+{
+    if (!reader)
+        return;
+
+    g_array_unref(reader->entries);
+    g_object_unref(reader->stream);
+    g_free(reader);
+}
+
+guint
+zip_reader_get_n_entries(ZipReader *reader)
+{
+    return reader->entries->len;
+}
+
+const gchar*
+zip_reader_get_name(ZipReader *reader, guint index)
+{
+    g_return_val_if_fail(index < reader->entries->len, NULL);
+
+    return g_array_index(reader->entries, ZipEntry, index).name;
+}
+
+guint64
+zip_reader_get_size(ZipReader *reader, guint index)
+{
+    g_return_val_if_fail(index < reader->entries->len, 0);
+
+    return g_array_index(reader->entries, ZipEntry, index).size;
+}
+
+guint64
+zip_reader_get_compressed_size(ZipReader *reader, guint index)
+{
+    g_return_val_if_fail(index < reader->entries->len, 0);
+
+    return g_array_index(reader->entries, ZipEntry, index).compressed_size;
+}
+
+gboolean
+zip_reader_extract(ZipReader *reader, guint index, guint64 max_bytes,
+                   ZipReaderSink sink, gpointer user_data,
+                   GCancellable *cancellable, GError **error)
+{
+    const ZipEntry *entry;
+    guchar local[ZIP_LOCAL_SIZE];
+    guchar *in = NULL, *out = NULL;
+    guint64 remaining, produced = 0;
+    z_stream zs;
+    gboolean inflating = FALSE;
+    gboolean ok = FALSE;
+
+    g_return_val_if_fail(index < reader->entries->len, FALSE);
+
+    entry = &g_array_index(reader->entries, ZipEntry, index);
+
+    if (entry->flags & ZIP_FLAG_ENCRYPTED) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                    "Encrypted ZIP entry '%s'", entry->name);
+        return FALSE;
+    }
+
+    if (entry->method != ZIP_METHOD_STORED && entry->method != ZIP_METHOD_DEFLATE) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                    "Unsupported compression method %u in '%s'", entry->method, entry->name);
+        return FALSE;
+    }
+
+    // Локальный заголовок нужен только ради длины имени и extra-поля;
+    // размеры берутся из оглавления, они надёжнее (data descriptor)
+    if (!zip_read_at(reader, (goffset)entry->local_offset, local, sizeof(local), cancellable, error))
+        return FALSE;
+
+    if (read_u32(local) != ZIP_LOCAL_SIGNATURE) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                    "Broken local header for '%s'", entry->name);
+        return FALSE;
+    }
+
+    if (!g_seekable_seek(G_SEEKABLE(reader->stream),
+                         (goffset)entry->local_offset + ZIP_LOCAL_SIZE +
+                         read_u16(local + 26) + read_u16(local + 28),
+                         G_SEEK_SET, cancellable, error))
+        return FALSE;
+
+    in = g_malloc(ZIP_CHUNK);
+
+    if (entry->method == ZIP_METHOD_DEFLATE) {
+        memset(&zs, 0, sizeof(zs));
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "inflateInit failed");
+            goto out;
+        }
+        inflating = TRUE;
+        out = g_malloc(ZIP_CHUNK);
+    }
+
+    remaining = entry->compressed_size;
+
+    while (remaining > 0) {
+        gsize want = (gsize)MIN(remaining, ZIP_CHUNK);
+        gssize n_read = g_input_stream_read(reader->stream, in, want, cancellable, error);
+
+        if (n_read < 0)
+            goto out;
+        if (n_read == 0) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                        "Truncated ZIP entry '%s'", entry->name);
+            goto out;
+        }
+        remaining -= n_read;
+
+        if (!inflating) {
+            gsize len = (gsize)n_read;
+
+            if (max_bytes && produced + len > max_bytes)
+                len = (gsize)(max_bytes - produced);
+            produced += len;
+
+            if (!sink((const gchar *)in, len, user_data) ||
+                (max_bytes && produced >= max_bytes))
+                break;
+            continue;
+        }
+
+        zs.next_in = in;
+        zs.avail_in = (uInt)n_read;
+
+        // Пока выходной буфер заполняется целиком, у zlib ещё есть данные
+        do {
+            gsize len;
+            gint ret;
+
+            zs.next_out = out;
+            zs.avail_out = ZIP_CHUNK;
+            ret = inflate(&zs, Z_NO_FLUSH);
+
+            // Выход заполнился ровно вместе с концом входного блока:
+            // продолжать нечем, нужен следующий блок
+            if (ret == Z_BUF_ERROR)
+                break;
+            if (ret != Z_OK && ret != Z_STREAM_END) {
+                g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                            "Broken deflate data in '%s'", entry->name);
+                goto out;
+            }
+
+            len = ZIP_CHUNK - zs.avail_out;
+            if (max_bytes && produced + len > max_bytes)
+                len = (gsize)(max_bytes - produced);
+            produced += len;
+
+            if (len > 0 && !sink((const gchar *)out, len, user_data))
+                goto done;
+            if ((max_bytes && produced >= max_bytes) || ret == Z_STREAM_END)
+                goto done;
+        } while (zs.avail_in > 0 || zs.avail_out == 0);
+    }
+
+    // Сжатые данные кончились раньше потока deflate
+    if (inflating) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                    "Truncated deflate data in '%s'", entry->name);
+        goto out;
+    }
+
+done:
+    ok = TRUE;
+
+out:
+    if (inflating)
+        inflateEnd(&zs);
+    g_free(in);
+    g_free(out);
+    return ok;
+}
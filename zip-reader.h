@@ -0,0 +1,31 @@
+#ifndef ZIP_READER_H
+#define ZIP_READER_H
+
+#include <gio/gio.h>
+
+// Чтение ZIP-контейнера (ODF, OOXML, архивы) без распаковки во временные файлы.
+// Поток должен поддерживать GSeekable: оглавление читается с конца файла,
+// а нужные записи распаковываются блоками прямо в функцию-приёмник.
+typedef struct _ZipReader ZipReader;
+
+// Приёмник распакованных данных; FALSE - остановить распаковку
+typedef gboolean (*ZipReaderSink)(const gchar *data, gsize len, gpointer user_data);
+
+ZipReader* zip_reader_new(GInputStream *stream, GCancellable *cancellable, GError **error);
+// Второй читатель того же архива для другого потока: оглавление общее,
+// stream - отдельно открытый поток с тем же содержимым
+ZipReader* zip_reader_clone(ZipReader *reader, GInputStream *stream);
+void zip_reader_free(ZipReader *reader);
+
+guint zip_reader_get_n_entries(ZipReader *reader);
+const gchar* zip_reader_get_name(ZipReader *reader, guint index);
+guint64 zip_reader_get_size(ZipReader *reader, guint index);
+guint64 zip_reader_get_compressed_size(ZipReader *reader, guint index);
+
+// Распаковка записи не более чем в max_bytes байт (0 - без ограничения).
+// Остановка приёмником или по лимиту не считается ошибкой.
+gboolean zip_reader_extract(ZipReader *reader, guint index, guint64 max_bytes,
+                            ZipReaderSink sink, gpointer user_data,
+                            GCancellable *cancellable, GError **error);
+
+#endif /* ZIP_READER_H */